@@ -0,0 +1,210 @@
+/*
+  Application protocol compression benchmark.
+
+  Compresses and inflates the messages of a stream of calls, as they would go to an application
+  over a connection that negotiated compression, and reports how many bytes that saves and what it
+  costs in cpu.  Every message is checked to come back unchanged.  Results are written to stdout as JSON:
+
+    make bench_client_compression && ./bench_client_compression > compression.json
+
+  usage: bench_client_compression [--impl per-message,stream] [--calls 20000] [--sdp-size 600]
+
+  Implementations:
+    per-message  each message deflated on its own with zlib's compress2, as the baseline
+    stream       FrameCompressor as used by BaseClient: one stream per direction, primed with
+                 the sip dictionary and flushed after each message
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+
+#include <zlib.h>
+
+#include "client-framing.hpp"
+#include "client-compression.hpp"
+
+using std::string ;
+using std::vector ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  string makeSdp( size_t n, size_t size ) {
+    string sdp = "v=0\r\no=- " + std::to_string( 1000000 + n ) + " 1 IN IP4 10.0.1.10\r\ns=-\r\nc=IN IP4 10.0.1.10\r\nt=0 0\r\n"
+      "m=audio " + std::to_string( 20000 + 2 * (n % 10000) ) + " RTP/AVP 0 8 101\r\n"
+      "a=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\na=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\n"
+      "a=ptime:20\r\na=sendrecv\r\n" ;
+    // the rest of a large offer, candidates and crypto lines that differ from call to call
+    while( sdp.length() < size ) sdp += "a=candidate:" + std::to_string( n * 7 + sdp.length() ) + " 1 udp 2130706431 10.0.1.10 " + std::to_string( 30000 + sdp.length() ) + " typ host\r\n" ;
+    return sdp ;
+  }
+
+  // what an application sees of a call: the INVITE, the responses it sent and our replies to them, the ACK, the BYE and the cdrs
+  void makeCall( size_t n, size_t sdpSize, vector<string>& msgs ) {
+    string id = std::to_string( 100000000000 + n ) ;
+    string uuid = "6b2c1a9e-41f0-4c8e-9d2b-" + id ;
+    string callId = id + "-bench@10.0.1.10" ;
+    string dialog = "|" + callId + ";from-tag=" + id ;
+    string common = "From: <sip:+15083084800@10.0.1.10>;tag=" + id + "\r\n"
+      "To: <sip:+15083084809@10.0.1.20>\r\n"
+      "Call-ID: " + callId + "\r\n" ;
+    string via = "Via: SIP/2.0/UDP 10.0.1.10:5060;rport=5060;branch=z9hG4bK-" + id + ";received=10.0.1.10\r\n" ;
+    string sdp = makeSdp( n, sdpSize ) ;
+
+    msgs.push_back( uuid + "|sip|network|" + std::to_string( sdp.length() + 700 ) + "|udp|10.0.1.10|5060|09:41:53.178453|" + uuid + "||\r\n"
+      "INVITE sip:+15083084809@10.0.1.20:5060 SIP/2.0\r\n" + via + common +
+      "CSeq: 1 INVITE\r\nContact: <sip:+15083084800@10.0.1.10:5060>\r\nMax-Forwards: 70\r\n"
+      "Allow: INVITE, ACK, CANCEL, BYE, OPTIONS, INFO, UPDATE, PRACK, REFER, NOTIFY\r\n"
+      "Supported: timer, replaces\r\nContent-Type: application/sdp\r\nContent-Length: " + std::to_string( sdp.length() ) + "\r\n\r\n" + sdp ) ;
+    msgs.push_back( uuid + "|cdr:attempt|network|" + std::to_string( sdp.length() + 700 ) + "|udp|10.0.1.10|5060|09:41:53.178453|" + uuid + "||\r\n"
+      "INVITE sip:+15083084809@10.0.1.20:5060 SIP/2.0\r\n" + via + common + "CSeq: 1 INVITE\r\n\r\n" ) ;
+    msgs.push_back( uuid + "|response|" + id + "|OK|" + uuid + dialog ) ;
+    msgs.push_back( uuid + "|sip|application|410|udp|10.0.1.20|5060|09:41:53.280611|" + uuid + dialog + "|\r\n"
+      "SIP/2.0 180 Ringing\r\n" + via + common + "CSeq: 1 INVITE\r\nContact: <sip:10.0.1.20:5060>\r\nContent-Length: 0\r\n\r\n" ) ;
+    msgs.push_back( uuid + "|response|" + id + "|OK|" + uuid + dialog ) ;
+    msgs.push_back( uuid + "|cdr:start|application|" + std::to_string( sdp.length() + 500 ) + "|udp|10.0.1.20|5060|09:41:55.100314|" + uuid + dialog + "|\r\n"
+      "SIP/2.0 200 OK\r\n" + via + common + "CSeq: 1 INVITE\r\nContact: <sip:10.0.1.20:5060>\r\nContent-Type: application/sdp\r\n"
+      "Content-Length: " + std::to_string( sdp.length() ) + "\r\n\r\n" + sdp ) ;
+    msgs.push_back( uuid + "|sip|network|380|udp|10.0.1.10|5060|09:41:55.163028|" + uuid + dialog + "|\r\n"
+      "ACK sip:10.0.1.20:5060 SIP/2.0\r\n" + via + common + "CSeq: 1 ACK\r\nMax-Forwards: 70\r\nContent-Length: 0\r\n\r\n" ) ;
+    msgs.push_back( uuid + "|sip|network|390|udp|10.0.1.10|5060|09:44:12.004417|" + uuid + dialog + "|\r\n"
+      "BYE sip:10.0.1.20:5060 SIP/2.0\r\n" + via + common + "CSeq: 2 BYE\r\nMax-Forwards: 70\r\nContent-Length: 0\r\n\r\n" ) ;
+    msgs.push_back( uuid + "|cdr:stop|network|390|udp|10.0.1.10|5060|09:44:12.004417|" + uuid + dialog + "|normal-release\r\n"
+      "BYE sip:10.0.1.20:5060 SIP/2.0\r\n" + via + common + "CSeq: 2 BYE\r\n\r\n" ) ;
+  }
+
+  class PerMessage {
+  public:
+    bool init(void) { return true ; }
+    bool compress( std::string_view msg, string& out ) {
+      uLongf len = compressBound( msg.size() ) ;
+      out.resize( len ) ;
+      if( Z_OK != compress2( reinterpret_cast<Bytef*>( &out[0] ), &len, reinterpret_cast<const Bytef*>( msg.data() ), msg.size(), Z_DEFAULT_COMPRESSION ) ) return false ;
+      out.resize( len ) ;
+      return true ;
+    }
+    bool decompress( std::string_view frame, string& out, size_t maxSize ) {
+      uLongf len = maxSize ;
+      out.resize( len ) ;
+      if( Z_OK != uncompress( reinterpret_cast<Bytef*>( &out[0] ), &len, reinterpret_cast<const Bytef*>( frame.data() ), frame.size() ) ) return false ;
+      out.resize( len ) ;
+      return true ;
+    }
+  } ;
+
+  struct Result_t {
+    string    impl ;
+    size_t    messages ;
+    size_t    plainBytes ;
+    size_t    compressedBytes ;
+    double    compressSecs ;
+    double    inflateSecs ;
+  } ;
+
+  template<typename Impl>
+  Result_t run( const char* name, const vector<string>& msgs ) {
+    // each end has its own streams, just as the server and the application do
+    Impl sender, receiver ;
+    if( !sender.init() || !receiver.init() ) {
+      std::cerr << name << ": unable to initialize" << std::endl ;
+      exit(1) ;
+    }
+
+    vector<string> frames( msgs.size() ) ;
+    Result_t r ;
+    r.impl = name ;
+    r.messages = msgs.size() ;
+    r.plainBytes = r.compressedBytes = 0 ;
+
+    Clock::time_point start = Clock::now() ;
+    for( size_t i = 0; i < msgs.size(); i++ ) {
+      if( !sender.compress( msgs[i], frames[i] ) ) {
+        std::cerr << name << ": failed to compress message " << i << std::endl ;
+        exit(1) ;
+      }
+    }
+    Clock::time_point compressed = Clock::now() ;
+    string out ;
+    for( size_t i = 0; i < frames.size(); i++ ) {
+      if( !receiver.decompress( frames[i], out, FrameReader::MAX_FRAME_SIZE ) || out != msgs[i] ) {
+        std::cerr << name << ": message " << i << " did not survive the round trip" << std::endl ;
+        exit(1) ;
+      }
+    }
+    Clock::time_point inflated = Clock::now() ;
+
+    for( size_t i = 0; i < msgs.size(); i++ ) {
+      // the length prefix is on the wire either way
+      size_t prefix = std::to_string( msgs[i].length() ).length() + 1 ;
+      r.plainBytes += prefix + msgs[i].length() ;
+      r.compressedBytes += std::to_string( frames[i].length() ).length() + 1 + frames[i].length() ;
+    }
+    r.compressSecs = std::chrono::duration<double>( compressed - start ).count() ;
+    r.inflateSecs = std::chrono::duration<double>( inflated - compressed ).count() ;
+    return r ;
+  }
+
+  vector<string> splitList( const char* sz ) {
+    vector<string> v ;
+    boost::split( v, sz, boost::is_any_of(",") ) ;
+    return v ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_client_compression [--impl per-message,stream] [--calls 20000] [--sdp-size 600]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> impls = splitList( "per-message,stream" ) ;
+  size_t calls = 20000 ;
+  size_t sdpSize = 600 ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--impl" ) ) impls = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--calls" ) ) calls = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--sdp-size" ) ) sdpSize = strtoul( argv[++i], NULL, 10 ) ;
+    else usage() ;
+  }
+  if( 0 == calls || sdpSize > 60000 ) usage() ;
+
+  vector<string> msgs ;
+  for( size_t n = 0; n < calls; n++ ) makeCall( n, sdpSize, msgs ) ;
+
+  vector<Result_t> results ;
+  for( const string& impl : impls ) {
+    std::cerr << "running " << impl << " over " << msgs.size() << " messages.." << std::endl ;
+    if( "per-message" == impl ) results.push_back( run<PerMessage>( "per-message", msgs ) ) ;
+    else if( "stream" == impl ) results.push_back( run<FrameCompressor>( "stream", msgs ) ) ;
+    else {
+      std::cerr << "unknown implementation: " << impl << std::endl ;
+      usage() ;
+    }
+  }
+
+  printf( "{\n  \"benchmark\": \"client_compression\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"sdp_size\": %zu,\n  \"results\": [\n", sdpSize ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"impl\": \"%s\", \"messages\": %zu, \"plain_bytes\": %zu, \"compressed_bytes\": %zu, \"ratio\": %.3f, "
+      "\"compress_mb_per_sec\": %.1f, \"inflate_mb_per_sec\": %.1f}%s\n",
+      r.impl.c_str(), r.messages, r.plainBytes, r.compressedBytes, (double) r.compressedBytes / r.plainBytes,
+      r.plainBytes / r.compressSecs / 1e6, r.plainBytes / r.inflateSecs / 1e6, i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+  return 0 ;
+}
@@ -0,0 +1,293 @@
+/*
+  Application protocol framing benchmark.
+
+  Streams framed SIP requests over a loopback TCP connection, the way a busy application sends
+  them to us, and measures how fast the receiving side can find the frames and split each one into
+  its meta tokens, start line, headers and body.  Results are written to stdout as JSON:
+
+    make bench_client_framing && ./bench_client_framing > framing.json
+
+  usage: bench_client_framing [--parser legacy,zero-copy] [--messages 500000] [--body-size 400]
+
+  Parsers:
+    legacy     the parser as it was before FrameReader: socket reads are copied into a circular
+               buffer, the length prefix is popped off a char at a time, each frame is copied into
+               a string and split into newly allocated strings
+    zero-copy  FrameReader, splitMsg and splitTokens as used by BaseClient::read_handler
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <thread>
+#include <iostream>
+#include <functional>
+#include <algorithm>
+
+#include <boost/asio.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "client-framing.hpp"
+
+using std::string ;
+using std::vector ;
+using boost::asio::ip::tcp ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  // what we keep of each parsed message, so that the parsing can not be optimized away
+  struct Totals_t {
+    size_t messages = 0 ;
+    size_t tokens = 0 ;
+    size_t bytes = 0 ;
+  } ;
+
+  string makeMessage( size_t n, size_t bodySize ) {
+    string msg = "6b2c1a9e-41f0-4c8e-9d2b-" + std::to_string( 100000000000 + n ) + "|sip|||\r\n" ;
+    msg += "INVITE sip:+15083084809@10.0.1.20:5060 SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP 10.0.1.10:5060;branch=z9hG4bK-" + std::to_string( n ) + "\r\n"
+      "From: <sip:+15083084800@10.0.1.10>;tag=" + std::to_string( n ) + "\r\n"
+      "To: <sip:+15083084809@10.0.1.20>\r\n"
+      "Call-ID: " + std::to_string( n ) + "-bench@10.0.1.10\r\n"
+      "CSeq: 1 INVITE\r\n"
+      "Contact: <sip:10.0.1.10:5060>\r\n"
+      "Max-Forwards: 70\r\n"
+      "Content-Type: application/sdp\r\n"
+      "Content-Length: " + std::to_string( bodySize ) + "\r\n\r\n" ;
+    msg += string( bodySize, 'v' ) ;
+    return std::to_string( msg.length() ) + "#" + msg ;
+  }
+
+  // the parser as it was, kept here as the baseline
+  class LegacyParser {
+  public:
+    LegacyParser() : m_buffer(12228), m_nMessageLength(0) {}
+
+    boost::asio::mutable_buffer readBuffer(void) { return boost::asio::buffer( m_readBuf ) ; }
+
+    void parse( size_t bytes_transferred, Totals_t& totals ) {
+      // grow rather than overwrite, the original capacity is too small for a full read on top of a partial frame
+      if( m_buffer.reserve() < bytes_transferred ) m_buffer.set_capacity( m_buffer.size() + bytes_transferred ) ;
+      m_buffer.insert( m_buffer.end(), m_readBuf.begin(), m_readBuf.begin() + bytes_transferred ) ;
+      if( 0 == m_nMessageLength && !readMessageLength( m_nMessageLength ) ) return ;
+
+      while( m_buffer.size() >= m_nMessageLength && m_nMessageLength > 0 ) {
+        string in( m_buffer.begin(), m_buffer.begin() + m_nMessageLength ) ;
+        string meta, startLine, headers, body ;
+        splitMsg( in, meta, startLine, headers, body ) ;
+        vector<string> tokens ;
+        boost::split( tokens, meta, boost::is_any_of("|") ) ;
+        totals.messages++ ;
+        totals.tokens += tokens.size() ;
+        totals.bytes += startLine.length() + headers.length() + body.length() ;
+
+        m_buffer.erase_begin( m_nMessageLength ) ;
+        if( m_buffer.size() ) {
+          if( !readMessageLength( m_nMessageLength ) ) break ;
+        }
+        else {
+          m_nMessageLength = 0 ;
+        }
+      }
+    }
+
+  private:
+    bool readMessageLength( unsigned int& len ) {
+      bool continueOn = true ;
+      std::array<char, 6> ch ;
+      memset( ch.data(), 0, sizeof(ch) ) ;
+      unsigned int i = 0 ;
+      char c ;
+      do {
+        c = m_buffer.front() ;
+        m_buffer.pop_front() ;
+        if( '#' == c ) break ;
+        ch[i++] = c ;
+      } while( m_buffer.size() && i < 6 ) ;
+
+      if( 0 == m_buffer.size() ) {
+        if( '#' != c ) {
+          for( unsigned int n = 0; n < i; n++ ) m_buffer.push_back( ch[n] ) ;
+          len = 0 ;
+          return false ;
+        }
+        continueOn = false ;
+      }
+      len = boost::lexical_cast<unsigned int>( ch.data() ) ;
+      return continueOn ;
+    }
+
+    static void splitMsg( const string& msg, string& meta, string& startLine, string& headers, string& body ) {
+      size_t pos = msg.find( "\r\n" ) ;
+      if( string::npos == pos ) {
+        meta = msg ;
+        return ;
+      }
+      meta = msg.substr( 0, pos ) ;
+      string chunk = msg.substr( pos + 2 ) ;
+      pos = chunk.find( "\r\n\r\n" ) ;
+      if( string::npos != pos ) {
+        body = chunk.substr( pos + 4 ) ;
+        chunk = chunk.substr( 0, pos ) ;
+      }
+      pos = chunk.find( "\r\n" ) ;
+      if( string::npos == pos ) {
+        startLine = chunk ;
+      }
+      else {
+        startLine = chunk.substr( 0, pos ) ;
+        headers = chunk.substr( pos + 2 ) ;
+      }
+    }
+
+    std::array<char, 8192> m_readBuf ;
+    boost::circular_buffer<char> m_buffer ;
+    unsigned int m_nMessageLength ;
+  } ;
+
+  class ZeroCopyParser {
+  public:
+    boost::asio::mutable_buffer readBuffer(void) {
+      size_t size ;
+      char* p = m_reader.prepare( size ) ;
+      return boost::asio::buffer( p, size ) ;
+    }
+
+    void parse( size_t bytes_transferred, Totals_t& totals ) {
+      m_reader.commit( bytes_transferred ) ;
+      std::string_view in ;
+      while( m_reader.next( in ) ) {
+        std::string_view meta, startLine, headers, body ;
+        splitMsg( in, meta, startLine, headers, body ) ;
+        splitTokens( meta, m_tokens ) ;
+        totals.messages++ ;
+        totals.tokens += m_tokens.size() ;
+        totals.bytes += startLine.length() + headers.length() + body.length() ;
+      }
+    }
+
+  private:
+    FrameReader m_reader ;
+    vector<std::string_view> m_tokens ;
+  } ;
+
+  struct Result_t {
+    string    parser ;
+    size_t    messages ;
+    size_t    wireBytes ;
+    double    secs ;
+  } ;
+
+  /**
+   * one run: a writer thread sends count messages, cycling through the prepared frames in 64k
+   * writes, while this thread reads and parses them until all have arrived
+   */
+  template<typename Parser>
+  Result_t run( const char* name, const vector<string>& frames, size_t count ) {
+    boost::asio::io_context ioc ;
+    tcp::acceptor acceptor( ioc, tcp::endpoint( boost::asio::ip::address_v4::loopback(), 0 ) ) ;
+    tcp::socket reader( ioc ), writer( ioc ) ;
+    writer.connect( acceptor.local_endpoint() ) ;
+    acceptor.accept( reader ) ;
+    reader.set_option( tcp::no_delay( true ) ) ;
+    writer.set_option( tcp::no_delay( true ) ) ;
+
+    size_t wireBytes = 0 ;
+    for( size_t i = 0; i < count; i++ ) wireBytes += frames[ i % frames.size() ].length() ;
+
+    std::thread sender( [&writer, &frames, count]() {
+      string chunk ;
+      for( size_t i = 0; i < count; i++ ) {
+        chunk += frames[ i % frames.size() ] ;
+        if( chunk.length() >= 65536 || i + 1 == count ) {
+          boost::asio::write( writer, boost::asio::buffer( chunk ) ) ;
+          chunk.clear() ;
+        }
+      }
+    } ) ;
+
+    Parser parser ;
+    Totals_t totals ;
+    Clock::time_point start = Clock::now() ;
+    while( totals.messages < count ) {
+      size_t n = reader.read_some( parser.readBuffer() ) ;
+      parser.parse( n, totals ) ;
+    }
+    Clock::time_point end = Clock::now() ;
+    sender.join() ;
+
+    if( totals.tokens != 5 * count ) {
+      std::cerr << name << ": parsed " << totals.tokens << " tokens, expected " << 5 * count << std::endl ;
+      exit(1) ;
+    }
+
+    Result_t r ;
+    r.parser = name ;
+    r.messages = totals.messages ;
+    r.wireBytes = wireBytes ;
+    r.secs = std::chrono::duration<double>( end - start ).count() ;
+    return r ;
+  }
+
+  vector<string> splitList( const char* sz ) {
+    vector<string> v ;
+    boost::split( v, sz, boost::is_any_of(",") ) ;
+    return v ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_client_framing [--parser legacy,zero-copy] [--messages 500000] [--body-size 400]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> parsers = splitList( "legacy,zero-copy" ) ;
+  size_t count = 500000 ;
+  size_t bodySize = 400 ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--parser" ) ) parsers = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--messages" ) ) count = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--body-size" ) ) bodySize = strtoul( argv[++i], NULL, 10 ) ;
+    else usage() ;
+  }
+  if( 0 == count ) usage() ;
+
+  vector<string> frames ;
+  for( size_t i = 0; i < 1024; i++ ) frames.push_back( makeMessage( i, bodySize ) ) ;
+
+  vector<Result_t> results ;
+  for( const string& p : parsers ) {
+    std::cerr << "running " << p << " with " << count << " messages.." << std::endl ;
+    if( "legacy" == p ) results.push_back( run<LegacyParser>( "legacy", frames, count ) ) ;
+    else if( "zero-copy" == p ) results.push_back( run<ZeroCopyParser>( "zero-copy", frames, count ) ) ;
+    else {
+      std::cerr << "unknown parser: " << p << std::endl ;
+      usage() ;
+    }
+  }
+
+  printf( "{\n  \"benchmark\": \"client_framing\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"message_size\": %zu,\n  \"results\": [\n", frames[0].length() ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"parser\": \"%s\", \"messages\": %zu, \"secs\": %.3f, \"msgs_per_sec\": %.0f, \"mb_per_sec\": %.1f}%s\n",
+      r.parser.c_str(), r.messages, r.secs, r.messages / r.secs, r.wireBytes / r.secs / (1024 * 1024),
+      i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+  return 0 ;
+}
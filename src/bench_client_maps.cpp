@@ -0,0 +1,235 @@
+/*
+  ClientController map contention benchmark.
+
+  Runs the add / find / remove traffic that ClientController puts on its transaction, api request and
+  dialog maps from several threads at once, the way the sip thread and the client io threads do, and
+  compares one mutex over all of the maps with the striped maps.  Results are written to stdout as JSON:
+
+    make bench_client_maps && ./bench_client_maps > maps.json
+
+  usage: bench_client_maps [--impl single-lock,striped] [--threads 1,2,4,8] [--requests 200000]
+
+  Each thread plays a stream of requests: every request adds an api request and an app transaction,
+  looks both up the way the response path does, sometimes creates a dialog that is then looked up a
+  few times, and finally removes everything it added.  A background population of live dialogs is
+  created up front so that the maps have a realistic size.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <unordered_map>
+
+#include <boost/algorithm/string.hpp>
+
+#include "striped-map.hpp"
+
+using std::string ;
+using std::vector ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  struct Client_t {} ;
+  typedef std::weak_ptr<Client_t> client_weak_ptr ;
+  typedef std::shared_ptr<Client_t> client_ptr ;
+
+  // the maps as they were: guarded together by one lock
+  class SingleLockMaps {
+  public:
+    void add( int map, const string& id, const client_weak_ptr& client ) {
+      std::lock_guard<std::mutex> l( m_lock ) ;
+      m_maps[map].insert( std::make_pair( id, client ) ) ;
+    }
+    client_ptr find( int map, const string& id ) {
+      std::lock_guard<std::mutex> l( m_lock ) ;
+      auto it = m_maps[map].find( id ) ;
+      if( m_maps[map].end() == it ) return client_ptr() ;
+      return it->second.lock() ;
+    }
+    void remove( int map, const string& id ) {
+      std::lock_guard<std::mutex> l( m_lock ) ;
+      m_maps[map].erase( id ) ;
+    }
+    size_t size( int map ) {
+      std::lock_guard<std::mutex> l( m_lock ) ;
+      return m_maps[map].size() ;
+    }
+
+  private:
+    std::mutex m_lock ;
+    std::unordered_map<string, client_weak_ptr> m_maps[3] ;
+  } ;
+
+  class StripedMaps {
+  public:
+    void add( int map, const string& id, const client_weak_ptr& client ) {
+      m_maps[map].insert( id, client ) ;
+    }
+    client_ptr find( int map, const string& id ) {
+      client_weak_ptr owner ;
+      if( !m_maps[map].find( id, owner ) ) return client_ptr() ;
+      return owner.lock() ;
+    }
+    void remove( int map, const string& id ) {
+      m_maps[map].erase( id ) ;
+    }
+    size_t size( int map ) {
+      return m_maps[map].size() ;
+    }
+
+  private:
+    StripedMap<string, client_weak_ptr> m_maps[3] ;
+  } ;
+
+  enum { API_REQUESTS = 0, APP_TRANSACTIONS, DIALOGS } ;
+
+  const size_t LIVE_DIALOGS = 20000 ;
+
+  // uuid shaped ids, like the ones generateUuid hands out
+  string makeId( size_t thread, size_t n ) {
+    char sz[40] ;
+    snprintf( sz, sizeof(sz), "%08zx-41f0-4c8e-9d2b-%012zx", thread, n * 2654435761u ) ;
+    return sz ;
+  }
+
+  template<typename Maps>
+  void play( Maps& maps, const client_ptr& client, size_t thread, size_t count, size_t& found ) {
+    for( size_t i = 0; i < count; i++ ) {
+      string msgId = makeId( thread, 2 * i ) ;
+      string transactionId = makeId( thread, 2 * i + 1 ) ;
+
+      maps.add( API_REQUESTS, msgId, client ) ;
+      maps.add( APP_TRANSACTIONS, transactionId, client ) ;
+      if( maps.find( APP_TRANSACTIONS, transactionId ) ) found++ ;
+      if( maps.find( API_REQUESTS, msgId ) ) found++ ;
+
+      // one request in four establishes a dialog, which sees a few in-dialog requests before the BYE
+      if( 0 == i % 4 ) {
+        maps.add( DIALOGS, transactionId, client ) ;
+        for( int n = 0; n < 4; n++ ) if( maps.find( DIALOGS, transactionId ) ) found++ ;
+        maps.remove( DIALOGS, transactionId ) ;
+      }
+      // and requests for the long lived dialogs arrive all the while
+      if( maps.find( DIALOGS, makeId( 0xffff, i % LIVE_DIALOGS ) ) ) found++ ;
+
+      maps.remove( APP_TRANSACTIONS, transactionId ) ;
+      maps.remove( API_REQUESTS, msgId ) ;
+    }
+  }
+
+  struct Result_t {
+    string    impl ;
+    unsigned  threads ;
+    size_t    ops ;
+    double    secs ;
+  } ;
+
+  template<typename Maps>
+  Result_t run( const char* name, unsigned nThreads, size_t count ) {
+    Maps maps ;
+    client_ptr client = std::make_shared<Client_t>() ;
+    for( size_t i = 0; i < LIVE_DIALOGS; i++ ) maps.add( DIALOGS, makeId( 0xffff, i ), client ) ;
+
+    size_t perThread = count / nThreads ;
+    vector<size_t> found( nThreads, 0 ) ;
+    std::atomic<unsigned> ready(0) ;
+    std::atomic<bool> go(false) ;
+    vector<std::thread> threads ;
+    for( unsigned t = 0; t < nThreads; t++ ) {
+      threads.emplace_back( [&, t]() {
+        size_t n = 0 ;
+        ready++ ;
+        while( !go ) std::this_thread::yield() ;
+        play( maps, client, t, perThread, n ) ;
+        found[t] = n ;
+      } ) ;
+    }
+    while( ready < nThreads ) std::this_thread::yield() ;
+    Clock::time_point start = Clock::now() ;
+    go = true ;
+    for( auto& t : threads ) t.join() ;
+    Clock::time_point end = Clock::now() ;
+
+    // adds and removes of 2 ids, finds of 2 ids plus the live dialog; and for one in four, 1 add, 4 finds, 1 remove
+    size_t requests = perThread * nThreads ;
+    size_t expected = requests * 3 + ((perThread + 3) / 4) * nThreads * 4 ;
+    size_t total = 0 ;
+    for( size_t n : found ) total += n ;
+    if( total != expected || 0 != maps.size( API_REQUESTS ) || 0 != maps.size( APP_TRANSACTIONS ) ||
+      LIVE_DIALOGS != maps.size( DIALOGS ) ) {
+      std::cerr << name << ": found " << total << " ids, expected " << expected << std::endl ;
+      exit(1) ;
+    }
+
+    Result_t r ;
+    r.impl = name ;
+    r.threads = nThreads ;
+    r.ops = requests * 7 + ((perThread + 3) / 4) * nThreads * 6 ;
+    r.secs = std::chrono::duration<double>( end - start ).count() ;
+    return r ;
+  }
+
+  vector<string> splitList( const char* sz ) {
+    vector<string> v ;
+    boost::split( v, sz, boost::is_any_of(",") ) ;
+    return v ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_client_maps [--impl single-lock,striped] [--threads 1,2,4,8] [--requests 200000]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> impls = splitList( "single-lock,striped" ) ;
+  vector<string> threads = splitList( "1,2,4,8" ) ;
+  size_t count = 200000 ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--impl" ) ) impls = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--threads" ) ) threads = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--requests" ) ) count = strtoul( argv[++i], NULL, 10 ) ;
+    else usage() ;
+  }
+  if( 0 == count ) usage() ;
+
+  vector<Result_t> results ;
+  for( const string& t : threads ) {
+    unsigned nThreads = strtoul( t.c_str(), NULL, 10 ) ;
+    if( 0 == nThreads || nThreads > count ) usage() ;
+    for( const string& impl : impls ) {
+      std::cerr << "running " << impl << " with " << nThreads << " threads.." << std::endl ;
+      if( "single-lock" == impl ) results.push_back( run<SingleLockMaps>( "single-lock", nThreads, count ) ) ;
+      else if( "striped" == impl ) results.push_back( run<StripedMaps>( "striped", nThreads, count ) ) ;
+      else {
+        std::cerr << "unknown implementation: " << impl << std::endl ;
+        usage() ;
+      }
+    }
+  }
+
+  printf( "{\n  \"benchmark\": \"client_maps\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"cores\": %u,\n  \"results\": [\n", std::thread::hardware_concurrency() ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"impl\": \"%s\", \"threads\": %u, \"ops\": %zu, \"secs\": %.3f, \"ops_per_sec\": %.0f}%s\n",
+      r.impl.c_str(), r.threads, r.ops, r.secs, r.ops / r.secs, i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+  return 0 ;
+}
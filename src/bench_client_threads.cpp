@@ -0,0 +1,335 @@
+/*
+  Application connection threading benchmark.
+
+  Runs a server modelled on ClientController: one io_context served by a pool of threads, each
+  connection bound to its own strand, reading frames with FrameReader, splitting them with splitMsg
+  and splitTokens, and answering each one through a queue that keeps a single write outstanding.
+  A load generator on its own io_context pipelines framed SIP requests over many loopback
+  connections and counts the responses.  Results are written to stdout as JSON:
+
+    make bench_client_threads && ./bench_client_threads > threads.json
+
+  usage: bench_client_threads [--threads 1,2,4,8] [--connections 64] [--messages 500000]
+                              [--body-size 400] [--cert-file cert.pem --key-file key.pem]
+
+  With a certificate and key the connections use TLS, which is where spreading connections over
+  threads matters most.  --messages is the total across all connections.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <iostream>
+#include <functional>
+#include <type_traits>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "client-framing.hpp"
+
+using std::string ;
+using std::vector ;
+using boost::asio::ip::tcp ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+  typedef boost::asio::ip::tcp::socket socket_t ;
+  typedef boost::asio::ssl::stream<socket_t> ssl_socket_t ;
+  typedef boost::asio::strand<boost::asio::io_context::executor_type> strand_t ;
+
+  string frame( const string& msg ) {
+    return std::to_string( msg.length() ) + "#" + msg ;
+  }
+
+  string makeRequest( size_t n, size_t bodySize ) {
+    string msg = "req-" + std::to_string( n ) + "|sip|||\r\n" ;
+    msg += "INVITE sip:+15083084809@10.0.1.20:5060 SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP 10.0.1.10:5060;branch=z9hG4bK-" + std::to_string( n ) + "\r\n"
+      "From: <sip:+15083084800@10.0.1.10>;tag=" + std::to_string( n ) + "\r\n"
+      "To: <sip:+15083084809@10.0.1.20>\r\n"
+      "Call-ID: " + std::to_string( n ) + "-bench@10.0.1.10\r\n"
+      "CSeq: 1 INVITE\r\n"
+      "Content-Type: application/sdp\r\n"
+      "Content-Length: " + std::to_string( bodySize ) + "\r\n\r\n" ;
+    msg += string( bodySize, 'v' ) ;
+    return frame( msg ) ;
+  }
+
+  socket_t::lowest_layer_type& lowest( socket_t& s ) { return s.lowest_layer() ; }
+  socket_t::lowest_layer_type& lowest( ssl_socket_t& s ) { return s.lowest_layer() ; }
+
+  /**
+   * server side of one connection, the way BaseClient handles it: everything on the strand, frames
+   * parsed in place, responses queued behind a single outstanding write
+   */
+  template<typename T>
+  class Session : public std::enable_shared_from_this<Session<T>> {
+  public:
+    template<typename... Args>
+    Session( boost::asio::io_context& ioc, Args&... args ) : m_strand( boost::asio::make_strand( ioc ) ), m_sock( ioc, args... ), m_nWriting(0) {}
+
+    T& socket() { return m_sock ; }
+    strand_t& strand() { return m_strand ; }
+
+    void start() {
+      if constexpr (std::is_same<T, ssl_socket_t>::value) {
+        auto self( this->shared_from_this() ) ;
+        m_sock.async_handshake( boost::asio::ssl::stream_base::server, boost::asio::bind_executor( m_strand,
+          [self, this](const boost::system::error_code& ec) { if( !ec ) read() ; } ) ) ;
+      }
+      else {
+        read() ;
+      }
+    }
+
+  private:
+    void read() {
+      size_t size ;
+      char* p = m_reader.prepare( size ) ;
+      auto self( this->shared_from_this() ) ;
+      m_sock.async_read_some( boost::asio::buffer( p, size ), boost::asio::bind_executor( m_strand,
+        [self, this](const boost::system::error_code& ec, size_t bytes) {
+          if( ec ) return ;
+          m_reader.commit( bytes ) ;
+          std::string_view in ;
+          while( m_reader.next( in ) ) {
+            std::string_view meta, startLine, headers, body ;
+            splitMsg( in, meta, startLine, headers, body ) ;
+            splitTokens( meta, m_tokens ) ;
+            string msg = "6b2c1a9e-41f0-4c8e-9d2b-5f7e3a1c0d42|response|" ;
+            msg.append( m_tokens[0] ) ;
+            msg.append( "|OK" ) ;
+            m_outQueue.push_back( frame( msg ) ) ;
+          }
+          if( 0 == m_nWriting && !m_outQueue.empty() ) write() ;
+          read() ;
+        } ) ) ;
+    }
+
+    void write() {
+      vector<boost::asio::const_buffer> buffers ;
+      m_nWriting = std::min( m_outQueue.size(), (size_t) 64 ) ;
+      for( size_t i = 0; i < m_nWriting; i++ ) buffers.push_back( boost::asio::buffer( m_outQueue[i] ) ) ;
+      if constexpr (std::is_same<T, ssl_socket_t>::value) {
+        m_writeBuf.clear() ;
+        for( const auto& b : buffers ) m_writeBuf.append( static_cast<const char*>( b.data() ), b.size() ) ;
+        buffers.assign( 1, boost::asio::buffer( m_writeBuf ) ) ;
+      }
+      auto self( this->shared_from_this() ) ;
+      boost::asio::async_write( m_sock, buffers, boost::asio::bind_executor( m_strand,
+        [self, this](const boost::system::error_code& ec, size_t) {
+          if( ec ) return ;
+          for( ; m_nWriting > 0; m_nWriting-- ) m_outQueue.pop_front() ;
+          if( !m_outQueue.empty() ) write() ;
+        } ) ) ;
+    }
+
+    strand_t m_strand ;
+    T m_sock ;
+    FrameReader m_reader ;
+    vector<std::string_view> m_tokens ;
+    std::deque<string> m_outQueue ;
+    size_t m_nWriting ;
+    string m_writeBuf ;
+  } ;
+
+  /**
+   * load generator side of one connection: writes its share of the requests as fast as the socket
+   * takes them, and counts responses until all have arrived
+   */
+  template<typename T>
+  class Driver : public std::enable_shared_from_this<Driver<T>> {
+  public:
+    template<typename... Args>
+    Driver( boost::asio::io_context& ioc, const vector<string>& requests, size_t count, std::atomic<size_t>& done, Args&... args ) :
+      m_strand( boost::asio::make_strand( ioc ) ), m_sock( ioc, args... ), m_requests( requests ), m_count( count ), 
+      m_sent(0), m_received(0), m_done( done ) {}
+
+    T& socket() { return m_sock ; }
+
+    void start() {
+      if constexpr (std::is_same<T, ssl_socket_t>::value) {
+        m_sock.set_verify_mode( boost::asio::ssl::verify_none ) ;
+        boost::system::error_code ec ;
+        m_sock.handshake( boost::asio::ssl::stream_base::client, ec ) ;
+        if( ec ) {
+          std::cerr << "tls handshake failed: " << ec.message() << std::endl ;
+          exit(1) ;
+        }
+      }
+    }
+
+    void run() {
+      boost::asio::post( m_strand, [self = this->shared_from_this(), this]() {
+        write() ;
+        read() ;
+      } ) ;
+    }
+
+  private:
+    void write() {
+      if( m_sent == m_count ) return ;
+      m_chunk.clear() ;
+      while( m_sent < m_count && m_chunk.length() < 65536 ) m_chunk += m_requests[ m_sent++ % m_requests.size() ] ;
+      auto self( this->shared_from_this() ) ;
+      boost::asio::async_write( m_sock, boost::asio::buffer( m_chunk ), boost::asio::bind_executor( m_strand,
+        [self, this](const boost::system::error_code& ec, size_t) {
+          if( !ec ) write() ;
+        } ) ) ;
+    }
+
+    void read() {
+      size_t size ;
+      char* p = m_reader.prepare( size ) ;
+      auto self( this->shared_from_this() ) ;
+      m_sock.async_read_some( boost::asio::buffer( p, size ), boost::asio::bind_executor( m_strand,
+        [self, this](const boost::system::error_code& ec, size_t bytes) {
+          if( ec ) return ;
+          m_reader.commit( bytes ) ;
+          std::string_view in ;
+          while( m_reader.next( in ) ) m_received++ ;
+          if( m_received == m_count ) {
+            m_done++ ;
+            return ;
+          }
+          read() ;
+        } ) ) ;
+    }
+
+    strand_t m_strand ;
+    T m_sock ;
+    const vector<string>& m_requests ;
+    size_t m_count ;
+    size_t m_sent ;
+    size_t m_received ;
+    std::atomic<size_t>& m_done ;
+    string m_chunk ;
+    FrameReader m_reader ;
+  } ;
+
+  struct Result_t {
+    unsigned int  threads ;
+    size_t        messages ;
+    double        secs ;
+  } ;
+
+  template<typename T, typename... Args>
+  Result_t run( unsigned int nThreads, size_t nConnections, size_t count, const vector<string>& requests, Args&... args ) {
+    boost::asio::io_context server( nThreads ), load ;
+    tcp::acceptor acceptor( server, tcp::endpoint( boost::asio::ip::address_v4::loopback(), 0 ) ) ;
+
+    // connect everything up front so that only the message exchange is timed
+    std::atomic<size_t> done(0) ;
+    vector<std::shared_ptr<Driver<T>>> drivers ;
+    for( size_t i = 0; i < nConnections; i++ ) {
+      size_t share = count / nConnections + (i < count % nConnections ? 1 : 0) ;
+      auto session = std::make_shared<Session<T>>( server, args... ) ;
+      auto driver = std::make_shared<Driver<T>>( load, requests, share, done, args... ) ;
+      lowest( driver->socket() ).connect( acceptor.local_endpoint() ) ;
+      acceptor.accept( lowest( session->socket() ) ) ;
+      lowest( driver->socket() ).set_option( tcp::no_delay( true ) ) ;
+      lowest( session->socket() ).set_option( tcp::no_delay( true ) ) ;
+      boost::asio::post( session->strand(), std::bind( &Session<T>::start, session ) ) ;
+      drivers.push_back( driver ) ;
+    }
+
+    auto work = boost::asio::make_work_guard( server ) ;
+    vector<std::thread> threads ;
+    for( unsigned int i = 0; i < nThreads; i++ ) threads.push_back( std::thread( [&server]() { server.run() ; } ) ) ;
+    for( auto& d : drivers ) d->start() ;
+
+    Clock::time_point start = Clock::now() ;
+    for( auto& d : drivers ) d->run() ;
+    vector<std::thread> loaders ;
+    unsigned int nLoaders = std::max( 1U, std::thread::hardware_concurrency() / 2 ) ;
+    for( unsigned int i = 0; i < nLoaders; i++ ) loaders.push_back( std::thread( [&load]() { load.run() ; } ) ) ;
+    for( std::thread& t : loaders ) t.join() ;
+    Clock::time_point end = Clock::now() ;
+
+    if( done != nConnections ) {
+      std::cerr << "only " << done << " of " << nConnections << " connections completed" << std::endl ;
+      exit(1) ;
+    }
+    work.reset() ;
+    server.stop() ;
+    for( std::thread& t : threads ) t.join() ;
+
+    Result_t r ;
+    r.threads = nThreads ;
+    r.messages = count ;
+    r.secs = std::chrono::duration<double>( end - start ).count() ;
+    return r ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_client_threads [--threads 1,2,4,8] [--connections 64] [--messages 500000] " <<
+      "[--body-size 400] [--cert-file cert.pem --key-file key.pem]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> threadCounts ;
+  boost::split( threadCounts, "1,2,4,8", boost::is_any_of(",") ) ;
+  size_t nConnections = 64 ;
+  size_t count = 500000 ;
+  size_t bodySize = 400 ;
+  string certFile, keyFile ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--threads" ) ) boost::split( threadCounts, argv[++i], boost::is_any_of(",") ) ;
+    else if( 0 == strcmp( argv[i], "--connections" ) ) nConnections = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--messages" ) ) count = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--body-size" ) ) bodySize = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--cert-file" ) ) certFile = argv[++i] ;
+    else if( 0 == strcmp( argv[i], "--key-file" ) ) keyFile = argv[++i] ;
+    else usage() ;
+  }
+  if( 0 == nConnections || count < nConnections || certFile.empty() != keyFile.empty() ) usage() ;
+  bool tls = !certFile.empty() ;
+
+  vector<string> requests ;
+  for( size_t i = 0; i < 1024; i++ ) requests.push_back( makeRequest( i, bodySize ) ) ;
+
+  // one context serves both ends, the load generator does not verify the certificate
+  boost::asio::ssl::context context( boost::asio::ssl::context::sslv23 ) ;
+  if( tls ) {
+    context.use_certificate_chain_file( certFile ) ;
+    context.use_private_key_file( keyFile, boost::asio::ssl::context::pem ) ;
+  }
+
+  vector<Result_t> results ;
+  for( const string& t : threadCounts ) {
+    unsigned int nThreads = ::atoi( t.c_str() ) ;
+    if( 0 == nThreads ) usage() ;
+    std::cerr << "running " << count << " messages over " << nConnections << (tls ? " tls" : " tcp") <<
+      " connections with " << nThreads << " threads.." << std::endl ;
+    if( tls ) results.push_back( run<ssl_socket_t>( nThreads, nConnections, count, requests, context ) ) ;
+    else results.push_back( run<socket_t>( nThreads, nConnections, count, requests ) ) ;
+  }
+
+  printf( "{\n  \"benchmark\": \"client_threads\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"transport\": \"%s\",\n  \"connections\": %zu,\n  \"cores\": %u,\n  \"results\": [\n",
+    tls ? "tls" : "tcp", nConnections, std::thread::hardware_concurrency() ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"threads\": %u, \"messages\": %zu, \"secs\": %.3f, \"msgs_per_sec\": %.0f}%s\n",
+      r.threads, r.messages, r.secs, r.messages / r.secs, i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+  return 0 ;
+}
@@ -0,0 +1,216 @@
+/*
+  Dialog journal benchmark.
+
+  Measures what the dialog journal costs the stack thread while dialogs come and go, and how long a warm
+  restart takes to read it back, with a large population of established dialogs:
+
+    make bench_dialog_journal && ./bench_dialog_journal > dialog-journal.json
+
+  usage: bench_dialog_journal [--dialogs 500000] [--refreshes 2] [--churn 0.2] [--rate 50000]
+                              [--path /tmp/bench-dialogs.journal]
+
+  Every dialog is created, then refreshed --refreshes times (as each re-arm of its session timer does), and
+  --churn of them are destroyed, in the order a busy server would see it, at --rate records a second (a server
+  with 500k dialogs refreshing every 15 minutes and taking 500 calls a second journals under 2000 a second).  The records are typical of an
+  answered call through an SBC: a two-entry route set and a local sdp of a few hundred bytes.  We report:
+    append_ns_mean      time the calling (stack) thread spends per record
+    append_ns_p99, append_ns_p999, append_ns_max
+                        the tail; on a host with fewer cores than threads this is mostly the writer being scheduled
+    drain_ms            how long the writer took to catch up once the last record was queued
+    file_mb             size of the journal file
+    replay_ms           time to read the journal back and hand each live dialog to the restore function
+    compact_ms          time to compact the journal to the live dialogs and restart the writer
+    dialogs_restored    which must equal the number of dialogs not destroyed; the run fails otherwise
+
+  The nta_leg_t that drachtio rebuilds for each restored dialog is not part of this measurement.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+
+#include "dialog-journal.hpp"
+
+using std::string ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  double msecsSince( Clock::time_point start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count() ;
+  }
+
+  string callId( size_t n ) {
+    char sz[64] ;
+    snprintf( sz, sizeof(sz), "%08zx-6b1e-4d7a-a1f4-%012zx", n, n * 2654435761u ) ;
+    return sz ;
+  }
+
+  void makeRecord( size_t n, DialogJournal::Record_t& rec, const string& sdp ) {
+    rec.callId = callId( n ) ;
+    rec.localTag = "as" + std::to_string( n * 7919 ) ;
+    rec.remoteTag = "gK" + std::to_string( n * 104729 ) ;
+    rec.dialogId = rec.callId + ";from-tag=" + rec.remoteTag ;
+    rec.role = 1 ;
+    rec.local = "<sip:+15085551212@10.0.1.10>;tag=" + rec.localTag ;
+    rec.remote = "\"Jane\" <sip:+16175550100@carrier.example.com>;tag=" + rec.remoteTag ;
+    rec.routeSet = "<sip:192.0.2.10;lr;ftag=" + rec.remoteTag + ">, <sip:sbc.carrier.example.com;lr>" ;
+    rec.target = "<sip:+16175550100@198.51.100.20:5060;transport=udp>" ;
+    rec.localSeq = 1 ;
+    rec.remoteSeq = 101 ;
+    rec.localContact = "<sip:10.0.1.10:5060>" ;
+    rec.protocol = "udp" ;
+    rec.transportAddress = "10.0.1.10" ;
+    rec.transportPort = "5060" ;
+    rec.sourceAddress = "198.51.100.20" ;
+    rec.sourcePort = 5060 ;
+    rec.localSdp = sdp ;
+    rec.localContentType = "application/sdp" ;
+    rec.sessionExpires = 1800 ;
+    rec.refresher = 1 ;
+    rec.minSE = 90 ;
+    rec.sessionDue = time( 0 ) + 900 ;
+    rec.startTime = rec.connectTime = time( 0 ) ;
+    rec.appName = "ivr" ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_dialog_journal [--dialogs 500000] [--refreshes 2] [--churn 0.2] [--rate 50000] " <<
+      "[--path /tmp/bench-dialogs.journal]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  size_t count = 500000 ;
+  unsigned int refreshes = 2 ;
+  double churn = 0.2 ;
+  unsigned long rate = 50000 ;
+  string path = "/tmp/bench-dialogs.journal" ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--dialogs" ) ) count = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--refreshes" ) ) refreshes = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--churn" ) ) churn = atof( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--rate" ) ) rate = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--path" ) ) path = argv[++i] ;
+    else usage() ;
+  }
+  if( 0 == count || 0 == rate || churn < 0 || churn > 1 ) usage() ;
+  unlink( path.c_str() ) ;
+
+  string sdp = "v=0\r\no=- 3912345678 3912345678 IN IP4 10.0.1.20\r\ns=-\r\nc=IN IP4 10.0.1.20\r\nt=0 0\r\n"
+    "m=audio 40000 RTP/AVP 0 8 101\r\na=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\na=ptime:20\r\na=sendrecv\r\n" ;
+
+  /* the order in which the stack thread would see the events: creates, then refreshes and destroys interleaved */
+  struct Event_t { size_t dialog ; DialogJournal::RecordType_t type ; } ;
+  std::vector<Event_t> events ;
+  events.reserve( count * (2 + refreshes) ) ;
+  for( size_t n = 0; n < count; n++ ) events.push_back( { n, DialogJournal::rec_create } ) ;
+  std::vector<Event_t> later ;
+  std::mt19937 rng(42) ;
+  std::vector<bool> destroyed( count, false ) ;
+  for( size_t n = 0; n < count; n++ ) {
+    for( unsigned int r = 0; r < refreshes; r++ ) later.push_back( { n, DialogJournal::rec_refresh } ) ;
+    if( (rng() % 1000000) < churn * 1000000 ) {
+      destroyed[n] = true ;
+      later.push_back( { n, DialogJournal::rec_destroy } ) ;
+    }
+  }
+  std::shuffle( later.begin(), later.end(), rng ) ;
+  // a refresh that lands after the destroy would be ignored anyway; keep each dialog's destroy last so the counts are exact
+  std::stable_partition( later.begin(), later.end(), []( const Event_t& e ) { return DialogJournal::rec_destroy != e.type ; } ) ;
+  events.insert( events.end(), later.begin(), later.end() ) ;
+  size_t live = std::count( destroyed.begin(), destroyed.end(), false ) ;
+
+  /* 1. journal the events, timing each append on this thread */
+  std::vector<float> appendNs ;
+  appendNs.reserve( events.size() ) ;
+  double drainMs, writeMs ;
+  size_t fileSize ;
+  uint64_t dropped ;
+  {
+    DialogJournal journal( path ) ;
+    journal.replay( []( const DialogJournal::Record_t& ) { return true ; } ) ;
+    if( !journal.start() ) {
+      std::cerr << "unable to create journal at " << path << std::endl ;
+      return 1 ;
+    }
+    std::vector<uint32_t> seqs( count, 1 ) ;
+    DialogJournal::Record_t rec ;
+    Clock::time_point start = Clock::now() ;
+    for( size_t i = 0; i < events.size(); i++ ) {
+      const Event_t& e = events[i] ;
+      if( 0 == i % 1000 ) std::this_thread::sleep_until( start + std::chrono::microseconds( i * 1000000 / rate ) ) ;
+      makeRecord( e.dialog, rec, sdp ) ;
+      if( DialogJournal::rec_refresh == e.type ) {
+        rec.localSeq = ++seqs[e.dialog] ;
+      }
+      Clock::time_point t = Clock::now() ;
+      if( DialogJournal::rec_destroy == e.type ) journal.appendDestroy( rec.dialogId ) ;
+      else journal.append( e.type, rec ) ;
+      appendNs.push_back( std::chrono::duration<float, std::nano>( Clock::now() - t ).count() ) ;
+    }
+    writeMs = msecsSince( start ) ;
+    start = Clock::now() ;
+    journal.stop() ;
+    drainMs = msecsSince( start ) ;
+    fileSize = journal.getFileSize() ;
+    dropped = journal.getDroppedCount() ;
+  }
+
+  /* 2. a warm restart: read it back, checking each dialog against what was journaled */
+  size_t restored = 0, mismatched = 0 ;
+  double replayMs, compactMs ;
+  {
+    DialogJournal journal( path ) ;
+    DialogJournal::Record_t expected ;
+    Clock::time_point start = Clock::now() ;
+    restored = journal.replay( [&]( const DialogJournal::Record_t& rec ) {
+      size_t n = strtoul( rec.callId.c_str(), NULL, 16 ) ;
+      makeRecord( n, expected, sdp ) ;
+      if( n >= count || destroyed[n] || rec.dialogId != expected.dialogId || rec.local != expected.local ||
+        rec.remote != expected.remote || rec.routeSet != expected.routeSet || rec.localSdp != expected.localSdp ||
+        rec.appName != expected.appName || rec.localSeq != 1 + refreshes ) {
+        mismatched++ ;
+      }
+      return true ;
+    }) ;
+    replayMs = msecsSince( start ) ;
+    start = Clock::now() ;
+    journal.start() ;
+    compactMs = msecsSince( start ) ;
+  }
+  unlink( path.c_str() ) ;
+
+  double appendNsMean = 0 ;
+  for( float ns : appendNs ) appendNsMean += ns ;
+  appendNsMean /= appendNs.size() ;
+  std::sort( appendNs.begin(), appendNs.end() ) ;
+  auto percentile = [&appendNs]( double p ) { return appendNs[ std::min( appendNs.size() - 1, (size_t) (p * appendNs.size()) ) ] ; } ;
+
+  printf( "{\n  \"benchmark\": \"dialog_journal\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"dialogs\": %zu,\n  \"refreshes\": %u,\n  \"churn\": %.2f,\n  \"rate\": %lu,\n", count, refreshes, churn, rate ) ;
+  printf( "  \"records\": %zu,\n  \"records_dropped\": %llu,\n  \"append_ns_mean\": %.0f,\n  \"append_ns_p99\": %.0f,\n"
+    "  \"append_ns_p999\": %.0f,\n  \"append_ns_max\": %.0f,\n", events.size(), (unsigned long long) dropped, appendNsMean,
+    percentile( 0.99 ), percentile( 0.999 ), appendNs.back() ) ;
+  printf( "  \"append_ms\": %.1f,\n  \"drain_ms\": %.1f,\n  \"file_mb\": %.1f,\n", writeMs, drainMs, fileSize / (1024.0 * 1024.0) ) ;
+  printf( "  \"replay_ms\": %.1f,\n  \"compact_ms\": %.1f,\n  \"dialogs_live\": %zu,\n  \"dialogs_restored\": %zu,\n  \"dialogs_mismatched\": %zu\n}\n",
+    replayMs, compactMs, live, restored, mismatched ) ;
+
+  return (restored == live && 0 == mismatched && 0 == dropped) ? 0 : 1 ;
+}
@@ -0,0 +1,407 @@
+/*
+  SipDialogController storage contention benchmark.
+
+  Plays the traffic that SipDialogController puts on its invites in progress, stable dialogs, requests
+  in progress (RIP) and incoming request (IRQ) stores from several threads at once, the way the stack
+  thread and the client threads do, with a large population of established dialogs.  Compares the stores
+  as they were -- a multi_index container behind one mutex per store, and one mutex over the RIP and IRQ
+  maps -- with the striped indexes.  Every lock is timed, and the time threads spent waiting for locks
+  that were held by someone else is reported.  Results are written to stdout as JSON:
+
+    make bench_dialog_stores && ./bench_dialog_stores > dialog-stores.json
+
+  usage: bench_dialog_stores [--impl single-lock,striped] [--threads 1,2,4,8] [--calls 200000] [--dialogs 100000]
+
+  Each thread plays a stream of calls: an invite in progress is added and found by its irq, leg and
+  transaction id as the responses go back and forth, a RIP and an IRQ entry come and go, the call becomes
+  a stable dialog that sees a few in-dialog requests, and is torn down.  All the while, requests arrive
+  for the long lived dialogs.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <unordered_map>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/identity.hpp>
+
+#include "striped-map.hpp"
+
+using std::string ;
+using std::vector ;
+using namespace drachtio ;
+using namespace ::boost::multi_index ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  // a mutex that adds the time spent waiting for it to the waiting thread's total
+  thread_local uint64_t waitNsecs = 0 ;
+  thread_local uint64_t waits = 0 ;
+
+  class TimedMutex {
+  public:
+    void lock() {
+      if( m_mutex.try_lock() ) return ;
+      Clock::time_point start = Clock::now() ;
+      m_mutex.lock() ;
+      waitNsecs += std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - start ).count() ;
+      waits++ ;
+    }
+    void unlock() { m_mutex.unlock() ; }
+
+  private:
+    std::mutex m_mutex ;
+  } ;
+
+  // stand-ins for the sofia handles: only their addresses matter
+  struct Leg {} ;
+  struct Irq {} ;
+  struct Orq {} ;
+
+  struct IIP {
+    IIP( const Leg* l, const Irq* i, const string& t ) : leg_(l), irq_(i), tid_(t) {}
+    const Leg* leg() const { return leg_ ; }
+    const Irq* irq() const { return irq_ ; }
+    const string& tid() const { return tid_ ; }
+    const Leg* leg_ ;
+    const Irq* irq_ ;
+    string tid_ ;
+  } ;
+
+  struct Dialog {
+    Dialog( const Leg* l, const string& id ) : leg_(l), id_(id) {}
+    const Leg* leg() const { return leg_ ; }
+    const string& id() const { return id_ ; }
+    const Leg* leg_ ;
+    string id_ ;
+  } ;
+
+  struct RIP { string dialogId ; } ;
+
+  struct LegTag{} ;
+  struct IrqTag{} ;
+  struct TidTag{} ;
+  struct IdTag{} ;
+
+  // the stores as they were: multi_index containers, each behind its own lock, and one lock over the RIP and IRQ maps
+  class SingleLockStores {
+  public:
+    void addIIP( const std::shared_ptr<IIP>& iip ) {
+      std::lock_guard<TimedMutex> l( m_iipLock ) ;
+      m_iips.insert( iip ) ;
+    }
+    bool findIIPByIrq( const Irq* irq ) {
+      std::lock_guard<TimedMutex> l( m_iipLock ) ;
+      return m_iips.get<IrqTag>().find( irq ) != m_iips.get<IrqTag>().end() ;
+    }
+    bool findIIPByLeg( const Leg* leg ) {
+      std::lock_guard<TimedMutex> l( m_iipLock ) ;
+      return m_iips.get<LegTag>().find( leg ) != m_iips.get<LegTag>().end() ;
+    }
+    bool findIIPByTid( const string& tid ) {
+      std::lock_guard<TimedMutex> l( m_iipLock ) ;
+      return m_iips.get<TidTag>().find( tid ) != m_iips.get<TidTag>().end() ;
+    }
+    void clearIIP( const std::shared_ptr<IIP>& iip ) {
+      std::lock_guard<TimedMutex> l( m_iipLock ) ;
+      m_iips.get<LegTag>().erase( iip->leg() ) ;
+    }
+
+    void addDialog( const std::shared_ptr<Dialog>& dlg ) {
+      std::lock_guard<TimedMutex> l( m_sdLock ) ;
+      m_dialogs.insert( dlg ) ;
+    }
+    bool findDialog( const string& id ) {
+      std::lock_guard<TimedMutex> l( m_sdLock ) ;
+      return m_dialogs.get<IdTag>().find( id ) != m_dialogs.get<IdTag>().end() ;
+    }
+    void clearDialog( const Leg* leg ) {
+      std::lock_guard<TimedMutex> l( m_sdLock ) ;
+      m_dialogs.get<LegTag>().erase( leg ) ;
+    }
+
+    void addRIP( const Orq* orq, const std::shared_ptr<RIP>& rip ) {
+      std::lock_guard<TimedMutex> l( m_lock ) ;
+      m_rips.emplace( orq, rip ) ;
+    }
+    bool findRIP( const Orq* orq ) {
+      std::lock_guard<TimedMutex> l( m_lock ) ;
+      return m_rips.find( orq ) != m_rips.end() ;
+    }
+    void clearRIP( const Orq* orq ) {
+      std::lock_guard<TimedMutex> l( m_lock ) ;
+      m_rips.erase( orq ) ;
+    }
+    void addIrq( const string& tid, const Irq* irq ) {
+      std::lock_guard<TimedMutex> l( m_lock ) ;
+      m_irqs.emplace( tid, irq ) ;
+    }
+    bool removeIrq( const string& tid ) {
+      std::lock_guard<TimedMutex> l( m_lock ) ;
+      return 0 != m_irqs.erase( tid ) ;
+    }
+
+    size_t iips() { std::lock_guard<TimedMutex> l( m_iipLock ) ; return m_iips.size() ; }
+    size_t dialogs() { std::lock_guard<TimedMutex> l( m_sdLock ) ; return m_dialogs.size() ; }
+
+  private:
+    typedef multi_index_container<
+      std::shared_ptr<IIP>,
+      indexed_by<
+        hashed_unique< identity< std::shared_ptr<IIP> > >,
+        hashed_non_unique< tag<IrqTag>, const_mem_fun<IIP, const Irq*, &IIP::irq> >,
+        hashed_non_unique< tag<LegTag>, const_mem_fun<IIP, const Leg*, &IIP::leg> >,
+        hashed_unique< tag<TidTag>, const_mem_fun<IIP, const string&, &IIP::tid> >
+      >
+    > IIPs_t ;
+    typedef multi_index_container<
+      std::shared_ptr<Dialog>,
+      indexed_by<
+        hashed_unique< identity< std::shared_ptr<Dialog> > >,
+        hashed_unique< tag<LegTag>, const_mem_fun<Dialog, const Leg*, &Dialog::leg> >,
+        hashed_unique< tag<IdTag>, const_mem_fun<Dialog, const string&, &Dialog::id> >
+      >
+    > Dialogs_t ;
+
+    TimedMutex m_iipLock ;
+    IIPs_t m_iips ;
+    TimedMutex m_sdLock ;
+    Dialogs_t m_dialogs ;
+    TimedMutex m_lock ;
+    std::unordered_map<const Orq*, std::shared_ptr<RIP>> m_rips ;
+    std::unordered_map<string, const Irq*> m_irqs ;
+  } ;
+
+  template<typename K, typename V>
+  using Striped = StripedMap<K, V, 32, std::hash<K>, TimedMutex> ;
+
+  // the striped indexes, used the way the IIP_* and SD_* helpers use them
+  class StripedStores {
+  public:
+    void addIIP( const std::shared_ptr<IIP>& iip ) {
+      if( !m_iipByTid.insert( iip->tid(), iip ) ) return ;
+      m_iipByLeg.insert( iip->leg(), iip ) ;
+      m_iipByIrq.insert( iip->irq(), iip ) ;
+    }
+    bool findIIPByIrq( const Irq* irq ) { std::shared_ptr<IIP> p ; return m_iipByIrq.find( irq, p ) ; }
+    bool findIIPByLeg( const Leg* leg ) { std::shared_ptr<IIP> p ; return m_iipByLeg.find( leg, p ) ; }
+    bool findIIPByTid( const string& tid ) { std::shared_ptr<IIP> p ; return m_iipByTid.find( tid, p ) ; }
+    void clearIIP( const std::shared_ptr<IIP>& iip ) {
+      auto same = [&iip]( const std::shared_ptr<IIP>& p ) { return p == iip ; } ;
+      m_iipByTid.eraseIf( iip->tid(), same ) ;
+      m_iipByLeg.eraseIf( iip->leg(), same ) ;
+      m_iipByIrq.eraseIf( iip->irq(), same ) ;
+    }
+
+    void addDialog( const std::shared_ptr<Dialog>& dlg ) {
+      if( !m_sdById.insert( dlg->id(), dlg ) ) return ;
+      m_sdByLeg.insert( dlg->leg(), dlg ) ;
+    }
+    bool findDialog( const string& id ) { std::shared_ptr<Dialog> p ; return m_sdById.find( id, p ) ; }
+    void clearDialog( const Leg* leg ) {
+      std::shared_ptr<Dialog> dlg ;
+      if( m_sdByLeg.erase( leg, dlg ) ) m_sdById.eraseIf( dlg->id(), [&dlg]( const std::shared_ptr<Dialog>& p ) { return p == dlg ; } ) ;
+    }
+
+    void addRIP( const Orq* orq, const std::shared_ptr<RIP>& rip ) { m_rips.insert( orq, rip ) ; }
+    bool findRIP( const Orq* orq ) { std::shared_ptr<RIP> p ; return m_rips.find( orq, p ) ; }
+    void clearRIP( const Orq* orq ) { m_rips.erase( orq ) ; }
+    void addIrq( const string& tid, const Irq* irq ) { m_irqs.insert( tid, irq ) ; }
+    bool removeIrq( const string& tid ) { return m_irqs.erase( tid ) ; }
+
+    size_t iips() { return m_iipByTid.size() ; }
+    size_t dialogs() { return m_sdById.size() ; }
+
+  private:
+    Striped<string, std::shared_ptr<IIP>>        m_iipByTid ;
+    Striped<const Leg*, std::shared_ptr<IIP>>    m_iipByLeg ;
+    Striped<const Irq*, std::shared_ptr<IIP>>    m_iipByIrq ;
+    Striped<string, std::shared_ptr<Dialog>>     m_sdById ;
+    Striped<const Leg*, std::shared_ptr<Dialog>> m_sdByLeg ;
+    Striped<const Orq*, std::shared_ptr<RIP>>    m_rips ;
+    Striped<string, const Irq*>                  m_irqs ;
+  } ;
+
+  // uuid shaped ids, like the ones generateUuid hands out
+  string makeId( size_t thread, size_t n ) {
+    char sz[40] ;
+    snprintf( sz, sizeof(sz), "%08zx-41f0-4c8e-9d2b-%012zx", thread, n * 2654435761u ) ;
+    return sz ;
+  }
+
+  // the handles of a call: a leg, an incoming and an outgoing transaction
+  struct Handles_t {
+    Leg leg ;
+    Irq irq ;
+    Orq orq ;
+  } ;
+
+  template<typename Stores>
+  void play( Stores& stores, size_t thread, size_t count, size_t liveDialogs, size_t& found ) {
+    vector<Handles_t> handles( 64 ) ;
+    for( size_t i = 0; i < count; i++ ) {
+      Handles_t& h = handles[ i % handles.size() ] ;
+      string tid = makeId( thread, 2 * i ) ;
+      string dialogId = makeId( thread, 2 * i + 1 ) ;
+
+      // the INVITE arrives, the application answers it, and the ACK comes in
+      std::shared_ptr<IIP> iip = std::make_shared<IIP>( &h.leg, &h.irq, tid ) ;
+      stores.addIIP( iip ) ;
+      if( stores.findIIPByTid( tid ) ) found++ ;
+      if( stores.findIIPByIrq( &h.irq ) ) found++ ;
+      if( stores.findIIPByLeg( &h.leg ) ) found++ ;
+      stores.addDialog( std::make_shared<Dialog>( &h.leg, dialogId ) ) ;
+      if( stores.findIIPByLeg( &h.leg ) ) found++ ;
+      stores.clearIIP( iip ) ;
+
+      // an in-dialog request from the network, and one from the application
+      stores.addIrq( tid, &h.irq ) ;
+      if( stores.findDialog( dialogId ) ) found++ ;
+      if( stores.removeIrq( tid ) ) found++ ;
+      if( stores.findDialog( dialogId ) ) found++ ;
+      stores.addRIP( &h.orq, std::make_shared<RIP>() ) ;
+      if( stores.findRIP( &h.orq ) ) found++ ;
+      stores.clearRIP( &h.orq ) ;
+
+      // requests for the long lived dialogs arrive all the while
+      if( stores.findDialog( makeId( 0xffff, (thread * 7919 + i) % liveDialogs ) ) ) found++ ;
+
+      stores.clearDialog( &h.leg ) ;
+    }
+  }
+
+  struct Result_t {
+    string    impl ;
+    unsigned  threads ;
+    size_t    calls ;
+    double    secs ;
+    double    waitSecs ;
+    uint64_t  waits ;
+  } ;
+
+  template<typename Stores>
+  Result_t run( const char* name, unsigned nThreads, size_t count, size_t liveDialogs ) {
+    Stores stores ;
+    vector<std::unique_ptr<Leg>> liveLegs ;
+    for( size_t i = 0; i < liveDialogs; i++ ) {
+      liveLegs.emplace_back( new Leg ) ;
+      stores.addDialog( std::make_shared<Dialog>( liveLegs.back().get(), makeId( 0xffff, i ) ) ) ;
+    }
+
+    size_t perThread = count / nThreads ;
+    vector<size_t> found( nThreads, 0 ) ;
+    vector<uint64_t> waitNs( nThreads, 0 ), nWaits( nThreads, 0 ) ;
+    std::atomic<unsigned> ready(0) ;
+    std::atomic<bool> go(false) ;
+    vector<std::thread> threads ;
+    for( unsigned t = 0; t < nThreads; t++ ) {
+      threads.emplace_back( [&, t]() {
+        size_t n = 0 ;
+        ready++ ;
+        while( !go ) std::this_thread::yield() ;
+        waitNsecs = waits = 0 ;
+        play( stores, t, perThread, liveDialogs, n ) ;
+        found[t] = n ;
+        waitNs[t] = waitNsecs ;
+        nWaits[t] = waits ;
+      } ) ;
+    }
+    while( ready < nThreads ) std::this_thread::yield() ;
+    Clock::time_point start = Clock::now() ;
+    go = true ;
+    for( auto& t : threads ) t.join() ;
+    Clock::time_point end = Clock::now() ;
+
+    size_t expected = perThread * nThreads * 9 ;
+    size_t total = 0 ;
+    for( size_t n : found ) total += n ;
+    if( total != expected || 0 != stores.iips() || liveDialogs != stores.dialogs() ) {
+      std::cerr << name << ": found " << total << " entries, expected " << expected << std::endl ;
+      exit(1) ;
+    }
+
+    Result_t r ;
+    r.impl = name ;
+    r.threads = nThreads ;
+    r.calls = perThread * nThreads ;
+    r.secs = std::chrono::duration<double>( end - start ).count() ;
+    r.waitSecs = 0 ;
+    r.waits = 0 ;
+    for( unsigned t = 0; t < nThreads; t++ ) {
+      r.waitSecs += waitNs[t] / 1e9 ;
+      r.waits += nWaits[t] ;
+    }
+    return r ;
+  }
+
+  vector<string> splitList( const char* sz ) {
+    vector<string> v ;
+    boost::split( v, sz, boost::is_any_of(",") ) ;
+    return v ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_dialog_stores [--impl single-lock,striped] [--threads 1,2,4,8] [--calls 200000] [--dialogs 100000]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> impls = splitList( "single-lock,striped" ) ;
+  vector<string> threads = splitList( "1,2,4,8" ) ;
+  size_t count = 200000 ;
+  size_t liveDialogs = 100000 ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--impl" ) ) impls = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--threads" ) ) threads = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--calls" ) ) count = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--dialogs" ) ) liveDialogs = strtoul( argv[++i], NULL, 10 ) ;
+    else usage() ;
+  }
+  if( 0 == count || 0 == liveDialogs ) usage() ;
+
+  vector<Result_t> results ;
+  for( const string& t : threads ) {
+    unsigned nThreads = strtoul( t.c_str(), NULL, 10 ) ;
+    if( 0 == nThreads || nThreads > count ) usage() ;
+    for( const string& impl : impls ) {
+      std::cerr << "running " << impl << " with " << nThreads << " threads.." << std::endl ;
+      if( "single-lock" == impl ) results.push_back( run<SingleLockStores>( "single-lock", nThreads, count, liveDialogs ) ) ;
+      else if( "striped" == impl ) results.push_back( run<StripedStores>( "striped", nThreads, count, liveDialogs ) ) ;
+      else {
+        std::cerr << "unknown implementation: " << impl << std::endl ;
+        usage() ;
+      }
+    }
+  }
+
+  printf( "{\n  \"benchmark\": \"dialog_stores\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"cores\": %u,\n  \"dialogs\": %zu,\n  \"results\": [\n", std::thread::hardware_concurrency(), liveDialogs ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"impl\": \"%s\", \"threads\": %u, \"calls\": %zu, \"secs\": %.3f, \"calls_per_sec\": %.0f, "
+      "\"lock_waits\": %llu, \"lock_wait_secs\": %.4f, \"lock_wait_pct\": %.2f}%s\n",
+      r.impl.c_str(), r.threads, r.calls, r.secs, r.calls / r.secs, (unsigned long long) r.waits, r.waitSecs,
+      100.0 * r.waitSecs / (r.secs * r.threads), i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+  return 0 ;
+}
@@ -0,0 +1,238 @@
+/*
+  Session timer benchmark.
+
+  Measures what it costs the su_root thread to keep session timers for a large number of stable
+  dialogs, the old way (one su_timer_t and one heap-allocated weak_ptr per dialog, as SipDialog used
+  to have) against the shared coarse-grained TimerWheel that SipDialogController now owns:
+
+    make bench_session_timers && ./bench_session_timers > session-timers.json
+
+  usage: bench_session_timers [--impl su-timer,wheel] [--dialogs 200000] [--session-expires 90]
+                              [--seconds 60]
+
+  Every dialog is its own refresher, so its timer goes off halfway through the session interval
+  (+/- 5s, as in SipDialog::setSessionTimer) and is immediately re-armed, as it is when the 200 OK
+  to the refreshing re-INVITE arrives.  Dialogs are armed at random points of their first interval
+  so that the run starts in steady state.  For each implementation we report:
+    arm_ms         wall time to arm the timers for every dialog
+    cpu_ms         user + system cpu used by the su_root thread over the timed run
+    refreshes      timer callbacks that ran during the run
+    wakeups        times the su_root thread woke up to run a timer callback
+    cpu_us_per_refresh
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+
+#include "sofia-sip/su.h"
+#include "sofia-sip/su_wait.h"
+#include "sofia-sip/nta.h"
+
+#include "timer-queue.hpp"
+
+using std::string ;
+using std::vector ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  struct Result_t {
+    string    impl ;
+    size_t    dialogs ;
+    double    armMs ;
+    double    cpuMs ;
+    uint64_t  refreshes ;
+    uint64_t  wakeups ;
+  } ;
+
+  unsigned long sessionExpires = 90 ;
+  std::mt19937 rng(42) ;
+  uint64_t refreshes = 0 ;
+  uint64_t wakeups = 0 ;
+
+  // the refresh interval SipDialog::setSessionTimer arms when we are the refresher
+  uint32_t refreshMsecs(void) {
+    return sessionExpires * 1000 / 2 + (rng() % 10000) - 5000 ;
+  }
+
+  double cpuMsecs(void) {
+    struct rusage ru ;
+    getrusage( RUSAGE_SELF, &ru ) ;
+    return ru.ru_utime.tv_sec * 1000.0 + ru.ru_utime.tv_usec / 1000.0 +
+      ru.ru_stime.tv_sec * 1000.0 + ru.ru_stime.tv_usec / 1000.0 ;
+  }
+
+  /* the old way: each dialog owns an su_timer_t, with a heap-allocated weak_ptr to itself as the argument */
+  struct SuTimerDialog : public std::enable_shared_from_this<SuTimerDialog> {
+    SuTimerDialog(su_root_t* root) : m_root(root), m_timer(NULL), m_ppSelf(NULL) {}
+    ~SuTimerDialog() {
+      if( m_timer ) su_timer_destroy( m_timer ) ;
+      delete m_ppSelf ;
+    }
+    void arm( uint32_t msecs ) {
+      if( m_timer ) su_timer_destroy( m_timer ) ;
+      delete m_ppSelf ;
+      m_timer = su_timer_create( su_root_task( m_root ), msecs ) ;
+      m_ppSelf = new std::weak_ptr<SuTimerDialog>( shared_from_this() ) ;
+      su_timer_set( m_timer, fired, (su_timer_arg_t *) m_ppSelf ) ;
+    }
+    static void fired( su_root_magic_t* magic, su_timer_t* timer, su_timer_arg_t* arg ) {
+      std::shared_ptr<SuTimerDialog> dlg = reinterpret_cast< std::weak_ptr<SuTimerDialog> *>( arg )->lock() ;
+      refreshes++ ;
+      wakeups++ ;
+      if( dlg ) dlg->arm( refreshMsecs() ) ;
+    }
+
+    su_root_t*  m_root ;
+    su_timer_t* m_timer ;
+    std::weak_ptr<SuTimerDialog>* m_ppSelf ;
+  } ;
+
+  /* the new way: one wheel with a one second tick for every dialog's session timer */
+  struct WheelDialog : public std::enable_shared_from_this<WheelDialog> {
+    WheelDialog(TimerWheel* wheel) : m_wheel(wheel), m_timer(NULL) {}
+    ~WheelDialog() {
+      if( m_timer ) m_wheel->remove( m_timer ) ;
+    }
+    void arm( uint32_t msecs ) {
+      if( m_timer ) m_wheel->remove( m_timer ) ;
+      std::weak_ptr<WheelDialog> self = shared_from_this() ;
+      m_timer = m_wheel->add( [self](void*) {
+        std::shared_ptr<WheelDialog> dlg = self.lock() ;
+        refreshes++ ;
+        if( dlg ) {
+          dlg->m_timer = NULL ;
+          dlg->arm( refreshMsecs() ) ;
+        }
+      }, NULL, msecs ) ;
+    }
+
+    TimerWheel*       m_wheel ;
+    TimerEventHandle  m_timer ;
+  } ;
+
+  // counts the passes in which the wheel fires anything: each one is a single su_root wakeup
+  class CountingWheel : public TimerWheel {
+  public:
+    using TimerWheel::TimerWheel ;
+    virtual void doTimer(su_timer_t* timer) {
+      wakeups++ ;
+      TimerWheel::doTimer( timer ) ;
+    }
+  } ;
+
+  void stopRoot( su_root_magic_t* magic, su_timer_t* timer, su_timer_arg_t* arg ) {
+    su_root_break( reinterpret_cast<su_root_t *>( arg ) ) ;
+  }
+
+  template<typename Dialog, typename Arg>
+  Result_t run( su_root_t* root, const char* name, Arg arg, size_t count, unsigned int seconds ) {
+    Result_t r ;
+    r.impl = name ;
+    r.dialogs = count ;
+
+    vector< std::shared_ptr<Dialog> > dialogs ;
+    dialogs.reserve( count ) ;
+    Clock::time_point start = Clock::now() ;
+    for( size_t i = 0; i < count; i++ ) {
+      dialogs.push_back( std::make_shared<Dialog>( arg ) ) ;
+      dialogs.back()->arm( 1 + rng() % refreshMsecs() ) ;
+    }
+    r.armMs = std::chrono::duration<double, std::milli>( Clock::now() - start ).count() ;
+
+    refreshes = wakeups = 0 ;
+    su_timer_t* stop = su_timer_create( su_root_task( root ), seconds * 1000 ) ;
+    su_timer_set( stop, stopRoot, (su_timer_arg_t *) root ) ;
+    double cpuStart = cpuMsecs() ;
+    su_root_run( root ) ;
+    r.cpuMs = cpuMsecs() - cpuStart ;
+    r.refreshes = refreshes ;
+    r.wakeups = wakeups ;
+    su_timer_destroy( stop ) ;
+
+    dialogs.clear() ;
+    return r ;
+  }
+
+  vector<string> splitList( const char* sz ) {
+    vector<string> v ;
+    string s( sz ) ;
+    size_t pos = 0 ;
+    while( pos <= s.length() ) {
+      size_t comma = s.find( ',', pos ) ;
+      if( string::npos == comma ) comma = s.length() ;
+      if( comma > pos ) v.push_back( s.substr( pos, comma - pos ) ) ;
+      pos = comma + 1 ;
+    }
+    return v ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_session_timers [--impl su-timer,wheel] [--dialogs 200000] [--session-expires 90] " <<
+      "[--seconds 60]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> implNames = splitList( "su-timer,wheel" ) ;
+  size_t count = 200000 ;
+  unsigned int seconds = 60 ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--impl" ) ) implNames = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--dialogs" ) ) count = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--session-expires" ) ) sessionExpires = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--seconds" ) ) seconds = strtoul( argv[++i], NULL, 10 ) ;
+    else usage() ;
+  }
+  if( 0 == count || 0 == seconds || sessionExpires < 12 ) usage() ;
+
+  su_init() ;
+  su_root_t* root = su_root_create( NULL ) ;
+
+  vector<Result_t> results ;
+  for( const string& name : implNames ) {
+    std::cerr << "running " << name << " with " << count << " dialogs for " << seconds << "s.." << std::endl ;
+    if( "su-timer" == name ) {
+      results.push_back( run<SuTimerDialog>( root, "su-timer", root, count, seconds ) ) ;
+    }
+    else if( "wheel" == name ) {
+      CountingWheel wheel( root, "session", 1000 ) ;
+      results.push_back( run<WheelDialog>( root, "wheel", (TimerWheel *) &wheel, count, seconds ) ) ;
+    }
+    else {
+      std::cerr << "unknown implementation: " << name << std::endl ;
+      usage() ;
+    }
+  }
+
+  printf( "{\n  \"benchmark\": \"session-timers\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"session_expires\": %lu,\n  \"seconds\": %u,\n  \"results\": [\n", sessionExpires, seconds ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"impl\": \"%s\", \"dialogs\": %zu, \"arm_ms\": %.1f, \"cpu_ms\": %.1f, \"refreshes\": %llu, "
+      "\"wakeups\": %llu, \"cpu_us_per_refresh\": %.2f}%s\n",
+      r.impl.c_str(), r.dialogs, r.armMs, r.cpuMs, (unsigned long long) r.refreshes, (unsigned long long) r.wakeups,
+      r.refreshes ? r.cpuMs * 1000.0 / r.refreshes : 0.0, i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+
+  su_root_destroy( root ) ;
+  su_deinit() ;
+  return 0 ;
+}
@@ -0,0 +1,267 @@
+/*
+  Client to stack thread handoff benchmark.
+
+  Hands the requests and responses of a stream of calls from a client thread to the stack thread the way
+  SipDialogController does: a zeroed block is allocated for the message (su_msg_create uses su_zalloc),
+  the message is placed into it, and the stack thread reads its fields back and destroys it.  Compares the
+  fixed-size layout we used to have with the packed one in packed-message.hpp, and reports the bytes each
+  message costs and how long the handoff takes.  Results are written to stdout as JSON:
+
+    make bench_sip_message_data && ./bench_sip_message_data > message-data.json
+
+  usage: bench_sip_message_data [--impl fixed,packed] [--calls 100000] [--sdp-size 600] [--large-body 16384]
+
+  Every hundredth call also sends an INFO carrying a --large-body sized body (e.g. siprec metadata), to show
+  what the fixed layout truncates.  The timing covers allocation, construction, reading the fields back and
+  release on a single thread; the wakeup of the stack thread is the same for both layouts and is left out.
+
+  Implementations:
+    fixed   fixed char arrays for every field, about 22 KB per message regardless of its size
+    packed  SipMessageData: the fields packed after the object, sized to the message
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+
+#include "packed-message.hpp"
+
+using std::string ;
+using std::vector ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  // the layout SipMessageData had before the fields were packed
+  const int MSG_ID_LEN = 128 ;
+  const int MAX_DIALOG_ID_LEN = 1024 ;
+  const int START_LEN = 512 ;
+  const int HDR_LEN = 8400 ;
+  const int BODY_LEN = 12288 ;
+
+  class FixedMessageData {
+  public:
+    FixedMessageData() : m_tQueued(Clock::now()) {
+      memset(m_szClientMsgId, 0, sizeof(m_szClientMsgId) ) ;
+      memset(m_szTransactionId, 0, sizeof(m_szTransactionId) ) ;
+      memset(m_szRequestId, 0, sizeof(m_szRequestId) ) ;
+      memset(m_szDialogId, 0, sizeof(m_szDialogId) ) ;
+      memset(m_szStartLine, 0, sizeof(m_szStartLine) ) ;
+      memset(m_szHeaders, 0, sizeof(m_szHeaders) ) ;
+      memset(m_szBody, 0, sizeof(m_szBody) ) ;
+      memset(m_szRouteUrl, 0, sizeof(m_szRouteUrl) ) ;
+    }
+    FixedMessageData(const string& clientMsgId, const string& transactionId, const string& requestId, const string& dialogId,
+      std::string_view startLine, std::string_view headers, std::string_view body ) : FixedMessageData() {
+      memcpy( m_szClientMsgId, clientMsgId.c_str(), std::min(MSG_ID_LEN, (int) clientMsgId.length()) ) ;
+      if( !transactionId.empty() ) memcpy( m_szTransactionId, transactionId.c_str(), std::min(MSG_ID_LEN, (int) transactionId.length())) ;
+      if( !requestId.empty() ) memcpy( m_szRequestId, requestId.c_str(), std::min(MSG_ID_LEN, (int) requestId.length()));
+      if( !dialogId.empty() )  memcpy( m_szDialogId, dialogId.c_str(), std::min(MAX_DIALOG_ID_LEN, (int) dialogId.length()));
+      memcpy( m_szStartLine, startLine.data(), std::min(START_LEN, (int) startLine.length()));
+      memcpy( m_szHeaders, headers.data(), std::min(HDR_LEN, (int) headers.length())) ;
+      memcpy( m_szBody, body.data(), std::min(BODY_LEN, (int) body.length()));
+    }
+    const char* getClientMsgId() { return m_szClientMsgId; }
+    const char* getTransactionId() { return m_szTransactionId; }
+    const char* getDialogId() { return m_szDialogId; }
+    const char* getHeaders() { return m_szHeaders; }
+    const char* getStartLine() { return m_szStartLine; }
+    std::string_view getBodyView() { return m_szBody; }
+
+  private:
+    char	m_szClientMsgId[MSG_ID_LEN+1];
+    char	m_szTransactionId[MSG_ID_LEN+1];
+    char	m_szRequestId[MSG_ID_LEN+1];
+    char	m_szDialogId[MAX_DIALOG_ID_LEN+1];
+    char	m_szStartLine[START_LEN+1];
+    char	m_szHeaders[HDR_LEN+1];
+    char	m_szBody[BODY_LEN+1];
+    char	m_szRouteUrl[START_LEN+1];
+    Clock::time_point	m_tQueued;
+  } ;
+
+  struct Message_t {
+    string clientMsgId ;
+    string transactionId ;
+    string dialogId ;
+    string startLine ;
+    string headers ;
+    string body ;
+  } ;
+
+  string makeSdp( size_t n, size_t size ) {
+    string sdp = "v=0\r\no=- " + std::to_string( 1000000 + n ) + " 1 IN IP4 10.0.1.10\r\ns=-\r\nc=IN IP4 10.0.1.10\r\nt=0 0\r\n"
+      "m=audio " + std::to_string( 20000 + 2 * (n % 10000) ) + " RTP/AVP 0 8 101\r\n"
+      "a=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\na=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\n" ;
+    while( sdp.length() < size ) sdp += "a=candidate:" + std::to_string( n * 7 + sdp.length() ) + " 1 udp 2130706431 10.0.1.10 " + std::to_string( 30000 + sdp.length() ) + " typ host\r\n" ;
+    return sdp ;
+  }
+
+  // what an application sends for a call it answers and later hangs up: 180, 200 with sdp, and a BYE
+  void makeCall( size_t n, size_t sdpSize, size_t largeBody, vector<Message_t>& msgs ) {
+    string id = std::to_string( 100000000000 + n ) ;
+    string txn = "6b2c1a9e-41f0-4c8e-9d2b-" + id ;
+    string dialog = id + "-bench@10.0.1.10;from-tag=" + id ;
+    string hdrs = "X-Application: bench\r\nContact: <sip:10.0.1.20:5060>" ;
+    string sdp = makeSdp( n, sdpSize ) ;
+
+    msgs.push_back( { "a" + id, txn, "", "SIP/2.0 180 Ringing", hdrs, "" } ) ;
+    msgs.push_back( { "b" + id, txn, "", "SIP/2.0 200 OK", hdrs + "\r\nContent-Type: application/sdp", sdp } ) ;
+    if( largeBody && 0 == n % 100 ) {
+      string body( largeBody, 'x' ) ;
+      msgs.push_back( { "c" + id, "", dialog, "INFO sip:10.0.1.10:5060 SIP/2.0", "Content-Type: application/rs-metadata+xml", body } ) ;
+    }
+    msgs.push_back( { "d" + id, "", dialog, "BYE sip:10.0.1.10:5060 SIP/2.0", "X-Reason: normal", "" } ) ;
+  }
+
+  // the fields as the stack thread reads them back
+  size_t consume( FixedMessageData* d, const Message_t& m ) {
+    string transactionId( d->getTransactionId() ) ;
+    string dialogId( d->getDialogId() ) ;
+    string startLine( d->getStartLine() ) ;
+    string headers( d->getHeaders() ) ;
+    string body( d->getBodyView() ) ;
+    string clientMsgId( d->getClientMsgId() ) ;
+    return body.length() == m.body.length() && headers.length() == m.headers.length() ? 0 : 1 ;
+  }
+  size_t consume( SipMessageData* d, const Message_t& m ) {
+    string transactionId( d->getTransactionId() ) ;
+    string dialogId( d->getDialogId() ) ;
+    string startLine( d->getStartLine() ) ;
+    string headers( d->getHeaders() ) ;
+    string body( d->getBodyView() ) ;
+    string clientMsgId( d->getClientMsgId() ) ;
+    return body == m.body && headers == m.headers ? 0 : 1 ;
+  }
+
+  struct Fixed {
+    static size_t size( const Message_t& ) { return sizeof(FixedMessageData) ; }
+    static FixedMessageData* create( void* place, const Message_t& m ) {
+      return new(place) FixedMessageData( m.clientMsgId, m.transactionId, "", m.dialogId, m.startLine, m.headers, m.body ) ;
+    }
+    static void destroy( FixedMessageData* d ) { d->~FixedMessageData() ; }
+  } ;
+
+  struct Packed {
+    static size_t size( const Message_t& m ) {
+      return SipMessageData::size( m.clientMsgId, m.transactionId, "", m.dialogId, m.startLine, m.headers, m.body ) ;
+    }
+    static SipMessageData* create( void* place, const Message_t& m ) {
+      return new(place) SipMessageData( m.clientMsgId, m.transactionId, "", m.dialogId, m.startLine, m.headers, m.body ) ;
+    }
+    static void destroy( SipMessageData* d ) { d->~SipMessageData() ; }
+  } ;
+
+  struct Result_t {
+    string    impl ;
+    size_t    messages ;
+    size_t    messageBytes ;    // what the application actually sent
+    size_t    blockBytes ;      // what was allocated, zeroed and handed over
+    size_t    truncated ;
+    double    secs ;
+    double    p50 ;
+    double    p99 ;
+  } ;
+
+  template<typename Impl>
+  Result_t run( const char* name, const vector<Message_t>& msgs ) {
+    Result_t r ;
+    r.impl = name ;
+    r.messages = msgs.size() ;
+    r.messageBytes = r.blockBytes = r.truncated = 0 ;
+
+    vector<double> usecs ;
+    usecs.reserve( msgs.size() ) ;
+    Clock::time_point start = Clock::now() ;
+    for( const Message_t& m : msgs ) {
+      Clock::time_point t0 = Clock::now() ;
+      size_t size = Impl::size( m ) ;
+      void* place = calloc( 1, size ) ;
+      if( !place ) {
+        std::cerr << name << ": out of memory" << std::endl ;
+        exit(1) ;
+      }
+      auto d = Impl::create( place, m ) ;
+      r.truncated += consume( d, m ) ;
+      Impl::destroy( d ) ;
+      free( place ) ;
+      usecs.push_back( std::chrono::duration<double, std::micro>( Clock::now() - t0 ).count() ) ;
+
+      r.blockBytes += size ;
+      r.messageBytes += m.clientMsgId.length() + m.transactionId.length() + m.dialogId.length() + m.startLine.length() +
+        m.headers.length() + m.body.length() ;
+    }
+    r.secs = std::chrono::duration<double>( Clock::now() - start ).count() ;
+    std::sort( usecs.begin(), usecs.end() ) ;
+    r.p50 = usecs[ usecs.size() / 2 ] ;
+    r.p99 = usecs[ std::min( usecs.size() - 1, usecs.size() * 99 / 100 ) ] ;
+    return r ;
+  }
+
+  vector<string> splitList( const char* sz ) {
+    vector<string> v ;
+    boost::split( v, sz, boost::is_any_of(",") ) ;
+    return v ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_sip_message_data [--impl fixed,packed] [--calls 100000] [--sdp-size 600] [--large-body 16384]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> impls = splitList( "fixed,packed" ) ;
+  size_t calls = 100000 ;
+  size_t sdpSize = 600 ;
+  size_t largeBody = 16384 ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--impl" ) ) impls = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--calls" ) ) calls = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--sdp-size" ) ) sdpSize = strtoul( argv[++i], NULL, 10 ) ;
+    else if( 0 == strcmp( argv[i], "--large-body" ) ) largeBody = strtoul( argv[++i], NULL, 10 ) ;
+    else usage() ;
+  }
+  if( 0 == calls ) usage() ;
+
+  vector<Message_t> msgs ;
+  for( size_t n = 0; n < calls; n++ ) makeCall( n, sdpSize, largeBody, msgs ) ;
+
+  vector<Result_t> results ;
+  for( const string& impl : impls ) {
+    std::cerr << "running " << impl << " over " << msgs.size() << " messages.." << std::endl ;
+    if( "fixed" == impl ) results.push_back( run<Fixed>( "fixed", msgs ) ) ;
+    else if( "packed" == impl ) results.push_back( run<Packed>( "packed", msgs ) ) ;
+    else {
+      std::cerr << "unknown implementation: " << impl << std::endl ;
+      usage() ;
+    }
+  }
+
+  printf( "{\n  \"benchmark\": \"sip_message_data\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"sdp_size\": %zu,\n  \"large_body\": %zu,\n  \"results\": [\n", sdpSize, largeBody ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"impl\": \"%s\", \"messages\": %zu, \"avg_message_bytes\": %.0f, \"avg_block_bytes\": %.0f, \"truncated\": %zu, "
+      "\"msgs_per_sec\": %.0f, \"p50_usecs\": %.3f, \"p99_usecs\": %.3f}%s\n",
+      r.impl.c_str(), r.messages, (double) r.messageBytes / r.messages, (double) r.blockBytes / r.messages, r.truncated,
+      r.messages / r.secs, r.p50, r.p99, i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+  return 0 ;
+}
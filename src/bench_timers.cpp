@@ -0,0 +1,277 @@
+/*
+  Timer subsystem microbenchmark.
+
+  Drives each TimerQueue implementation with SIP-shaped workloads at several live-set sizes
+  and writes the results to stdout as JSON, so that runs can be diffed between releases:
+
+    make bench_timers && ./bench_timers > timers.json
+
+  usage: bench_timers [--impl list,locking,wheel] [--pattern timer-d,retransmit,random-cancel]
+                      [--sizes 1000,10000,100000,1000000]
+
+  For each (implementation, pattern, live entries) the live set is built first, then we time:
+    add_ns           adding entries to the live set, following the pattern
+    remove_ns        removing those same entries again, in random order
+    fire_ns          expiring and running the callbacks of a live set of the same size
+    bytes_per_timer  heap growth caused by building the live set, divided by its size
+
+  Patterns:
+    timer-d        every entry expires 32s after it is armed, so expiries increase monotonically
+    retransmit     Timer A/E style doubling intervals: 500ms, 1s, 2s, 4s
+    random-cancel  expiries spread uniformly over 64s, every entry cancelled in random order
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <malloc.h>
+#endif
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <functional>
+#include <iostream>
+
+#include "sofia-sip/su.h"
+#include "sofia-sip/su_wait.h"
+#include "sofia-sip/nta.h"
+
+#include "timer-queue.hpp"
+
+using std::string ;
+using std::vector ;
+using namespace drachtio ;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock ;
+
+  struct Impl_t {
+    const char* name ;
+    std::function<TimerQueue* (su_root_t*)> create ;
+  } ;
+
+  // add new TimerQueue implementations here
+  const Impl_t impls[] = {
+    { "list",    [](su_root_t* root) -> TimerQueue* { return new TimerQueue(root, "bench") ; } },
+    { "locking", [](su_root_t* root) -> TimerQueue* { return new LockingTimerQueue(root, "bench") ; } },
+    { "wheel",   [](su_root_t* root) -> TimerQueue* { return new TimerWheel(root, "bench") ; } }
+  } ;
+
+  const char* patterns[] = { "timer-d", "retransmit", "random-cancel" } ;
+
+  struct Arm_t {
+    su_time_t   now ;     // time the entry is armed at
+    uint32_t    msecs ;   // duration it is armed for
+  } ;
+
+  struct Result_t {
+    string      impl ;
+    string      pattern ;
+    size_t      live ;
+    size_t      ops ;
+    double      addNs ;
+    double      removeNs ;
+    double      fireNs ;
+    double      bytesPerTimer ;
+  } ;
+
+  unsigned long fired = 0 ;
+  void onTimer(void* arg) { fired++ ; }
+
+  su_time_t addUsecs( su_time_t t, uint64_t usecs ) {
+    uint64_t us = t.tv_usec + usecs ;
+    t.tv_sec += us / 1000000 ;
+    t.tv_usec = us % 1000000 ;
+    return t ;
+  }
+
+  int64_t expiryUsecs( const Arm_t& a ) {
+    return (int64_t) a.now.tv_sec * 1000000 + a.now.tv_usec + (int64_t) a.msecs * 1000 ;
+  }
+
+  /**
+   * generate count arm operations for a pattern, starting from entry number first; entries are armed
+   * one microsecond apart, as they would be under a steady stream of transactions
+   */
+  vector<Arm_t> generate( const string& pattern, su_time_t base, size_t first, size_t count, std::mt19937& rng ) {
+    static const uint32_t retransmit[] = { NTA_SIP_T1, 2 * NTA_SIP_T1, 4 * NTA_SIP_T1, 8 * NTA_SIP_T1 } ;
+    std::uniform_int_distribution<uint32_t> spread(1, 64000) ;
+    vector<Arm_t> v(count) ;
+    for( size_t i = 0; i < count; i++ ) {
+      v[i].now = addUsecs( base, first + i ) ;
+      if( "timer-d" == pattern ) v[i].msecs = 32000 ;
+      else if( "retransmit" == pattern ) v[i].msecs = retransmit[ (first + i) % 4 ] ;
+      else v[i].msecs = spread( rng ) ;
+    }
+    return v ;
+  }
+
+  size_t heapInUse(void) {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 mi = mallinfo2() ;
+    return mi.uordblks + mi.hblkhd ;
+#elif defined(__GLIBC__)
+    struct mallinfo mi = mallinfo() ;
+    return (size_t) mi.uordblks + (size_t) mi.hblkhd ;
+#else
+    return 0 ;
+#endif
+  }
+
+  // the live set is built in expiry order so that building it does not dominate the run time
+  void fill( TimerQueue* queue, vector<Arm_t> arms, vector<TimerEventHandle>& handles ) {
+    std::sort( arms.begin(), arms.end(), [](const Arm_t& a, const Arm_t& b) { return expiryUsecs(a) < expiryUsecs(b) ; } ) ;
+    for( const Arm_t& a : arms ) handles.push_back( queue->add( onTimer, NULL, a.msecs, a.now ) ) ;
+  }
+
+  double nsPerOp( Clock::time_point start, Clock::time_point end, size_t ops ) {
+    return ops ? std::chrono::duration<double, std::nano>( end - start ).count() / ops : 0.0 ;
+  }
+
+  Result_t run( su_root_t* root, const Impl_t& impl, const string& pattern, size_t live ) {
+    std::mt19937 rng(42) ;
+    Result_t r ;
+    r.impl = impl.name ;
+    r.pattern = pattern ;
+    r.live = live ;
+
+    // keep total work roughly constant: inserting into the list is O(n)
+    r.ops = std::max( (size_t) 100, std::min( (size_t) 10000, (size_t) 100000000 / live ) ) ;
+
+    su_time_t base = su_now() ;
+    vector<Arm_t> arms = generate( pattern, base, 0, live, rng ) ;
+    vector<TimerEventHandle> handles ;
+
+    // add + remove at steady state
+    {
+      TimerQueue* queue = impl.create( root ) ;
+      handles.reserve( live ) ;
+      size_t heapBefore = heapInUse() ;
+      fill( queue, arms, handles ) ;
+      size_t heapAfter = heapInUse() ;
+      r.bytesPerTimer = heapAfter > heapBefore ? (double) (heapAfter - heapBefore) / live : 0.0 ;
+      if( 0.0 == r.bytesPerTimer ) {
+        // no allocator statistics on this platform; fall back to what the entry pool has reserved
+        r.bytesPerTimer = (double) queue->getEntryPool().capacity() * sizeof(queueEntry_t) / live ;
+      }
+
+      vector<Arm_t> more = generate( pattern, base, live, r.ops, rng ) ;
+      vector<TimerEventHandle> added(r.ops) ;
+      Clock::time_point start = Clock::now() ;
+      for( size_t i = 0; i < r.ops; i++ ) added[i] = queue->add( onTimer, NULL, more[i].msecs, more[i].now ) ;
+      Clock::time_point end = Clock::now() ;
+      r.addNs = nsPerOp( start, end, r.ops ) ;
+
+      std::shuffle( added.begin(), added.end(), rng ) ;
+      start = Clock::now() ;
+      for( TimerEventHandle h : added ) queue->remove( h ) ;
+      end = Clock::now() ;
+      r.removeNs = nsPerOp( start, end, r.ops ) ;
+
+      // the random-cancel pattern also tears the whole live set down by cancelling
+      if( "random-cancel" == pattern ) std::shuffle( handles.begin(), handles.end(), rng ) ;
+      for( TimerEventHandle h : handles ) queue->remove( h ) ;
+      delete queue ;
+    }
+
+    // fire: arm the live set an hour in the past, so that one pass of the timer expires all of it
+    {
+      TimerQueue* queue = impl.create( root ) ;
+      su_time_t past = base ;
+      past.tv_sec -= 3600 ;
+      vector<Arm_t> expired = generate( pattern, past, 0, live, rng ) ;
+      handles.clear() ;
+      fill( queue, expired, handles ) ;
+
+      fired = 0 ;
+      Clock::time_point start = Clock::now() ;
+      while( !queue->isEmpty() ) queue->doTimer( NULL ) ;
+      Clock::time_point end = Clock::now() ;
+      r.fireNs = nsPerOp( start, end, fired ) ;
+      delete queue ;
+    }
+
+    return r ;
+  }
+
+  vector<string> splitList( const char* sz ) {
+    vector<string> v ;
+    string s( sz ) ;
+    size_t pos = 0 ;
+    while( pos <= s.length() ) {
+      size_t comma = s.find( ',', pos ) ;
+      if( string::npos == comma ) comma = s.length() ;
+      if( comma > pos ) v.push_back( s.substr( pos, comma - pos ) ) ;
+      pos = comma + 1 ;
+    }
+    return v ;
+  }
+
+  void usage() {
+    std::cerr << "usage: bench_timers [--impl list,locking,wheel] [--pattern timer-d,retransmit,random-cancel] " <<
+      "[--sizes 1000,10000,100000,1000000]" << std::endl ;
+    exit(1) ;
+  }
+}
+
+int main( int argc, char** argv ) {
+  vector<string> implNames, patternNames, sizeNames ;
+  for( const Impl_t& i : impls ) implNames.push_back( i.name ) ;
+  for( const char* p : patterns ) patternNames.push_back( p ) ;
+  sizeNames = splitList( "1000,10000,100000,1000000" ) ;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( i + 1 >= argc ) usage() ;
+    if( 0 == strcmp( argv[i], "--impl" ) ) implNames = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--pattern" ) ) patternNames = splitList( argv[++i] ) ;
+    else if( 0 == strcmp( argv[i], "--sizes" ) ) sizeNames = splitList( argv[++i] ) ;
+    else usage() ;
+  }
+
+  su_init() ;
+  su_root_t* root = su_root_create( NULL ) ;
+
+  vector<Result_t> results ;
+  for( const string& name : implNames ) {
+    const Impl_t* impl = NULL ;
+    for( const Impl_t& i : impls ) if( name == i.name ) impl = &i ;
+    if( !impl ) {
+      std::cerr << "unknown implementation: " << name << std::endl ;
+      usage() ;
+    }
+    for( const string& pattern : patternNames ) {
+      if( std::find( std::begin(patterns), std::end(patterns), pattern ) == std::end(patterns) ) {
+        std::cerr << "unknown pattern: " << pattern << std::endl ;
+        usage() ;
+      }
+      for( const string& size : sizeNames ) {
+        size_t live = strtoul( size.c_str(), NULL, 10 ) ;
+        if( 0 == live ) usage() ;
+        std::cerr << "running " << name << " / " << pattern << " / " << live << " live entries.." << std::endl ;
+        results.push_back( run( root, *impl, pattern, live ) ) ;
+      }
+    }
+  }
+
+  printf( "{\n  \"benchmark\": \"timers\",\n" ) ;
+#ifdef DRACHTIO_VERSION
+  printf( "  \"version\": \"%s\",\n", DRACHTIO_VERSION ) ;
+#endif
+  printf( "  \"entry_size\": %zu,\n  \"results\": [\n", sizeof(queueEntry_t) ) ;
+  for( size_t i = 0; i < results.size(); i++ ) {
+    const Result_t& r = results[i] ;
+    printf( "    {\"impl\": \"%s\", \"pattern\": \"%s\", \"live\": %zu, \"ops\": %zu, "
+      "\"add_ns\": %.1f, \"remove_ns\": %.1f, \"fire_ns\": %.1f, \"bytes_per_timer\": %.1f}%s\n",
+      r.impl.c_str(), r.pattern.c_str(), r.live, r.ops, r.addNs, r.removeNs, r.fireNs, r.bytesPerTimer,
+      i + 1 < results.size() ? "," : "" ) ;
+  }
+  printf( "  ]\n}\n" ) ;
+
+  su_root_destroy( root ) ;
+  su_deinit() ;
+  return 0 ;
+}
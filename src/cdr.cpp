@@ -18,7 +18,7 @@ namespace drachtio {
         pCdr->encodeMessage( encodedMessage ) ;
         pCdr->encodeMetaData( meta ) ;
 
-        pClientController->getIOService().post( std:: bind(&BaseClient::sendCdrToClient, client, encodedMessage, meta ) ) ;
+        pClientController->postToClient( client, std::bind(&BaseClient::sendCdrToClient, client, encodedMessage, meta ), encodedMessage.length() ) ;
       }
     }
     return pCdr ;
@@ -0,0 +1,131 @@
+#include <cstring>
+#include <algorithm>
+
+#include "client-compression.hpp"
+
+namespace {
+  // the empty stored block that ends every sync flush
+  const unsigned char FLUSH_TRAILER[] = { 0x00, 0x00, 0xff, 0xff } ;
+
+  // window bits for raw deflate, with no zlib header or checksum
+  const int RAW_WINDOW_BITS = -15 ;
+}
+
+namespace drachtio {
+
+  const char* const FrameCompressor::NAME = "deflate" ;
+
+  // deflate finds matches most cheaply near the end of the dictionary, so the commonest text goes last
+  const std::string_view FrameCompressor::DICTIONARY = 
+    "a=rtcp-mux\r\na=rtcp-fb:* nack\r\na=fmtp:101 0-16\r\na=rtpmap:101 telephone-event/8000\r\n"
+    "a=rtpmap:18 G729/8000\r\na=rtpmap:8 PCMA/8000\r\na=rtpmap:0 PCMU/8000\r\na=ptime:20\r\n"
+    "a=sendrecv\r\na=sendonly\r\na=recvonly\r\na=inactive\r\nm=audio RTP/AVP 0 8 101\r\n"
+    "c=IN IP4 \r\nt=0 0\r\ns=-\r\no=- IN IP4 \r\nv=0\r\n"
+    "multipart/mixed;boundary=application/dtmf-relay\r\napplication/sdp\r\n"
+    "Proxy-Authenticate: Digest realm=\"\", nonce=\"\", algorithm=MD5, qop=\"auth\"\r\n"
+    "WWW-Authenticate: Digest realm=\"\", nonce=\"\", algorithm=MD5, qop=\"auth\"\r\n"
+    "Proxy-Authorization: Digest username=\"\", uri=\"sip:\", response=\"\"\r\nAuthorization: Digest \r\n"
+    "Subscription-State: active;expires=\r\nEvent: presence\r\nRefer-To: \r\nReferred-By: \r\n"
+    "P-Asserted-Identity: \r\nRemote-Party-ID: \r\nDiversion: \r\nPrivacy: none\r\nReason: Q.850;cause=16\r\n"
+    "Session-Expires: 1800;refresher=uac\r\nMin-SE: 90\r\nExpires: 3600\r\nRequire: timer\r\n"
+    "Supported: timer, path, replaces, 100rel\r\n"
+    "Allow: INVITE, ACK, CANCEL, BYE, OPTIONS, INFO, UPDATE, PRACK, REFER, NOTIFY, SUBSCRIBE, MESSAGE\r\n"
+    "Accept: application/sdp\r\nUser-Agent: \r\nServer: \r\nRecord-Route: <sip:;lr>\r\nRoute: <sip:;lr>\r\n"
+    "SIP/2.0 100 Trying\r\nSIP/2.0 180 Ringing\r\nSIP/2.0 183 Session Progress\r\nSIP/2.0 200 OK\r\n"
+    "SIP/2.0 401 Unauthorized\r\nSIP/2.0 407 Proxy Authentication Required\r\nSIP/2.0 487 Request Terminated\r\n"
+    "REGISTER sip:OPTIONS sip:BYE sip:ACK sip:CANCEL sip:INVITE sip:"
+    "|cdr:attempt|cdr:start|cdr:stop|network|application|udp|tcp|tls|wss|response|OK|sip|"
+    "Max-Forwards: 70\r\nContent-Type: application/sdp\r\nContent-Length: 0\r\nContact: <sip:>\r\n"
+    "CSeq: 1 INVITE\r\nCall-ID: \r\nTo: <sip:>;tag=\r\nFrom: <sip:>;tag=\r\n"
+    "Via: SIP/2.0/UDP ;rport;branch=z9hG4bK\r\n SIP/2.0\r\n" ;
+
+  FrameCompressor::FrameCompressor() : m_bDeflateInit(false), m_bInflateInit(false) {
+    memset( &m_deflate, 0, sizeof(m_deflate) ) ;
+    memset( &m_inflate, 0, sizeof(m_inflate) ) ;
+  }
+
+  FrameCompressor::~FrameCompressor() {
+    if( m_bDeflateInit ) deflateEnd( &m_deflate ) ;
+    if( m_bInflateInit ) inflateEnd( &m_inflate ) ;
+  }
+
+  bool FrameCompressor::init(void) {
+    if( Z_OK != deflateInit2( &m_deflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED, RAW_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY ) ) return false ;
+    m_bDeflateInit = true ;
+    if( Z_OK != inflateInit2( &m_inflate, RAW_WINDOW_BITS ) ) return false ;
+    m_bInflateInit = true ;
+
+    const Bytef* dict = reinterpret_cast<const Bytef*>( DICTIONARY.data() ) ;
+    return Z_OK == deflateSetDictionary( &m_deflate, dict, DICTIONARY.size() ) &&
+      Z_OK == inflateSetDictionary( &m_inflate, dict, DICTIONARY.size() ) ;
+  }
+
+  bool FrameCompressor::offered( std::string_view offer ) {
+    while( !offer.empty() ) {
+      size_t comma = offer.find( ',' ) ;
+      if( offer.substr( 0, comma ) == NAME ) return true ;
+      if( std::string_view::npos == comma ) break ;
+      offer.remove_prefix( comma + 1 ) ;
+    }
+    return false ;
+  }
+
+  bool FrameCompressor::compress( std::string_view msg, std::string& out ) {
+    // an empty frame carries nothing, compressed or not
+    if( msg.empty() ) {
+      out.clear() ;
+      return true ;
+    }
+    m_deflate.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( msg.data() ) ) ;
+    m_deflate.avail_in = msg.size() ;
+
+    // sip compresses to well under half its size once the stream is going; grow in the rare case it does not
+    out.resize( msg.size() / 2 + 64 ) ;
+    size_t used = 0 ;
+    do {
+      if( used == out.size() ) out.resize( 2 * out.size() ) ;
+      m_deflate.next_out = reinterpret_cast<Bytef*>( &out[used] ) ;
+      m_deflate.avail_out = out.size() - used ;
+      int rc = deflate( &m_deflate, Z_SYNC_FLUSH ) ;
+      if( Z_OK != rc && Z_BUF_ERROR != rc ) return false ;
+      used = out.size() - m_deflate.avail_out ;
+    } while( 0 == m_deflate.avail_out ) ;
+
+    if( used < sizeof(FLUSH_TRAILER) || 0 != memcmp( &out[used - sizeof(FLUSH_TRAILER)], FLUSH_TRAILER, sizeof(FLUSH_TRAILER) ) ) return false ;
+    out.resize( used - sizeof(FLUSH_TRAILER) ) ;
+    return true ;
+  }
+
+  bool FrameCompressor::decompress( std::string_view frame, std::string& out, size_t maxSize ) {
+    out.resize( std::min( std::max( 4 * frame.size(), (size_t) 1024 ), maxSize + 1 ) ) ;
+    size_t used = 0 ;
+
+    // the frame, and then the trailer that the sender left off
+    const std::string_view input[] = { 
+      frame, std::string_view( reinterpret_cast<const char*>( FLUSH_TRAILER ), sizeof(FLUSH_TRAILER) ) 
+    } ;
+    for( const std::string_view& in : input ) {
+      m_inflate.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( in.data() ) ) ;
+      m_inflate.avail_in = in.size() ;
+      for(;;) {
+        if( used == out.size() ) {
+          // one byte past maxSize is enough to tell the message is too large
+          if( out.size() > maxSize ) return false ;
+          out.resize( std::min( 2 * out.size(), maxSize + 1 ) ) ;
+        }
+        m_inflate.next_out = reinterpret_cast<Bytef*>( &out[used] ) ;
+        m_inflate.avail_out = out.size() - used ;
+        int rc = inflate( &m_inflate, Z_SYNC_FLUSH ) ;
+        used = out.size() - m_inflate.avail_out ;
+
+        // the stream lasts as long as the connection, so a final block is as much an error as corrupt data
+        if( Z_OK != rc && Z_BUF_ERROR != rc ) return false ;
+        if( 0 == m_inflate.avail_in && 0 != m_inflate.avail_out ) break ;
+        if( Z_BUF_ERROR == rc && 0 != m_inflate.avail_out ) return false ;
+      }
+    }
+    if( used > maxSize ) return false ;
+    out.resize( used ) ;
+    return true ;
+  }
+}
@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __CLIENT_COMPRESSION_HPP__
+#define __CLIENT_COMPRESSION_HPP__
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+
+namespace drachtio {
+
+  /**
+   * Optional compression of the application protocol, which a client asks for when it authenticates.
+   *
+   * Each direction of a connection is a single raw deflate stream, primed with a dictionary of the
+   * text that sip messages and our meta lines have in common.  Every message is flushed to a byte
+   * boundary and carried whole as the payload of its own "<length>#<payload>" frame, so the framing
+   * is unchanged; the 4 byte empty block that ends each flush is left off and put back on receipt.
+   * Because the window carries over from one message to the next, even a short message compresses
+   * well against the ones that went before it.
+   *
+   * We compress what we send from the first message after our response to the authenticate request.
+   * A client may have sent more messages behind its authenticate before it saw that response, so what
+   * it sends is only compressed after it says so with a plain "<msgId>|compress|deflate" message.
+   */
+  class FrameCompressor {
+  public:
+    // the name a client asks for, and we confirm, at authenticate time
+    static const char* const NAME ;
+
+    // the dictionary both ends prime their streams with; it is part of the protocol and must never change
+    static const std::string_view DICTIONARY ;
+
+    FrameCompressor() ;
+    FrameCompressor( const FrameCompressor& ) = delete ;
+    ~FrameCompressor() ;
+
+    // false if zlib could not set up the streams
+    bool init(void) ;
+
+    // true if NAME is among the comma separated compressions a client offered
+    static bool offered( std::string_view offer ) ;
+
+    // the compressed frame payload for a message
+    bool compress( std::string_view msg, std::string& out ) ;
+
+    // the message carried in a compressed frame; false if the frame is corrupt or the message is larger than maxSize
+    bool decompress( std::string_view frame, std::string& out, size_t maxSize ) ;
+
+  private:
+    z_stream m_deflate ;
+    z_stream m_inflate ;
+    bool m_bDeflateInit ;
+    bool m_bInflateInit ;
+  } ;
+}
+
+#endif
@@ -24,6 +24,12 @@ THE SOFTWARE.
 #include <functional>
 #include <algorithm>
 
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 #include <boost/tokenizer.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/asio.hpp>
@@ -53,13 +59,15 @@ namespace drachtio {
     // both tcp and tls
     ClientController::ClientController( DrachtioController* pController, string& address, unsigned int tcpPort, unsigned int tlsPort, 
         const string& chainFile, const string& certFile, const string& keyFile, const string& dhFile ) :
-        m_pController( pController ),
+        m_pController( pController ), m_selection( client_selection_round_robin ), m_backlogPolicy( client_backlog_avoid ),
         m_endpoint_tcp(boost::asio::ip::make_address(address.c_str()), tcpPort),
         m_acceptor_tcp(m_ioservice, m_endpoint_tcp), 
         m_endpoint_tls(boost::asio::ip::make_address(address.c_str()), tlsPort),
         m_acceptor_tls(m_ioservice, m_endpoint_tls), 
+        m_acceptor_local(m_ioservice),
         m_context(boost::asio::ssl::context::sslv23),
-        m_tcpPort(tcpPort), m_tlsPort(tlsPort) {
+        m_tcpPort(tcpPort), m_tlsPort(tlsPort),
+        m_lagTimer(m_ioservice), m_backlogTimer(m_ioservice) {
 
         if (0 != tlsPort) {
             m_context.set_options(
@@ -90,24 +98,85 @@ namespace drachtio {
         DR_LOG(log_debug) << "ClientController::ClientController done setting tls options: ";
     }
 
-    void ClientController::start() {
+    void ClientController::start( unsigned int nThreads ) {
         DR_LOG(log_debug) << "Client controller thread id: " << std::this_thread::get_id()  ;
-        std::thread t(&ClientController::threadFunc, this) ;
-        m_thread.swap( t ) ;
+
+        /* each io thread gets its own monitor, so a handler blocking one of them is reported against it; only the first is probed */
+        nThreads = std::max( nThreads, 1U ) ;
+        for( unsigned int i = 0; i < nThreads; i++ ) {
+            m_loopNames.push_back( 0 == i ? string("client") : string("client-") + std::to_string(i) ) ;
+        }
+        for( unsigned int i = 0; i < nThreads; i++ ) {
+            m_loopMonitors.push_back( std::make_unique<LoopMonitor>( m_loopNames[i].c_str() ) ) ;
+        }
+        for( unsigned int i = 0; i < nThreads; i++ ) {
+            m_threads.push_back( std::thread(&ClientController::threadFunc, this, i) ) ;
+        }
+        DR_LOG(log_notice) << "ClientController::start - serving application connections with " << nThreads << " io threads" ;
             
         if (m_tcpPort) start_accept_tcp() ;
         if (m_tlsPort) start_accept_tls() ;
+        if (m_acceptor_local.is_open()) start_accept_local() ;
+
+        if (theOneAndOnlyController->getStatsCollector().enabled()) armBacklogReport() ;
+    }
+
+    bool ClientController::listenLocal( const string& path, unsigned int mode ) {
+        if (path.length() >= sizeof(((struct sockaddr_un *) 0)->sun_path)) {
+            DR_LOG(log_error) << "ClientController::listenLocal - socket path is too long: " << path ;
+            return false ;
+        }
+
+        // a socket left behind by an earlier run would fail the bind, so remove it unless someone is still listening on it
+        struct stat st ;
+        if (0 == ::lstat(path.c_str(), &st)) {
+            if (!S_ISSOCK(st.st_mode)) {
+                DR_LOG(log_error) << "ClientController::listenLocal - " << path << " exists and is not a socket" ;
+                return false ;
+            }
+            boost::system::error_code ec ;
+            local_socket_t probe(m_ioservice) ;
+            probe.connect(boost::asio::local::stream_protocol::endpoint(path), ec) ;
+            if (!ec) {
+                DR_LOG(log_error) << "ClientController::listenLocal - " << path << " is in use by another process" ;
+                return false ;
+            }
+            ::unlink(path.c_str()) ;
+        }
+
+        boost::system::error_code ec ;
+        boost::asio::local::stream_protocol::endpoint endpoint(path) ;
+        m_acceptor_local.open(endpoint.protocol(), ec) ;
+        if (!ec) m_acceptor_local.bind(endpoint, ec) ;
+        if (!ec) m_acceptor_local.listen(boost::asio::socket_base::max_listen_connections, ec) ;
+        if (ec) {
+            DR_LOG(log_error) << "ClientController::listenLocal - unable to listen on " << path << ": " << ec.message() ;
+            boost::system::error_code ignored ;
+            m_acceptor_local.close(ignored) ;
+            return false ;
+        }
+        m_localPath = path ;
+
+        if (0 != ::chmod(path.c_str(), mode)) {
+            DR_LOG(log_error) << "ClientController::listenLocal - unable to set mode " << std::oct << mode << std::dec << 
+                " on " << path << ": " << strerror(errno) ;
+        }
+        return true ;
     }
 
     ClientController::~ClientController() {
         stop() ;
     }
-    void ClientController::threadFunc() {
+    void ClientController::threadFunc( unsigned int idx ) {
         
         DR_LOG(log_debug) << "Client controller thread id: " << std::this_thread::get_id()  ;
          
         /* to make sure the event loop doesn't terminate when there is no work to do */
         boost::asio::io_context::work work(m_ioservice);
+
+        /* measure how late the event loop runs */
+        m_loopMonitors[idx]->bindToCurrentThread() ;
+        if( 0 == idx ) armLagProbe() ;
         
         for(;;) {
             
@@ -123,15 +192,76 @@ namespace drachtio {
         }
     }
     void ClientController::join( client_ptr client ) {
+        std::lock_guard<std::mutex> l( m_lock ) ;
         m_clients.insert( client ) ;
-        client_weak_ptr p( client ) ;
         DR_LOG(log_info) << "ClientController::join - Added client, count of connected clients is now: " << m_clients.size()  ;       
     }
     void ClientController::leave( client_ptr client ) {
-        m_clients.erase( client ) ;
-        time_t duration = client->getConnectionDuration();
-        DR_LOG(log_info) << "ClientController::leave - Removed client, connection duration " << std::dec << 
-            duration << " seconds, count of connected clients is now: " << m_clients.size()  ;
+        {
+            std::lock_guard<std::mutex> l( m_lock ) ;
+            if( m_clients.erase( client ) && theOneAndOnlyController->getStatsCollector().enabled() ) {
+                // under the lock, so that the backlog report can not put it back
+                theOneAndOnlyController->getStatsCollector().gaugeRemove(STATS_GAUGE_CLIENT_BACKLOG_BYTES, {{"client", backlogLabel( client )}}) ;
+            }
+            string appName ;
+            if( client->getAppName( appName ) ) {
+                pair<map_of_services::iterator,map_of_services::iterator> range = m_services.equal_range( appName ) ;
+                for( map_of_services::iterator it = range.first; it != range.second; ) {
+                    client_ptr other = it->second.lock() ;
+                    if( !other || other == client ) it = m_services.erase( it ) ;
+                    else ++it ;
+                }
+            }
+            time_t duration = client->getConnectionDuration();
+            DR_LOG(log_info) << "ClientController::leave - Removed client, connection duration " << std::dec << 
+                duration << " seconds, count of connected clients is now: " << m_clients.size()  ;
+        }
+
+        // release everything the client owned; m_mapDialogId2Appname is kept so its dialogs can fail over to another client for the app
+        BaseClient::owned_ids_t owned ;
+        if( !client->releaseOwned( owned ) ) return ;
+
+        mapId2Client* maps[BaseClient::owned_map_count] ;
+        maps[BaseClient::owned_dialog] = &m_mapDialogs ;
+        maps[BaseClient::owned_app_transaction] = &m_mapAppTransactions ;
+        maps[BaseClient::owned_net_transaction] = &m_mapNetTransactions ;
+        maps[BaseClient::owned_api_request] = &m_mapApiRequests ;
+        for( size_t i = 0; i < BaseClient::owned_map_count; i++ ) {
+            for( const string& id : owned[i] ) {
+                maps[i]->eraseIf( id, [&client](const client_weak_ptr& owner) { return owner.lock() == client; } ) ;
+            }
+        }
+        DR_LOG(log_info) << "ClientController::leave - released " << std::dec << owned[BaseClient::owned_dialog].size() << " dialogs, " << 
+            owned[BaseClient::owned_app_transaction].size() << " app transactions, " << 
+            owned[BaseClient::owned_net_transaction].size() << " net transactions and " << 
+            owned[BaseClient::owned_api_request].size() << " api requests" ;
+    }
+
+    void ClientController::track( mapId2Client& map, BaseClient::owned_map_t which, client_ptr client, const string& id ) {
+        if( !client->own( which, id ) ) return ;
+        if( !map.insert( id, client ) ) {
+            // the id is already taken; unless by this same client, it is not ours to release
+            client_weak_ptr owner ;
+            if( map.find( id, owner ) && owner.lock() != client ) client->disown( which, id ) ;
+            return ;
+        }
+
+        // the client may have left between own() and the insert, in which case it did not release this entry
+        if( client->hasLeft() ) {
+            map.eraseIf( id, [&client](const client_weak_ptr& owner) { return owner.lock() == client; } ) ;
+        }
+    }
+    bool ClientController::untrack( mapId2Client& map, BaseClient::owned_map_t which, const string& id ) {
+        client_weak_ptr owner ;
+        if( !map.erase( id, owner ) ) return false ;
+        client_ptr client = owner.lock() ;
+        if( client ) client->disown( which, id ) ;
+        return true ;
+    }
+    size_t ClientController::countOrphaned( const mapId2Client& map ) {
+        size_t count = 0 ;
+        map.forEach([&count](const string&, const client_weak_ptr& owner) { if( owner.expired() ) count++; });
+        return count ;
     }
     void ClientController::outboundFailed( const string& transactionId ) {
       string headers, body;
@@ -149,8 +279,8 @@ namespace drachtio {
     }
 
     void ClientController::addNamedService( client_ptr client, string& strAppName ) {
-        //TODO: should we be locking here?  need to review entire locking strategy for this class
         client_weak_ptr p( client ) ;
+        std::lock_guard<std::mutex> l( m_lock ) ;
         m_services.insert( map_of_services::value_type(strAppName,p)) ;       
     }
 
@@ -162,7 +292,7 @@ namespace drachtio {
     }
 	void ClientController::accept_handler_tcp( client_ptr session, const boost::system::error_code& ec) {
         DR_LOG(log_debug) << "ClientController::accept_handler_tcp - got connection" ;       
-        if(!ec) session->start() ;
+        if(!ec) boost::asio::dispatch( session->getStrand(), std::bind(&BaseClient::start, session) ) ;
         start_accept_tcp(); 
     }
 
@@ -174,20 +304,32 @@ namespace drachtio {
     }
 	void ClientController::accept_handler_tls( client_ptr session, const boost::system::error_code& ec) {
         DR_LOG(log_debug) << "ClientController::accept_handler_tls - got connection" ;       
-        if(!ec) session->start() ;
+        if(!ec) boost::asio::dispatch( session->getStrand(), std::bind(&BaseClient::start, session) ) ;
         start_accept_tls(); 
     }
 
+	void ClientController::start_accept_local() {
+        DR_LOG(log_debug) << "ClientController::start_accept_local"   ;
+        Client<local_socket_t>* p = new Client<local_socket_t>(m_ioservice, *this);
+		client_ptr new_session(p) ;
+		m_acceptor_local.async_accept( p->socket(), std::bind(&ClientController::accept_handler_local, shared_from_this(), new_session, std::placeholders::_1));
+    }
+	void ClientController::accept_handler_local( client_ptr session, const boost::system::error_code& ec) {
+        DR_LOG(log_debug) << "ClientController::accept_handler_local - got connection" ;       
+        if(!ec) boost::asio::dispatch( session->getStrand(), std::bind(&BaseClient::start, session) ) ;
+        start_accept_local(); 
+    }
+
     void ClientController::makeOutboundConnection( const string& transactionId, const string& host, const string& port, const string& transport ) {
         if (0 == transport.compare("tls")) {
             Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>* p =  new Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>( m_ioservice, m_context, *this, transactionId, host, port ) ;
             client_ptr new_session(p) ;
-            p->async_connect() ;
+            boost::asio::post( new_session->getStrand(), std::bind(&BaseClient::async_connect, new_session) ) ;
         }
         else {
             Client<socket_t>* p =  new Client<socket_t>( m_ioservice, *this, transactionId, host, port ) ;
             client_ptr new_session(p) ;
-            p->async_connect() ;
+            boost::asio::post( new_session->getStrand(), std::bind(&BaseClient::async_connect, new_session) ) ;
         }
     }
 
@@ -246,13 +388,14 @@ namespace drachtio {
     }
 
     client_ptr ClientController::selectClientForRequestOutsideDialog(const char* keyword, const char* tag) {
-        string method_name = keyword ;
-        transform(method_name.begin(), method_name.end(), method_name.begin(), ::tolower);
+        // lowercased into a buffer that is reused, rather than a new string for every request
+        thread_local string method_name ;
+        method_name.assign( keyword ) ;
+        for( char& c : method_name ) c = ::tolower( static_cast<unsigned char>( c ) ) ;
 
-        /* round robin select a client that has registered for this request type (and, optionally, tag)*/
+        /* select a client that has registered for this request type (and, optionally, tag) */
         std::lock_guard<std::mutex> l( m_lock ) ;
         client_ptr client ;
-        string matchId ;
         pair<map_of_request_types::iterator,map_of_request_types::iterator> pair = m_request_types.equal_range(method_name) ;
         unsigned int nPossibles = std::distance(pair.first, pair.second) ;
         if( 0 == nPossibles ) {
@@ -266,19 +409,18 @@ namespace drachtio {
         }
 
         unsigned int nOffset = 0 ;
-        map_of_request_type_offsets::const_iterator itOffset = m_map_of_request_type_offsets.find(method_name) ;
+        map_of_request_type_offsets::iterator itOffset = m_map_of_request_type_offsets.find(method_name) ;
         if( m_map_of_request_type_offsets.end() != itOffset ) {
-            unsigned int i = itOffset->second;
-            if( i < nPossibles ) nOffset = i ;
-            else nOffset = 0;
+            if( itOffset->second < nPossibles ) nOffset = itOffset->second ;
+            itOffset->second = nOffset + 1 ;
         }
         DR_LOG(log_debug) << "ClientController::selectClientForRequestOutsideDialog - there are " << nPossibles << 
             " possible clients, we are starting with offset " << nOffset  ;
 
-        m_map_of_request_type_offsets.erase(itOffset) ;
-        m_map_of_request_type_offsets.insert(map_of_request_type_offsets::value_type(method_name, nOffset + 1)) ;
-
-        unsigned int nTries = 0 ;
+        // round robin takes the first eligible client from the offset on; the other policies look at all of 
+        // them and take the least loaded, starting from the offset so that ties are still shared out in turn
+        client_ptr best ;
+        double bestScore = 0 ;
         map_of_request_types::iterator it = pair.first ;
         std::advance(it, nOffset) ;
         do {
@@ -288,29 +430,98 @@ namespace drachtio {
             client = spec.client() ;
             if (!client) {
                 DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - Removing disconnected client while iterating"  ;
+                bool first = it == pair.first ;
                 it = m_request_types.erase( it ) ;
-                //pair = m_request_types.equal_range(method_name) ;
-                //nOffset = 0 ;
-                //nPossibles = std::distance( pair.first, pair.second ) ;
+                if( first ) pair.first = it ;
+            }
+            else if (client->isClosing() || 
+                (client_backlog_shed != m_backlogPolicy && (client->isOverBacklogLimit() || !client->isWritable()))) {
+                DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - passing over client at offset " << nOffset << 
+                    " with a backlog of " << client->getBacklog() << " bytes" << (client->isWritable() ? "" : ", over its send high watermark") ;
+                it++;
             }
             else if (tag && !client->hasTag(tag)) {
                 DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - client at offset " << nOffset << " does not support tag " << tag;
-                client = NULL;
                 it++;
             }
-            else {
+            else if (client_selection_round_robin == m_selection) {
                 DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - Selected client at offset " << nOffset  ;                
+                best = client ;
+                break ;
+            }
+            else {
+                double score = loadScore( client ) ;
+                if( !best || score < bestScore ) {
+                    best = client ;
+                    bestScore = score ;
+                }
+                it++;
             }
             nPossibles--;
-        } while( !client && nPossibles > 0 ) ;
+        } while( nPossibles > 0 && pair.first != pair.second ) ;
 
-        if( !client ) {
+        if( !best ) {
             DR_LOG(log_info) << "ClientController::route_request_outside_dialog - No clients found to handle incoming " << method_name << " request"  ;
-            return client ;
+            return best ;
+        }
+        if( client_backlog_shed == m_backlogPolicy && best->isOverBacklogLimit() ) {
+            // rather than pile its share of the traffic onto the other clients
+            DR_LOG(log_warning) << "ClientController::route_request_outside_dialog - shedding " << method_name << " request for client " << 
+                best->endpoint_address() << ":" << best->endpoint_port() << " with a backlog of " << best->getBacklog() << " bytes" ;
+            return client_ptr() ;
+        }
+        if( client_selection_round_robin != m_selection ) {
+            DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - Selected client with " << best->getOutstanding() << 
+                " outstanding requests, load score " << bestScore ;
+        }
+        return best ;
+    }
+
+    double ClientController::loadScore( client_ptr client ) const {
+        double outstanding = client->getOutstanding() ;
+        switch( m_selection ) {
+            case client_selection_least_latency:
+                // the expected wait: how long it has lately taken to answer, for each request ahead of this one; 
+                // the floor keeps a client that has not answered anything yet from taking every request meanwhile
+                return std::max( client->getResponseLatency(), MIN_RESPONSE_LATENCY ) * (outstanding + 1) ;
+            case client_selection_weighted:
+                return (outstanding + 1) / std::max( client->getCapacity(), 1U ) ;
+            default:
+                return outstanding ;
         }
- 
-        return client ;
     }
+
+    bool ClientController::parseSelection( const char* name, ClientSelection& selection ) {
+        if( 0 == strcmp( name, "round-robin" ) ) selection = client_selection_round_robin ;
+        else if( 0 == strcmp( name, "least-outstanding" ) ) selection = client_selection_least_outstanding ;
+        else if( 0 == strcmp( name, "least-latency" ) ) selection = client_selection_least_latency ;
+        else if( 0 == strcmp( name, "weighted" ) ) selection = client_selection_weighted ;
+        else return false ;
+        return true ;
+    }
+    bool ClientController::parseBacklogPolicy( const char* name, ClientBacklogPolicy& policy ) {
+        if( 0 == strcmp( name, "avoid" ) ) policy = client_backlog_avoid ;
+        else if( 0 == strcmp( name, "shed" ) ) policy = client_backlog_shed ;
+        else if( 0 == strcmp( name, "disconnect" ) ) policy = client_backlog_disconnect ;
+        else return false ;
+        return true ;
+    }
+    const char* ClientController::backlogPolicyName( ClientBacklogPolicy policy ) {
+        switch( policy ) {
+            case client_backlog_shed: return "shed" ;
+            case client_backlog_disconnect: return "disconnect" ;
+            default: return "avoid" ;
+        }
+    }
+    const char* ClientController::selectionName( ClientSelection selection ) {
+        switch( selection ) {
+            case client_selection_least_outstanding: return "least-outstanding" ;
+            case client_selection_least_latency: return "least-latency" ;
+            case client_selection_weighted: return "weighted" ;
+            default: return "round-robin" ;
+        }
+    }
+
     bool ClientController::route_ack_request_inside_dialog( const string& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, 
         sip_t const *sip, const string& transactionId, const string& inviteTransactionId, const string& dialogId ) {
 
@@ -324,10 +535,9 @@ namespace drachtio {
         }
 
         void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        postToClient( client, std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta), rawSipMsg.length() ) ;
 
         this->removeNetTransaction( inviteTransactionId ) ;
-        DR_LOG(log_debug) << "ClientController::route_ack_request_inside_dialog - removed incoming invite transaction, map size is now: " << m_mapNetTransactions.size() << " request"  ;
  
         return true ;
 
@@ -346,7 +556,7 @@ namespace drachtio {
  
         DR_LOG(log_debug) << "ClientController::route_request_inside_invite - sending cancel prack or update to client"  ;
         void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        postToClient( client, std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta), rawSipMsg.length() ) ;
 
         return true ;
     }
@@ -381,7 +591,7 @@ namespace drachtio {
         if (string::npos == transactionId.find("unsolicited")) this->addNetTransaction( client, transactionId ) ;
  
         void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        postToClient( client, std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta), rawSipMsg.length() ) ;
 
         // if this is a BYE from the network, it ends the dialog 
         if( isBye || isFinalNotifyForSubscribe) {
@@ -399,12 +609,11 @@ namespace drachtio {
             DR_LOG(log_warning) << "ClientController::route_response_inside_transaction - client managing transaction has disconnected: " << transactionId  ;
             removeAppTransaction( transactionId ) ;
             removeDialog( dialogId ) ;
-            DR_LOG(log_debug) << "ClientController::route_response_inside_transaction - removed dialog: " << dialogId << ", " <<  m_mapDialogs.size() << " dialogs remain" ;
             return false ;
         }
 
         void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        postToClient( client, std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta), rawSipMsg.length() ) ;
 
         string method_name = sip->sip_cseq->cs_method_name ;
         if( sip->sip_status->st_status >= 200 ) {
@@ -419,20 +628,19 @@ namespace drachtio {
     }
     
     void ClientController::addDialogForTransaction( const string& transactionId, const string& dialogId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        mapId2Client::iterator it = m_mapNetTransactions.find( transactionId ) ;
-        if( m_mapNetTransactions.end() != it ) {
-            m_mapDialogs.insert( mapId2Client::value_type(dialogId, it->second ) ) ;
+        client_weak_ptr owner ;
+        if( m_mapNetTransactions.find( transactionId, owner ) ) {
+            client_ptr client = owner.lock() ;
+            if( client ) track( m_mapDialogs, BaseClient::owned_dialog, client, dialogId ) ;
             DR_LOG(log_info) << "ClientController::addDialogForTransaction - added dialog (uas), now tracking: " << 
                 m_mapDialogs.size() << " dialogs and " << m_mapNetTransactions.size() << " net transactions"  ;
          }
         else {
             /* dialog will already exist if we received a reliable provisional response */
-            mapId2Client::iterator itDialog = m_mapDialogs.find( dialogId ) ;
-            if( m_mapDialogs.end() == itDialog ) {
-                mapId2Client::iterator itApp = m_mapAppTransactions.find( transactionId ) ;
-                if( m_mapAppTransactions.end() != itApp ) {
-                    m_mapDialogs.insert( mapId2Client::value_type(dialogId, itApp->second ) ) ;
+            if( !m_mapDialogs.find( dialogId, owner ) ) {
+                if( m_mapAppTransactions.find( transactionId, owner ) ) {
+                    client_ptr client = owner.lock() ;
+                    if( client ) track( m_mapDialogs, BaseClient::owned_dialog, client, dialogId ) ;
                     DR_LOG(log_info) << "ClientController::addDialogForTransaction - added dialog (uac), now tracking: " << 
                         m_mapDialogs.size() << " dialogs and " << m_mapAppTransactions.size() << " app transactions"  ;
                 }
@@ -446,24 +654,24 @@ namespace drachtio {
         DR_LOG(log_debug) << "ClientController::addDialogForTransaction - transaction id " << transactionId << 
             " has associated dialog " << dialogId  ;
 
-        client_ptr client = this->findClientForDialog_nolock( dialogId );
+        client_ptr client = this->findClientForDialog( dialogId );
         if( !client ) {
-            m_mapDialogs.erase( dialogId ) ;
+            untrack( m_mapDialogs, BaseClient::owned_dialog, dialogId ) ;
             DR_LOG(log_warning) << "ClientController::addDialogForTransaction - client managing dialog has disconnected: " << dialogId  ;
             return  ;
         }
         else {
             string strAppName ;
             if( client->getAppName( strAppName ) ) {
-                m_mapDialogId2Appname.insert( mapDialogId2Appname::value_type( dialogId, strAppName ) ) ;
+                m_mapDialogId2Appname.insert( dialogId, strAppName ) ;
                 
                 DR_LOG(log_debug) << "ClientController::addDialogForTransaction - dialog id " << dialogId << 
                     " has been established for client app " << strAppName << "; count of tracked dialogs is " << m_mapDialogId2Appname.size()  ;
             }
         }
     } 
-    bool ClientController::sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, const string& startLine, 
-        const string& headers, const string& body, string& transactionId ) {
+    bool ClientController::sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, std::string_view startLine, 
+        std::string_view headers, std::string_view body, string& transactionId ) {
 
         generateUuid( transactionId ) ;
         if( 0 != startLine.find("ACK") ) {
@@ -474,8 +682,8 @@ namespace drachtio {
         bool rc = m_pController->getDialogController()->sendRequestInsideDialog( clientMsgId, dialogId, startLine, headers, body, transactionId) ;
         return rc ;
     }
-    bool ClientController::sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, const string& startLine, const string& headers, 
-            const string& body, string& transactionId, string& dialogId, string& routeUrl ) {
+    bool ClientController::sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, std::string_view startLine, std::string_view headers, 
+            std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) {
 
         generateUuid( transactionId ) ;
         if( 0 != startLine.find("ACK") ) {
@@ -486,15 +694,16 @@ namespace drachtio {
         bool rc = m_pController->getDialogController()->sendRequestOutsideDialog( clientMsgId, startLine, headers, body, transactionId, dialogId, routeUrl) ;
         return rc ;        
     }
-    bool ClientController::respondToSipRequest( client_ptr client, const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, 
-        const string& body ) {
+    bool ClientController::respondToSipRequest( client_ptr client, const string& clientMsgId, const string& transactionId, std::string_view startLine, std::string_view headers, 
+        std::string_view body ) {
 
         addApiRequest( client, clientMsgId )  ;
+        client->responded( transactionId ) ;
         bool rc = m_pController->getDialogController()->respondToSipRequest( clientMsgId, transactionId, startLine, headers, body ) ;
         return rc ;               
     }   
-    bool ClientController::sendCancelRequest( client_ptr client, const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, 
-        const string& body ) {
+    bool ClientController::sendCancelRequest( client_ptr client, const string& clientMsgId, const string& transactionId, std::string_view startLine, std::string_view headers, 
+        std::string_view body ) {
 
         addApiRequest( client, clientMsgId )  ;
         bool rc = m_pController->getDialogController()->sendCancelRequest( clientMsgId, transactionId, startLine, headers, body ) ;
@@ -522,38 +731,66 @@ namespace drachtio {
         if( string::npos == additionalResponseData.find("|continue") ) {
             removeApiRequest( clientMsgId ) ;
         }
-        m_ioservice.post( std::bind(&BaseClient::sendApiResponseToClient, client, clientMsgId, responseText, additionalResponseData) ) ;
+        postToClient( client, std::bind(&BaseClient::sendApiResponseToClient, client, clientMsgId, responseText, additionalResponseData),
+            responseText.length() + additionalResponseData.length() ) ;
         return true ;                
     }
+
+    void ClientController::postToClient( client_ptr client, std::function<void()> handler, size_t bytes ) {
+        // a client that is being disconnected gets nothing more, and what is already waiting for it is dropped
+        if( client->isClosing() ) return ;
+
+        client->posted( bytes ) ;
+        if( client_backlog_disconnect == m_backlogPolicy && client->isOverBacklogLimit() && client->startClosing() ) {
+            DR_LOG(log_warning) << "ClientController::postToClient - disconnecting client " << client->endpoint_address() << ":" << 
+                client->endpoint_port() << " with a backlog of " << client->getBacklog() << " bytes" ;
+            client->unposted( bytes ) ;
+            boost::asio::post( client->getStrand(), std::bind(&BaseClient::disconnect, client) ) ;
+            return ;
+        }
+
+        if( !theOneAndOnlyController->getStatsCollector().enabled() ) {
+            boost::asio::post( client->getStrand(), [client, bytes, handler = std::move(handler)]() {
+                if( !client->isClosing() ) handler() ;
+                client->unposted( bytes ) ;
+            }) ;
+            return ;
+        }
+        auto queued = std::chrono::steady_clock::now() ;
+        boost::asio::post( client->getStrand(), [client, bytes, queued, handler = std::move(handler)]() {
+            STATS_HOP_OBSERVE(hop_sip_to_client_queue, queued)
+            if( !client->isClosing() ) handler() ;
+            client->unposted( bytes ) ;
+        }) ;
+    }
     
     void ClientController::removeDialog( const string& dialogId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        mapId2Client::iterator it = m_mapDialogs.find( dialogId ) ;
-        if( m_mapDialogs.end() == it ) {
-            DR_LOG(log_warning) << "ClientController::removeDialog - dialog not found: " << dialogId  ;
+        bool hadApp = m_mapDialogId2Appname.erase( dialogId ) ;
+        if( !untrack( m_mapDialogs, BaseClient::owned_dialog, dialogId ) ) {
+            // no longer there once the client that owned it has left, but then we knew its app
+            if( !hadApp ) DR_LOG(log_warning) << "ClientController::removeDialog - dialog not found: " << dialogId  ;
             return ;
         }
-        m_mapDialogs.erase( it ) ;
         DR_LOG(log_info) << "ClientController::removeDialog - after removing dialogs count is now: " << m_mapDialogs.size()  ;
     }
-    client_ptr ClientController::findClientForDialog( const string& dialogId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        return findClientForDialog_nolock( dialogId ) ;
+    void ClientController::addDialogForApp( const string& dialogId, const string& appName ) {
+        // no client owns the dialog; findClientForDialog hands it to whichever connection of the app asks for it
+        m_mapDialogId2Appname.insert( dialogId, appName ) ;
+        DR_LOG(log_debug) << "ClientController::addDialogForApp - dialog id " << dialogId << " restored for client app " << appName  ;
     }
-
-    client_ptr ClientController::findClientForDialog_nolock( const string& dialogId ) {
+    client_ptr ClientController::findClientForDialog( const string& dialogId ) {
         client_ptr client ;
 
-        mapId2Client::iterator it = m_mapDialogs.find( dialogId ) ;
-        if( m_mapDialogs.end() != it ) client = it->second.lock() ;
+        client_weak_ptr owner ;
+        if( m_mapDialogs.find( dialogId, owner ) ) client = owner.lock() ;
 
         // if that client is no longer connected, randomly select another client that is running that app 
         if( !client ) {
-            mapDialogId2Appname::iterator it = m_mapDialogId2Appname.find( dialogId ) ;
-            if( m_mapDialogId2Appname.end() != it ) {
-                string appName = it->second ;
+            string appName ;
+            if( m_mapDialogId2Appname.find( dialogId, appName ) ) {
                 DR_LOG(log_info) << "Attempting to find another client for app " << appName  ;
 
+                std::lock_guard<std::mutex> l( m_lock ) ;
                 pair<map_of_services::iterator,map_of_services::iterator> pair = m_services.equal_range( appName ) ;
                 unsigned int nPossibles = std::distance( pair.first, pair.second ) ;
                 if( 0 == nPossibles ) {
@@ -579,121 +816,153 @@ namespace drachtio {
     }
 
     client_ptr ClientController::findClientForAppTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        client_ptr client ;
-        mapId2Client::iterator it = m_mapAppTransactions.find( transactionId ) ;
-        if( m_mapAppTransactions.end() != it ) client = it->second.lock() ;
-        return client ;
+        client_weak_ptr owner ;
+        if( !m_mapAppTransactions.find( transactionId, owner ) ) return client_ptr() ;
+        return owner.lock() ;
     }
     client_ptr ClientController::findClientForNetTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        client_ptr client ;
-        mapId2Client::iterator it = m_mapNetTransactions.find( transactionId ) ;
-        if( m_mapNetTransactions.end() != it ) client = it->second.lock() ;
-        return client ;
+        client_weak_ptr owner ;
+        if( !m_mapNetTransactions.find( transactionId, owner ) ) return client_ptr() ;
+        return owner.lock() ;
     }
     client_ptr ClientController::findClientForApiRequest( const string& clientMsgId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        client_ptr client ;
-        mapId2Client::iterator it = m_mapApiRequests.find( clientMsgId ) ;
-        if( m_mapApiRequests.end() != it ) client = it->second.lock() ;
-        return client ;
+        client_weak_ptr owner ;
+        if( !m_mapApiRequests.find( clientMsgId, owner ) ) return client_ptr() ;
+        return owner.lock() ;
     }
     void ClientController::removeAppTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapAppTransactions.erase( transactionId ) ;        
+        untrack( m_mapAppTransactions, BaseClient::owned_app_transaction, transactionId ) ;
         DR_LOG(log_debug) << "ClientController::removeAppTransaction: transactionId " << transactionId << "; size: " << m_mapAppTransactions.size()  ;
     }
     void ClientController::removeNetTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapNetTransactions.erase( transactionId ) ;        
+        untrack( m_mapNetTransactions, BaseClient::owned_net_transaction, transactionId ) ;
         DR_LOG(log_debug) << "ClientController::removeNetTransaction: transactionId " << transactionId << "; size: " << m_mapNetTransactions.size()  ;
     }
     void ClientController::removeApiRequest( const string& clientMsgId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapApiRequests.erase( clientMsgId ) ;   
+        untrack( m_mapApiRequests, BaseClient::owned_api_request, clientMsgId ) ;
         DR_LOG(log_debug) << "ClientController::removeApiRequest: clientMsgId " << clientMsgId << "; size: " << m_mapApiRequests.size()  ;
     }
     void ClientController::addAppTransaction( client_ptr client, const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapAppTransactions.insert( make_pair( transactionId, client ) ) ;        
+        track( m_mapAppTransactions, BaseClient::owned_app_transaction, client, transactionId ) ;
         DR_LOG(log_debug) << "ClientController::addAppTransaction: transactionId " << transactionId << "; size: " << m_mapAppTransactions.size()  ;
     }
     void ClientController::addNetTransaction( client_ptr client, const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapNetTransactions.insert( make_pair( transactionId, client ) ) ;        
+        track( m_mapNetTransactions, BaseClient::owned_net_transaction, client, transactionId ) ;
         DR_LOG(log_debug) << "ClientController::addNetTransaction: transactionId " << transactionId << "; size: " << m_mapNetTransactions.size()  ;
     }
     void ClientController::addApiRequest( client_ptr client, const string& clientMsgId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapApiRequests.insert( make_pair( clientMsgId, client ) ) ;        
+        track( m_mapApiRequests, BaseClient::owned_api_request, client, clientMsgId ) ;
         DR_LOG(log_debug) << "ClientController::addApiRequest: clientMsgId " << clientMsgId << "; size: " << m_mapApiRequests.size()  ;
     }
 
     void ClientController::logStorageCount(bool bDetail) {
-        std::lock_guard<std::mutex> lock(m_lock) ;
-
-        DR_LOG(bDetail ? log_info : log_debug) << "ClientController storage counts"  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "----------------------------------"  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_clients size:                                                  " << m_clients.size()  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_services size:                                                 " << m_services.size()  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_request_types size:                                            " << m_request_types.size()  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_map_of_request_type_offsets size:                              " << m_map_of_request_type_offsets.size()  ;
+        size_t nClients ;
+        {
+            std::lock_guard<std::mutex> lock(m_lock) ;
+
+            nClients = m_clients.size() ;
+            DR_LOG(bDetail ? log_info : log_debug) << "ClientController storage counts"  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "----------------------------------"  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_clients size:                                                  " << m_clients.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_services size:                                                 " << m_services.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_request_types size:                                            " << m_request_types.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_map_of_request_type_offsets size:                              " << m_map_of_request_type_offsets.size()  ;
+        }
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapDialogs size:                                               " << m_mapDialogs.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapDialogs) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    dialog id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapDialogs.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    dialog id: " << std::hex << id.c_str();
+            });
         }
 
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapNetTransactions size:                                       " << m_mapNetTransactions.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapNetTransactions) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    transaction id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapNetTransactions.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    transaction id: " << std::hex << id.c_str();
+            });
         }
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapAppTransactions size:                                       " << m_mapAppTransactions.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapAppTransactions) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    transaction id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapAppTransactions.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    transaction id: " << std::hex << id.c_str();
+            });
         }
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapApiRequests size:                                           " << m_mapApiRequests.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapApiRequests) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    client msg id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapApiRequests.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    client msg id: " << std::hex << id.c_str();
+            });
         }
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapDialogId2Appname size:                                      " << m_mapDialogId2Appname.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapDialogId2Appname) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    dialog id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapDialogId2Appname.forEach([](const string& id, const string&) {
+                DR_LOG(log_info) << "    dialog id: " << std::hex << id.c_str();
+            });
         }
 
-        STATS_GAUGE_SET(STATS_GAUGE_CLIENT_APP_CONNECTIONS, m_clients.size())
+        STATS_GAUGE_SET(STATS_GAUGE_CLIENT_APP_CONNECTIONS, nClients)
+
+        // entries whose client has gone; these should be released when it leaves, so anything here is a leak
+        if( theOneAndOnlyController->getStatsCollector().enabled() ) {
+            STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_CLIENT_ORPHANED_ENTRIES, countOrphaned( m_mapDialogs ), {{"map", "dialogs"}})
+            STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_CLIENT_ORPHANED_ENTRIES, countOrphaned( m_mapAppTransactions ), {{"map", "app_transactions"}})
+            STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_CLIENT_ORPHANED_ENTRIES, countOrphaned( m_mapNetTransactions ), {{"map", "net_transactions"}})
+            STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_CLIENT_ORPHANED_ENTRIES, countOrphaned( m_mapApiRequests ), {{"map", "api_requests"}})
+        }
 
     }
     void ClientController::getDialogIds(std::vector<std::string>& ids) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
         ids.reserve(m_mapDialogs.size());
-        for (const auto& kv : m_mapDialogs) ids.push_back(kv.first);
+        m_mapDialogs.forEach([&ids](const string& id, const client_weak_ptr&) { ids.push_back(id); });
     }
     void ClientController::getNetTransactionIds(std::vector<std::string>& ids) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
         ids.reserve(m_mapNetTransactions.size());
-        for (const auto& kv : m_mapNetTransactions) ids.push_back(kv.first);
+        m_mapNetTransactions.forEach([&ids](const string& id, const client_weak_ptr&) { ids.push_back(id); });
     }
 
     std::shared_ptr<SipDialogController> ClientController::getDialogController(void) {
         return m_pController->getDialogController();
     }
 
+    void ClientController::armLagProbe() {
+        m_lagTimer.expires_after( std::chrono::milliseconds( LoopMonitor::PROBE_INTERVAL_MSECS ) ) ;
+        m_loopMonitors[0]->armed( LoopMonitor::PROBE_INTERVAL_MSECS ) ;
+        m_lagTimer.async_wait( std::bind( &ClientController::onLagProbe, this, std::placeholders::_1 ) ) ;
+    }
+    void ClientController::onLagProbe( const boost::system::error_code& ec ) {
+        if( ec ) return ;
+        m_loopMonitors[0]->fired() ;
+        armLagProbe() ;
+    }
+
+    void ClientController::armBacklogReport() {
+        m_backlogTimer.expires_after( std::chrono::milliseconds( BACKLOG_REPORT_INTERVAL_MSECS ) ) ;
+        m_backlogTimer.async_wait( std::bind( &ClientController::onBacklogReport, this, std::placeholders::_1 ) ) ;
+    }
+    void ClientController::onBacklogReport( const boost::system::error_code& ec ) {
+        if( ec ) return ;
+        {
+            std::lock_guard<std::mutex> l( m_lock ) ;
+            for( const client_ptr& client : m_clients ) {
+                STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_CLIENT_BACKLOG_BYTES, client->getBacklog(), {{"client", backlogLabel( client )}})
+            }
+        }
+        armBacklogReport() ;
+    }
+    string ClientController::backlogLabel( client_ptr client ) {
+        // every unix socket client has the same address and port 0, so the connection id is what keeps their series apart
+        return client->endpoint_address() + ":" + std::to_string( client->endpoint_port() ) + "#" + std::to_string( client->getConnectionId() ) ;
+    }
+
     void ClientController::stop() {
+        m_lagTimer.cancel() ;
+        m_backlogTimer.cancel() ;
         m_acceptor_tcp.cancel() ;
         m_acceptor_tls.cancel() ;
+        if (m_acceptor_local.is_open()) m_acceptor_local.cancel() ;
         m_ioservice.stop() ;
-        m_thread.join() ;
+        for( std::thread& t : m_threads ) t.join() ;
+        if (!m_localPath.empty()) ::unlink(m_localPath.c_str()) ;
     }
 
  }
@@ -29,8 +29,10 @@ THE SOFTWARE.
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <functional>
 
 #include <sofia-sip/nta.h>
 #include <sofia-sip/sip.h>
@@ -40,10 +42,27 @@ THE SOFTWARE.
 
 #include "drachtio.h"
 #include "client.hpp"
+#include "loop-monitor.hpp"
+#include "striped-map.hpp"
 
 using namespace std ;
 
 namespace drachtio {
+
+  // how a request outside a dialog is given to one of the clients that registered for it
+  enum ClientSelection {
+    client_selection_round_robin = 0,
+    client_selection_least_outstanding,   // fewest requests routed to it and not yet completed
+    client_selection_least_latency,       // lowest response latency times requests outstanding
+    client_selection_weighted             // fewest requests outstanding relative to the capacity it advertised
+  } ;
+
+  // what happens to a client whose backlog of messages not yet written to it goes over the limit
+  enum ClientBacklogPolicy {
+    client_backlog_avoid = 0,     // new requests go to other clients until it catches up (as they do for one over the send high watermark)
+    client_backlog_shed,          // new requests that would have gone to it are rejected with a 503
+    client_backlog_disconnect     // it is disconnected, dropping everything waiting for it
+  } ;
     
   class ClientController : public std::enable_shared_from_this<ClientController>  {
   public:
@@ -60,10 +79,25 @@ namespace drachtio {
     
     ~ClientController() ;
     
-    void start();
+    // nThreads io threads serve all application connections, each connection is bound to a strand
+    void start( unsigned int nThreads = 1 );
+
+    // also accept applications on a unix domain socket at path; must be called before start
+    bool listenLocal( const string& path, unsigned int mode ) ;
+
+    void setSelection( ClientSelection selection ) { m_selection = selection; }
+    ClientSelection getSelection(void) const { return m_selection; }
+    static bool parseSelection( const char* name, ClientSelection& selection ) ;
+    static const char* selectionName( ClientSelection selection ) ;
+
+    void setBacklogPolicy( ClientBacklogPolicy policy ) { m_backlogPolicy = policy; }
+    ClientBacklogPolicy getBacklogPolicy(void) const { return m_backlogPolicy; }
+    static bool parseBacklogPolicy( const char* name, ClientBacklogPolicy& policy ) ;
+    static const char* backlogPolicyName( ClientBacklogPolicy policy ) ;
   	void start_accept_tcp() ;
   	void start_accept_tls() ;
-  	void threadFunc(void) ;
+  	void start_accept_local() ;
+  	void threadFunc( unsigned int idx ) ;
 
     void join( client_ptr client ) ;
     void leave( client_ptr client ) ;
@@ -80,6 +114,10 @@ namespace drachtio {
     void addNetTransaction( client_ptr client, const string& transactionId );
     void addApiRequest( client_ptr client, const string& clientMsgId );
     void removeDialog( const string& dialogId ) ;
+
+    // the app a dialog was established for, which the dialog journal keeps so that a restored dialog can be routed
+    bool findAppForDialog( const string& dialogId, string& appName ) { return m_mapDialogId2Appname.find( dialogId, appName ) ; }
+    void addDialogForApp( const string& dialogId, const string& appName ) ;
     void removeAppTransaction( const string& transactionId ) ;
     void removeNetTransaction( const string& transactionId ) ;
     void removeApiRequest( const string& clientMsgId ) ;
@@ -93,10 +131,10 @@ namespace drachtio {
     void makeOutboundConnection( const string& transactionId, const string& host, const string& port, const string& transport ) ;
     void selectClientForTag(const string& transactionId, const string& tag);
 
-    bool sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, const string& startLine, const string& headers, const string& body, string& transactionId ) ;
-    bool sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, const string& startLine, const string& headers, const string& body, string& transactionId, string& dialogId, string& routeUrl ) ;
-    bool respondToSipRequest( client_ptr client, const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;      
-    bool sendCancelRequest( client_ptr client, const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;
+    bool sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, std::string_view startLine, std::string_view headers, std::string_view body, string& transactionId ) ;
+    bool sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, std::string_view startLine, std::string_view headers, std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) ;
+    bool respondToSipRequest( client_ptr client, const string& msgId, const string& transactionId, std::string_view startLine, std::string_view headers, std::string_view body ) ;      
+    bool sendCancelRequest( client_ptr client, const string& msgId, const string& transactionId, std::string_view startLine, std::string_view headers, std::string_view body ) ;
     bool proxyRequest( client_ptr client, const string& clientMsgId, const string& transactionId, bool recordRoute, bool fullResponse,
       bool followRedirects, bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, 
       const vector<string>& vecDestination, const string& headers ) ;
@@ -125,6 +163,10 @@ namespace drachtio {
 
     boost::asio::io_context& getIOService(void) { return m_ioservice ;}
 
+    // queue work on a client's strand, timing how long it waits (sip_to_client_queue hop); bytes is about what 
+    // the handler will send, and counts against the client's backlog until the handler has run
+    void postToClient( client_ptr client, std::function<void()> handler, size_t bytes ) ;
+
     std::shared_ptr<SipDialogController> getDialogController(void) ;
 
     //void sendSipMessageToClient( client_ptr client, const string& transactionId, const string& rawSipMsg, const SipMsgData_t& meta );
@@ -149,22 +191,44 @@ namespace drachtio {
   private:
     void accept_handler_tcp( client_ptr session, const boost::system::error_code& ec) ;
     void accept_handler_tls( client_ptr session, const boost::system::error_code& ec) ;
+    void accept_handler_local( client_ptr session, const boost::system::error_code& ec) ;
     void stop() ;
+    void armLagProbe(void) ;
+    void onLagProbe( const boost::system::error_code& ec ) ;
+    void armBacklogReport(void) ;
+    void onBacklogReport( const boost::system::error_code& ec ) ;
+    static string backlogLabel( client_ptr client ) ;
+
+    // lower is better
+    double loadScore( client_ptr client ) const ;
 
-    client_ptr findClientForDialog_nolock( const string& dialogId ) ;
+    // seconds; the least a client is assumed to take to respond
+    static constexpr double MIN_RESPONSE_LATENCY = 0.001 ;
+
+    // how often each client's backlog is exported
+    static const unsigned int BACKLOG_REPORT_INTERVAL_MSECS = 1000 ;
 
     DrachtioController*         m_pController ;
-    std::thread                 m_thread ;
-    std::mutex                m_lock ;
+    std::vector<std::thread>    m_threads ;
+    std::mutex                m_lock ;    // m_clients, m_services and the request type maps
+    ClientSelection           m_selection ;
+    ClientBacklogPolicy       m_backlogPolicy ;
 
     boost::asio::io_context m_ioservice;
     boost::asio::ip::tcp::endpoint  m_endpoint_tcp;
     boost::asio::ip::tcp::acceptor  m_acceptor_tcp ;
     boost::asio::ip::tcp::endpoint  m_endpoint_tls;
     boost::asio::ip::tcp::acceptor  m_acceptor_tls ;
+    boost::asio::local::stream_protocol::acceptor m_acceptor_local ;
+    string m_localPath ;
     boost::asio::ssl::context m_context;
     unsigned int m_tcpPort, m_tlsPort;
 
+    std::vector<string> m_loopNames;
+    std::vector<std::unique_ptr<LoopMonitor>> m_loopMonitors;
+    boost::asio::steady_timer m_lagTimer;
+    boost::asio::steady_timer m_backlogTimer;
+
     typedef std::unordered_set<client_ptr> set_of_clients ;
     set_of_clients m_clients ;
 
@@ -177,14 +241,21 @@ namespace drachtio {
     typedef std::unordered_map<string,unsigned int> map_of_request_type_offsets ;
     map_of_request_type_offsets m_map_of_request_type_offsets ;
 
-    typedef std::unordered_map<string,client_weak_ptr> mapId2Client ;
+    // per transaction and dialog state is touched by the sip thread and every client thread, so 
+    // these are striped maps with their own locks rather than being guarded by m_lock
+    typedef StripedMap<string,client_weak_ptr> mapId2Client ;
     mapId2Client m_mapDialogs ;
     mapId2Client m_mapAppTransactions ;
     mapId2Client m_mapNetTransactions ;
     mapId2Client m_mapApiRequests ;
 
-    typedef std::unordered_map<string,string> mapDialogId2Appname ;
+    typedef StripedMap<string,string> mapDialogId2Appname ;
     mapDialogId2Appname m_mapDialogId2Appname ;
+
+    // add or remove an entry in one of the id maps, keeping the owning client's reverse index in step
+    void track( mapId2Client& map, BaseClient::owned_map_t which, client_ptr client, const string& id ) ;
+    bool untrack( mapId2Client& map, BaseClient::owned_map_t which, const string& id ) ;
+    size_t countOrphaned( const mapId2Client& map ) ;
       
   } ;
 
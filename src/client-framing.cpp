@@ -0,0 +1,112 @@
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <stdexcept>
+
+#include "client-framing.hpp"
+
+namespace {
+  const std::string_view CRLF("\r\n") ;
+  const std::string_view CRLF2("\r\n\r\n") ;
+}
+
+namespace drachtio {
+
+  FrameReader::FrameReader() : m_buf(INITIAL_SIZE), m_start(0), m_end(0), m_needed(0), m_prefix(0) {
+  }
+
+  char* FrameReader::prepare( size_t& size ) {
+    if( m_start == m_end ) {
+      m_start = m_end = 0 ;
+    }
+    else if( m_start > 0 ) {
+      // move the partial frame to the front, it is never more than one frame's worth
+      memmove( m_buf.data(), m_buf.data() + m_start, m_end - m_start ) ;
+      m_end -= m_start ;
+      m_start = 0 ;
+    }
+
+    size_t wanted = std::max( m_needed, m_end + MIN_READ_SIZE ) ;
+    if( wanted > m_buf.size() ) m_buf.resize( std::max( wanted, 2 * m_buf.size() ) ) ;
+
+    size = m_buf.size() - m_end ;
+    return m_buf.data() + m_end ;
+  }
+
+  bool FrameReader::next( std::string_view& frame ) {
+    while( m_start < m_end ) {
+      const char* p = m_buf.data() + m_start ;
+      size_t avail = m_end - m_start ;
+
+      if( m_needed > 0 ) {
+        if( avail < m_needed ) return false ;
+      }
+      else {
+        size_t len = 0 ;
+        unsigned int i = 0 ;
+        for( ; i < avail && i <= MAX_LENGTH_DIGITS && '#' != p[i]; i++ ) {
+          if( !isdigit( p[i] ) ) throw std::runtime_error("FrameReader::next - invalid message length specifier") ;
+          len = len * 10 + (p[i] - '0') ;
+        }
+        if( i == avail ) return false ;  // split in the middle of the length specifier
+        if( 0 == i || i > MAX_LENGTH_DIGITS ) throw std::runtime_error("FrameReader::next - invalid message length specifier") ;
+
+        m_prefix = i + 1 ;
+        m_needed = m_prefix + len ;
+        if( 0 == len ) {
+          // nothing to hand out for an empty frame
+          m_start += m_needed ;
+          m_needed = 0 ;
+          continue ;
+        }
+        if( avail < m_needed ) return false ;
+      }
+
+      frame = std::string_view( p + m_prefix, m_needed - m_prefix ) ;
+      m_start += m_needed ;
+      m_needed = 0 ;
+      return true ;
+    }
+    return false ;
+  }
+
+  void splitMsg( std::string_view msg, std::string_view& meta, std::string_view& startLine, 
+    std::string_view& headers, std::string_view& body ) {
+    size_t pos = msg.find( CRLF ) ;
+    if( std::string_view::npos == pos ) {
+      meta = msg ;
+      return ;
+    }
+    meta = msg.substr( 0, pos ) ;
+    std::string_view chunk = msg.substr( pos + CRLF.length() ) ;
+
+    pos = chunk.find( CRLF2 ) ;
+    if( std::string_view::npos != pos ) {
+      body = chunk.substr( pos + CRLF2.length() ) ;
+      chunk = chunk.substr( 0, pos ) ;
+    }
+
+    pos = chunk.find( CRLF ) ;
+    if( std::string_view::npos == pos ) {
+      startLine = chunk ;
+    }
+    else {
+      startLine = chunk.substr( 0, pos ) ;
+      headers = chunk.substr( pos + CRLF.length() ) ;
+    }
+  }
+
+  void splitTokens( std::string_view s, std::vector<std::string_view>& vec ) {
+    vec.clear() ;
+    size_t pos = 0 ;
+    for(;;) {
+      size_t bar = s.find( '|', pos ) ;
+      if( std::string_view::npos == bar ) {
+        vec.push_back( s.substr( pos ) ) ;
+        return ;
+      }
+      vec.push_back( s.substr( pos, bar - pos ) ) ;
+      pos = bar + 1 ;
+    }
+  }
+}
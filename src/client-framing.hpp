@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __CLIENT_FRAMING_HPP__
+#define __CLIENT_FRAMING_HPP__
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace drachtio {
+
+  /**
+   * Receive side of the application protocol, where each message is framed as "<length>#<message>".
+   *
+   * The socket reads straight into one contiguous buffer and complete frames are handed out as views
+   * into it, so a message is never copied between the socket and the parser.  A view stays valid
+   * until the next call to prepare(); only the tail of a partially received frame is ever moved, to
+   * the front of the buffer, and the buffer grows when a single frame does not fit.
+   */
+  class FrameReader {
+  public:
+    static const size_t INITIAL_SIZE = 16384 ;
+    static const size_t MIN_READ_SIZE = 4096 ;
+    static const unsigned int MAX_LENGTH_DIGITS = 5 ;
+    static const size_t MAX_FRAME_SIZE = 99999 ;    // the largest length MAX_LENGTH_DIGITS can specify
+
+    FrameReader() ;
+    FrameReader( const FrameReader& ) = delete ;
+
+    // free space to read into; invalidates the views handed out by next()
+    char* prepare( size_t& size ) ;
+
+    // bytes have been read into the space returned by prepare()
+    void commit( size_t bytes ) { m_end += bytes ; }
+
+    // the next complete frame, if one has been received; throws std::runtime_error if the length prefix is invalid
+    bool next( std::string_view& frame ) ;
+
+    // bytes received but not yet handed out
+    size_t pending(void) const { return m_end - m_start ; }
+
+  private:
+    std::vector<char> m_buf ;
+    size_t m_start ;      // first byte not yet handed out
+    size_t m_end ;        // end of the bytes received
+    size_t m_needed ;     // size, including the prefix, of the frame at m_start; 0 if not known yet
+    size_t m_prefix ;     // length of its "<length>#" prefix
+  } ;
+
+  // split a message into its meta line, sip start line, headers and body; the views refer to msg
+  void splitMsg( std::string_view msg, std::string_view& meta, std::string_view& startLine, 
+    std::string_view& headers, std::string_view& body ) ;
+
+  // split the meta line into its '|' separated tokens, keeping empty ones; the views refer to s
+  void splitTokens( std::string_view s, std::vector<std::string_view>& vec ) ;
+}
+
+#endif
@@ -30,6 +30,8 @@ THE SOFTWARE.
 
 #include <functional>
 #include <algorithm>
+#include <charconv>
+#include <type_traits>
 
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string.hpp>
@@ -89,18 +91,56 @@ namespace drachtio {
         }
     }
 
+    // bytes on compressed connections, as sent or received and as they were before compression or after inflating
+    void countCompressedBytes( bool outbound, size_t plain, size_t compressed ) {
+        StatsCollector& stats = theOneAndOnlyController->getStatsCollector() ;
+        if( !stats.enabled() ) return ;
+        static const StatsCollector::CounterHandle handles[2][2] = {
+            { 
+                stats.counterHandle(STATS_COUNTER_CLIENT_COMPRESSION_BYTES, {{"direction", "in"}, {"form", "plain"}}),
+                stats.counterHandle(STATS_COUNTER_CLIENT_COMPRESSION_BYTES, {{"direction", "in"}, {"form", "compressed"}})
+            },
+            {
+                stats.counterHandle(STATS_COUNTER_CLIENT_COMPRESSION_BYTES, {{"direction", "out"}, {"form", "plain"}}),
+                stats.counterHandle(STATS_COUNTER_CLIENT_COMPRESSION_BYTES, {{"direction", "out"}, {"form", "compressed"}})
+            }
+        } ;
+        stats.counterIncrement( handles[outbound][0], plain ) ;
+        stats.counterIncrement( handles[outbound][1], compressed ) ;
+    }
+
     // BaseClient
+    std::atomic<size_t> BaseClient::highWatermark(4 * 1024 * 1024) ;
+    std::atomic<size_t> BaseClient::lowWatermark(1024 * 1024) ;
+    std::atomic<size_t> BaseClient::backlogLimit(0) ;
+    std::atomic<uint64_t> BaseClient::lastConnectionId(0) ;
+
+    BaseClient::OutboundFrame::OutboundFrame( string&& str ) : 
+        m_payload(std::move(str)), m_queued(std::chrono::steady_clock::now()) {
+        char* end = std::to_chars(m_header.data(), m_header.data() + m_header.size() - 1, m_payload.length()).ptr ;
+        *end++ = '#' ;
+        m_headerLen = end - m_header.data() ;
+    }
+
     BaseClient::BaseClient(ClientController& controller) :
         m_controller( controller ),  
-        m_state(initial), m_buffer(12228), m_nMessageLength(0) {
+        m_strand( boost::asio::make_strand( controller.getIOService() ) ),
+        m_state(initial), m_bDeflating(false), m_bInflating(false),
+        m_connectionId(++lastConnectionId),
+        m_nWriting(0), m_nQueuedBytes(0), m_bCongested(false), m_nPostedBytes(0), m_bClosing(false), m_bLeft(false),
+        m_nOutstanding(0), m_responseLatency(0), m_capacity(0) {
             time(&m_tConnect);
     }
     BaseClient::BaseClient(ClientController& controller, 
         const string& transactionId, 
         const string& host, const string& port) :
         m_controller( controller ), 
+        m_strand( boost::asio::make_strand( controller.getIOService() ) ),
+        m_state(initial), m_bDeflating(false), m_bInflating(false),
         m_transactionId(transactionId), m_host(host), m_port(port),
-        m_state(initial), m_buffer(12228), m_nMessageLength(0) {
+        m_connectionId(++lastConnectionId),
+        m_nWriting(0), m_nQueuedBytes(0), m_bCongested(false), m_nPostedBytes(0), m_bClosing(false), m_bLeft(false),
+        m_nOutstanding(0), m_responseLatency(0), m_capacity(0) {
             time(&m_tConnect);
     }
 
@@ -108,15 +148,53 @@ namespace drachtio {
       DR_LOG(log_debug) << "BaseClient::~BaseClient";
     }
 
+    bool BaseClient::own( owned_map_t map, const string& id ) {
+        std::lock_guard<std::mutex> l( m_ownedLock ) ;
+        if( m_bLeft ) return false ;
+        if( owned_net_transaction == map ) {
+            m_owned[map].emplace( id, std::chrono::steady_clock::now() ) ;
+            m_nOutstanding = m_owned[map].size() ;
+        }
+        else m_owned[map].emplace( id, std::chrono::steady_clock::time_point() ) ;
+        return true ;
+    }
+    void BaseClient::disown( owned_map_t map, const string& id ) {
+        std::lock_guard<std::mutex> l( m_ownedLock ) ;
+        m_owned[map].erase( id ) ;
+        if( owned_net_transaction == map ) m_nOutstanding = m_owned[map].size() ;
+    }
+    bool BaseClient::releaseOwned( owned_ids_t& ids ) {
+        std::lock_guard<std::mutex> l( m_ownedLock ) ;
+        if( m_bLeft ) return false ;
+        m_bLeft = true ;
+        for( size_t i = 0; i < owned_map_count; i++ ) {
+            ids[i].reserve( m_owned[i].size() ) ;
+            for( const auto& kv : m_owned[i] ) ids[i].push_back( kv.first ) ;
+            m_owned[i].clear() ;
+        }
+        m_nOutstanding = 0 ;
+        return true ;
+    }
+    void BaseClient::responded( const string& transactionId ) {
+        std::lock_guard<std::mutex> l( m_ownedLock ) ;
+        auto it = m_owned[owned_net_transaction].find( transactionId ) ;
+        if( m_owned[owned_net_transaction].end() == it || std::chrono::steady_clock::time_point() == it->second ) return ;
+
+        double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - it->second ).count() ;
+        it->second = std::chrono::steady_clock::time_point() ;
+        double average = m_responseLatency ;
+        m_responseLatency = 0 == average ? secs : average + RESPONSE_LATENCY_ALPHA * (secs - average) ;
+    }
+
     std::shared_ptr<SipDialogController> BaseClient::getDialogController() {
         return m_controller.getDialogController(); 
     }
 
-    bool BaseClient::processClientMessage( const string& msg, string& msgResponse ) {
-        string meta, startLine, headers, body ;
+    bool BaseClient::processClientMessage( std::string_view msg, string& msgResponse ) {
+        std::string_view meta, startLine, headers, body ;
        
         splitMsg( msg, meta, startLine, headers, body ) ;
-        vector<string>tokens ;
+        vector<std::string_view> tokens ;
         splitTokens( meta, tokens) ;
 
         if( tokens.size() < 2 ) {
@@ -130,7 +208,7 @@ namespace drachtio {
             return true;
         }
         else if( 0 == tokens[1].compare("route") ) {
-            if( !m_controller.wants_requests( shared_from_this(), tokens[2] ) ) {
+            if( !m_controller.wants_requests( shared_from_this(), string(tokens[2]) ) ) {
                 DR_LOG(log_error) << "Route request includes unsupported verb: " << tokens[2]  ;   
                 createResponseMsg( tokens[0], msgResponse, false, "Route request includes unsupported verb" ) ;
                 return false ;        
@@ -138,17 +216,27 @@ namespace drachtio {
             createResponseMsg( tokens[0], msgResponse ) ;
         }
         else if( 0 == tokens[1].compare("remove_route") ) {
-            if( !m_controller.no_longer_wants_requests( shared_from_this(), tokens[2] ) ) {
+            if( !m_controller.no_longer_wants_requests( shared_from_this(), string(tokens[2]) ) ) {
                 DR_LOG(log_error) << "Remove route request includes unsupported verb: " << tokens[2]  ;   
                 createResponseMsg( tokens[0], msgResponse, false, "Remove route request includes unsupported verb" ) ;
                 return false ;        
             }
             createResponseMsg( tokens[0], msgResponse ) ;
         }
+        else if( 0 == tokens[1].compare("compress") ) {
+            // the client has seen compression taken up in our authenticate response; every frame it sends after this one is compressed
+            if( !m_compressor || m_bInflating || tokens.size() < 3 || 0 != tokens[2].compare(FrameCompressor::NAME) ) {
+                DR_LOG(log_error) << "Client::processClientMessage - compress request without compression having been negotiated: " << msg ;
+                createResponseMsg( tokens[0], msgResponse, false, "compression not negotiated" ) ;
+                return false ;
+            }
+            m_bInflating = true ;
+            createResponseMsg( tokens[0], msgResponse ) ;
+        }
         else if( 0 == tokens[1].compare("authenticate")) {
-            string secret = tokens[2] ;
+            string secret(tokens[2]) ;
             if (tokens.size() > 3) {
-                string tags = tokens[3];
+                string tags(tokens[3]);
                 vector<string> strs;
                 boost::split(strs, tags, boost::is_any_of(","));
                 for (vector<string>::iterator it = strs.begin(); it != strs.end(); ++it) {
@@ -156,6 +244,18 @@ namespace drachtio {
                 }
                 DR_LOG(log_debug) << "Client::processAuthentication - added tags " << tags ;
             }
+            if (tokens.size() > 4 && !tokens[4].empty()) {
+                // optional: the relative capacity of this client, used by the weighted client selection
+                unsigned int capacity = 0 ;
+                std::from_chars_result r = std::from_chars(tokens[4].data(), tokens[4].data() + tokens[4].size(), capacity) ;
+                if (r.ec == std::errc() && r.ptr == tokens[4].data() + tokens[4].size() && capacity > 0) {
+                    m_capacity = capacity ;
+                    DR_LOG(log_debug) << "Client::processAuthentication - advertised capacity " << capacity ;
+                }
+                else {
+                    DR_LOG(log_info) << "Client::processAuthentication - ignoring invalid capacity " << tokens[4] ;
+                }
+            }
             DR_LOG(log_debug) << "Client::processAuthentication - validating secret " << secret  ;
             if( !theOneAndOnlyController->isSecret( secret ) ) {
                 DR_LOG(log_info) << "Client::processAuthentication - secret validation failed: " << secret  ;
@@ -169,6 +269,26 @@ namespace drachtio {
                 string hostports = boost::algorithm::join(hps, ",") ;
                 string localHostports = boost::algorithm::join(local_hps, ",") ;
                 string response = hostports + "|" + DRACHTIO_VERSION + "|" + localHostports ;
+                if (tokens.size() > 5 && !m_compressor && FrameCompressor::offered(tokens[5])) {
+                    // optional: compressions the client supports; we confirm the one we will use, which takes effect after this response
+                    m_compressor = std::make_unique<FrameCompressor>() ;
+                    if (m_compressor->init()) {
+                        response += "|" ;
+                        response += FrameCompressor::NAME ;
+                        DR_LOG(log_debug) << "Client::processAuthentication - using " << FrameCompressor::NAME << " compression" ;
+                    }
+                    else {
+                        DR_LOG(log_error) << "Client::processAuthentication - unable to set up compression, continuing without it" ;
+                        m_compressor.reset() ;
+                    }
+                }
+                if (tokens.size() > 6 && !tokens[6].empty() && m_strAppName.empty()) {
+                    // optional: the name of the application; a dialog is routed to another connection of its app when the one
+                    // it was established on has gone, including a dialog restored from the dialog journal after a restart
+                    m_strAppName = string(tokens[6]) ;
+                    m_controller.addNamedService( shared_from_this(), m_strAppName ) ;
+                    DR_LOG(log_debug) << "Client::processAuthentication - client app " << m_strAppName ;
+                }
                 createResponseMsg( tokens[0], msgResponse, true, response.c_str()) ;
                 DR_LOG(log_debug) << "Client::processAuthentication - secret validated successfully: " << secret ;
                 return true ;
@@ -176,11 +296,12 @@ namespace drachtio {
         }
         else if( 0 == tokens[1].compare("sip") ) {
             bool bOK = false ;
-            string transactionId, dialogId, routeUrl ;
+            string clientMsgId, transactionId, dialogId, routeUrl ;
 
             DR_LOG(log_debug) << "Client::processMessage - got request with " << tokens.size() << " tokens"  ;
             assert(tokens.size() >= 4) ;
 
+            clientMsgId = tokens[0] ;
             transactionId = tokens[2] ;
             dialogId = tokens[3] ;
             if (tokens.size() > 4) routeUrl = tokens[4] ;
@@ -195,17 +316,17 @@ namespace drachtio {
                     createResponseMsg( tokens[0], msgResponse, false, "transaction id missing" ) ;
                     return false; 
                 }
-                m_controller.respondToSipRequest( shared_from_this(), tokens[0], transactionId, startLine, headers, body ) ;
+                m_controller.respondToSipRequest( shared_from_this(), clientMsgId, transactionId, startLine, headers, body ) ;
             }
             else if( dialogId.length() > 0 ) { 
                 //has dialog id - request within a dialog
                 DR_LOG(log_debug) << "Client::processMessage - sending a request inside a dialog (dialogId provided)"  ;
-                bOK = m_controller.sendRequestInsideDialog( shared_from_this(), tokens[0], dialogId, startLine, headers, body, transactionId ) ;
+                bOK = m_controller.sendRequestInsideDialog( shared_from_this(), clientMsgId, dialogId, startLine, headers, body, transactionId ) ;
             }
             else if( transactionId.length() > 0 ) {
                 if( 0 == startLine.find("CANCEL") ) {
                     DR_LOG(log_debug) << "Client::processMessage - sending a CANCEL request inside a transaction" ;
-                    bOK = m_controller.sendCancelRequest( shared_from_this(), tokens[0], transactionId, startLine, headers, body) ;
+                    bOK = m_controller.sendCancelRequest( shared_from_this(), clientMsgId, transactionId, startLine, headers, body) ;
                 }
                 else {
                     assert(false) ;// are there other requests within a transaction, besides CANCEL??
@@ -219,33 +340,34 @@ namespace drachtio {
                     std::shared_ptr<SipDialog> dlg ;
                     if( getDialogController()->findDialogByCallId( strCallId, dlg ) ) {
                         DR_LOG(log_debug) << "Client::processMessage - sending a request inside a dialog (call-id provided)"  ;
-                        m_controller.sendRequestInsideDialog( shared_from_this(), tokens[0], dlg->getDialogId(), startLine, headers, body, transactionId ) ;
+                        m_controller.sendRequestInsideDialog( shared_from_this(), clientMsgId, dlg->getDialogId(), startLine, headers, body, transactionId ) ;
                         return true ;
                     }
                 }
                 DR_LOG(log_debug) << "Client::processMessage - sending a request outside of a dialog"  ;
-                bOK = m_controller.sendRequestOutsideDialog( shared_from_this(), tokens[0], startLine, headers, body, transactionId, dialogId, routeUrl ) ;
+                bOK = m_controller.sendRequestOutsideDialog( shared_from_this(), clientMsgId, startLine, headers, body, transactionId, dialogId, routeUrl ) ;
              }
 
              return true ;
         }
         else if( 0 == tokens[1].compare("proxy") ) {
-            DR_LOG(log_debug) << "Client::processMessage - received proxy request " << boost::algorithm::join(tokens, ",");
+            vector<string> strTokens( tokens.begin(), tokens.end() ) ;
+            DR_LOG(log_debug) << "Client::processMessage - received proxy request " << boost::algorithm::join(strTokens, ",");
             if( tokens.size() < 4 ) {
-                DR_LOG(log_error) << "Invalid proxy request: insufficient tokens: '" <<  boost::algorithm::join(tokens, ",") ;
+                DR_LOG(log_error) << "Invalid proxy request: insufficient tokens: '" <<  boost::algorithm::join(strTokens, ",") ;
                 createResponseMsg( tokens[0], msgResponse, false, "Invalid proxy request: not enough information provided" ) ;
                 return false ;             
             }
-            string transactionId = tokens[2] ;
+            string transactionId(tokens[2]) ;
             bool recordRoute = 0 == tokens[3].compare("remainInDialog") ;
             bool fullResponse = 0 == tokens[4].compare("fullResponse") ;
             bool followRedirects = 0 == tokens[5].compare("followRedirects") ;
             bool simultaneous = 0 == tokens[6].compare("simultaneous") ;
-            string provisionalTimeout = tokens[7] ;
-            string finalTimeout = tokens[8]; 
-            vector<string> vecDestinations( tokens.begin() + 9, tokens.end() ) ;
-            m_controller.proxyRequest( shared_from_this(), tokens[0], transactionId, recordRoute, fullResponse, followRedirects, 
-                simultaneous, provisionalTimeout, finalTimeout, vecDestinations, headers ) ;
+            string provisionalTimeout(tokens[7]) ;
+            string finalTimeout(tokens[8]); 
+            vector<string> vecDestinations( strTokens.begin() + 9, strTokens.end() ) ;
+            m_controller.proxyRequest( shared_from_this(), strTokens[0], transactionId, recordRoute, fullResponse, followRedirects, 
+                simultaneous, provisionalTimeout, finalTimeout, vecDestinations, string(headers) ) ;
             return true ;
         }
         else {
@@ -257,38 +379,8 @@ namespace drachtio {
         return true ;
     }
 
-    bool BaseClient::readMessageLength(unsigned int& len) {
-        bool continueOn = true ;
-        std::array<char, 6> ch ;
-        memset( ch.data(), 0, sizeof(ch)) ;
-        unsigned int i = 0 ;
-        char c ;
-        do {
-            c = m_buffer.front() ;
-            m_buffer.pop_front() ;
-            if ('#' == c) break ;
-            if (!isdigit(c)) throw std::runtime_error("Client::readMessageLength - invalid message length specifier") ;
-            ch[i++] = c ;
-        } while(m_buffer.size() && i < 6) ;
-
-        if (6 == i) throw std::runtime_error("Client::readMessageLength - invalid message length specifier") ;
-
-        if (0 == m_buffer.size()) {
-            if('#' != c) {
-                /* the message was split in the middle of the length specifier - put them back for next time to be read in full once remainder come in */
-                for( unsigned int n = 0; n < i; n++ ) m_buffer.push_back( ch[n] ) ;
-                len = 0 ;
-                return false ;
-            }
-            continueOn = false ;
-        }
-
-        len = boost::lexical_cast<unsigned int>(ch.data()); 
-        return continueOn ;
-    }
-
-
     void BaseClient::sendSipMessageToClient( const string& transactionId, const string& dialogId, const string& rawSipMsg, const SipMsgData_t& meta ) {
+        LOOP_ACTIVITY("BaseClient::sendSipMessageToClient")
         string strUuid, s ;
         generateUuid( strUuid ) ;
         meta.toMessageFormat(s) ;
@@ -297,6 +389,7 @@ namespace drachtio {
     }
 
     void BaseClient::sendSipMessageToClient( const string& transactionId, const string& rawSipMsg, const SipMsgData_t& meta ) {
+        LOOP_ACTIVITY("BaseClient::sendSipMessageToClient")
         string strUuid, s ;
         generateUuid( strUuid ) ;
         meta.toMessageFormat(s) ;
@@ -311,7 +404,7 @@ namespace drachtio {
         strMsg += rawSipMsg;
 
         //send(strUuid + "|sip|" + s + "|" + transactionId + "||" + DR_CRLF + rawSipMsg) ;
-        send(strMsg) ;
+        send(std::move(strMsg)) ;
     }
 
     void BaseClient::sendCdrToClient( const string& rawSipMsg, const string& meta ) {
@@ -330,13 +423,78 @@ namespace drachtio {
             msg.append("|") ;
             msg.append( additionalResponseText ) ;
         }
-        send(msg) ;
+        send(std::move(msg)) ;
+    }
+
+    bool BaseClient::enqueue( string&& str ) {
+        if( m_bDeflating ) {
+            string compressed ;
+            if( !m_compressor->compress( str, compressed ) ) {
+                // the stream can not be trusted after this, so the client has to reconnect; nothing more is posted to it
+                DR_LOG(log_error) << "Client::enqueue - failed to compress message for client " << m_strRemoteAddress << ":" << m_nRemotePort ;
+                if( startClosing() ) {
+                    m_controller.leave( shared_from_this() ) ;
+                    disconnect() ;
+                }
+                return false ;
+            }
+            countCompressedBytes( true, str.length(), compressed.length() ) ;
+            str = std::move(compressed) ;
+        }
+        m_outQueue.emplace_back( std::move(str) ) ;
+        m_nQueuedBytes += m_outQueue.back().size() ;
+        checkWatermarks() ;
+        return true ;
+    }
+
+    bool BaseClient::unwrap( std::string_view frame, std::string_view& msg ) {
+        if( !m_bInflating ) {
+            msg = frame ;
+            return true ;
+        }
+        if( !m_compressor->decompress( frame, m_inflated, FrameReader::MAX_FRAME_SIZE ) ) return false ;
+        countCompressedBytes( false, m_inflated.length(), frame.length() ) ;
+        msg = m_inflated ;
+        return true ;
+    }
+
+    void BaseClient::writeComplete( const boost::system::error_code& ec, std::size_t bytes_transferred ) {
+        DR_LOG(log_debug) << "Client::writeComplete - wrote " << bytes_transferred << " bytes in " << m_nWriting << " messages: " << ec  ;
+        if( ec ) {
+            // the read side sees the same error and removes the client, nothing more will be written
+            m_outQueue.clear() ;
+            m_nWriting = m_nQueuedBytes = 0 ;
+            return ;
+        }
+        for( ; m_nWriting > 0; m_nWriting-- ) {
+            STATS_HOP_OBSERVE(hop_client_write, m_outQueue.front().m_queued)
+            m_nQueuedBytes -= m_outQueue.front().size() ;
+            m_outQueue.pop_front() ;
+        }
+        checkWatermarks() ;
     }
 
-    void BaseClient::createResponseMsg(const string& msgId, string& msg, bool ok, const char* szReason ) {
+    void BaseClient::checkWatermarks(void) {
+        size_t high = highWatermark ;
+        size_t low = std::min( lowWatermark.load(), high ) ;
+        if( !m_bCongested && high > 0 && m_nQueuedBytes > high ) {
+            m_bCongested = true ;
+            DR_LOG(log_warning) << "Client::checkWatermarks - client " << m_strRemoteAddress << ":" << m_nRemotePort << 
+                " is not keeping up, " << m_nQueuedBytes << " bytes in " << m_outQueue.size() << " messages queued for it" ;
+        }
+        else if( m_bCongested && m_nQueuedBytes <= low ) {
+            m_bCongested = false ;
+            DR_LOG(log_notice) << "Client::checkWatermarks - client " << m_strRemoteAddress << ":" << m_nRemotePort << 
+                " has drained its queue to " << m_nQueuedBytes << " bytes" ;
+        }
+    }
+
+    void BaseClient::createResponseMsg( std::string_view msgId, string& msg, bool ok, const char* szReason ) {
         string strUuid ;
         generateUuid( strUuid ) ;
-        msg = strUuid + "|response|" + msgId + "|" ;
+        msg = strUuid + "|response|" ;
+        msg.append( msgId ) ;
+        msg.append( "|" ) ;
         msg.append( ok ? "OK" : "NO") ;
         if( szReason ) {
             msg.append("|") ;
@@ -348,62 +506,54 @@ namespace drachtio {
 
     template<typename T, typename S>
     void Client<T,S>::read_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) {
+        LOOP_ACTIVITY("Client::read_handler")
 
         if( ec ) {
             DR_LOG(log_debug) << "Client::read_handler - bouncing client due to error reading: " << ec ;
             m_controller.leave( shared_from_this() ) ;
             return ;
         }
+        auto tRead = std::chrono::steady_clock::now() ;
 
-        //DR_LOG(log_debug) << "Client::read_handler read raw message of " << bytes_transferred << " bytes: " << std::string(m_readBuf.begin(), m_readBuf.begin() + bytes_transferred) << endl ;
-
-        /* append the data to our in-process buffer */
-        m_buffer.insert( m_buffer.end(), m_readBuf.begin(),  m_readBuf.begin() + bytes_transferred ) ;
-
-        /* if we're starting a new message, parse the message length */
-        if( 0 == m_nMessageLength ) {
+        //DR_LOG(log_debug) << "Client::read_handler read " << bytes_transferred << " bytes" ;
+        m_reader.commit( bytes_transferred ) ;
 
+        /* process each complete message in place; the views are valid until the next read is posted */
+        for(;;) {
+            std::string_view frame, in ;
             try {
-                if( !readMessageLength( m_nMessageLength ) ) {
-                    DR_LOG(log_debug) << "Client::read_handler - message was split after message length of " << m_nMessageLength  ;                     
-                    goto read_again ;
-                }
+                if( !m_reader.next( frame ) ) break ;
             }
             catch( std::runtime_error& err ) {
-                DR_LOG(log_error) << "Client::read_handler client sent invalid message -- JSON message length not specified properly"  ;                     
+                DR_LOG(log_error) << "Client::read_handler client sent invalid message -- message length not specified properly"  ;                     
+                m_controller.leave( shared_from_this() ) ;               
+                return ;
+            }
+            if( !unwrap( frame, in ) ) {
+                DR_LOG(log_error) << "Client::read_handler client sent a compressed message that could not be inflated"  ;                     
                 m_controller.leave( shared_from_this() ) ;               
                 return ;
             }
-        }
 
-        /* while we have at least one full message, process it */
-        while( m_buffer.size() >= m_nMessageLength && m_nMessageLength > 0 ) {
             string msgResponse ;
-            string in ;
             bool bContinue = true ;
             try {
-                in.assign(m_buffer.begin(), m_buffer.begin() + m_nMessageLength);
                 DR_LOG(log_debug) << "Client::read_handler read: " << in << endl ;
                 bContinue = processClientMessage( in, msgResponse ) ;
+                STATS_HOP_OBSERVE(hop_client_dispatch, tRead)
             } catch( std::runtime_error& err ) {
-                DR_LOG(log_error) << "Client::read_handler - Error processing client message: " << std::string( m_buffer.begin(), m_buffer.begin() + m_nMessageLength ) << " : " << err.what()  ;
+                DR_LOG(log_error) << "Client::read_handler - Error processing client message: " << in << " : " << err.what()  ;
                 m_controller.leave( shared_from_this() ) ;
                 return ;
             }
 
             /* send response if indicated */
             if( !msgResponse.empty() ) {
-                int len = std::size(msgResponse);
-                auto forthelifeofsend = std::make_shared<std::string>(
-                    std::to_string(len) + std::string("#") + msgResponse
-                );
-
-                auto self(shared_from_this());
-                DR_LOG(log_debug) << "Sending response: " << *forthelifeofsend << endl ;
-                boost::asio::async_write( m_sock, boost::asio::buffer( *forthelifeofsend ), 
-                    [self, forthelifeofsend](const boost::system::error_code& ec, std::size_t bytes_transferred) {
-                        DR_LOG(log_debug) << "Client::read_handler - wrote " << bytes_transferred << " bytes: " << ec  ;
-                    } );
+                send( std::move(msgResponse) ) ;
+            }
+            if( m_compressor && !m_bDeflating ) {
+                // the authenticate response has gone out as is; everything we send after it is compressed
+                m_bDeflating = true ;
             }
             if( !bContinue ) {
                  DR_LOG(log_error) << "Client::read_handler - disconnecting client due to error processing client message" ;
@@ -414,33 +564,13 @@ namespace drachtio {
             if( this->isOutbound() && string::npos != in.find("|authenticate|")) {
               m_controller.outboundReady( shared_from_this(), m_transactionId ) ;
             }
-
-
-            /* reload for next message */
-            m_buffer.erase_begin( m_nMessageLength ) ;
-            if( m_buffer.size() ) {
-                DR_LOG(log_debug) << "Client::read_handler processing follow-on message in read buffer, remaining bytes to process: " << m_buffer.size()  ;
-                try {
-                    if( !readMessageLength( m_nMessageLength ) ) {
-                        DR_LOG(log_debug) << "Client::read_handler - message was split after message length of " << m_nMessageLength  ;                     
-                        break ;
-                    }
-                }
-                catch( std::runtime_error& err ) {
-                    DR_LOG(log_error) << "Client::read_handler client sent invalid message -- message length not specified properly"  ;                     
-                    m_controller.leave( shared_from_this() ) ;               
-                    return ;
-                }
-                DR_LOG(log_debug) << "Client::read_handler follow-on message length of " << m_nMessageLength << " bytes "  ; 
-            }
-            else {
-                m_nMessageLength = 0 ;
-            }
+        }
+        if( m_reader.pending() ) {
+            DR_LOG(log_debug) << "Client::read_handler - message was split, " << m_reader.pending() << " bytes waiting for the remainder" ;
         }
 
-read_again:
-        m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-            std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ;
+        m_sock.async_read_some(readBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
        
     }
 
@@ -450,24 +580,57 @@ read_again:
     }
 
     template<typename T, typename S>
-    void Client<T,S>::send( const string& str ) {
-        int len = std::size(str);
-
-        if (0 == len) {
+    void Client<T,S>::send( string str ) {
+        if (str.empty()) {
             DR_LOG(log_info) << "Client::send - we are unable to send this message back to client" << str; 
             return;
         }
 
-        auto forthelifeofsend = std::make_shared<std::string>(
-            std::to_string(len) + std::string("#") + str
-        );
+        DR_LOG(log_debug) << "Sending: " << str.length() << "#" << str << endl ;
+        if( !enqueue( std::move(str) ) ) return ;
+
+        // only one write is ever outstanding; anything queued while it is in flight goes out in the next one
+        if( 0 == m_nWriting ) startWrite() ;
+    }
+
+    template<typename T, typename S>
+    void Client<T,S>::startWrite(void) {
+        std::vector<boost::asio::const_buffer> buffers ;
+        m_nWriting = std::min( m_outQueue.size(), MAX_FRAMES_PER_WRITE ) ;
+        buffers.reserve( 2 * m_nWriting ) ;
+        for( size_t i = 0; i < m_nWriting; i++ ) {
+            const OutboundFrame& frame = m_outQueue[i] ;
+            buffers.push_back( boost::asio::buffer( frame.m_header.data(), frame.m_headerLen ) ) ;
+            buffers.push_back( boost::asio::buffer( frame.m_payload ) ) ;
+        }
 
+        // deque::push_back does not move existing elements, so the buffers stay valid while more frames are queued
         auto self(shared_from_this());
-        DR_LOG(log_debug) << "Sending: " << *forthelifeofsend << endl ;
-        boost::asio::async_write( m_sock, boost::asio::buffer( *forthelifeofsend ), 
-            [self, forthelifeofsend](const boost::system::error_code& ec, std::size_t bytes_transferred) {
-                DR_LOG(log_debug) << "Client::send - wrote " << bytes_transferred << " bytes: " << ec  ;
-            } );
+        auto handler = [self, this](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+            writeComplete( ec, bytes_transferred ) ;
+            if( 0 == m_nWriting && !m_outQueue.empty() ) startWrite() ;
+        } ;
+
+        if constexpr (std::is_same<T, ssl_socket_t>::value) {
+            m_writeBuf.clear() ;
+            for( const auto& b : buffers ) m_writeBuf.append( static_cast<const char*>(b.data()), b.size() ) ;
+            boost::asio::async_write( m_sock, boost::asio::buffer( m_writeBuf ), boost::asio::bind_executor( m_strand, handler ) ) ;
+        }
+        else {
+            boost::asio::async_write( m_sock, buffers, boost::asio::bind_executor( m_strand, handler ) ) ;
+        }
+    }
+
+    template<typename T, typename S>
+    void Client<T,S>::disconnect(void) {
+        DR_LOG(log_info) << "Client::disconnect - closing connection to " << m_strRemoteAddress << ":" << m_nRemotePort ;
+        boost::system::error_code ec ;
+        if constexpr (std::is_same<T, ssl_socket_t>::value) {
+            m_sock.lowest_layer().close( ec ) ;
+        }
+        else {
+            m_sock.close( ec ) ;
+        }
     }
 
     // Client (member function specializations for plain tcp connections)
@@ -498,8 +661,8 @@ read_again:
         setTcpKeepAlive(m_sock.native_handle());
 
         m_controller.join( shared_from_this() ) ;
-        m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-            std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ;
+        m_sock.async_read_some(readBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
     }
 
     template<>
@@ -509,12 +672,14 @@ read_again:
         tcp::resolver::iterator endpointIterator = resolver.resolve(query);
         tcp::endpoint endpoint = *endpointIterator;
 
-        m_sock.async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
+        m_sock.async_connect(endpoint, boost::asio::bind_executor(m_strand, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator)));
     }
 
     template<>
     void Client<socket_t>::connect_handler(const boost::system::error_code& ec, tcp::resolver::iterator endpointIterator) {
         if( !ec ) {
+            m_strRemoteAddress = m_sock.remote_endpoint().address().to_string();
+            m_nRemotePort = m_sock.remote_endpoint().port();
             DR_LOG(log_debug) << "Client::connect_handler tcp - successfully connected to " <<
             endpoint_address() << ":" << endpoint_port() ;
 
@@ -522,9 +687,9 @@ read_again:
 
         setTcpKeepAlive(m_sock.native_handle());
 
-        m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-            std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, 
-            std::placeholders::_2 ) ) ;
+        m_sock.async_read_some(readBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, 
+            std::placeholders::_2 ) ) ) ;
 
         //TODO: set a timeout of 2 secs or so for remote side to authenticate
 
@@ -534,7 +699,7 @@ read_again:
             endpoint_address() << ":" << endpoint_port() ;
             m_sock.close() ;
             tcp::endpoint endpoint = *endpointIterator;
-            m_sock.async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
+            m_sock.async_connect(endpoint, boost::asio::bind_executor(m_strand, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator)));
         }
         else {
             // final failure
@@ -569,8 +734,8 @@ read_again:
         setTcpKeepAlive(m_sock.lowest_layer().native_handle());
 
         m_sock.async_handshake(boost::asio::ssl::stream_base::server,
-            std::bind(&BaseClient::handle_handshake, shared_from_this(),
-            std::placeholders::_1));
+            boost::asio::bind_executor(m_strand, std::bind(&BaseClient::handle_handshake, shared_from_this(),
+            std::placeholders::_1)));
     }
 
     template<>
@@ -580,24 +745,25 @@ read_again:
         tcp::resolver::iterator endpointIterator = resolver.resolve(query);
         tcp::endpoint endpoint = *endpointIterator;
 
-        m_sock.lowest_layer().async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
+        m_sock.lowest_layer().async_connect(endpoint, boost::asio::bind_executor(m_strand, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator)));
     }
 
     template<>
     void Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::connect_handler(const boost::system::error_code& ec, tcp::resolver::iterator endpointIterator) {
         if( !ec ) {
-            DR_LOG(log_debug) << "Client::connect_handler tls - successfully connected to " << m_sock.lowest_layer().remote_endpoint().address().to_string() << 
-                ":" << m_sock.lowest_layer().remote_endpoint().port() ;
+            m_strRemoteAddress = m_sock.lowest_layer().remote_endpoint().address().to_string();
+            m_nRemotePort = m_sock.lowest_layer().remote_endpoint().port();
+            DR_LOG(log_debug) << "Client::connect_handler tls - successfully connected to " << m_strRemoteAddress << ":" << m_nRemotePort ;
 
             m_controller.join( shared_from_this() ) ;
-            m_sock.async_handshake(boost::asio::ssl::stream_base::client, std::bind(&BaseClient::handle_handshake, shared_from_this(), std::placeholders::_1));
+            m_sock.async_handshake(boost::asio::ssl::stream_base::client, boost::asio::bind_executor(m_strand, std::bind(&BaseClient::handle_handshake, shared_from_this(), std::placeholders::_1)));
         }
         else if( endpointIterator != tcp::resolver::iterator() ) {
             DR_LOG(log_debug) << "Client::connect_handler tls - failed to connect to "  << m_sock.lowest_layer().remote_endpoint().address().to_string() << 
                 ":" << m_sock.lowest_layer().remote_endpoint().port() ;
             m_sock.lowest_layer().close() ;
             tcp::endpoint endpoint = *endpointIterator;
-            m_sock.lowest_layer().async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
+            m_sock.lowest_layer().async_connect(endpoint, boost::asio::bind_executor(m_strand, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator)));
         }
         else {
             // final failure
@@ -610,8 +776,8 @@ read_again:
     void Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::handle_handshake(const boost::system::error_code& ec) {
         if (!ec) {
             DR_LOG(log_debug) << "Client::handle_handshake - TLS handshake succeeded ";
-            m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-                std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ;
+            m_sock.async_read_some(readBuffer(),
+                boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
         }
         else {
             m_controller.leave( shared_from_this() ) ;
@@ -622,4 +788,41 @@ read_again:
     void Client<socket_t>::handle_handshake(const boost::system::error_code& ec) {
         assert(0);
     }
+
+    // Client (member function specializations for unix domain socket connections, which are inbound only)
+
+    template<>
+    Client<local_socket_t>::Client(boost::asio::io_context& io_context, ClientController& controller) :
+        BaseClient(controller),
+        m_sock(io_context) {
+    }
+
+    template<>
+    void Client<local_socket_t>::start() {
+
+        // peers on a unix socket are normally unnamed, so we identify them by the path they connected to
+        m_strRemoteAddress = "unix:" + m_sock.local_endpoint().path();
+        m_nRemotePort = 0;
+
+        DR_LOG(log_debug) << "Client::start - Received connection from client at " << m_strRemoteAddress ;
+
+        m_controller.join( shared_from_this() ) ;
+        m_sock.async_read_some(readBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
+    }
+
+    template<>
+    void Client<local_socket_t>::async_connect() {
+        assert(0);
+    }
+
+    template<>
+    void Client<local_socket_t>::connect_handler(const boost::system::error_code& ec, tcp::resolver::iterator endpointIterator) {
+        assert(0);
+    }
+
+    template<>
+    void Client<local_socket_t>::handle_handshake(const boost::system::error_code& ec) {
+        assert(0);
+    }
 }
@@ -25,18 +25,27 @@ THE SOFTWARE.
 #include <unordered_map>
 #include <unordered_set>
 #include <array>
+#include <deque>
+#include <atomic>
+#include <chrono>
 #include <thread>
+#include <mutex>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
-#include <boost/circular_buffer.hpp>
 
 #include <time.h>
 
+#include "client-framing.hpp"
+#include "client-compression.hpp"
+
 namespace drachtio {
 
     typedef boost::asio::ip::tcp::socket socket_t;
     typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket_t;
+    typedef boost::asio::local::stream_protocol::socket local_socket_t;
+    typedef boost::asio::strand<boost::asio::io_context::executor_type> strand_t;
 
 	class ClientController ;
 
@@ -49,6 +58,9 @@ namespace drachtio {
             const string& transactionId, const string& host, const string& port);
         ~BaseClient();
 
+        // every handler touching this client runs on its strand, so a client is never used by two io threads at once
+        strand_t& getStrand(void) { return m_strand; }
+
         const string& endpoint_address() const { return m_strRemoteAddress;}
         const unsigned short endpoint_port() const { return m_nRemotePort;}
         
@@ -62,7 +74,7 @@ namespace drachtio {
         virtual void handle_handshake(const boost::system::error_code& ec) = 0;
 
 
-        bool processClientMessage( const string& msg, string& msgResponse ) ;
+        bool processClientMessage( std::string_view msg, string& msgResponse ) ;
         void sendSipMessageToClient( const string& transactionId, const string& dialogId, const string& rawSipMsg, const SipMsgData_t& meta ) ;
         void sendSipMessageToClient( const string& transactionId, const string& rawSipMsg, const SipMsgData_t& meta ) ;
         void sendCdrToClient( const string& rawSipMsg, const string& meta ) ;
@@ -72,29 +84,123 @@ namespace drachtio {
         bool isOutbound(void) const { return !m_transactionId.empty(); }
         bool hasTag(const char* tag) const { return m_tags.find(tag) != m_tags.end(); }
 
+        uint64_t getConnectionId(void) const { return m_connectionId; }
+
         int getConnectionDuration(void) const { 
             return time(NULL) - m_tConnect; 
         }
+
+        // bytes queued for this client that have not yet been written to the socket
+        size_t getQueuedBytes(void) const { return m_nQueuedBytes; }
+
+        // false from the time the outbound queue passes the high watermark until it drains below the low watermark; read 
+        // from the sip thread, which passes the client over for new requests meanwhile unless the backlog policy is shed
+        bool isWritable(void) const { return !m_bCongested; }
+
+        // bytes handed to this client that are not yet written to its socket: messages posted to its strand and not 
+        // yet serialized, plus the outbound queue; read from the sip thread to keep a stalled client from piling up memory
+        size_t getBacklog(void) const { return m_nPostedBytes + m_nQueuedBytes; }
+        bool isOverBacklogLimit(void) const { size_t limit = backlogLimit; return limit > 0 && getBacklog() > limit; }
+        void posted( size_t bytes ) { m_nPostedBytes += bytes; }
+        void unposted( size_t bytes ) { m_nPostedBytes -= bytes; }
+
+        // the connection is being closed and nothing more is to be sent on it; startClosing is true for the first caller only
+        bool startClosing(void) { return !m_bClosing.exchange(true); }
+        bool isClosing(void) const { return m_bClosing; }
+
+        // close the socket, which the read side sees as the client leaving; runs on the strand
+        virtual void disconnect() = 0;
+
+        // reverse index of the ClientController map entries this client owns, so that leaving releases just those
+        enum owned_map_t {
+            owned_dialog = 0,
+            owned_app_transaction,
+            owned_net_transaction,
+            owned_api_request,
+            owned_map_count
+        } ;
+        typedef std::array<std::vector<string>, owned_map_count> owned_ids_t ;
+
+        // returns false, and does not record the id, once the client has left
+        bool own( owned_map_t map, const string& id ) ;
+        void disown( owned_map_t map, const string& id ) ;
+        bool hasLeft(void) const { return m_bLeft; }
+
+        // marks the client as having left and hands back everything it owned; false if it had already left
+        bool releaseOwned( owned_ids_t& ids ) ;
+
+        // load signals for picking a client for a new request: requests we have routed to it that are not yet 
+        // complete, how long it has lately been taking to answer them, and the capacity it advertised, if any
+        size_t getOutstanding(void) const { return m_nOutstanding; }
+        double getResponseLatency(void) const { return m_responseLatency; }
+        unsigned int getCapacity(void) const { return m_capacity; }
+
+        // the client has sent a response for a request we routed to it; the first one is its response latency
+        void responded( const string& transactionId ) ;
+
+        static void setSendHighWatermark( size_t bytes ) { highWatermark = bytes; }
+        static void setSendLowWatermark( size_t bytes ) { lowWatermark = bytes; }
+        static size_t getSendHighWatermark(void) { return highWatermark; }
+        static size_t getSendLowWatermark(void) { return lowWatermark; }
+        static void setBacklogLimit( size_t bytes ) { backlogLimit = bytes; }
+        static size_t getBacklogLimit(void) { return backlogLimit; }
+
     protected:
-        virtual void send( const string& str ) = 0 ;  
+        // queues a message, which is framed with its length prefix when it is written
+        virtual void send( string str ) = 0 ;  
+
+        // a message waiting in the outbound queue; the length prefix is kept apart so the payload is never copied
+        struct OutboundFrame {
+            OutboundFrame( string&& str ) ;
+
+            std::array<char, 12> m_header ;
+            uint8_t m_headerLen ;
+            string m_payload ;
+            std::chrono::steady_clock::time_point m_queued ;
+
+            size_t size(void) const { return m_headerLen + m_payload.length(); }
+        } ;
+
+        // max frames gathered into a single write
+        static constexpr size_t MAX_FRAMES_PER_WRITE = 64 ;
+
+        // false if the message could not be queued, in which case the client is being disconnected
+        bool enqueue( string&& str ) ;
+
+        // the message carried in a frame read from the client, which is inflated into m_inflated when inflating
+        bool unwrap( std::string_view frame, std::string_view& msg ) ;
+        void writeComplete( const boost::system::error_code& ec, std::size_t bytes_transferred ) ;
+        void checkWatermarks(void) ;
 
         enum state {
             initial = 0,
             authenticated,
         } ;
     
-        bool readMessageLength( unsigned int& len ) ;
-        void createResponseMsg( const string& msgId, string& msg, bool ok = true, const char* szReason = NULL ) ;
+        // space for the next read from the socket
+        boost::asio::mutable_buffer readBuffer(void) {
+            size_t size ;
+            char* p = m_reader.prepare( size ) ;
+            return boost::asio::buffer( p, size ) ;
+        }
+
+        void createResponseMsg( std::string_view msgId, string& msg, bool ok = true, const char* szReason = NULL ) ;
         std::shared_ptr<SipDialogController> getDialogController(void);
 
         ClientController& m_controller ;
+        strand_t m_strand ;
         state m_state ;
 
-        std::array<char, 8192> m_readBuf ;
-        boost::circular_buffer<char> m_buffer ;
-        unsigned int m_nMessageLength ;
+        FrameReader m_reader ;
         string m_strAppName ;
 
+        // set up when the client asks for compression at authenticate time; what we send is compressed from the
+        // first message after our response to the authenticate request, what the client sends once it says so
+        std::unique_ptr<FrameCompressor> m_compressor ;
+        bool m_bDeflating ;
+        bool m_bInflating ;
+        string m_inflated ;     // the message in the frame being processed, when inflating
+
         typedef std::unordered_set<string> set_of_tags ;
         set_of_tags m_tags;
 
@@ -107,6 +213,35 @@ namespace drachtio {
         unsigned int m_nRemotePort;
 
         time_t m_tConnect ;
+
+        // unique for the life of the process, unlike the remote address
+        const uint64_t m_connectionId ;
+
+        // outbound queue: frames [0, m_nWriting) are the ones owned by the write in progress
+        std::deque<OutboundFrame> m_outQueue ;
+        size_t m_nWriting ;
+        std::atomic<size_t> m_nQueuedBytes ;
+        std::atomic<bool> m_bCongested ;
+        std::atomic<size_t> m_nPostedBytes ;
+        std::atomic<bool> m_bClosing ;
+
+        // owned ids are added and removed from the sip thread as well as our own strand; net transactions
+        // are kept with the time they were routed to us until they are first answered
+        std::mutex m_ownedLock ;
+        std::array<std::unordered_map<string, std::chrono::steady_clock::time_point>, owned_map_count> m_owned ;
+        std::atomic<bool> m_bLeft ;
+
+        std::atomic<size_t> m_nOutstanding ;
+        std::atomic<double> m_responseLatency ;   // seconds, moving average; 0 until the first response
+        std::atomic<unsigned int> m_capacity ;
+
+        // weight of the newest sample in the response latency average
+        static constexpr double RESPONSE_LATENCY_ALPHA = 0.2 ;
+
+        static std::atomic<size_t> highWatermark ;
+        static std::atomic<size_t> lowWatermark ;
+        static std::atomic<size_t> backlogLimit ;
+        static std::atomic<uint64_t> lastConnectionId ;
     };
 
 	template <typename T, typename S = T> 
@@ -131,14 +266,19 @@ namespace drachtio {
         void handle_handshake(const boost::system::error_code& ec);
 
         void start(); 
+        void disconnect();
 
         T& socket() { return m_sock; }
 
     protected:
-        void send( const string& str );  
+        void send( string str );  
+        void startWrite(void) ;
 
         T m_sock;
 
+        // tls only: frames are flattened here, since the ssl stream writes one buffer per record
+        string m_writeBuf ;
+
     private:
         Client();  // prohibited
 
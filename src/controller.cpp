@@ -113,8 +113,12 @@ namespace {
         return ;
     }
     void watchdogTimerHandler(su_root_magic_t *p, su_timer_t *timer, su_timer_arg_t *arg) {
+        LOOP_ACTIVITY("processWatchdogTimer")
         theOneAndOnlyController->processWatchdogTimer() ;
     }
+    void lagProbeTimerHandler(su_root_magic_t *p, su_timer_t *timer, su_timer_arg_t *arg) {
+        theOneAndOnlyController->processLagProbe() ;
+    }
             
 	/* sofia logging is redirected to this function */
 	static void __sofiasip_logger_func(void *logarg, char const *fmt, va_list ap) {
@@ -178,14 +182,16 @@ namespace {
                         nta_incoming_t* irq,
                         sip_t const *sip) {
         
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", sip->sip_request->rq_method_name}})
+        LOOP_ACTIVITY("processRequestInsideDialog")
+        STATS_SIP_REQUEST_IN(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
         return controller->processRequestInsideDialog( leg, irq, sip ) ;
     }
     int stateless_callback(nta_agent_magic_t *controller,
                     nta_agent_t *agent,
                     msg_t *msg,
                     sip_t *sip) {
-        if( sip && sip->sip_request ) STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", sip->sip_request->rq_method_name}})
+        LOOP_ACTIVITY("processMessageStatelessly")
+        if( sip && sip->sip_request ) STATS_SIP_REQUEST_IN(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
         return controller->processMessageStatelessly( msg, sip ) ;
     }
 
@@ -287,13 +293,14 @@ namespace drachtio {
     }
  
     DrachtioController::DrachtioController( int argc, char* argv[] ) : m_bDaemonize(false), m_bLoggingInitialized(false),
-        m_configFilename(DEFAULT_CONFIG_FILENAME), m_adminTcpPort(0), m_adminTlsPort(0), m_bNoConfig(false), 
+        m_configFilename(DEFAULT_CONFIG_FILENAME), m_adminTcpPort(0), m_adminTlsPort(0), m_adminLocalSocketMode(0), m_bNoConfig(false), 
         m_current_severity_threshold(log_none), m_nSofiaLoglevel(-1), m_bIsOutbound(false), m_bConsoleLogging(false),
-        m_nHomerPort(0), m_nHomerId(0), m_mtu(0), m_bAggressiveNatDetection(false), m_bMemoryDebug(false),
-        m_nPrometheusPort(0), m_strPrometheusAddress("0.0.0.0"), m_tcpKeepaliveSecs(UINT16_MAX), m_tportQueuesize(64),
+        m_nHomerPort(0), m_nHomerId(0), m_mtu(0), m_bAggressiveNatDetection(false), m_bMemoryDebug(false), m_bDialogMemoryReport(false),
+        m_nPrometheusPort(0), m_strPrometheusAddress("0.0.0.0"), m_tcpKeepaliveSecs(UINT16_MAX), m_clientThreads(1), m_clientSelection(client_selection_round_robin), m_clientBacklogPolicy(client_backlog_avoid), m_tportQueuesize(64),
         m_tportMaxConsecutiveTimeouts(0), m_bDumpMemory(false),
         m_minTlsVersion(0), m_bDisableNatDetection(false), m_pBlacklist(nullptr), m_bAlwaysSend180(false),
-        m_bGloballyReadableLogs(false), m_bTlsVerifyClientCert(false), m_bRejectRegisterWithNoRealm(false) {
+        m_bGloballyReadableLogs(false), m_bTlsVerifyClientCert(false), m_bRejectRegisterWithNoRealm(false),
+        m_lagTimer(nullptr), m_sipLoopMonitor("sip") {
 
         getEnv();
 
@@ -463,6 +470,21 @@ namespace drachtio {
                 {"blacklist-redis-master", required_argument, 0, 'W'},
                 {"blacklist-redis-password", required_argument, 0, 'X'},
                 {"tls-cipherlist", required_argument, 0, 0},
+                {"timer-queue", required_argument, 0, 0},
+                {"timer-slack", required_argument, 0, 0},
+                {"timer-coalesce", required_argument, 0, 0},
+                {"event-loop-lag-threshold", required_argument, 0, 0},
+                {"client-send-high-watermark", required_argument, 0, 0},
+                {"client-send-low-watermark", required_argument, 0, 0},
+                {"client-threads", required_argument, 0, 0},
+                {"client-selection", required_argument, 0, 0},
+                {"client-backlog-limit", required_argument, 0, 0},
+                {"client-backlog-policy", required_argument, 0, 0},
+                {"admin-local-socket", required_argument, 0, 0},
+                {"admin-local-socket-mode", required_argument, 0, 0},
+                {"dialog-journal", required_argument, 0, 0},
+                {"dialog-memory-report", no_argument, 0, 0},
+                {"dialog-remote-sdp", no_argument, 0, 0},
                 {"version",    no_argument, 0, 'v'},
                 {0, 0, 0, 0}
             };
@@ -483,6 +505,80 @@ namespace drachtio {
                       m_tlsCipherList = optarg;
                       break;
                     }
+                    if (strcmp(long_options[option_index].name, "timer-queue") == 0) {
+                      if( 0 == strcmp(optarg, "list") ) m_timerSettings.m_type = timer_queue_list ;
+                      else if( 0 == strcmp(optarg, "wheel") ) m_timerSettings.m_type = timer_queue_wheel ;
+                      else {
+                        cerr << "Invalid timer-queue '" << optarg << "': valid choices are list, wheel" << endl ; 
+                        return false ;
+                      }
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "timer-slack") == 0) {
+                      m_timerSettings.m_slackMsecs = ::atoi(optarg) > 0 ? std::min(::atoi(optarg), 100) : 0 ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "timer-coalesce") == 0) {
+                      if( !m_timerSettings.parseCoalescing(optarg) ) {
+                        cerr << "Invalid timer-coalesce '" << optarg << "': expected a list like D=100,K=100 (classes: A-K, general, provisional)" << endl ; 
+                        return false ;
+                      }
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "event-loop-lag-threshold") == 0) {
+                      LoopMonitor::setThreshold(::atoi(optarg) > 0 ? ::atoi(optarg) : 0) ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "client-send-high-watermark") == 0) {
+                      BaseClient::setSendHighWatermark(::atol(optarg) > 0 ? ::atol(optarg) : 0) ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "client-send-low-watermark") == 0) {
+                      BaseClient::setSendLowWatermark(::atol(optarg) > 0 ? ::atol(optarg) : 0) ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "client-threads") == 0) {
+                      m_clientThreads = std::min(std::max(::atoi(optarg), 1), 64) ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "client-selection") == 0) {
+                      if( !ClientController::parseSelection(optarg, m_clientSelection) ) {
+                        cerr << "Invalid client-selection '" << optarg << "': valid choices are round-robin, least-outstanding, least-latency, weighted" << endl ; 
+                        return false ;
+                      }
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "client-backlog-limit") == 0) {
+                      BaseClient::setBacklogLimit(::atol(optarg) > 0 ? ::atol(optarg) : 0) ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "client-backlog-policy") == 0) {
+                      if( !ClientController::parseBacklogPolicy(optarg, m_clientBacklogPolicy) ) {
+                        cerr << "Invalid client-backlog-policy '" << optarg << "': valid choices are avoid, shed, disconnect" << endl ; 
+                        return false ;
+                      }
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "admin-local-socket") == 0) {
+                      m_adminLocalSocket = optarg ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "admin-local-socket-mode") == 0) {
+                      m_adminLocalSocketMode = ::strtoul(optarg, NULL, 8) & 0777 ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "dialog-journal") == 0) {
+                      m_dialogJournal = optarg ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "dialog-memory-report") == 0) {
+                      m_bDialogMemoryReport = true ;
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "dialog-remote-sdp") == 0) {
+                      SipDialog::setKeepRemoteSdp(true) ;
+                      break;
+                    }
                     /* If this option set a flag, do nothing else now. */
                     if (long_options[option_index].flag != 0)
                         break;
@@ -750,6 +846,8 @@ namespace drachtio {
         cerr << endl << "Start drachtio sip engine" << endl << endl ;
         cerr << "Options:" << endl << endl ;
         cerr << "    --address                          Bind to the specified address for application connections (default: 0.0.0.0)" << endl ;
+        cerr << "    --admin-local-socket               also accept application connections on a unix domain socket at this path" << endl ;
+        cerr << "    --admin-local-socket-mode          permissions for the unix domain socket, in octal (default: 0660)" << endl ;
         cerr << "    --aggressive-nat-detection         take presence of 'nat=yes' in Record-Route or Contact hdr as an indicator a remote server is behind a NAT" << endl ;
         cerr << "    --blacklist-redis-address          address of redis server that contains a set with blacklisted IPs" << endl;
         cerr << "    --blacklist-redis-port             port for redis server containing blacklisted IPs" << endl;
@@ -760,8 +858,17 @@ namespace drachtio {
         cerr << "    --daemon                           Run the process as a daemon background process" << endl ;
         cerr << "    --cert-file                        TLS certificate file" << endl ;
         cerr << "    --chain-file                       TLS certificate chain file" << endl ;
+        cerr << "    --client-send-high-watermark       bytes queued for an application before new requests go to other applications until it drains, unless --client-backlog-policy is shed (default: 4194304, 0=never)" << endl ;
+        cerr << "    --client-send-low-watermark        bytes the queue for an application over the high watermark must drain to before it is sent new requests again (default: 1048576)" << endl ;
+        cerr << "    --client-threads                   number of threads serving application connections (default: 1, max: 64)" << endl ;
+        cerr << "    --client-selection                 how new requests are shared among applications: round-robin (default), least-outstanding, least-latency, weighted" << endl ;
+        cerr << "    --client-backlog-limit             bytes that may be waiting to be written to an application before --client-backlog-policy applies (default: 0=no limit)" << endl ;
+        cerr << "    --client-backlog-policy            what to do with an application over the backlog limit: avoid (default) sends new requests elsewhere, shed rejects them with 503, disconnect closes the connection" << endl ;
         cerr << "-c, --contact                          Sip contact url to bind to (see /etc/drachtio.conf.xml for examples)" << endl ;
         cerr << "    --dh-param                         file containing Diffie-Helman parameters, required when using encrypted TLS admin connections" << endl ;
+        cerr << "    --dialog-journal                   file in which to journal stable dialogs, so that they survive a restart (default: none)" << endl ;
+        cerr << "    --dialog-memory-report             add a breakdown of the bytes held per stable dialog, by field, to each storage report" << endl ;
+        cerr << "    --dialog-remote-sdp                keep the remote sdp in each dialog (default: only the local sdp, which session refreshes resend, is kept)" << endl ;
         cerr << "    --dns-name                         specifies a DNS name that resolves to the local host, if any" << endl ;
         cerr << "-f, --file                             Path to configuration file (default /etc/drachtio.conf.xml)" << endl ;
         cerr << "    --homer                            ip:port of homer/sipcapture agent" << endl ;
@@ -778,9 +885,13 @@ namespace drachtio {
         cerr << "    --reject-register-with-no-realm    reject with a 403 any REGISTER that has an IP address in the sip uri host" << endl ;
         cerr << "    --secret                           The shared secret to use for authenticating application connections" << endl ;
         cerr << "    --sofia-loglevel                   Log level of internal sip stack (choices: 0-9)" << endl ;
+        cerr << "    --event-loop-lag-threshold         msecs an event loop may be blocked before the handler blocking it is logged (default: 250, 0=never)" << endl ;
         cerr << "    --external-ip                      External IP address to use in SIP messaging" << endl ;
         cerr << "    --stdout                           Log to standard output as well as any configured log destinations" << endl ;
         cerr << "    --tcp-keepalive-interval           tcp keepalive in seconds (0=no keepalive)" << endl ;
+        cerr << "    --timer-coalesce                   per-class msecs to round sip timer expiries up to, so they share wakeups (e.g. D=100,K=100)" << endl ;
+        cerr << "    --timer-queue                      implementation of the sip transaction timer queues (choices: list (default), wheel)" << endl ;
+        cerr << "    --timer-slack                      msecs early a sip timer may fire so it can be batched with one already due (default: 0, max: 100)" << endl ;
         cerr << "    --tls-cipherlist                   list of ciphers to support for TLS connections (default: all strong ciphers supported)" << endl ;
         cerr << "    --min-tls-version                  minimum allowed TLS version for connecting clients (default: 1.0)" << endl ;
         cerr << "    --user-agent-options-auto-respond  If we see this User-Agent header value in an OPTIONS request, automatically send 200 OK" << endl ;
@@ -793,10 +904,20 @@ namespace drachtio {
         if (p && ::atoi(p) > 0) m_adminTcpPort = ::atoi(p);
         p = std::getenv("DRACHTIO_ADMIN_TLS_PORT");
         if (p && ::atoi(p) > 0) m_adminTlsPort = ::atoi(p);
+        p = std::getenv("DRACHTIO_ADMIN_LOCAL_SOCKET");
+        if (p) m_adminLocalSocket = p;
+        p = std::getenv("DRACHTIO_ADMIN_LOCAL_SOCKET_MODE");
+        if (p) m_adminLocalSocketMode = ::strtoul(p, NULL, 8) & 0777;
         p = std::getenv("DRACHTIO_AGRESSIVE_NAT_DETECTION");
         if (p && ::atoi(p) == 1) m_bAggressiveNatDetection = true;
         p = std::getenv("DRACHTIO_MEMORY_DEBUG");
         if (p && ::atoi(p) == 1) m_bMemoryDebug = true;
+        p = std::getenv("DRACHTIO_DIALOG_JOURNAL");
+        if (p) m_dialogJournal = p;
+        p = std::getenv("DRACHTIO_DIALOG_MEMORY_REPORT");
+        if (p && ::atoi(p) == 1) m_bDialogMemoryReport = true;
+        p = std::getenv("DRACHTIO_DIALOG_REMOTE_SDP");
+        if (p && ::atoi(p) == 1) SipDialog::setKeepRemoteSdp(true);
         p = std::getenv("DRACHTIO_TLS_CERT_FILE");
         if (p) m_tlsCertFile = p;
         p = std::getenv("DRACHTIO_TLS_CHAIN_FILE");
@@ -855,6 +976,30 @@ namespace drachtio {
             if (n > 1000) n = 1000;
             m_tportMaxConsecutiveTimeouts = (unsigned int) n;
         }
+        p = std::getenv("DRACHTIO_TIMER_QUEUE");
+        if (p) {
+            if (0 == strcmp(p, "wheel")) m_timerSettings.m_type = timer_queue_wheel;
+            else if (0 == strcmp(p, "list")) m_timerSettings.m_type = timer_queue_list;
+        }
+        // slack is capped at 100ms, well under T1 (500ms), so retransmission intervals are not visibly shortened
+        p = std::getenv("DRACHTIO_TIMER_SLACK");
+        if (p && ::atoi(p) > 0) m_timerSettings.m_slackMsecs = std::min(::atoi(p), 100);
+        p = std::getenv("DRACHTIO_TIMER_COALESCE");
+        if (p) m_timerSettings.parseCoalescing(p);
+        p = std::getenv("DRACHTIO_EVENT_LOOP_LAG_THRESHOLD");
+        if (p) LoopMonitor::setThreshold(::atoi(p) > 0 ? ::atoi(p) : 0);
+        p = std::getenv("DRACHTIO_CLIENT_SEND_HIGH_WATERMARK");
+        if (p) BaseClient::setSendHighWatermark(::atol(p) > 0 ? ::atol(p) : 0);
+        p = std::getenv("DRACHTIO_CLIENT_SEND_LOW_WATERMARK");
+        if (p) BaseClient::setSendLowWatermark(::atol(p) > 0 ? ::atol(p) : 0);
+        p = std::getenv("DRACHTIO_CLIENT_THREADS");
+        if (p && ::atoi(p) > 0) m_clientThreads = std::min(::atoi(p), 64);
+        p = std::getenv("DRACHTIO_CLIENT_SELECTION");
+        if (p) ClientController::parseSelection(p, m_clientSelection);
+        p = std::getenv("DRACHTIO_CLIENT_BACKLOG_LIMIT");
+        if (p) BaseClient::setBacklogLimit(::atol(p) > 0 ? ::atol(p) : 0);
+        p = std::getenv("DRACHTIO_CLIENT_BACKLOG_POLICY");
+        if (p) ClientController::parseBacklogPolicy(p, m_clientBacklogPolicy);
         p = std::getenv("DRACHTIO_SECRET");
         if (p) m_secret = p;
         p = std::getenv("DRACHTIO_CONSOLE_LOGGING");
@@ -1135,6 +1280,11 @@ namespace drachtio {
         if (!m_adminAddress.empty()) adminAddress = m_adminAddress;
         if( 0 != m_adminTcpPort ) adminTcpPort = m_adminTcpPort ;
         if( 0 != m_adminTlsPort ) adminTlsPort = m_adminTlsPort ;
+        string adminLocalSocket ;
+        unsigned int adminLocalSocketMode ;
+        m_Config->getAdminLocalSocket(adminLocalSocket, adminLocalSocketMode) ;
+        if (!m_adminLocalSocket.empty()) adminLocalSocket = m_adminLocalSocket;
+        if( 0 != m_adminLocalSocketMode ) adminLocalSocketMode = m_adminLocalSocketMode ;
 
         if( 0 == m_vecTransports.size() ) {
             m_Config->getTransports( m_vecTransports ) ; 
@@ -1206,7 +1356,16 @@ namespace drachtio {
              DR_LOG(log_notice) << "DrachtioController::run listening for applications on tcp port " << adminTcpPort << " and tls port " << adminTlsPort ;
            m_pClientController.reset(new ClientController(this, adminAddress, adminTcpPort, adminTlsPort, tlsChainFile, tlsCertFile, tlsKeyFile, dhParam));
         }
-        m_pClientController->start();
+        if (!adminLocalSocket.empty()) {
+            if (!m_pClientController->listenLocal(adminLocalSocket, adminLocalSocketMode)) {
+                throw runtime_error("unable to listen on local socket");
+            }
+            DR_LOG(log_notice) << "DrachtioController::run listening for applications on unix socket " << adminLocalSocket << 
+                " (mode " << std::oct << adminLocalSocketMode << std::dec << ")" ;
+        }
+        m_pClientController->setSelection(m_clientSelection);
+        m_pClientController->setBacklogPolicy(m_clientBacklogPolicy);
+        m_pClientController->start(m_clientThreads);
         
         // mtu
         /*
@@ -1314,6 +1473,31 @@ namespace drachtio {
                 << m_tportMaxConsecutiveTimeouts << " consecutive request timeouts";
         }
 
+        DR_LOG(log_notice) << "sip transaction timers use a " << 
+            (timer_queue_wheel == m_timerSettings.m_type ? "hierarchical timing wheel" : "sorted list") <<
+            ", expiry slack " << m_timerSettings.m_slackMsecs << "ms";
+        for (int i = 0; i < SIP_TIMER_CLASS_COUNT; i++) {
+            if (m_timerSettings.m_coalesceMsecs[i]) {
+                DR_LOG(log_notice) << "sip " << sipTimerClassName(static_cast<SipTimerClass>(i)) << " expiries are coalesced to " << 
+                    m_timerSettings.m_coalesceMsecs[i] << "ms";
+            }
+        }
+
+        if (LoopMonitor::getThreshold()) {
+            DR_LOG(log_notice) << "event loop handlers blocking for more than " << LoopMonitor::getThreshold() << "ms will be logged";
+        }
+        if (client_selection_round_robin != m_clientSelection) {
+            DR_LOG(log_notice) << "new requests are given to applications by " << ClientController::selectionName(m_clientSelection) << " selection";
+        }
+        if (BaseClient::getSendHighWatermark()) {
+            DR_LOG(log_notice) << "applications with more than " << BaseClient::getSendHighWatermark() << " bytes queued for them are flagged as congested until below " <<
+                std::min(BaseClient::getSendLowWatermark(), BaseClient::getSendHighWatermark()) << " bytes";
+        }
+        if (BaseClient::getBacklogLimit()) {
+            DR_LOG(log_notice) << "applications with more than " << BaseClient::getBacklogLimit() << " bytes waiting to be written to them are handled by the " << 
+                ClientController::backlogPolicyName(m_clientBacklogPolicy) << " policy";
+        }
+
         int rv = su_init() ;
         if( rv < 0 ) {
             DR_LOG(log_error) << "Error calling su_init: " << rv ;
@@ -1441,6 +1625,14 @@ namespace drachtio {
             NTATAG_SIP_T1X64(t1x64),
             TAG_END()
         ) ;
+
+        /* a warm restart: rebuild the dialogs that were up when we went down, before any messages are processed */
+        if( !m_dialogJournal.empty() ) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+            size_t count = m_pDialogController->restoreDialogs( m_dialogJournal ) ;
+            DR_LOG(log_notice) << "DrachtioController::run - restored " << count << " dialogs from " << m_dialogJournal << " in " << 
+                std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count() << "ms" ;
+        }
     
         /* sofia event loop */
         DR_LOG(log_notice) << "Starting sofia event loop in main thread: " <<  std::this_thread::get_id()  ;
@@ -1448,6 +1640,13 @@ namespace drachtio {
         /* start a timer */
         m_timer = su_timer_create( su_root_task(m_root), 30000) ;
         su_timer_set_for_ever(m_timer, watchdogTimerHandler, this) ;
+
+        /* and a probe to measure how late the event loop runs */
+        m_sipLoopMonitor.bindToCurrentThread() ;
+        m_lagTimer = su_timer_create( su_root_task(m_root), LoopMonitor::PROBE_INTERVAL_MSECS) ;
+        su_timer_set_interval(m_lagTimer, lagProbeTimerHandler, this, LoopMonitor::PROBE_INTERVAL_MSECS) ;
+        m_sipLoopMonitor.armed(LoopMonitor::PROBE_INTERVAL_MSECS) ;
+        LoopMonitor::startWatchdog() ;
  
         su_root_run( m_root ) ;
         DR_LOG(log_notice) << "Sofia event loop ended"  ;
@@ -1489,7 +1688,7 @@ namespace drachtio {
             // sofia sanity check on message format
             if( sip_sanity_check(sip) < 0 ) {
                 DR_LOG(log_error) << "DrachtioController::processMessageStatelessly: invalid incoming request message; discarding call-id " << sip->sip_call_id->i_id ;
-                STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "400"}})
+                STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 400)
                 nta_msg_treply( m_nta, msg, 400, NULL, TAG_END() ) ;
                 return -1 ;
             }
@@ -1503,7 +1702,7 @@ namespace drachtio {
                 else {
                     DR_LOG(log_error) << "DrachtioController::processMessageStatelessly: discarding invalid message";
                 }
-                STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "400"}})
+                STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 400)
                 nta_msg_treply( m_nta, msg, 400, NULL, TAG_END() ) ;
                 return -1 ;
             }
@@ -1557,7 +1756,7 @@ namespace drachtio {
                                 nta_incoming_remote_host(irq) << ":" << nta_incoming_remote_port(irq)  << 
                                 " due to header value: " << err.what()  ;
                         }
-                        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "603"}})
+                        STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 603)
                         nta_incoming_treply( irq, 603, "Decline", TAG_END() ) ;
                         nta_incoming_destroy(irq) ;   
 
@@ -1605,7 +1804,7 @@ namespace drachtio {
                         std::regex ipRegex("^(?:[0-9]{1,3}\\.){3}[0-9]{1,3}$");
                         if (std::regex_match(sip->sip_request->rq_url->url_host, ipRegex)) {
                             DR_LOG(log_info) << "DrachtioController::processMessageStatelessly: rejecting REGISTER with no realm" ;
-                            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", "REGISTER"},{"code", "403"}})
+                            STATS_SIP_RESPONSE_OUT(sip_method_register, "REGISTER", 403)
                             nta_msg_treply( m_nta, msg, 403, NULL, TAG_END() ) ;
                             return -1 ;
                         }
@@ -1614,7 +1813,7 @@ namespace drachtio {
                     /* reject register with invalid Contact header */
                     if (sip->sip_contact && !sip->sip_contact->m_url[0].url_scheme) {
                         DR_LOG(log_info) << "DrachtioController::processMessageStatelessly: rejecting REGISTER with invalid Contact header, call-id: " << sip->sip_call_id->i_id ;
-                        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", "REGISTER"},{"code", "400"}})
+                        STATS_SIP_RESPONSE_OUT(sip_method_register, "REGISTER", 400)
                         nta_msg_treply( m_nta, msg, 400, NULL, TAG_END() ) ;
                         return -1 ;
                     }
@@ -1623,7 +1822,7 @@ namespace drachtio {
                     if (sip->sip_contact && 0 == strcmp(sip->sip_contact->m_url[0].url_scheme, "*") &&
                         sip->sip_expires && sip->sip_expires->ex_delta != 0) {
                         DR_LOG(log_info) << "DrachtioController::processMessageStatelessly: rejecting REGISTER with Contact: * and non-zero Expires" ;
-                        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", "REGISTER"},{"code", "400"}})
+                        STATS_SIP_RESPONSE_OUT(sip_method_register, "REGISTER", 400)
                         nta_msg_treply( m_nta, msg, 400, NULL, TAG_END() ) ;
                         return -1 ;
                     }
@@ -1726,17 +1925,17 @@ namespace drachtio {
                             client_ptr client = m_pClientController->findClientForNetTransaction(p->getTransactionId()); 
                             if(client) {
                                 void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-                                m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), encodedMessage, meta)) ;
+                                m_pClientController->postToClient( client, std::bind(fn, client, p->getTransactionId(), encodedMessage, meta), encodedMessage.length()) ;
                             }
 
-                            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "200"}})
+                            STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 200)
                             nta_msg_treply( m_nta, msg, 200, NULL, TAG_END() ) ;  
                             p->cancel() ;
-                            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", "INVITE"},{"code", "487"}})
+                            STATS_SIP_RESPONSE_OUT(sip_method_invite, "INVITE", 487)
                             nta_msg_treply( m_nta, msg_dup(p->getMsg()), 487, NULL, TAG_END() ) ;
                         }
                         else {
-                            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "481"}})
+                            STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 481)
                             nta_msg_treply( m_nta, msg, 481, NULL, TAG_END() ) ;                              
                         }
                     }
@@ -1744,7 +1943,7 @@ namespace drachtio {
                     
                     case sip_method_update:
                     case sip_method_bye:
-                        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "481"}})
+                        STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 481)
                         nta_msg_treply( m_nta, msg, 481, NULL, TAG_END() ) ;   
                         break;                           
 
@@ -2363,6 +2562,12 @@ namespace drachtio {
        STATS_GAUGE_SET(STATS_GAUGE_REGISTERED_ENDPOINTS, m_mapUri2InvalidData.size());
 
     }
+    void DrachtioController::processLagProbe() {
+        m_sipLoopMonitor.fired() ;
+        su_timer_set_interval(m_lagTimer, lagProbeTimerHandler, this, LoopMonitor::PROBE_INTERVAL_MSECS) ;
+        m_sipLoopMonitor.armed(LoopMonitor::PROBE_INTERVAL_MSECS) ;
+    }
+
     void DrachtioController::processWatchdogTimer() {
         DR_LOG(log_debug) << "DrachtioController::processWatchdogTimer"  ;
     
@@ -2404,12 +2609,15 @@ namespace drachtio {
         STATS_COUNTER_CREATE(STATS_COUNTER_SIP_RESPONSES_IN, "count of sip responses received")
         STATS_COUNTER_CREATE(STATS_COUNTER_SIP_RESPONSES_OUT, "count of sip responses sent")
         STATS_COUNTER_CREATE(STATS_COUNTER_BUILD_INFO, "drachtio version running")
+        STATS_COUNTER_CREATE(STATS_COUNTER_CLIENT_COMPRESSION_BYTES, "bytes exchanged with applications over compressed connections, by direction and as plain or compressed")
 
         STATS_GAUGE_CREATE(STATS_GAUGE_START_TIME, "drachtio start time")
         STATS_GAUGE_CREATE(STATS_GAUGE_STABLE_DIALOGS, "count of SIP dialogs in progress")
         STATS_GAUGE_CREATE(STATS_GAUGE_PROXY, "count of proxied call setups in progress")
         STATS_GAUGE_CREATE(STATS_GAUGE_REGISTERED_ENDPOINTS, "count of registered endpoints")
         STATS_GAUGE_CREATE(STATS_GAUGE_CLIENT_APP_CONNECTIONS, "count of connections to drachtio applications")
+        STATS_GAUGE_CREATE(STATS_GAUGE_CLIENT_ORPHANED_ENTRIES, "count of dialog, transaction and api request entries still held for disconnected applications, by map")
+        STATS_GAUGE_CREATE(STATS_GAUGE_CLIENT_BACKLOG_BYTES, "bytes waiting to be written to each connected application")
 
         //sofia stats
         STATS_GAUGE_CREATE(STATS_GAUGE_SOFIA_CLIENT_HASH_SIZE, "current size of sofia hash table for client transactions")
@@ -2427,6 +2635,12 @@ namespace drachtio {
         STATS_GAUGE_CREATE(STATS_GAUGE_SOFIA_RETRANS_REQ, "count of sip requests retransmitted by sofia sip stack")
         STATS_GAUGE_CREATE(STATS_GAUGE_SOFIA_RETRANS_RES, "count of sip responses retransmitted by sofia sip stack")
 
+        //sip timer stats, labeled by owning controller and timer class
+        STATS_GAUGE_CREATE(STATS_GAUGE_SIP_TIMERS_ARMED, "count of sip timers started")
+        STATS_GAUGE_CREATE(STATS_GAUGE_SIP_TIMERS_FIRED, "count of sip timers that expired")
+        STATS_GAUGE_CREATE(STATS_GAUGE_SIP_TIMERS_CANCELLED, "count of sip timers cancelled before expiring")
+        STATS_GAUGE_CREATE(STATS_GAUGE_SIP_TIMERS_QUEUED, "count of sip timers currently pending")
+
         STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_INVITE_RESPONSE_TIME_IN, "call answer time in seconds for calls received", 
             {1.0, 3.0, 6.0, 10.0, 15.0, 20.0, 30.0, 60.0})
         STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_INVITE_RESPONSE_TIME_OUT, "call answer time in seconds for calls sent", 
@@ -2435,6 +2649,15 @@ namespace drachtio {
             {1.0, 2.0, 3.0, 5.0, 7.0, 10.0, 15.0, 20.0})
         STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_INVITE_PDD_OUT, "call post-dial delay seconds for calls received", 
             {1.0, 2.0, 3.0, 5.0, 7.0, 10.0, 15.0, 20.0})
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_TIMER_BATCH_SIZE, "count of timers fired by a single timer queue wakeup", 
+            {1.0, 2.0, 5.0, 10.0, 25.0, 50.0, 100.0, 250.0, 500.0, 1000.0})
+        STATS_GAUGE_CREATE(STATS_GAUGE_EVENT_LOOP_LAG, "seconds late the most recent event loop probe ran, by loop")
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_EVENT_LOOP_LAG, "seconds late event loop probes ran, by loop", 
+            {0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0})
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_HOP_LATENCY, "time in seconds a message spends on each internal hop between the sip, application and http threads", 
+            {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0})
+
+        m_sipMetrics.init(m_statsCollector);
 
         STATS_COUNTER_INCREMENT(STATS_COUNTER_BUILD_INFO, {{"version", DRACHTIO_VERSION}})
         STATS_GAUGE_SET_TO_CURRENT_TIME(STATS_GAUGE_START_TIME)
@@ -75,6 +75,8 @@ THE SOFTWARE.
 #include "sip-transports.hpp"
 #include "request-router.hpp"
 #include "stats-collector.hpp"
+#include "sip-metrics.hpp"
+#include "loop-monitor.hpp"
 #include "blacklist.hpp"
 
 using namespace std ;
@@ -160,6 +162,7 @@ namespace drachtio {
 
     void printStats(bool bDetail) ;
     void processWatchdogTimer(void) ;
+    void processLagProbe(void) ;
 
     const tport_t* getTportForProtocol( const string& remoteHost, const char* proto ) ;
 
@@ -176,6 +179,7 @@ namespace drachtio {
 
     RequestRouter& getRequestRouter(void) { return m_requestRouter; }
     StatsCollector& getStatsCollector(void) { return m_statsCollector; }
+    SipMetrics& getSipMetrics(void) { return m_sipMetrics; }
     std::unordered_set<std::string>& getPreservedHeaderNames(void) { return m_preservedHeaderNames; }
 
     void makeOutboundConnection(const string& transactionId, const string& uri);
@@ -184,10 +188,12 @@ namespace drachtio {
 
     bool isAggressiveNatEnabled(void) { return m_bAggressiveNatDetection; }
     bool isNatDetectionDisabled(void) { return m_bDisableNatDetection; }
+    bool isDialogMemoryReportEnabled(void) { return m_bDialogMemoryReport; }
 
     unsigned int getTcpKeepaliveInterval() { return m_tcpKeepaliveSecs; }
     unsigned int getTportQueuesize() { return m_tportQueuesize; }
     unsigned int getTportMaxConsecutiveTimeouts() { return m_tportMaxConsecutiveTimeouts; }
+    const SipTimerSettings& getTimerSettings() { return m_timerSettings; }
 
 	private:
 
@@ -225,6 +231,8 @@ namespace drachtio {
     string  m_user ;    //system user to run as
     unsigned int m_adminTcpPort; 
     unsigned int m_adminTlsPort; 
+    string m_adminLocalSocket;
+    unsigned int m_adminLocalSocketMode;
     string m_tlsKeyFile, m_tlsCertFile, m_tlsChainFile, m_dhParam;
     unsigned int m_mtu;
 
@@ -269,6 +277,8 @@ namespace drachtio {
     su_home_t* 	m_home ;
     su_root_t* 	m_root ;
     su_timer_t*     m_timer ;
+    su_timer_t*     m_lagTimer ;
+    LoopMonitor     m_sipLoopMonitor ;
     nta_agent_t*	m_nta ;
     nta_leg_t*      m_defaultLeg ;
   	su_clone_r 	m_clone ;
@@ -284,18 +294,27 @@ namespace drachtio {
 
     RequestRouter   m_requestRouter ;
     StatsCollector  m_statsCollector;
+    SipMetrics      m_sipMetrics;
 
     bool    m_bAggressiveNatDetection;
     string m_strPrometheusAddress;
     unsigned int m_nPrometheusPort;
 
     bool m_bMemoryDebug;
+    bool m_bDialogMemoryReport;
+    string m_dialogJournal;
     unsigned int m_tcpKeepaliveSecs;
+    unsigned int m_clientThreads;
+    ClientSelection m_clientSelection;
+    ClientBacklogPolicy m_clientBacklogPolicy;
     unsigned int m_tportQueuesize;
     // opt-in dead-connection detection: max consecutive request timeouts on a
     // connection-oriented tport before it is force-closed. 0 = disabled (legacy).
     unsigned int m_tportMaxConsecutiveTimeouts;
 
+    // implementation, expiry slack and per-class coalescing of the sip transaction timer queues
+    SipTimerSettings m_timerSettings;
+
     bool m_bDumpMemory;
 
     float m_minTlsVersion;
@@ -0,0 +1,551 @@
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef TEST
+#include "drachtio.h"
+#include "controller.hpp"
+#endif
+
+#include "dialog-journal.hpp"
+
+namespace {
+
+  /* the file starts with a header, followed by frames of [length][checksum][record]; a zero length ends the journal.
+    Integers are in host byte order: the journal is only ever read back by the host that wrote it */
+  const char MAGIC[8] = { 'D', 'R', 'D', 'L', 'G', 'J', 'N', 'L' } ;
+  const uint32_t VERSION = 2 ;
+  const size_t HEADER_SIZE = 16 ;
+  const size_t FRAME_HEADER = 2 * sizeof(uint32_t) ;
+
+  const unsigned int WRITE_INTERVAL_MSECS = 50 ;
+  const unsigned int SYNC_INTERVAL_MSECS = 1000 ;
+  const size_t WAKE_WRITER_BYTES = 1024 * 1024 ;
+  const size_t BLOCK_SIZE = 256 * 1024 ;
+  const size_t BLOCK_SLACK = 16 * 1024 ;    // start a new block rather than risk growing one past this
+  const size_t MAX_SPARE_BLOCKS = 64 ;
+
+  // FNV-style, a word at a time: it only has to catch a torn record, and the replay checks every byte of the file
+  uint32_t checksum( const char* data, size_t len ) {
+    uint64_t h = 14695981039346656037ull ^ len ;
+    size_t i = 0 ;
+    for( ; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t) ) {
+      uint64_t w ;
+      memcpy( &w, data + i, sizeof(w) ) ;
+      h = (h ^ w) * 1099511628211ull ;
+      h ^= h >> 29 ;
+    }
+    for( ; i < len; i++ ) h = (h ^ static_cast<uint8_t>( data[i] )) * 1099511628211ull ;
+    return static_cast<uint32_t>( h ^ (h >> 32) ) ;
+  }
+
+  uint32_t readU32( const char* p ) {
+    uint32_t v ;
+    memcpy( &v, p, sizeof(v) ) ;
+    return v ;
+  }
+
+  void putU8( std::string& out, uint8_t v ) { out.push_back( static_cast<char>( v ) ) ; }
+  void putU32( std::string& out, uint32_t v ) { out.append( reinterpret_cast<const char*>( &v ), sizeof(v) ) ; }
+  void putI64( std::string& out, int64_t v ) { out.append( reinterpret_cast<const char*>( &v ), sizeof(v) ) ; }
+  void putStr( std::string& out, const std::string& s ) {
+    putU32( out, s.length() ) ;
+    out.append( s ) ;
+  }
+
+  class Reader {
+  public:
+    Reader( const char* data, size_t len ) : m_p(data), m_end(data + len), m_ok(true) {}
+
+    bool ok(void) const { return m_ok ; }
+
+    uint8_t u8(void) {
+      if( !need( 1 ) ) return 0 ;
+      return static_cast<uint8_t>( *m_p++ ) ;
+    }
+    uint32_t u32(void) {
+      if( !need( sizeof(uint32_t) ) ) return 0 ;
+      uint32_t v = readU32( m_p ) ;
+      m_p += sizeof(v) ;
+      return v ;
+    }
+    int64_t i64(void) {
+      int64_t v = 0 ;
+      if( !need( sizeof(v) ) ) return 0 ;
+      memcpy( &v, m_p, sizeof(v) ) ;
+      m_p += sizeof(v) ;
+      return v ;
+    }
+    void str( std::string& s ) {
+      uint32_t len = u32() ;
+      if( !need( len ) ) {
+        s.clear() ;
+        return ;
+      }
+      s.assign( m_p, len ) ;
+      m_p += len ;
+    }
+
+  private:
+    bool need( size_t n ) {
+      if( m_ok && static_cast<size_t>( m_end - m_p ) >= n ) return true ;
+      m_ok = false ;
+      return false ;
+    }
+
+    const char* m_p ;
+    const char* m_end ;
+    bool        m_ok ;
+  } ;
+
+  /* reserve the blocks up front: a store to a mapped page that the filesystem can not back is a SIGBUS, not an error */
+  bool allocate( int fd, size_t size ) {
+    int rc = posix_fallocate( fd, 0, size ) ;
+    if( EINVAL == rc || EOPNOTSUPP == rc ) rc = 0 == ftruncate( fd, size ) ? 0 : errno ;
+    errno = rc ;
+    return 0 == rc ;
+  }
+
+  // file sizes are whole multiples of the initial size
+  size_t roundUp( size_t size ) {
+    const size_t unit = drachtio::DialogJournal::INITIAL_SIZE ;
+    return std::max( unit, (size + unit - 1) / unit * unit ) ;
+  }
+}
+
+namespace drachtio {
+
+  DialogJournal::DialogJournal( const std::string& path ) : m_path(path), m_fd(-1), m_base(NULL), m_size(0), m_used(0),
+    m_liveBytes(0), m_bTorn(false), m_nQueuedBytes(0), m_bRunning(false), m_nDialogs(0), m_nFileSize(0), m_nDropped(0) {
+  }
+
+  DialogJournal::~DialogJournal() {
+    stop() ;
+    unmap() ;
+  }
+
+  void DialogJournal::encode( std::string& out, RecordType_t type, const Record_t& rec ) {
+    putU8( out, type ) ;
+    putStr( out, rec.dialogId ) ;
+    if( rec_destroy == type ) return ;
+
+    if( rec_create == type ) {
+      putStr( out, rec.callId ) ;
+      putU8( out, rec.role ) ;
+      putU8( out, rec.inviteDialog ) ;
+      putStr( out, rec.localTag ) ;
+      putStr( out, rec.remoteTag ) ;
+      putStr( out, rec.local ) ;
+      putStr( out, rec.remote ) ;
+      putStr( out, rec.localContact ) ;
+      putStr( out, rec.routeUri ) ;
+      putStr( out, rec.protocol ) ;
+      putStr( out, rec.transportAddress ) ;
+      putStr( out, rec.transportPort ) ;
+      putStr( out, rec.sourceAddress ) ;
+      putU32( out, rec.sourcePort ) ;
+      putI64( out, rec.startTime ) ;
+      putI64( out, rec.connectTime ) ;
+      putStr( out, rec.appName ) ;
+    }
+    putStr( out, rec.routeSet ) ;
+    putStr( out, rec.target ) ;
+    putU32( out, rec.localSeq ) ;
+    putU32( out, rec.remoteSeq ) ;
+    putStr( out, rec.localSdp ) ;
+    putStr( out, rec.localContentType ) ;
+    putU32( out, rec.sessionExpires ) ;
+    putU8( out, rec.refresher ) ;
+    putU32( out, rec.minSE ) ;
+    putI64( out, rec.sessionDue ) ;
+  }
+
+  bool DialogJournal::decode( const char* data, size_t len, RecordType_t& type, Record_t& rec ) {
+    Reader r( data, len ) ;
+    type = static_cast<RecordType_t>( r.u8() ) ;
+    r.str( rec.dialogId ) ;
+    if( rec_destroy == type ) return r.ok() ;
+    if( rec_create != type && rec_refresh != type ) return false ;
+
+    if( rec_create == type ) {
+      r.str( rec.callId ) ;
+      rec.role = r.u8() ;
+      rec.inviteDialog = r.u8() ;
+      r.str( rec.localTag ) ;
+      r.str( rec.remoteTag ) ;
+      r.str( rec.local ) ;
+      r.str( rec.remote ) ;
+      r.str( rec.localContact ) ;
+      r.str( rec.routeUri ) ;
+      r.str( rec.protocol ) ;
+      r.str( rec.transportAddress ) ;
+      r.str( rec.transportPort ) ;
+      r.str( rec.sourceAddress ) ;
+      rec.sourcePort = r.u32() ;
+      rec.startTime = r.i64() ;
+      rec.connectTime = r.i64() ;
+      r.str( rec.appName ) ;
+    }
+    r.str( rec.routeSet ) ;
+    r.str( rec.target ) ;
+    rec.localSeq = r.u32() ;
+    rec.remoteSeq = r.u32() ;
+    r.str( rec.localSdp ) ;
+    r.str( rec.localContentType ) ;
+    rec.sessionExpires = r.u32() ;
+    rec.refresher = r.u8() ;
+    rec.minSE = r.u32() ;
+    rec.sessionDue = r.i64() ;
+    return r.ok() ;
+  }
+
+  void DialogJournal::append( RecordType_t type, const Record_t& rec ) {
+    std::lock_guard<std::mutex> l( m_lock ) ;
+    if( !m_bRunning ) return ;
+    if( m_nQueuedBytes >= MAX_QUEUED_BYTES ) {
+      m_nDropped++ ;
+      return ;
+    }
+
+    /* records go into fixed size blocks, recycled by the writer, so that queueing never reallocates a large buffer */
+    if( m_queue.empty() || m_queue.back().size() + BLOCK_SLACK > BLOCK_SIZE ) {
+      m_queue.push_back( std::string() ) ;
+      if( m_spare.empty() ) m_queue.back().reserve( BLOCK_SIZE ) ;
+      else {
+        m_queue.back().swap( m_spare.back() ) ;
+        m_spare.pop_back() ;
+      }
+    }
+    std::string& block = m_queue.back() ;
+    size_t start = block.size() ;
+    putU32( block, 0 ) ;
+    encode( block, type, rec ) ;
+    uint32_t len = block.size() - start - sizeof(uint32_t) ;
+    memcpy( &block[start], &len, sizeof(len) ) ;
+
+    // the writer polls; only wake it early when a burst has piled up
+    size_t queued = m_nQueuedBytes ;
+    m_nQueuedBytes += block.size() - start ;
+    if( queued < WAKE_WRITER_BYTES && m_nQueuedBytes >= WAKE_WRITER_BYTES ) m_cond.notify_one() ;
+  }
+
+  void DialogJournal::appendDestroy( const std::string& dialogId ) {
+    Record_t rec ;
+    rec.dialogId = dialogId ;
+    append( rec_destroy, rec ) ;
+  }
+
+  bool DialogJournal::map(void) {
+    int fd = ::open( m_path.c_str(), O_RDWR ) ;
+    if( fd < 0 ) return false ;
+
+    struct stat st ;
+    if( 0 != fstat( fd, &st ) || static_cast<size_t>( st.st_size ) < HEADER_SIZE ) {
+      ::close( fd ) ;
+      errno = EINVAL ;
+      return false ;
+    }
+    size_t size = st.st_size ;
+
+    void* base = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) ;
+    if( MAP_FAILED == base ) {
+      int err = errno ;
+      ::close( fd ) ;
+      errno = err ;
+      return false ;
+    }
+    unmap() ;
+    m_fd = fd ;
+    m_base = static_cast<char*>( base ) ;
+    m_size = size ;
+    m_nFileSize = size ;
+    return true ;
+  }
+
+  void DialogJournal::unmap(void) {
+    if( m_base ) munmap( m_base, m_size ) ;
+    if( m_fd >= 0 ) ::close( m_fd ) ;
+    m_base = NULL ;
+    m_fd = -1 ;
+    m_size = 0 ;
+  }
+
+  size_t DialogJournal::frameSize( uint64_t offset ) const {
+    return FRAME_HEADER + readU32( m_base + offset ) ;
+  }
+
+  void DialogJournal::index( uint64_t offset, const char* payload, uint32_t len ) {
+    Reader r( payload, len ) ;
+    uint8_t type = r.u8() ;
+    std::string dialogId ;
+    r.str( dialogId ) ;
+    if( !r.ok() ) return ;
+
+    if( rec_create == type ) {
+      Entry_t& e = m_index[dialogId] ;
+      if( e.create ) m_liveBytes -= frameSize( e.create ) ;
+      if( e.refresh ) m_liveBytes -= frameSize( e.refresh ) ;
+      e.create = offset ;
+      e.refresh = 0 ;
+      m_liveBytes += FRAME_HEADER + len ;
+    }
+    else {
+      // a refresh or destroy for a dialog we never saw created (an early dialog, say) is of no interest
+      Index_t::iterator it = m_index.find( dialogId ) ;
+      if( m_index.end() == it ) return ;
+      Entry_t& e = it->second ;
+      if( e.refresh ) m_liveBytes -= frameSize( e.refresh ) ;
+      if( rec_refresh == type ) {
+        e.refresh = offset ;
+        m_liveBytes += FRAME_HEADER + len ;
+      }
+      else {
+        m_liveBytes -= frameSize( e.create ) ;
+        m_index.erase( it ) ;
+      }
+    }
+    m_nDialogs = m_index.size() ;
+  }
+
+  size_t DialogJournal::replay( const RestoreFunc& f ) {
+    assert( !m_bRunning ) ;
+    if( !map() ) {
+#ifndef TEST
+      if( ENOENT != errno ) {
+        DR_LOG(log_error) << "DialogJournal::replay - unable to open " << m_path << ": " << strerror( errno ) ;
+      }
+#endif
+      return 0 ;
+    }
+    if( 0 != memcmp( m_base, MAGIC, sizeof(MAGIC) ) || VERSION != readU32( m_base + sizeof(MAGIC) ) ) {
+#ifndef TEST
+      DR_LOG(log_error) << "DialogJournal::replay - " << m_path << " is not a dialog journal we can read, ignoring it" ;
+#endif
+      unmap() ;
+      return 0 ;
+    }
+
+    /* first find the latest records of each dialog still up.. */
+    m_index.reserve( m_size / 1024 ) ;
+    size_t offset = HEADER_SIZE ;
+    while( offset + FRAME_HEADER <= m_size ) {
+      uint32_t len = readU32( m_base + offset ) ;
+      if( 0 == len ) break ;
+      const char* payload = m_base + offset + FRAME_HEADER ;
+      if( len > m_size - offset - FRAME_HEADER || checksum( payload, len ) != readU32( m_base + offset + sizeof(uint32_t) ) ) {
+#ifndef TEST
+        DR_LOG(log_warning) << "DialogJournal::replay - " << m_path << " has a torn record at offset " << std::dec << offset <<
+          ", ignoring the rest of the journal" ;
+#endif
+        m_bTorn = true ;
+        break ;
+      }
+      index( offset, payload, len ) ;
+      offset += FRAME_HEADER + len ;
+    }
+    m_used = offset ;
+
+    /* ..then hand each one back, its latest refresh applied over its create; those that can not be rebuilt are forgotten */
+    Record_t rec ;
+    for( Index_t::iterator it = m_index.begin(); it != m_index.end(); ) {
+      RecordType_t type ;
+      const Entry_t& e = it->second ;
+      bool ok = decode( m_base + e.create + FRAME_HEADER, readU32( m_base + e.create ), type, rec ) ;
+      if( ok && e.refresh ) ok = decode( m_base + e.refresh + FRAME_HEADER, readU32( m_base + e.refresh ), type, rec ) ;
+      if( ok && f( rec ) ) {
+        ++it ;
+        continue ;
+      }
+      m_liveBytes -= frameSize( e.create ) ;
+      if( e.refresh ) m_liveBytes -= frameSize( e.refresh ) ;
+      it = m_index.erase( it ) ;
+    }
+    m_nDialogs = m_index.size() ;
+    return m_index.size() ;
+  }
+
+  bool DialogJournal::compact( size_t needed ) {
+    std::string path = m_path + ".compact" ;
+    size_t size = roundUp( HEADER_SIZE + m_liveBytes + m_liveBytes / 2 + needed ) ;
+
+    int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0640 ) ;
+    if( fd < 0 ) return false ;
+    void* p = MAP_FAILED ;
+    if( allocate( fd, size ) ) p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) ;
+    if( MAP_FAILED == p ) {
+      int err = errno ;
+      ::close( fd ) ;
+      unlink( path.c_str() ) ;
+      errno = err ;
+      return false ;
+    }
+    char* base = static_cast<char*>( p ) ;
+
+    memcpy( base, MAGIC, sizeof(MAGIC) ) ;
+    memcpy( base + sizeof(MAGIC), &VERSION, sizeof(VERSION) ) ;
+    size_t used = HEADER_SIZE ;
+    for( Index_t::iterator it = m_index.begin(); it != m_index.end(); ++it ) {
+      Entry_t& e = it->second ;
+      size_t n = frameSize( e.create ) ;
+      memcpy( base + used, m_base + e.create, n ) ;
+      e.create = used ;
+      used += n ;
+      if( e.refresh ) {
+        n = frameSize( e.refresh ) ;
+        memcpy( base + used, m_base + e.refresh, n ) ;
+        e.refresh = used ;
+        used += n ;
+      }
+    }
+
+    // the new file must be complete on disk before it replaces the old one
+    if( 0 != msync( base, used, MS_SYNC ) || 0 != rename( path.c_str(), m_path.c_str() ) ) {
+      int err = errno ;
+      munmap( base, size ) ;
+      ::close( fd ) ;
+      unlink( path.c_str() ) ;
+      errno = err ;
+      return false ;
+    }
+    unmap() ;
+    m_fd = fd ;
+    m_base = base ;
+    m_size = size ;
+    m_used = used ;
+    m_nFileSize = size ;
+    return true ;
+  }
+
+  bool DialogJournal::grow( size_t needed ) {
+    size_t size = roundUp( m_size + std::max( m_size / 2, needed ) ) ;
+    if( !allocate( m_fd, size ) ) return false ;
+    void* p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 ) ;
+    if( MAP_FAILED == p ) return false ;
+    munmap( m_base, m_size ) ;
+    m_base = static_cast<char*>( p ) ;
+    m_size = size ;
+    m_nFileSize = size ;
+    return true ;
+  }
+
+  bool DialogJournal::write( const char* payload, uint32_t len ) {
+    size_t needed = FRAME_HEADER + len + sizeof(uint32_t) ;   // room for the zero length that ends the journal
+    if( m_used + needed > m_size ) {
+      // compact when most of the file is records of dialogs since destroyed or refreshed, else grow it
+      bool ok = (m_used - HEADER_SIZE > 2 * m_liveBytes) ? compact( needed ) : grow( needed ) ;
+      if( !ok ) return false ;
+    }
+    char* frame = m_base + m_used ;
+    uint32_t sum = checksum( payload, len ) ;
+    memcpy( frame + FRAME_HEADER, payload, len ) ;
+    memcpy( frame + sizeof(uint32_t), &sum, sizeof(sum) ) ;
+    memcpy( frame, &len, sizeof(len) ) ;
+    index( m_used, frame + FRAME_HEADER, len ) ;
+    m_used += FRAME_HEADER + len ;
+    return true ;
+  }
+
+  bool DialogJournal::start(void) {
+    // a journal that was read to its end is appended to as it is; the writer compacts it when it fills up
+    if( (!m_base || m_bTorn) && !compact( 0 ) ) {
+#ifndef TEST
+      DR_LOG(log_error) << "DialogJournal::start - unable to write " << m_path << ": " << strerror( errno ) ;
+#endif
+      return false ;
+    }
+#ifndef TEST
+    DR_LOG(log_notice) << "DialogJournal::start - journaling stable dialogs to " << m_path << ", " << std::dec <<
+      m_index.size() << " dialogs carried over" ;
+#endif
+    std::lock_guard<std::mutex> l( m_lock ) ;
+    m_bRunning = true ;
+    m_thread = std::thread( &DialogJournal::threadFunc, this ) ;
+    return true ;
+  }
+
+  void DialogJournal::stop(void) {
+    {
+      std::lock_guard<std::mutex> l( m_lock ) ;
+      if( !m_bRunning ) return ;
+      m_bRunning = false ;
+    }
+    m_cond.notify_one() ;
+    m_thread.join() ;
+  }
+
+  void DialogJournal::threadFunc(void) {
+    typedef std::chrono::steady_clock Clock ;
+    std::vector<std::string> batch ;
+    Clock::time_point lastSync = Clock::now() ;
+    bool failing = false ;
+#ifndef TEST
+    uint64_t lastDropped = 0 ;
+#endif
+
+    for(;;) {
+      bool running ;
+      {
+        std::unique_lock<std::mutex> l( m_lock ) ;
+        for( std::string& block : batch ) {
+          if( m_spare.size() >= MAX_SPARE_BLOCKS ) break ;
+          block.clear() ;
+          m_spare.push_back( std::string() ) ;
+          m_spare.back().swap( block ) ;
+        }
+        batch.clear() ;
+        if( m_bRunning && m_queue.empty() ) m_cond.wait_for( l, std::chrono::milliseconds( WRITE_INTERVAL_MSECS ) ) ;
+        batch.swap( m_queue ) ;
+        m_nQueuedBytes = 0 ;
+        running = m_bRunning ;
+      }
+
+      for( const std::string& block : batch ) {
+        const char* p = block.data() ;
+        const char* end = p + block.size() ;
+        while( p + sizeof(uint32_t) <= end ) {
+          uint32_t len = readU32( p ) ;
+          p += sizeof(len) ;
+          if( write( p, len ) ) failing = false ;
+          else {
+            m_nDropped++ ;
+            if( !failing ) {
+#ifndef TEST
+              DR_LOG(log_error) << "DialogJournal - unable to grow " << m_path << ": " << strerror( errno ) <<
+                "; dialogs will not be journaled until there is room" ;
+#endif
+              failing = true ;
+            }
+          }
+          p += len ;
+        }
+      }
+      if( !running ) break ;
+
+#ifndef TEST
+      uint64_t dropped = m_nDropped ;
+      if( dropped != lastDropped ) {
+        DR_LOG(log_warning) << "DialogJournal - " << std::dec << (dropped - lastDropped) << " records dropped; " <<
+          "dialogs created or cleared meanwhile may be wrongly restored after a restart" ;
+        lastDropped = dropped ;
+      }
+#endif
+
+      // the page cache survives a restart of the process; syncing is only for a crash of the host
+      Clock::time_point now = Clock::now() ;
+      if( now - lastSync >= std::chrono::milliseconds( SYNC_INTERVAL_MSECS ) ) {
+        msync( m_base, m_used, MS_ASYNC ) ;
+        lastSync = now ;
+      }
+    }
+    msync( m_base, m_used, MS_SYNC ) ;
+  }
+
+}
@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __DIALOG_JOURNAL_HPP__
+#define __DIALOG_JOURNAL_HPP__
+
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace drachtio {
+
+  /**
+   * Append-only journal of stable dialogs, kept in a memory-mapped file so that they survive a restart.
+   *
+   * The stack thread encodes a create record when a dialog is established, a refresh record when its session
+   * timer is re-armed, and a destroy record when it is cleared, and queues it; it never touches the file.  A
+   * writer thread copies queued records into the mapping, and when the file fills up either compacts it down to
+   * the dialogs that are still up (written to a new file that is then renamed over the old one) or grows it.
+   *
+   * At startup the journal is replayed before the stack starts: each dialog still up is handed to the caller to
+   * rebuild, and the writer then carries on appending to the same file.  A record is framed by its length and a
+   * checksum, so a record torn by a crash ends the replay rather than corrupting it; the journal is then compacted
+   * before anything more is written to it.
+   */
+  class DialogJournal {
+  public:
+    enum RecordType_t {
+      rec_create = 1
+      ,rec_refresh
+      ,rec_destroy
+    } ;
+
+    /* what it takes to rebuild a dialog and its nta_leg_t.  A refresh record carries only what may change over the
+      life of a dialog: the route set and target, the CSeqs, the local sdp and the session timer */
+    struct Record_t {
+      Record_t() : role(0), inviteDialog(1), localSeq(0), remoteSeq(0), sourcePort(0), sessionExpires(0),
+        refresher(0), minSE(0), sessionDue(0), startTime(0), connectTime(0) {}
+
+      std::string dialogId ;
+      std::string callId ;
+      uint8_t     role ;              // SipDialog::DialogType_t
+      uint8_t     inviteDialog ;
+      std::string localTag ;
+      std::string remoteTag ;
+      std::string local ;             // From (uac) or To (uas), as a header value
+      std::string remote ;
+      std::string routeSet ;          // in the order requests are sent, as a header value
+      std::string target ;            // remote Contact
+      uint32_t    localSeq ;
+      uint32_t    remoteSeq ;
+      std::string localContact ;
+      std::string routeUri ;
+      std::string protocol ;
+      std::string transportAddress ;
+      std::string transportPort ;
+      std::string sourceAddress ;
+      uint32_t    sourcePort ;
+      std::string localSdp ;
+      std::string localContentType ;
+      uint32_t    sessionExpires ;
+      uint8_t     refresher ;         // SipDialog::SessionRefresher_t
+      uint32_t    minSE ;
+      int64_t     sessionDue ;        // when the session timer goes off, in secs since the epoch; 0 if none
+      int64_t     startTime ;
+      int64_t     connectTime ;
+      std::string appName ;           // the application the dialog was established for, if it named itself
+    } ;
+
+    // rebuilds a dialog from its record, false if it could not
+    typedef std::function<bool(const Record_t&)> RestoreFunc ;
+
+    static const size_t INITIAL_SIZE = 16 * 1024 * 1024 ;
+    static const size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024 ;
+
+    DialogJournal( const std::string& path ) ;
+    ~DialogJournal() ;
+    DialogJournal( const DialogJournal& ) = delete ;
+
+    const std::string& getPath(void) const { return m_path ; }
+
+    // before start: reads the journal and calls f with each dialog that was still up; returns how many were rebuilt
+    size_t replay( const RestoreFunc& f ) ;
+
+    // starts the writer thread, creating the journal if there was none; false if the file can not be written
+    bool start(void) ;
+
+    // drains the queue to the file and stops the writer thread
+    void stop(void) ;
+
+    // stack thread: encode and queue a record, without waiting on the writer; ignored until started
+    void append( RecordType_t type, const Record_t& rec ) ;
+    void appendDestroy( const std::string& dialogId ) ;
+
+    size_t getDialogCount(void) const { return m_nDialogs ; }
+    size_t getFileSize(void) const { return m_nFileSize ; }
+    uint64_t getDroppedCount(void) const { return m_nDropped ; }
+
+    // record encoding, exposed for the benchmark
+    static void encode( std::string& out, RecordType_t type, const Record_t& rec ) ;
+    static bool decode( const char* data, size_t len, RecordType_t& type, Record_t& rec ) ;
+
+  private:
+    /* where the latest records for a dialog are in the file; offsets are of the frame, 0 if none */
+    struct Entry_t {
+      Entry_t() : create(0), refresh(0) {}
+      uint64_t create ;
+      uint64_t refresh ;
+    } ;
+    typedef std::unordered_map<std::string, Entry_t> Index_t ;
+
+    bool map(void) ;
+    void unmap(void) ;
+    size_t frameSize( uint64_t offset ) const ;
+    bool write( const char* payload, uint32_t len ) ;
+    void index( uint64_t offset, const char* payload, uint32_t len ) ;
+    bool compact( size_t needed ) ;
+    bool grow( size_t needed ) ;
+    void threadFunc(void) ;
+
+    std::string               m_path ;
+    int                       m_fd ;
+    char*                     m_base ;
+    size_t                    m_size ;
+    size_t                    m_used ;
+    size_t                    m_liveBytes ;   // framed bytes of the records in m_index
+    bool                      m_bTorn ;       // replay stopped short of the end of the records
+    Index_t                   m_index ;       // replay, then the writer thread only
+
+    std::mutex                m_lock ;        // guards the queue only
+    std::condition_variable   m_cond ;
+    std::vector<std::string>  m_queue ;       // blocks of records waiting for the writer, each prefixed by its length
+    std::vector<std::string>  m_spare ;       // blocks the writer has drained, for reuse
+    size_t                    m_nQueuedBytes ;
+    bool                      m_bRunning ;
+    std::thread               m_thread ;
+
+    std::atomic<size_t>       m_nDialogs ;
+    std::atomic<size_t>       m_nFileSize ;
+    std::atomic<uint64_t>     m_nDropped ;
+  } ;
+
+}
+
+#endif
@@ -40,7 +40,7 @@ namespace drachtio {
 
      class DrachtioConfig::Impl {
     public:
-        Impl( const char* szFilename, bool isDaemonized) : m_bIsValid(false), m_adminTcpPort(0), m_adminTlsPort(0), m_bDaemon(isDaemonized),
+        Impl( const char* szFilename, bool isDaemonized) : m_bIsValid(false), m_adminTcpPort(0), m_adminTlsPort(0), m_adminLocalSocketMode(0660), m_bDaemon(isDaemonized),
         m_bConsoleLogger(false), m_captureHepVersion(3), m_mtu(0), m_udpBufferSize(0), m_bAggressiveNatDetection(false),
         m_sessionTimerDefaultRefresher("none"),
         m_prometheusPort(0), m_prometheusAddress("0.0.0.0"), m_tcpKeepalive(45), m_minTlsVersion(0) {
@@ -71,6 +71,9 @@ namespace drachtio {
                     m_adminAddress = pt.get<string>("drachtio.admin") ;
                     string tlsValue =  pt.get<string>("drachtio.admin.<xmlattr>.tls", "false") ;
                     m_tcpKeepalive = pt.get<unsigned int>("drachtio.admin.<xmlattr>.tcp-keepalive", 45);
+                    m_adminLocalSocket = pt.get<string>("drachtio.admin.<xmlattr>.local-socket", "") ;
+                    string mode = pt.get<string>("drachtio.admin.<xmlattr>.local-socket-mode", "") ;
+                    if (!mode.empty()) m_adminLocalSocketMode = std::strtoul(mode.c_str(), NULL, 8) & 0777 ;
                 } catch( boost::property_tree::ptree_bad_path& e ) {
                     cerr << "XML tag <admin> not found; this is required to provide admin socket details" << endl ;
                     return ;
@@ -400,6 +403,11 @@ namespace drachtio {
         unsigned int getAdminTlsPort() {
             return m_adminTlsPort ;
         }
+        bool getAdminLocalSocket( string& path, unsigned int& mode ) {
+            path = m_adminLocalSocket ;
+            mode = m_adminLocalSocketMode ;
+            return !path.empty() ;
+        }
         bool isSecret( const string& secret ) {
             return 0 == secret.compare( m_secret ) ;
         }
@@ -532,6 +540,8 @@ namespace drachtio {
         string m_adminAddress ;
         unsigned int m_adminTcpPort ;
         unsigned int m_adminTlsPort ;
+        string m_adminLocalSocket ;
+        unsigned int m_adminLocalSocketMode ;
         string m_secret ;
         bool m_bGenerateCdrs ;
         bool m_bDaemon;
@@ -616,6 +626,9 @@ namespace drachtio {
     bool DrachtioConfig::getAdminAddress( string& address ) {
         return m_pimpl->getAdminAddress( address ) ;
     }
+    bool DrachtioConfig::getAdminLocalSocket( string& path, unsigned int& mode ) {
+        return m_pimpl->getAdminLocalSocket( path, mode ) ;
+    }
     bool DrachtioConfig::isSecret( const string& secret ) const {
         return m_pimpl->isSecret( secret ) ;
     }
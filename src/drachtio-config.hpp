@@ -70,6 +70,7 @@ namespace drachtio {
         bool getAdminAddress( string& address ) ;
         unsigned int getAdminTcpPort( void ) ;
         unsigned int getAdminTlsPort( void ) ;
+        bool getAdminLocalSocket( string& path, unsigned int& mode ) ;
 
         bool getTlsFiles( string& keyFile, string& certFile, string& chainFile, string& dhParam ) const ;
 
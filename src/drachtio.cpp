@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include <ifaddrs.h>
 #include <errno.h>
 #include <stdio.h>
+#include <strings.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
@@ -600,35 +601,6 @@ namespace drachtio {
         }
     }
 
-    void splitTokens( const string& s, vector<string>& vec ) {
-        split( vec, s, boost::is_any_of("|") /*, boost::token_compress_on */); 
-    }
-
-    void splitMsg( const string& msg, string& meta, string& startLine, string& headers, string& body ) {
-        size_t pos = msg.find( DR_CRLF ) ;
-        if( string::npos == pos ) {
-            meta = msg ;
-            return ;
-        }
-        meta = msg.substr(0, pos) ;
-        string chunk = msg.substr(pos+DR_CRLF.length()) ;
-
-        pos = chunk.find( DR_CRLF2 ) ;
-        if( string::npos != pos  ) {
-            body = chunk.substr( pos + DR_CRLF2.length() ) ;
-            chunk = chunk.substr( 0, pos ) ;
-        }
-
-        pos = chunk.find( DR_CRLF ) ;
-        if( string::npos == pos ) {
-            startLine = chunk ;
-        }
-        else {
-            startLine = chunk.substr(0, pos) ;
-            headers = chunk.substr(pos + DR_CRLF.length()) ;
-        }
-    }
-
     sip_method_t parseStartLine( const string& startLine, string& methodName, string& requestUri ) {
         boost::char_separator<char> sep(" ");
         boost::tokenizer< boost::char_separator<char> > tokens(startLine, sep);
@@ -666,21 +638,28 @@ namespace drachtio {
         return method ;
     }
 
-    bool GetValueForHeader( const string& headers, const char *szHeaderName, string& headerValue ) {
-        vector<string> vec ;
-        splitLines( headers, vec ) ;
-        for( std::vector<string>::const_iterator it = vec.begin(); it != vec.end(); ++it )  {
-            string hdrName ;
-            size_t pos = (*it).find_first_of(":") ;
-            if( string::npos != pos ) {
-                hdrName = (*it).substr(0,pos) ;
-                boost::trim( hdrName );
-
-                if( boost::iequals( hdrName, szHeaderName ) ) {
-                    headerValue = (*it).substr(pos+1) ;
-                    boost::trim( headerValue ) ;    
-                    return true ;                
-                }
+    bool GetValueForHeader( std::string_view headers, const char *szHeaderName, string& headerValue ) {
+        // scanned in place, this is called on every new request an application sends
+        size_t nameLen = strlen( szHeaderName ) ;
+        size_t pos = 0 ;
+        while( pos < headers.length() ) {
+            size_t eol = headers.find_first_of( "\r\n", pos ) ;
+            if( std::string_view::npos == eol ) eol = headers.length() ;
+            std::string_view line = headers.substr( pos, eol - pos ) ;
+            pos = eol + 1 ;
+
+            size_t colon = line.find( ':' ) ;
+            if( std::string_view::npos == colon ) continue ;
+            std::string_view hdrName = line.substr( 0, colon ) ;
+            while( !hdrName.empty() && isspace( hdrName.front() ) ) hdrName.remove_prefix( 1 ) ;
+            while( !hdrName.empty() && isspace( hdrName.back() ) ) hdrName.remove_suffix( 1 ) ;
+
+            if( hdrName.length() == nameLen && 0 == strncasecmp( hdrName.data(), szHeaderName, nameLen ) ) {
+                std::string_view value = line.substr( colon + 1 ) ;
+                while( !value.empty() && isspace( value.front() ) ) value.remove_prefix( 1 ) ;
+                while( !value.empty() && isspace( value.back() ) ) value.remove_suffix( 1 ) ;
+                headerValue.assign( value.data(), value.length() ) ;
+                return true ;
             }
         }
         return false ;
@@ -29,6 +29,7 @@ THE SOFTWARE.
 #include <sys/stat.h>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <unordered_map>
 #include <chrono>
@@ -75,12 +76,15 @@ const string STATS_COUNTER_SIP_REQUESTS_IN = "drachtio_sip_requests_in_total";
 const string STATS_COUNTER_SIP_REQUESTS_OUT = "drachtio_sip_requests_out_total";
 const string STATS_COUNTER_SIP_RESPONSES_IN = "drachtio_sip_responses_in_total";
 const string STATS_COUNTER_SIP_RESPONSES_OUT = "drachtio_sip_responses_out_total";
+const string STATS_COUNTER_CLIENT_COMPRESSION_BYTES = "drachtio_app_compression_bytes_total";
 
 const string STATS_GAUGE_START_TIME = "drachtio_time_started";
 const string STATS_GAUGE_STABLE_DIALOGS = "drachtio_stable_dialogs";
 const string STATS_GAUGE_PROXY = "drachtio_proxy_cores";
 const string STATS_GAUGE_REGISTERED_ENDPOINTS = "drachtio_registered_endpoints";
 const string STATS_GAUGE_CLIENT_APP_CONNECTIONS = "drachtio_app_connections";
+const string STATS_GAUGE_CLIENT_ORPHANED_ENTRIES = "drachtio_app_orphaned_entries";
+const string STATS_GAUGE_CLIENT_BACKLOG_BYTES = "drachtio_app_backlog_bytes";
 
 // sofia status
 const string STATS_GAUGE_SOFIA_SERVER_HASH_SIZE = "drachtio_sofia_server_txn_hash_size";
@@ -98,10 +102,19 @@ const string STATS_GAUGE_SOFIA_BAD_REQS = "drachtio_sofia_bad_reqs_recv";
 const string STATS_GAUGE_SOFIA_RETRANS_REQ = "drachtio_sofia_retransmitted_requests";
 const string STATS_GAUGE_SOFIA_RETRANS_RES = "drachtio_sofia_retransmitted_responses";
 
+const string STATS_GAUGE_SIP_TIMERS_ARMED = "drachtio_sip_timers_armed";
+const string STATS_GAUGE_SIP_TIMERS_FIRED = "drachtio_sip_timers_fired";
+const string STATS_GAUGE_SIP_TIMERS_CANCELLED = "drachtio_sip_timers_cancelled";
+const string STATS_GAUGE_SIP_TIMERS_QUEUED = "drachtio_sip_timers_queued";
+
 const string STATS_HISTOGRAM_INVITE_RESPONSE_TIME_IN = "drachtio_call_answer_seconds_in";
 const string STATS_HISTOGRAM_INVITE_RESPONSE_TIME_OUT = "drachtio_call_answer_seconds_out";
 const string STATS_HISTOGRAM_INVITE_PDD_IN = "drachtio_call_pdd_seconds_in";
 const string STATS_HISTOGRAM_INVITE_PDD_OUT = "drachtio_call_pdd_seconds_out";
+const string STATS_HISTOGRAM_TIMER_BATCH_SIZE = "drachtio_timer_batch_size";
+const string STATS_HISTOGRAM_HOP_LATENCY = "drachtio_hop_latency_seconds";
+const string STATS_GAUGE_EVENT_LOOP_LAG = "drachtio_event_loop_lag_seconds";
+const string STATS_HISTOGRAM_EVENT_LOOP_LAG = "drachtio_event_loop_delay_seconds";
 
 #define TIMER_C_MSECS (185000)
 #define TIMER_B_MSECS (NTA_SIP_T1 * 64)
@@ -173,10 +186,6 @@ namespace drachtio {
 
 	void splitLines( const std::string& s, std::vector<std::string>& vec ) ;
 
-	void splitTokens( const std::string& s, std::vector<std::string>& vec ) ;
-
-	void splitMsg( const string& msg, string& meta, string& startLine, string& headers, string& body ) ;
-
 	sip_method_t parseStartLine( const string& startLine, string& methodName, string& requestUri ) ;
 
 	bool FindValueForHeader( const string& headers, const char* hdrName, string& hdrValue) ;
@@ -185,7 +194,7 @@ namespace drachtio {
 
 	void EncodeStackMessage( const sip_t* sip, string& encodedMessage ) ;
 
-	bool GetValueForHeader( const string& headers, const char *szHeaderName, string& headerValue ) ;
+	bool GetValueForHeader( std::string_view headers, const char *szHeaderName, string& headerValue ) ;
 
 	tagi_t* makeTags( const string& hdrs, const string& transport, const char* szExternalIP = NULL ) ;
 	tagi_t* makeSafeTags( const string& hdrs) ;
@@ -349,4 +358,39 @@ extern drachtio::DrachtioController* theOneAndOnlyController ;
 }
 #define STATS_HISTOGRAM_OBSERVE_NOCHECK(...) theOneAndOnlyController->getStatsCollector().histogramObserve(__VA_ARGS__) ;
 
+// sip message counters and call setup histograms, using handles resolved at startup (see sip-metrics.hpp)
+#define STATS_SIP_REQUEST_IN(method, name) \
+{ \
+	if (theOneAndOnlyController->getStatsCollector().enabled()) { \
+		theOneAndOnlyController->getSipMetrics().requestIn(method, name); \
+	} \
+}
+#define STATS_SIP_REQUEST_OUT(method, name) \
+{ \
+	if (theOneAndOnlyController->getStatsCollector().enabled()) { \
+		theOneAndOnlyController->getSipMetrics().requestOut(method, name); \
+	} \
+}
+#define STATS_SIP_RESPONSE_IN(method, name, status) \
+{ \
+	if (theOneAndOnlyController->getStatsCollector().enabled()) { \
+		theOneAndOnlyController->getSipMetrics().responseIn(method, name, status); \
+	} \
+}
+#define STATS_SIP_RESPONSE_OUT(method, name, status) \
+{ \
+	if (theOneAndOnlyController->getStatsCollector().enabled()) { \
+		theOneAndOnlyController->getSipMetrics().responseOut(method, name, status); \
+	} \
+}
+#define STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(which, val) theOneAndOnlyController->getSipMetrics().observe(drachtio::SipMetrics::which, val) ;
+
+// time elapsed since a steady_clock time_point, for one of the internal hops in SipMetrics::Histogram_t
+#define STATS_HOP_OBSERVE(which, since) \
+{ \
+	if (theOneAndOnlyController->getStatsCollector().enabled()) { \
+		theOneAndOnlyController->getSipMetrics().observeSince(drachtio::SipMetrics::which, since); \
+	} \
+}
+
 #endif
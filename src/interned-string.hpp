@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __INTERNED_STRING_HPP__
+#define __INTERNED_STRING_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace drachtio {
+
+  // bytes a std::string holds on the heap beyond itself: nothing while it fits in the small-string buffer
+  inline size_t stringHeapBytes( const std::string& s ) {
+    const char* p = s.data() ;
+    const char* self = reinterpret_cast<const char*>( &s ) ;
+    return ( p >= self && p < self + sizeof(std::string) ) ? 0 : s.capacity() + 1 ;
+  }
+
+  /**
+   * A pointer-sized handle to an immutable string that is held once in a process-wide pool.  Values
+   * that repeat across most dialogs -- the transport host, port and protocol, the local contact, the
+   * content type -- then cost each dialog one pointer instead of a std::string apiece.
+   *
+   * Entries are reference counted and leave the pool with their last handle, so interning a value
+   * that came off the wire cannot grow the pool without bound.  Counts are guarded by the pool lock;
+   * handles are made and dropped when a dialog is, not per message, so that lock is not hot.
+   */
+  class InternedString {
+  public:
+    struct PoolStats {
+      size_t entries ;
+      size_t references ;
+      size_t bytes ;      // approximate: the strings, their counts and the hash nodes holding them
+    } ;
+
+    InternedString() : m_entry(nullptr) {}
+    InternedString( const std::string& s ) : m_entry(intern( s.data(), s.length() )) {}
+    InternedString( const char* s ) : m_entry(s ? intern( s, strlen( s ) ) : nullptr) {}
+    InternedString( const InternedString& o ) : m_entry(o.m_entry) { addRef( m_entry ) ; }
+    InternedString( InternedString&& o ) noexcept : m_entry(o.m_entry) { o.m_entry = nullptr ; }
+    ~InternedString() { release( m_entry ) ; }
+
+    InternedString& operator=( InternedString o ) noexcept {
+      std::swap( m_entry, o.m_entry ) ;
+      return *this ;
+    }
+
+    const std::string& str() const { return m_entry ? m_entry->first : emptyString() ; }
+    const char* c_str() const { return str().c_str() ; }
+    bool empty() const { return nullptr == m_entry ; }
+    void clear() { InternedString().swap( *this ) ; }
+    void swap( InternedString& o ) noexcept { std::swap( m_entry, o.m_entry ) ; }
+
+    bool operator==( const InternedString& o ) const { return m_entry == o.m_entry ; }
+    bool operator!=( const InternedString& o ) const { return m_entry != o.m_entry ; }
+
+    static PoolStats poolStats() {
+      Pool& p = pool() ;
+      std::lock_guard<std::mutex> l( p.lock ) ;
+      PoolStats stats = { p.map.size(), 0, p.map.bucket_count() * sizeof(void*) } ;
+      for( const auto& e : p.map ) {
+        stats.references += e.second ;
+        stats.bytes += sizeof(e) + 2 * sizeof(void*) + stringHeapBytes( e.first ) ;
+      }
+      return stats ;
+    }
+
+  private:
+    typedef std::unordered_map<std::string, uint32_t> Map_t ;
+    typedef Map_t::value_type Entry ;
+
+    struct Pool {
+      std::mutex  lock ;
+      Map_t       map ;
+    } ;
+
+    // never destroyed, so dialogs still alive while the process exits can drop their handles safely
+    static Pool& pool() {
+      static Pool* p = new Pool() ;
+      return *p ;
+    }
+
+    static const std::string& emptyString() {
+      static const std::string empty ;
+      return empty ;
+    }
+
+    // the empty string is not pooled; it is the null handle
+    static Entry* intern( const char* s, size_t len ) {
+      if( 0 == len ) return nullptr ;
+      Pool& p = pool() ;
+      std::lock_guard<std::mutex> l( p.lock ) ;
+      Entry& e = *p.map.emplace( std::string( s, len ), 0 ).first ;
+      e.second++ ;
+      return &e ;
+    }
+
+    static void addRef( Entry* e ) {
+      if( !e ) return ;
+      Pool& p = pool() ;
+      std::lock_guard<std::mutex> l( p.lock ) ;
+      e->second++ ;
+    }
+
+    static void release( Entry* e ) {
+      if( !e ) return ;
+      Pool& p = pool() ;
+      std::lock_guard<std::mutex> l( p.lock ) ;
+      if( 0 == --e->second ) p.map.erase( p.map.find( e->first ) ) ;
+    }
+
+    Entry*  m_entry ;
+  } ;
+
+  inline std::ostream& operator<<( std::ostream& os, const InternedString& s ) {
+    return os << s.str() ;
+  }
+
+}
+
+#endif
@@ -3,7 +3,7 @@
 
 #define MAX_CANCEL_DURATION (32000)
 
-#include <mutex>
+#include <algorithm>
 namespace {
     void cancel_timer_handler( su_root_magic_t* magic, su_timer_t* timer, su_timer_arg_t* args) {
       std::weak_ptr<drachtio::IIP> *p = reinterpret_cast< std::weak_ptr<drachtio::IIP> *>( args ) ;
@@ -12,7 +12,29 @@ namespace {
       else assert(0) ;
     }
 
-  std::mutex	iip_mutex;
+  // enters an IIP into every index, or into none if its transaction id is already there
+  bool insertIIP(drachtio::InvitesInProgress_t& iips, std::shared_ptr<drachtio::IIP>& iip) {
+    if (!iips.byTransactionId.insert(iip->getTransactionId(), iip)) return false;
+    iips.byLeg.update(iip->leg(), [&iip](std::vector<std::shared_ptr<drachtio::IIP>>& v) { v.push_back(iip); return true; });
+    if (iip->irq()) iips.byIrq.insert(iip->irq(), iip);
+    if (iip->orq()) iips.byOrq.insert(iip->orq(), iip);
+    return true;
+  }
+
+  // removes an IIP from every index it is in, leaving alone any other IIP entered under the same handle
+  void eraseIIP(drachtio::InvitesInProgress_t& iips, const std::shared_ptr<drachtio::IIP>& iip) {
+    auto same = [&iip](const std::shared_ptr<drachtio::IIP>& p) { return p == iip; };
+    iips.byTransactionId.eraseIf(iip->getTransactionId(), same);
+    iips.byLeg.update(iip->leg(), [&same](std::vector<std::shared_ptr<drachtio::IIP>>& v) {
+      v.erase(std::remove_if(v.begin(), v.end(), same), v.end());
+      return !v.empty();
+    });
+    if (iip->irq()) iips.byIrq.eraseIf(iip->irq(), same);
+    if (iip->orq()) iips.byOrq.eraseIf(iip->orq(), same);
+    for (auto rel : iip->reliables()) {
+      if (rel) iips.byReliable.eraseIf(rel, same);
+    }
+  }
 }
 namespace drachtio {
 
@@ -78,71 +100,39 @@ namespace drachtio {
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_incoming_t* irq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg) {
     std::shared_ptr<IIP> iip = std::make_shared<IIP>(leg, irq, transactionId, dlg);
     DR_LOG(log_debug) << "IIP_Insert incoming - ref count: " << iip.use_count() << " inserting " << *iip;
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
-    auto& idx = iips.get<PtrTag>();
-    auto res = idx.insert(iip);
-    if (!res.second) {
+    if (!insertIIP(iips, iip)) {
 	    DR_LOG(log_error) << "IIP_Insert failed to insert incoming IIP " << *iip;
 		}
   }
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_outgoing_t* orq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg) {
     std::shared_ptr<IIP> iip = std::make_shared<IIP>(leg, orq, transactionId, dlg);
     DR_LOG(log_debug) << "IIP_Insert outgoing - ref count: " << iip.use_count() << " inserting " << *iip;
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
-    auto& idx = iips.get<PtrTag>();
-    auto res = idx.insert(iip);
-    if (!res.second) {
+    if (!insertIIP(iips, iip)) {
 	    DR_LOG(log_error) << "IIP_Insert failed to insert outgoing IIP " << *iip;
 		}
   }
 
   bool IIP_FindByIrq(const InvitesInProgress_t& iips, nta_incoming_t* irq, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
-    auto &idx = iips.get<IrqTag>();
-    auto it = idx.find(irq);
-    if (it == idx.end()) return false;
-    iip = *it;
-    return true;
+    return iips.byIrq.find(irq, iip);
   }
 
   bool IIP_FindByOrq(const InvitesInProgress_t& iips, nta_outgoing_t* orq, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
-    auto &idx = iips.get<OrqTag>();
-    auto it = idx.find(orq);
-    if (it == idx.end()) return false;
-    iip = *it;
-    return true;
+    return iips.byOrq.find(orq, iip);
   }
 
   bool IIP_FindByLeg(const InvitesInProgress_t& iips, nta_leg_t* leg, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
-    auto &idx = iips.get<LegTag>();
-    auto it = idx.find(leg);
-    if (it == idx.end()) return false;
-    iip = *it;
+    std::vector<std::shared_ptr<IIP>> v;
+    if (!iips.byLeg.find(leg, v) || v.empty()) return false;
+    iip = v.front();
     return true;
   }
 
   bool IIP_FindByReliable(const InvitesInProgress_t& iips, nta_reliable_t* rel, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
-    auto &idx = iips.get<TransactionIdTag>();
-    for (auto it = idx.begin(); it != idx.end(); ++it) {
-        const auto& reliables = (*it)->reliables();
-        if (std::find(reliables.begin(), reliables.end(), rel) != reliables.end()) {
-            iip = *it;
-            return true;
-        }
-    }
-    return false;
+    return iips.byReliable.find(rel, iip);
   }
 
   bool IIP_FindByTransactionId(const InvitesInProgress_t& iips, const std::string& transactionId, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
-    auto &idx = iips.get<TransactionIdTag>();
-    auto it = idx.find(transactionId);
-    if (it == idx.end()) return false;
-    iip = *it;
-    return true;
+    return iips.byTransactionId.find(transactionId, iip);
   }
 
   void IIP_Clear(InvitesInProgress_t& iips, nta_leg_t* leg) {
@@ -153,7 +143,7 @@ namespace drachtio {
   }
 
   void IIP_Clear(InvitesInProgress_t& iips, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
+    eraseIIP(iips, iip);
 
     nta_incoming_t* irq = const_cast<nta_incoming_t*>(iip->irq());
     nta_outgoing_t* orq = const_cast<nta_outgoing_t*>(iip->orq());
@@ -171,45 +161,34 @@ namespace drachtio {
     // later note: the orq of the uac INVITE (as well as orq of uac ACK) is destroyed in SipDialog destructor
 
     iip->destroyAllReliables();
-   
-    auto &idx = iips.get<LegTag>();
-    idx.erase(iip->leg());
   }
 
   size_t IIP_Size(const InvitesInProgress_t& iips) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
-    auto &idx = iips.get<TransactionIdTag>();
-    return idx.size();
+    return iips.byTransactionId.size();
   }
 
   void IIP_AddReliable(InvitesInProgress_t& iips, std::shared_ptr<IIP>& iip, nta_reliable_t* rel) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
-    const std::string& transactionId = iip->getTransactionId();
-    auto &idx = iips.get<TransactionIdTag>();
-    auto it = idx.find(transactionId);
-    idx.modify(it, [rel](std::shared_ptr<IIP>& iip) {
-        iip->addReliable(rel);
-    });
+    if (!rel) return;
+    iip->addReliable(rel);
+    if (!iips.byReliable.insert(rel, iip)) {
+      DR_LOG(log_error) << "IIP_AddReliable reliable " << std::hex << (void*) rel << " already indexed, not adding to " << *iip;
+    }
   }
 
   void IIP_DestroyReliable(InvitesInProgress_t& iips, std::shared_ptr<IIP>& iip, nta_reliable_t* rel) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
-    const std::string& transactionId = iip->getTransactionId();
-    auto &idx = iips.get<TransactionIdTag>();
-    auto it = idx.find(transactionId);
-    idx.modify(it, [rel](std::shared_ptr<IIP>& iip) {
-        iip->destroyReliable(rel);
-    });
+    // unindex before destroying, so the handle cannot be found after sofia is free to reuse it
+    iips.byReliable.eraseIf(rel, [&iip](const std::shared_ptr<IIP>& p) { return p == iip; });
+    iip->destroyReliable(rel);
   }
  
   void IIP_Log(const InvitesInProgress_t& iips, bool full) {
     size_t count = IIP_Size(iips);
     DR_LOG(log_debug) << "IIP size:                                                        " << count;
     if (full && count) {
-      std::lock_guard<std::mutex> lock(iip_mutex) ;
-      auto &idx = iips.get<TimeTag>();
-      for (auto it = idx.begin(); it != idx.end(); ++it) {
-        std::shared_ptr<IIP> p = *it;
+      std::vector<std::shared_ptr<IIP>> v;
+      iips.byTransactionId.forEach([&v](const std::string&, const std::shared_ptr<IIP>& p) { v.push_back(p); });
+      std::sort(v.begin(), v.end(), [](const std::shared_ptr<IIP>& a, const std::shared_ptr<IIP>& b) { return *a < *b; });
+      for (const auto& p : v) {
         DR_LOG(log_info) << *p;
       }
     }
@@ -26,32 +26,16 @@ THE SOFTWARE.
 #include <vector>
 #include <algorithm>
 
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/identity.hpp>
-
 #include <sofia-sip/nta.h>
 
 #include "drachtio.h"
 #include "sip-dialog.hpp"
-
-using namespace ::boost::multi_index;
+#include "striped-map.hpp"
 
 namespace drachtio {
 
 	class DrachtioController ;
 
-  struct PtrTag{};
-  struct TimeTag{};
-  struct IrqTag{};
-  struct OrqTag{};
-  struct LegTag{};
-  struct RelTag{};
-  struct TransactionIdTag{};
-
 	/* invites in progress */
 	class IIP  : public std::enable_shared_from_this<IIP> {
   public:
@@ -116,35 +100,24 @@ namespace drachtio {
 	} ;
 
 
-  typedef multi_index_container<
-    std::shared_ptr<IIP>,
-    indexed_by<
-      hashed_unique<
-        boost::multi_index::tag<PtrTag>,
-        boost::multi_index::identity< std::shared_ptr<IIP> >
-      >,
-      ordered_non_unique<
-        boost::multi_index::tag<TimeTag>,
-        boost::multi_index::identity<IIP> 
-      >,
-      hashed_non_unique<
-        boost::multi_index::tag<IrqTag>,
-        boost::multi_index::const_mem_fun<IIP, const nta_incoming_t*, &IIP::irq>
-      >,
-      hashed_non_unique<
-        boost::multi_index::tag<OrqTag>,
-        boost::multi_index::const_mem_fun<IIP, const nta_outgoing_t*, &IIP::orq>
-      >,
-      hashed_non_unique<
-        boost::multi_index::tag<LegTag>,
-        boost::multi_index::const_mem_fun<IIP, const nta_leg_t*, &IIP::leg>
-      >,
-      hashed_unique<
-        boost::multi_index::tag<TransactionIdTag>,
-        boost::multi_index::const_mem_fun<IIP, const std::string&, &IIP::getTransactionId>
-      >
-    >
-  > InvitesInProgress_t;
+  /**
+   * Invites in progress, indexed by each of the handles they are looked up by.  Every index is a 
+   * StripedMap, so the stack thread and the client threads only wait on each other when they touch
+   * the same stripe of the same index, rather than on one lock over all invites.
+   *
+   * An IIP is entered into (and removed from) the indexes one at a time, so while that is happening
+   * it can be found by some handles and not others.  Use the IIP_* helpers rather than the indexes.
+   * The reliable provisionals of an IIP are only ever touched from the stack thread; byReliable
+   * holds one entry per reliable provisional still outstanding, so a PRACK finds its invite directly.
+   * byLeg is not unique: a leg can have more than one invite in progress, oldest first.
+   */
+  struct InvitesInProgress_t {
+    StripedMap<string, std::shared_ptr<IIP>>                  byTransactionId ;
+    StripedMap<const nta_leg_t*, std::vector<std::shared_ptr<IIP>>> byLeg ;
+    StripedMap<const nta_incoming_t*, std::shared_ptr<IIP>>   byIrq ;
+    StripedMap<const nta_outgoing_t*, std::shared_ptr<IIP>>   byOrq ;
+    StripedMap<const nta_reliable_t*, std::shared_ptr<IIP>>   byReliable ;
+  } ;
 
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_incoming_t* irq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg);
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_outgoing_t* irq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg);
@@ -0,0 +1,126 @@
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "loop-monitor.hpp"
+#include "drachtio.h"
+#include "controller.hpp"
+
+namespace {
+  std::mutex monitorsLock ;
+  std::vector<drachtio::LoopMonitor*> monitors ;
+
+  thread_local drachtio::LoopMonitor* tlsMonitor = nullptr ;
+}
+
+namespace drachtio {
+
+  std::atomic<unsigned int> LoopMonitor::s_thresholdMsecs(250) ;
+
+  LoopMonitor::LoopMonitor( const char* name ) : m_name(name), m_expected(0), m_activity(nullptr), 
+    m_activityStart(0), m_probes(0), m_reported(UINT64_MAX), m_reportedActivity(0) {
+    std::lock_guard<std::mutex> l( monitorsLock ) ;
+    monitors.push_back( this ) ;
+  }
+
+  LoopMonitor::~LoopMonitor() {
+    std::lock_guard<std::mutex> l( monitorsLock ) ;
+    monitors.erase( std::remove( monitors.begin(), monitors.end(), this ), monitors.end() ) ;
+  }
+
+  LoopMonitor* LoopMonitor::current(void) {
+    return tlsMonitor ;
+  }
+
+  void LoopMonitor::bindToCurrentThread(void) {
+    tlsMonitor = this ;
+  }
+
+  void LoopMonitor::armed( unsigned int msecs ) {
+    Clock::time_point expected = Clock::now() + std::chrono::milliseconds( msecs ) ;
+    m_expected.store( ticks( expected ), std::memory_order_relaxed ) ;
+  }
+
+  void LoopMonitor::fired(void) {
+    int64_t now = ticks( Clock::now() ) ;
+    int64_t expected = m_expected.exchange( 0, std::memory_order_relaxed ) ;
+    if( 0 == expected ) return ;
+    m_probes.fetch_add( 1, std::memory_order_relaxed ) ;
+
+    double lagMsecs = std::max( 0.0, msecsBetween( expected, now ) ) ;
+    STATS_GAUGE_SET(STATS_GAUGE_EVENT_LOOP_LAG, lagMsecs / 1000.0, {{"loop", m_name}})
+    STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_EVENT_LOOP_LAG, lagMsecs / 1000.0, {{"loop", m_name}})
+
+    unsigned int threshold = getThreshold() ;
+    if( threshold && lagMsecs > threshold ) {
+      DR_LOG(log_warning) << "LoopMonitor: " << m_name << " event loop is lagging, probe ran " << 
+        std::dec << (unsigned int) lagMsecs << "ms late" ;
+    }
+  }
+
+  void LoopMonitor::checkStalled( int64_t now ) {
+    unsigned int threshold = getThreshold() ;
+    const char* activity = m_activity.load( std::memory_order_relaxed ) ;
+    int64_t since = activity ? m_activityStart.load( std::memory_order_relaxed ) : m_expected.load( std::memory_order_relaxed ) ;
+    if( 0 == since || msecsBetween( since, now ) <= threshold ) return ;
+
+    // report a stall once: an activity when it is first seen running long, an overdue probe once per 
+    // probe, and not at all once the activity holding up that probe has been reported
+    uint64_t probes = m_probes.load( std::memory_order_relaxed ) ;
+    if( activity ) {
+      if( since == m_reportedActivity ) return ;
+      m_reportedActivity = since ;
+      m_reported = probes ;
+      DR_LOG(log_warning) << "LoopMonitor: " << m_name << " event loop is stalled, " << activity << 
+        " has been running for " << std::dec << (unsigned int) msecsBetween( since, now ) << "ms" ;
+    }
+    else {
+      if( probes == m_reported ) return ;
+      m_reported = probes ;
+      DR_LOG(log_warning) << "LoopMonitor: " << m_name << " event loop is stalled, probe is " << 
+        std::dec << (unsigned int) msecsBetween( since, now ) << "ms overdue" ;
+    }
+  }
+
+  void LoopMonitor::startWatchdog(void) {
+    std::thread t([]() {
+      for(;;) {
+        unsigned int threshold = getThreshold() ;
+        std::this_thread::sleep_for( std::chrono::milliseconds( threshold ? std::max( threshold / 2, 10U ) : 1000U ) ) ;
+        if( 0 == threshold ) continue ;
+
+        int64_t now = ticks( Clock::now() ) ;
+        std::lock_guard<std::mutex> l( monitorsLock ) ;
+        for( LoopMonitor* monitor : monitors ) monitor->checkStalled( now ) ;
+      }
+    }) ;
+    t.detach() ;
+  }
+
+  LoopActivity::LoopActivity( const char* name ) : m_monitor(LoopMonitor::current()) {
+    // only the outermost activity on the loop is tracked
+    if( !m_monitor || m_monitor->m_activity.load( std::memory_order_relaxed ) ) {
+      m_monitor = nullptr ;
+      return ;
+    }
+    m_monitor->m_activityStart.store( LoopMonitor::ticks( LoopMonitor::Clock::now() ), std::memory_order_relaxed ) ;
+    m_monitor->m_activity.store( name, std::memory_order_relaxed ) ;
+  }
+
+  LoopActivity::~LoopActivity() {
+    if( !m_monitor ) return ;
+
+    const char* name = m_monitor->m_activity.exchange( nullptr, std::memory_order_relaxed ) ;
+    unsigned int threshold = LoopMonitor::getThreshold() ;
+    if( threshold ) {
+      double msecs = LoopMonitor::msecsBetween( m_monitor->m_activityStart.load( std::memory_order_relaxed ), 
+        LoopMonitor::ticks( LoopMonitor::Clock::now() ) ) ;
+      if( msecs > threshold ) {
+        DR_LOG(log_warning) << "LoopMonitor: " << name << " blocked the " << m_monitor->m_name << 
+          " event loop for " << std::dec << (unsigned int) msecs << "ms" ;
+      }
+    }
+  }
+
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __LOOP_MONITOR_HPP__
+#define __LOOP_MONITOR_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace drachtio {
+
+  /**
+   * Measures the scheduling delay of one event loop thread (the sofia su_root thread, the client
+   * io_context thread).  The owner arms a periodic probe on its loop and tells us when it was armed
+   * and when it fired: how late it fired is the lag, which is exported as a gauge and a histogram.
+   *
+   * Handlers of interest name themselves with LOOP_ACTIVITY so that when the loop is blocked we can
+   * say by what: an activity that runs longer than the lag threshold is logged when it returns, and
+   * a watchdog thread logs a loop that is stalled right now, along with the activity it is stuck in.
+   */
+  class LoopMonitor {
+  public:
+    static const unsigned int PROBE_INTERVAL_MSECS = 100 ;
+
+    LoopMonitor( const char* name ) ;
+    ~LoopMonitor() ;
+    LoopMonitor( const LoopMonitor& ) = delete ;
+
+    const char* getName(void) const { return m_name ; }
+
+    // called on the monitored thread before it starts running its loop
+    void bindToCurrentThread(void) ;
+
+    // called on the monitored thread: the probe has been armed to fire in msecs
+    void armed( unsigned int msecs ) ;
+
+    // called on the monitored thread: the probe fired
+    void fired(void) ;
+
+    // lag threshold for logging, applies to all loops; 0 disables the stall reports
+    static void setThreshold( unsigned int msecs ) { s_thresholdMsecs = msecs ; }
+    static unsigned int getThreshold(void) { return s_thresholdMsecs ; }
+
+    // start the thread that reports loops that are stalled right now
+    static void startWatchdog(void) ;
+
+  private:
+    friend class LoopActivity ;
+
+    typedef std::chrono::steady_clock Clock ;
+
+    static int64_t ticks( Clock::time_point t ) { return t.time_since_epoch().count() ; }
+    static double msecsBetween( int64_t from, int64_t to ) {
+      return std::chrono::duration<double, std::milli>( Clock::duration( to - from ) ).count() ;
+    }
+
+    // the monitor bound to the calling thread, if any
+    static LoopMonitor* current(void) ;
+
+    void checkStalled( int64_t now ) ;
+
+    const char*               m_name ;
+
+    std::atomic<int64_t>      m_expected ;          // when the probe should fire, 0 if not armed
+    std::atomic<const char*>  m_activity ;          // what the loop is running, NULL if nothing named
+    std::atomic<int64_t>      m_activityStart ;
+    std::atomic<uint64_t>     m_probes ;            // count of probes fired
+    uint64_t                  m_reported ;          // watchdog only: m_probes when it last reported a stall
+    int64_t                   m_reportedActivity ;  // watchdog only: start of the activity it last reported
+
+    static std::atomic<unsigned int> s_thresholdMsecs ;
+  } ;
+
+  // names what the calling loop thread is doing until the end of the enclosing scope
+  class LoopActivity {
+  public:
+    LoopActivity( const char* name ) ;
+    ~LoopActivity() ;
+    LoopActivity( const LoopActivity& ) = delete ;
+
+  private:
+    LoopMonitor*  m_monitor ;
+  } ;
+
+}
+
+#define LOOP_ACTIVITY(name) drachtio::LoopActivity _loopActivity(name) ;
+
+#endif
@@ -0,0 +1,225 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __PACKED_MESSAGE_HPP__
+#define __PACKED_MESSAGE_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace drachtio {
+
+  /**
+   * Strings handed from a client thread to the stack thread in the same su_msg block as the object
+   * that carries them, packed right after it.  The block is sized to the message actually being sent,
+   * so a short BYE costs a few hundred bytes rather than the largest message we allow, and nothing
+   * is truncated.  Each field is stored length first and nul terminated, so it can be read back
+   * either as a string_view or as a C string.
+   *
+   * Fields are addressed by their offset from the start of the packed area; an offset of zero is a
+   * valid field, so an absent field is simply packed empty.
+   */
+  class PackedFields {
+  public:
+    typedef uint32_t offset_t ;
+
+    // bytes needed to pack a field
+    static size_t size( std::string_view s ) { return sizeof(offset_t) + s.length() + 1 ; }
+
+    // the packed area is written from the start, and must be at least the sum of size() of the fields added
+    explicit PackedFields( char* area ) : m_area(area), m_used(0) {}
+
+    // appends a field and returns its offset
+    offset_t add( std::string_view s ) {
+      offset_t off = m_used ;
+      offset_t len = s.length() ;
+      memcpy( m_area + m_used, &len, sizeof(len) ) ;
+      if( len ) memcpy( m_area + m_used + sizeof(len), s.data(), len ) ;
+      m_area[m_used + sizeof(len) + len] = '\0' ;
+      m_used += sizeof(len) + len + 1 ;
+      return off ;
+    }
+
+    static std::string_view get( const char* area, offset_t off ) {
+      offset_t len ;
+      memcpy( &len, area + off, sizeof(len) ) ;
+      return std::string_view( area + off + sizeof(len), len ) ;
+    }
+    static const char* c_str( const char* area, offset_t off ) { return area + off + sizeof(offset_t) ; }
+
+    // offset of the field packed after the one at off
+    static offset_t next( const char* area, offset_t off ) { return off + size( get( area, off ) ) ; }
+
+  private:
+    char*     m_area ;
+    offset_t  m_used ;
+  } ;
+
+  /**
+   * A request or response an application asked us to send, on its way from the client thread to the
+   * stack thread.  It must be constructed with placement new at the start of a block of at least
+   * size() bytes (the su_msg data), and its fields live in that same block, just after the object.
+   */
+  class SipMessageData {
+  public:
+    static size_t size( std::string_view clientMsgId, std::string_view transactionId, std::string_view requestId, 
+      std::string_view dialogId, std::string_view startLine, std::string_view headers, std::string_view body, 
+      std::string_view routeUrl = std::string_view() ) {
+      return sizeof(SipMessageData) + PackedFields::size( clientMsgId ) + PackedFields::size( transactionId ) + 
+        PackedFields::size( requestId ) + PackedFields::size( dialogId ) + PackedFields::size( startLine ) + 
+        PackedFields::size( headers ) + PackedFields::size( body ) + PackedFields::size( routeUrl ) ;
+    }
+
+    SipMessageData( std::string_view clientMsgId, std::string_view transactionId, std::string_view requestId, 
+      std::string_view dialogId, std::string_view startLine, std::string_view headers, std::string_view body, 
+      std::string_view routeUrl = std::string_view() ) : m_tQueued(std::chrono::steady_clock::now()) {
+      PackedFields packer( area() ) ;
+      m_field[field_client_msg_id] = packer.add( clientMsgId ) ;
+      m_field[field_transaction_id] = packer.add( transactionId ) ;
+      m_field[field_request_id] = packer.add( requestId ) ;
+      m_field[field_dialog_id] = packer.add( dialogId ) ;
+      m_field[field_start_line] = packer.add( startLine ) ;
+      m_field[field_headers] = packer.add( headers ) ;
+      m_field[field_body] = packer.add( body ) ;
+      m_field[field_route_url] = packer.add( routeUrl ) ;
+    }
+    SipMessageData( const SipMessageData& ) = delete ;
+    SipMessageData& operator=( const SipMessageData& ) = delete ;
+    ~SipMessageData() {}
+
+    const char* getClientMsgId() const { return field( field_client_msg_id ) ; }
+    const char* getTransactionId() const { return field( field_transaction_id ) ; }
+    const char* getDialogId() const { return field( field_dialog_id ) ; }
+    const char* getRequestId() const { return field( field_request_id ) ; }
+    const char* getHeaders() const { return field( field_headers ) ; }
+    const char* getStartLine() const { return field( field_start_line ) ; }
+    const char* getBody() const { return field( field_body ) ; }
+    std::string_view getBodyView() const { return PackedFields::get( area(), m_field[field_body] ) ; }
+    const char* getRouteUrl() const { return field( field_route_url ) ; }
+    std::chrono::steady_clock::time_point getQueuedTime() const { return m_tQueued; }
+
+  private:
+    enum field_t {
+      field_client_msg_id = 0,
+      field_transaction_id,
+      field_request_id,
+      field_dialog_id,
+      field_start_line,
+      field_headers,
+      field_body,
+      field_route_url,
+      field_count
+    } ;
+
+    char* area() { return reinterpret_cast<char*>( this + 1 ) ; }
+    const char* area() const { return reinterpret_cast<const char*>( this + 1 ) ; }
+    const char* field( field_t f ) const { return PackedFields::c_str( area(), m_field[f] ) ; }
+
+    std::chrono::steady_clock::time_point	m_tQueued;	// when the client thread handed it to the stack thread
+    PackedFields::offset_t m_field[field_count] ;
+  } ;
+
+  /**
+   * A request an application asked us to proxy, on its way from the client thread to the stack thread.
+   * Like SipMessageData it is placed at the start of a block of at least size() bytes and its fields,
+   * including any number of destinations, are packed just after it.
+   */
+  class ProxyData {
+  public:
+    static size_t size( std::string_view clientMsgId, std::string_view transactionId, std::string_view provisionalTimeout, 
+      std::string_view finalTimeout, const std::vector<std::string>& vecDestinations, std::string_view headers ) {
+      size_t n = sizeof(ProxyData) + PackedFields::size( clientMsgId ) + PackedFields::size( transactionId ) + 
+        PackedFields::size( provisionalTimeout ) + PackedFields::size( finalTimeout ) + PackedFields::size( headers ) ;
+      for( const std::string& dest : vecDestinations ) n += PackedFields::size( dest ) ;
+      return n ;
+    }
+
+    ProxyData( std::string_view clientMsgId, std::string_view transactionId, bool recordRoute, bool fullResponse, 
+      bool followRedirects, bool simultaneous, std::string_view provisionalTimeout, std::string_view finalTimeout, 
+      const std::vector<std::string>& vecDestinations, std::string_view headers ) : 
+      m_bRecordRoute(recordRoute), m_bFullResponse(fullResponse), m_bFollowRedirects(followRedirects), 
+      m_bSimultaneous(simultaneous), m_nDestinations(vecDestinations.size()) {
+      PackedFields packer( area() ) ;
+      m_field[field_client_msg_id] = packer.add( clientMsgId ) ;
+      m_field[field_transaction_id] = packer.add( transactionId ) ;
+      m_field[field_provisional_timeout] = packer.add( provisionalTimeout ) ;
+      m_field[field_final_timeout] = packer.add( finalTimeout ) ;
+      m_field[field_headers] = packer.add( headers ) ;
+
+      // destinations follow the other fields, one after the other
+      m_field[field_destinations] = 0 ;
+      for( size_t i = 0; i < vecDestinations.size(); i++ ) {
+        PackedFields::offset_t off = packer.add( vecDestinations[i] ) ;
+        if( 0 == i ) m_field[field_destinations] = off ;
+      }
+    }
+    ProxyData( const ProxyData& ) = delete ;
+    ProxyData& operator=( const ProxyData& ) = delete ;
+    ~ProxyData() {}
+
+    const char* getClientMsgId() const { return field( field_client_msg_id ) ; }
+    bool hasClientMsgId() const { return *getClientMsgId() != '\0'; }
+    const char* getTransactionId() const { return field( field_transaction_id ) ; }
+    bool getRecordRoute() const { return m_bRecordRoute;}
+    bool getFullResponse() const { return m_bFullResponse;}
+    bool getFollowRedirects() const { return m_bFollowRedirects;}
+    bool getSimultaneous() const { return m_bSimultaneous;}
+    const char* getProvisionalTimeout() const { return field( field_provisional_timeout ) ; }
+    const char* getFinalTimeout() const { return field( field_final_timeout ) ; }
+    void getDestinations( std::vector<std::string>& vecDestination ) const {
+      vecDestination.clear() ;
+      vecDestination.reserve( m_nDestinations ) ;
+      PackedFields::offset_t off = m_field[field_destinations] ;
+      for( uint32_t i = 0; i < m_nDestinations; i++, off = PackedFields::next( area(), off ) ) {
+        vecDestination.emplace_back( PackedFields::get( area(), off ) ) ;
+      }
+    }
+    const char* getHeaders() const { return field( field_headers ) ; }
+
+  private:
+    enum field_t {
+      field_client_msg_id = 0,
+      field_transaction_id,
+      field_provisional_timeout,
+      field_final_timeout,
+      field_headers,
+      field_destinations,
+      field_count
+    } ;
+
+    char* area() { return reinterpret_cast<char*>( this + 1 ) ; }
+    const char* area() const { return reinterpret_cast<const char*>( this + 1 ) ; }
+    const char* field( field_t f ) const { return PackedFields::c_str( area(), m_field[f] ) ; }
+
+    bool  m_bRecordRoute ;
+    bool  m_bFullResponse ;
+    bool  m_bFollowRedirects ;
+    bool  m_bSimultaneous ;
+    uint32_t m_nDestinations ;
+    PackedFields::offset_t m_field[field_count] ;
+  } ;
+}
+
+#endif
@@ -92,9 +92,7 @@ namespace drachtio {
       client = m_pClientController->selectClientForRequestOutsideDialog( sip->sip_request->rq_method_name ) ;
       if( !client ) {
         DR_LOG(log_error) << "processNewRequest - No providers available for " << sip->sip_request->rq_method_name  ;
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {
-          {"method", sip->sip_request->rq_method_name},
-          {"code", "503"}})
+        STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 503)
         generateUuid( transactionId ) ;
         return 503 ;
       }
@@ -121,7 +119,7 @@ namespace drachtio {
       m_pClientController->addNetTransaction( client, p->getTransactionId() ) ;
 
       void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-      m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), encodedMessage, meta ) ) ;
+      m_pClientController->postToClient( client, std::bind(fn, client, p->getTransactionId(), encodedMessage, meta ), encodedMessage.length() ) ;
     }
     else {
       // using outbound connection for this call
@@ -193,8 +191,8 @@ namespace drachtio {
     m_pClientController->addNetTransaction( client, p->getTransactionId() ) ;
 
     void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-    m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), 
-        p->getEncodedMsg(), p->getMeta() ) ) ;
+    m_pClientController->postToClient( client, std::bind(fn, client, p->getTransactionId(), 
+        p->getEncodedMsg(), p->getMeta() ), p->getEncodedMsg().length() ) ;
     return 0 ;
   }
 
@@ -242,8 +242,13 @@ namespace drachtio {
         DR_LOG(log_info) << "http " << response_code << " response received from server in " << dec <<
           std::setprecision(3) << total << " secs: " << conn->response;
 
+        auto completed = std::chrono::steady_clock::now() ;
+        STATS_HOP_OBSERVE(hop_http_route_request, 
+          std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(conn->started)))
+
         //notify controller
         theOneAndOnlyController->httpCallRoutingComplete(conn->transactionId, response_code, conn->response) ;
+        STATS_HOP_OBSERVE(hop_http_route_complete, completed)
 
         // return easy handle to cache
         {
@@ -502,11 +507,14 @@ namespace drachtio {
 
   /* Create a new easy handle, and add it to the global curl_multi */
   void RequestHandler::startRequest(const string& transactionId, 
-    const string& httpMethod, const string& url, const string& body, bool verifyPeer) {
+    const string& httpMethod, const string& url, const string& body, bool verifyPeer, 
+    std::chrono::steady_clock::time_point queued) {
 
     RequestHandler::ConnInfo *conn;
     CURLMcode rc;
 
+    STATS_HOP_OBSERVE(hop_http_route_queue, queued)
+
     if (0 == url.find("tcp://") || 0 == url.find("tls://")) {
       string json = "{\"action\": \"route\", \"data\": {\"uri\": \"";
       json.append(url.substr(6));
@@ -544,6 +552,7 @@ namespace drachtio {
     strncpy(conn->transactionId, transactionId.c_str(), TXNID_LEN);
     conn->hdr_list = NULL ;
     *conn->response = '\0' ;
+    conn->started = std::chrono::steady_clock::now().time_since_epoch().count() ;
 
     curl_easy_setopt(easy, CURLOPT_URL, conn->url);
     curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_cb);
@@ -630,6 +639,7 @@ namespace drachtio {
   void RequestHandler::makeRequestForRoute(const string& transactionId, const string& httpMethod, 
     const string& httpUrl, const string& body, bool verifyPeer) {
 
-    m_ioservice.post( std::bind(&RequestHandler::startRequest, this, transactionId, httpMethod, httpUrl, body, verifyPeer)) ;
+    m_ioservice.post( std::bind(&RequestHandler::startRequest, this, transactionId, httpMethod, httpUrl, body, verifyPeer, 
+      std::chrono::steady_clock::now())) ;
   }
  }
@@ -23,6 +23,7 @@ THE SOFTWARE.
 #define __REQUEST_HANDLER_H__
 
 #include <thread>
+#include <chrono>
 #include <unordered_set>
 
 #include <boost/asio.hpp>
@@ -64,6 +65,7 @@ namespace drachtio {
       struct curl_slist *hdr_list;
       GlobalInfo *global;
       char error[CURL_ERROR_SIZE];
+      std::chrono::steady_clock::rep started;   // steady_clock ticks when the request was started
     } ConnInfo;
 
     static std::shared_ptr<RequestHandler> getInstance();
@@ -85,7 +87,7 @@ namespace drachtio {
   protected:
 
     void startRequest(const string& transactionId, const string& httpMethod, 
-      const string& url, const string& body, bool verifyPeer);
+      const string& url, const string& body, bool verifyPeer, std::chrono::steady_clock::time_point queued);
 
   private:
     // NB: this is a singleton object, accessed via the static getInstance method
@@ -69,52 +69,52 @@ namespace {
   
 
     void cloneRespondToSipRequest(su_root_magic_t* p, su_msg_r msg, void* arg ) {
+        LOOP_ACTIVITY("SipDialogController::doRespondToSipRequest")
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
         pController->getDialogController()->doRespondToSipRequest( d ) ;
     }
     void cloneSendSipRequest(su_root_magic_t* p, su_msg_r msg, void* arg ) {
+        LOOP_ACTIVITY("SipDialogController::doSendRequestOutsideDialog")
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
         pController->getDialogController()->doSendRequestOutsideDialog( d ) ;
     }
     void cloneSendSipCancelRequest(su_root_magic_t* p, su_msg_r msg, void* arg ) {
+        LOOP_ACTIVITY("SipDialogController::doSendCancelRequest")
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", "CANCEL"}})
+        STATS_SIP_REQUEST_IN(sip_method_cancel, "CANCEL")
         pController->getDialogController()->doSendCancelRequest( d ) ;
     }
     int uacLegCallback( nta_leg_magic_t* p, nta_leg_t* leg, nta_incoming_t* irq, sip_t const *sip) {
-        if( sip && sip->sip_request ) STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", sip->sip_request->rq_method_name}})
+        if( sip && sip->sip_request ) STATS_SIP_REQUEST_IN(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         return pController->getDialogController()->processRequestInsideDialog( leg, irq, sip) ;
     }
     int uasCancelOrAck( nta_incoming_magic_t* p, nta_incoming_t* irq, sip_t const *sip ) {
-        if( sip && sip->sip_request ) STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", sip->sip_request->rq_method_name}})
+        if( sip && sip->sip_request ) STATS_SIP_REQUEST_IN(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         return pController->getDialogController()->processCancelOrAck( p, irq, sip) ;
     }
     int uasPrack( drachtio::SipDialogController *pController, nta_reliable_t *rel, nta_incoming_t *prack, sip_t const *sip) {
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", "PRACK"}})
+        STATS_SIP_REQUEST_IN(sip_method_prack, "PRACK")
         return pController->processPrack( rel, prack, sip) ;
     }
    int response_to_request_outside_dialog( nta_outgoing_magic_t* p, nta_outgoing_t* request, sip_t const* sip ) {  
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_IN, {
-            {"method", sip->sip_cseq->cs_method_name},
-            {"code", boost::lexical_cast<std::string>(sip->sip_status->st_status)}
-        }) 
+        LOOP_ACTIVITY("SipDialogController::processResponseOutsideDialog")
+        STATS_SIP_RESPONSE_IN(sip->sip_cseq->cs_method, sip->sip_cseq->cs_method_name, sip->sip_status->st_status) 
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         return pController->getDialogController()->processResponseOutsideDialog( request, sip ) ;
     } 
    int response_to_request_inside_dialog( nta_outgoing_magic_t* p, nta_outgoing_t* request, sip_t const* sip ) {   
+        LOOP_ACTIVITY("SipDialogController::processResponseInsideDialog")
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_IN, {
-            {"method", sip->sip_cseq->cs_method_name},
-            {"code", boost::lexical_cast<std::string>(sip->sip_status->st_status)}
-        }) 
+        STATS_SIP_RESPONSE_IN(sip->sip_cseq->cs_method, sip->sip_cseq->cs_method_name, sip->sip_status->st_status) 
         return pController->getDialogController()->processResponseInsideDialog( request, sip ) ;
     } 
     void cloneSendSipRequestInsideDialog(su_root_magic_t* p, su_msg_r msg, void* arg ) {
+        LOOP_ACTIVITY("SipDialogController::doSendRequestInsideDialog")
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
         pController->getDialogController()->doSendRequestInsideDialog( d ) ;
@@ -159,26 +159,30 @@ namespace drachtio {
 
             assert(m_agent) ;
             assert(m_pClientController) ;
-            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot() ) ;
+            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot(), pController->getTimerSettings(), "dialog" ) ;
             m_timerDHandler.setTimerQueueManager(m_pTQM);
+            m_pSessionTimers.reset( new TimerWheel( pController->getRoot(), "session", SESSION_TIMER_TICK_MSECS ) ) ;
+            m_pSessionTimers->setOwner( "dialog" ) ;
 	}
 	SipDialogController::~SipDialogController() {
+        m_dialogs.journal = nullptr ;
 	}
-    bool SipDialogController::sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, const string& startLine, const string& headers, const string& body, string& transactionId ) {
+    bool SipDialogController::sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, std::string_view startLine, std::string_view headers, std::string_view body, string& transactionId ) {
 
         assert( dialogId.length() > 0 ) ;
 
         if( 0 == transactionId.length() ) { generateUuid( transactionId ) ; }
 
         su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipRequestInsideDialog, sizeof( SipDialogController::SipMessageData ) );
+        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipRequestInsideDialog, 
+            SipMessageData::size( clientMsgId, transactionId, "", dialogId, startLine, headers, body ) );
         if( rv < 0 ) {
             m_pController->getClientController()->route_api_response( clientMsgId, "NOK", "Internal server error allocating message") ;
             return  false;
         }
         void* place = su_msg_data( msg ) ;
 
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
+        /* placement new into the su_msg block, which is sized for the object and the fields packed after it; the stack thread destroys it */
         SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", dialogId, startLine, headers, body ) ;
         rv = su_msg_send(msg);  
         if( rv < 0 ) {
@@ -190,6 +194,7 @@ namespace drachtio {
     }
     ///client-initiated outgoing messages (stack thread)
     void SipDialogController::doSendRequestInsideDialog( SipMessageData* pData ) {                
+        STATS_HOP_OBSERVE(hop_client_to_sip_queue, pData->getQueuedTime())
         nta_leg_t* leg = NULL ;
         nta_outgoing_t* orq = NULL ;
         string myHostport ;
@@ -288,7 +293,7 @@ namespace drachtio {
             }
 
             //set content-type if not supplied and body contains SDP
-            string body = pData->getBody() ;
+            string body( pData->getBodyView() ) ;
             string contentType ;
             if( body.length() && !searchForHeader( tags, siptag_content_type_str, contentType ) ) {
                 if( 0 == body.find("v=0") ) {
@@ -397,7 +402,7 @@ namespace drachtio {
                 msg_t* m = nta_outgoing_getrequest(orq) ;  // adds a reference
                 sip_t* sip = sip_object( m ) ;
 
-                STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", sip->sip_request->rq_method_name}})
+                STATS_SIP_REQUEST_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
 
                 string encodedMessage ;
                 EncodeStackMessage( sip, encodedMessage ) ;
@@ -452,20 +457,21 @@ namespace drachtio {
 
 //send request outside dialog
     //client thread
-    bool SipDialogController::sendRequestOutsideDialog( const string& clientMsgId, const string& startLine, const string& headers, const string& body, string& transactionId, string& dialogId, string& routeUrl ) {
+    bool SipDialogController::sendRequestOutsideDialog( const string& clientMsgId, std::string_view startLine, std::string_view headers, std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) {
         if( 0 == transactionId.length() ) { generateUuid( transactionId ) ; }
         if( string::npos != startLine.find("INVITE") ) {
             generateUuid( dialogId ) ;
         }
 
         su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipRequest, sizeof( SipDialogController::SipMessageData ) );
+        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipRequest, 
+            SipMessageData::size( clientMsgId, transactionId, "", dialogId, startLine, headers, body, routeUrl ) );
         if( rv < 0 ) {
             return  false;
         }
         void* place = su_msg_data( msg ) ;
 
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
+        /* placement new into the su_msg block, which is sized for the object and the fields packed after it; the stack thread destroys it */
         SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", dialogId, startLine, headers, body, routeUrl ) ;
         rv = su_msg_send(msg);  
         if( rv < 0 ) {
@@ -475,6 +481,7 @@ namespace drachtio {
     }
     //stack thread
      void SipDialogController::doSendRequestOutsideDialog( SipMessageData* pData ) {
+        STATS_HOP_OBSERVE(hop_client_to_sip_queue, pData->getQueuedTime())
         nta_leg_t* leg = NULL ;
         nta_outgoing_t* orq = NULL ;
         string requestUri ;
@@ -590,7 +597,7 @@ namespace drachtio {
             }
 
             //set content-type if not supplied and body contains SDP
-            string body = pData->getBody() ;
+            string body( pData->getBodyView() ) ;
             string contentType ;
             if( body.length() && !searchForHeader( tags, siptag_content_type_str, contentType ) ) {
                 if( 0 == body.find("v=0") ) {
@@ -647,7 +654,7 @@ namespace drachtio {
             DR_LOG(log_info) << "SipDialogController::doSendRequestOutsideDialog - created orq " << std::hex << (void *) orq  <<
                 " call-id " << sip->sip_call_id->i_id << " / transaction id: " << pData->getTransactionId();
 
-            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", sip->sip_request->rq_method_name}})
+            STATS_SIP_REQUEST_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
 
             if( method == sip_method_invite || method == sip_method_subscribe ) {
                 std::shared_ptr<SipDialog> dlg = std::make_shared<SipDialog>(pData->getTransactionId(), 
@@ -690,15 +697,16 @@ namespace drachtio {
         deleteTags(tags);
     }
 
-    bool SipDialogController::sendCancelRequest( const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) {
+    bool SipDialogController::sendCancelRequest( const string& clientMsgId, const string& transactionId, std::string_view startLine, std::string_view headers, std::string_view body ) {
         su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipCancelRequest, sizeof( SipDialogController::SipMessageData ) );
+        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipCancelRequest, 
+            SipMessageData::size( clientMsgId, transactionId, "", "", startLine, headers, body ) );
         if( rv < 0 ) {
             return  false;
         }
         void* place = su_msg_data( msg ) ;
 
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
+        /* placement new into the su_msg block, which is sized for the object and the fields packed after it; the stack thread destroys it */
         SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", "", startLine, headers, body ) ;
         rv = su_msg_send(msg);  
         if( rv < 0 ) {
@@ -706,15 +714,16 @@ namespace drachtio {
         }
         return true ;
     }
-    bool SipDialogController::respondToSipRequest( const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) {
+    bool SipDialogController::respondToSipRequest( const string& clientMsgId, const string& transactionId, std::string_view startLine, std::string_view headers, std::string_view body ) {
        su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneRespondToSipRequest, sizeof( SipDialogController::SipMessageData ) );
+        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneRespondToSipRequest, 
+            SipMessageData::size( clientMsgId, transactionId, "", "", startLine, headers, body ) );
         if( rv < 0 ) {
             return  false ;
         }
         void* place = su_msg_data( msg ) ;
 
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
+        /* placement new into the su_msg block, which is sized for the object and the fields packed after it; the stack thread destroys it */
         string rid ;
         SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", "", startLine, headers, body ) ;
         rv = su_msg_send(msg);  
@@ -872,10 +881,10 @@ namespace drachtio {
                     std::chrono::duration<double> diff = now - dlg->getArrivalTime();
                     if (!dlg->hasAlerted()) {
                         dlg->alerting();
-                        STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_PDD_OUT, diff.count())
+                        STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_pdd_out, diff.count())
                     }
                     if (200 == dlg->getSipStatus()) {
-                        STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_RESPONSE_TIME_OUT, diff.count())
+                        STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_answer_out, diff.count())
                     }
                 }
             }
@@ -954,7 +963,7 @@ namespace drachtio {
                     DR_LOG(log_info) << "SipDialogController::processResponseOutsideDialog - ACK/BYE race condition - received 200 OK to INVITE that was previously CANCELED";
                     dlg->doAckBye();
                 }
-                addDialog( dlg ) ;
+                addDialog( dlg, sip ) ;
             }
             tport_t* tp = nta_outgoing_transport(orq);
             if (sip->sip_cseq->cs_method == sip_method_invite && sip->sip_status->st_status == 200 && tport_is_dgram(tp)) {
@@ -1014,7 +1023,7 @@ namespace drachtio {
         string transactionId( pData->getTransactionId() );
         string startLine( pData->getStartLine()) ;
         string headers( pData->getHeaders() );
-        string body( pData->getBody()) ;
+        string body( pData->getBodyView() ) ;
         string clientMsgId( pData->getClientMsgId()) ;
         string contentType ;
         string dialogId ;
@@ -1463,7 +1472,7 @@ namespace drachtio {
                                 // add dialog for SUBSCRIBE dialogs
                                 if( 202 == code || 200 == code ) {
                                 DR_LOG(log_debug) << "SipDialogController::doRespondToSipRequest: adding dialog for subscribe with dialog id " <<  dlg->getDialogId()  ;
-                                this->addDialog( dlg ) ;
+                                this->addDialog( dlg, sip ) ;
                                 }
                             }
 
@@ -1471,16 +1480,16 @@ namespace drachtio {
                             // TODO: figure out why this is
                             if( sip_method_invite == nta_incoming_method(irq) && code == 200 ) {
                                 
-                                this->addDialog( dlg ) ;
+                                this->addDialog( dlg, sip ) ;
 
                                 if (tport_is_dgram(tp)) {
                                     // set timer G to retransmit 200 OK if we don't get ack
-                                    TimerEventHandle t = m_pTQM->addTimer("timerG",
+                                    TimerEventHandle t = m_pTQM->addTimer(sip_timer_G,
                                         std::bind(&SipDialogController::retransmitFinalResponse, this, irq, tp, dlg), NULL, NTA_SIP_T1 ) ;
                                     dlg->setTimerG(t) ;
                                 }
                                 // set timer H, which sets the time to stop these retransmissions
-                                TimerEventHandle t = m_pTQM->addTimer("timerH",
+                                TimerEventHandle t = m_pTQM->addTimer(sip_timer_H,
                                     std::bind(&SipDialogController::endRetransmitFinalResponse, this, irq, tp, dlg), NULL, TIMER_H_MSECS ) ;
                                 dlg->setTimerH(t) ;
                                 dlg->setInviteIrq(irq) ;
@@ -1495,10 +1504,10 @@ namespace drachtio {
                                     std::chrono::duration<double> diff = now - dlg->getArrivalTime();
                                     if (!dlg->hasAlerted()) {
                                         dlg->alerting();
-                                        STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_PDD_IN, diff.count())
+                                        STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_pdd_in, diff.count())
                                     }
                                     if (code == 200) {
-                                        STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_RESPONSE_TIME_IN, diff.count())
+                                        STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_answer_in, diff.count())
                                     }
                                 }
                             }
@@ -1539,9 +1548,7 @@ namespace drachtio {
                 EncodeStackMessage( sip, encodedMessage ) ;
                 SipMsgData_t meta( msg, irq, "application" ) ;
 
-                STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {
-                    {"method", sip->sip_cseq->cs_method_name},
-                    {"code", boost::lexical_cast<std::string>(code)}})
+                STATS_SIP_RESPONSE_OUT(sip->sip_cseq->cs_method, sip->sip_cseq->cs_method_name, code)
 
                 string s ;
                 meta.toMessageFormat(s) ;
@@ -1660,13 +1667,13 @@ namespace drachtio {
                   client_ptr client = m_pClientController->findClientForNetTransaction(p->getTransactionId());
                   if(client) {
                       void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-                      m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), encodedMessage, meta)) ;
+                      m_pClientController->postToClient( client, std::bind(fn, client, p->getTransactionId(), encodedMessage, meta), encodedMessage.length()) ;
                   }
 
-                  STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "200"}})
+                  STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 200)
                   nta_msg_treply( theOneAndOnlyController->getAgent(), msg, 200, NULL, TAG_END() );
                   p->cancel() ;
-                  STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", "INVITE"},{"code", "487"}})
+                  STATS_SIP_RESPONSE_OUT(sip_method_invite, "INVITE", 487)
                   nta_msg_treply( theOneAndOnlyController->getAgent(), msg_dup(p->getMsg()), 487, NULL, TAG_END() );
                   break;
                 }
@@ -1848,7 +1855,7 @@ namespace drachtio {
                     }
                     else if( sip_method_bye == sip->sip_request->rq_method ) {
                         // Schedule cleanup in case client never responds to BYE
-                        m_pTQM->addTimer("general-sip",
+                        m_pTQM->addTimer(sip_timer_general,
                             std::bind(&SipDialogController::timeoutBye, this, transactionId), NULL, 32000);
                     }
                     
@@ -2012,7 +2019,7 @@ namespace drachtio {
                        TAG_END());
 
                 nta_outgoing_destroy( ack_request ) ;
-                STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "ACK"}})
+                STATS_SIP_REQUEST_OUT(sip_method_ack, "ACK")
             }
             else {
                 DR_LOG(log_error) << "SipDialogController::processResponseToRefreshingReinvite: "
@@ -2154,7 +2161,7 @@ namespace drachtio {
 
             m_pClientController->route_request_inside_dialog( encodedMessage, meta, sip, transactionId, dlg->getDialogId() ) ;
 
-            iip->destroyReliable(rel);
+            IIP_DestroyReliable( m_invitesInProgress, iip, rel ) ;
 
             addIncomingRequestTransaction( prack, transactionId) ;
         }
@@ -2172,7 +2179,7 @@ namespace drachtio {
         }
 
         string strSdp = dlg->getLocalEndpoint().m_strSdp ;
-        string strContentType = dlg->getLocalEndpoint().m_strContentType ;
+        string strContentType = dlg->getLocalEndpoint().m_strContentType.str() ;
 
         assert( dlg->getSessionExpiresSecs() ) ;
         ostringstream o,v ;
@@ -2208,7 +2215,7 @@ namespace drachtio {
 
         DR_LOG(log_info) << "SipDialogController::notifyRefreshDialog - created orq " << std::hex << (void *) orq;
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "INVITE"}})
+        STATS_SIP_REQUEST_OUT(sip_method_invite, "INVITE")
 
         //m_pClientController->route_event_inside_dialog( "{\"eventName\": \"refresh\"}",dlg->getTransactionId(), dlg->getDialogId() ) ;
     }
@@ -2249,7 +2256,7 @@ namespace drachtio {
             Cdr::postCdr( std::make_shared<CdrStop>( m, "application", ackbye ? Cdr::ackbye : Cdr::session_expired ) );
             nta_outgoing_destroy(orq) ;
 
-            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "BYE"}})
+            STATS_SIP_REQUEST_OUT(sip_method_bye, "BYE")
         }
         SD_Clear(m_dialogs, dlg) ;
     }
@@ -2289,39 +2296,32 @@ namespace drachtio {
 
     void SipDialogController::addRIP( nta_outgoing_t* orq, std::shared_ptr<RIP> rip) {
         DR_LOG(log_debug) << "SipDialogController::addRIP adding orq " << std::hex << (void*) orq  ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        m_mapOrq2RIP.insert( mapOrq2RIP::value_type(orq,rip)) ;
+        m_mapOrq2RIP.insert( orq, rip ) ;
     }
     bool SipDialogController::findRIPByOrq( nta_outgoing_t* orq, std::shared_ptr<RIP>& rip ) {
         DR_LOG(log_debug) << "SipDialogController::findRIPByOrq orq " << std::hex << (void*) orq  ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        mapOrq2RIP::iterator it = m_mapOrq2RIP.find( orq ) ;
-        if( m_mapOrq2RIP.end() == it ) return false ;
-        rip = it->second ;
-        return true ;                       
+        return m_mapOrq2RIP.find( orq, rip ) ;
     }
     void SipDialogController::clearRIP( nta_outgoing_t* orq ) {
         DR_LOG(log_debug) << "SipDialogController::clearRIP clearing orq " << std::hex << (void*) orq  ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        mapOrq2RIP::iterator it = m_mapOrq2RIP.find( orq ) ;
+        m_mapOrq2RIP.erase( orq ) ;
         nta_outgoing_destroy( orq ) ;
-        if( m_mapOrq2RIP.end() == it ) return  ;
-        m_mapOrq2RIP.erase( it ) ;                      
     }
     void SipDialogController::clearRIPByDialogId( const std::string dialogId) {
         DR_LOG(log_debug) << "SipDialogController::clearRIPByDialogId - searching for RIP for dialog id " <<  dialogId  ;
-        for (const auto& pair : m_mapOrq2RIP) {
-            nta_outgoing_t* orq = pair.first;
-            std::shared_ptr<RIP> p = pair.second;
-            if (0 == dialogId.compare(p->getDialogId())) {
-                DR_LOG(log_debug) << "SipDialogController::clearRIPByDialogId - found for RIP for dialog id, orq to destroy is " <<
-                std::hex << (void *) orq;
-                m_mapOrq2RIP.erase(orq);
-                nta_outgoing_destroy( orq ) ;
-                return;
-            }
-        }
-        return;
+        nta_outgoing_t* orq = nullptr ;
+        std::shared_ptr<RIP> rip ;
+        m_mapOrq2RIP.forEach([&](nta_outgoing_t* const& o, const std::shared_ptr<RIP>& p) {
+            if (!orq && 0 == dialogId.compare(p->getDialogId())) {
+                orq = o ;
+                rip = p ;
+            }
+        });
+        if (orq && m_mapOrq2RIP.eraseIf(orq, [&rip](const std::shared_ptr<RIP>& p) { return p == rip; })) {
+            DR_LOG(log_debug) << "SipDialogController::clearRIPByDialogId - found for RIP for dialog id, orq to destroy is " <<
+            std::hex << (void *) orq;
+            nta_outgoing_destroy( orq ) ;
+        }
     }
         
     void SipDialogController::retransmitFinalResponse( nta_incoming_t* irq, tport_t* tp, std::shared_ptr<SipDialog> dlg) {
@@ -2334,7 +2334,7 @@ namespace drachtio {
             // timerH is in a different queue, safe to remove
             TimerEventHandle h = dlg->getTimerH();
             if (h) {
-                m_pTQM->removeTimer(h, "timerH");
+                m_pTQM->removeTimer(h, sip_timer_H);
                 dlg->clearTimerH();
             }
             dlg->clearInviteIrq();
@@ -2345,7 +2345,7 @@ namespace drachtio {
 
         // set next timer
         uint32_t ms = dlg->bumpTimerG() ;
-        TimerEventHandle t = m_pTQM->addTimer("timerG",
+        TimerEventHandle t = m_pTQM->addTimer(sip_timer_G,
             std::bind(&SipDialogController::retransmitFinalResponse, this, irq, tp, dlg), NULL, ms ) ;
         dlg->setTimerG(t) ;
     }
@@ -2360,7 +2360,7 @@ namespace drachtio {
         nta_leg_t* leg = const_cast<nta_leg_t *>(dlg->getNtaLeg());
         TimerEventHandle h = dlg->getTimerG() ;
         if( h ) {
-            m_pTQM->removeTimer( h, "timerG");
+            m_pTQM->removeTimer( h, sip_timer_G);
             dlg->clearTimerG();
         }
         h = dlg->getTimerH() ;
@@ -2403,7 +2403,7 @@ namespace drachtio {
         DR_LOG(log_info) << "SipDialogController::endRetransmitFinalResponse - created orq " << std::hex << (void *) orq 
             << " for BYE on leg " << (void *)leg;
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "BYE"}})
+        STATS_SIP_REQUEST_OUT(sip_method_bye, "BYE")
 
         string encodedMessage ;
         EncodeStackMessage( sip, encodedMessage ) ;
@@ -2420,24 +2420,20 @@ namespace drachtio {
     }
     void SipDialogController::addIncomingRequestTransaction( nta_incoming_t* irq, const string& transactionId) {
         DR_LOG(log_debug) << "SipDialogController::addIncomingRequestTransaction - adding transactionId " << transactionId << " for irq:" << std::hex << (void*) irq;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        m_mapTransactionId2Irq.emplace( transactionId, IrqEntry(irq) ) ;
+        m_mapTransactionId2Irq.insert( transactionId, IrqEntry(irq) ) ;
     }
     bool SipDialogController::findIrqByTransactionId( const string& transactionId, nta_incoming_t*& irq ) {
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        mapTransactionId2Irq::iterator it = m_mapTransactionId2Irq.find( transactionId ) ;
-        if( m_mapTransactionId2Irq.end() == it ) return false ;
-        irq = it->second.irq ;
+        IrqEntry entry ;
+        if( !m_mapTransactionId2Irq.find( transactionId, entry ) ) return false ;
+        irq = entry.irq ;
         return true ;
     }
     nta_incoming_t* SipDialogController::findAndRemoveTransactionIdForIncomingRequest( const string& transactionId ) {
         DR_LOG(log_debug) << "SipDialogController::findAndRemoveTransactionIdForIncomingRequest - searching transactionId " << transactionId ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
         nta_incoming_t* irq = nullptr ;
-        mapTransactionId2Irq::iterator it = m_mapTransactionId2Irq.find( transactionId ) ;
-        if( m_mapTransactionId2Irq.end() != it ) {
-            irq = it->second.irq ;
-            m_mapTransactionId2Irq.erase( it ) ;
+        IrqEntry entry ;
+        if( m_mapTransactionId2Irq.erase( transactionId, entry ) ) {
+            irq = entry.irq ;
         }
         else {
             DR_LOG(log_debug) << "SipDialogController::findAndRemoveTransactionIdForIncomingRequest - failed to find transactionId " << transactionId << 
@@ -2468,12 +2464,12 @@ namespace drachtio {
         DR_LOG(log_debug) << "SipDialogController::clearSipTimers for " << dlg->getCallId()  ;
         TimerEventHandle h = dlg->getTimerG() ;
         if( h ) {
-            m_pTQM->removeTimer( h, "timerG");  
+            m_pTQM->removeTimer( h, sip_timer_G);  
             dlg->clearTimerG();
         }
         h = dlg->getTimerH() ;
         if( h ) {
-            m_pTQM->removeTimer( h, "timerH");
+            m_pTQM->removeTimer( h, sip_timer_H);
             dlg->clearTimerH();
         }
         dlg->clearInviteIrq();
@@ -2496,7 +2492,7 @@ namespace drachtio {
         m_mapCallIdAndCSeq2Invite.insert(mapCallIdAndCSeq2Invite::value_type(callIdAndCSeq, invite));
 
         // start timerD
-        TimerEventHandle t = m_pTQM->addTimer("timerD", std::bind(&TimerDHandler::timerD, this, invite, callIdAndCSeq), NULL, TIMER_D_MSECS ) ;
+        TimerEventHandle t = m_pTQM->addTimer(sip_timer_D, std::bind(&TimerDHandler::timerD, this, invite, callIdAndCSeq), NULL, TIMER_D_MSECS ) ;
 
         DR_LOG(log_info) << "TimerDHandler::addInvite orq " << hex << (void *)invite << ", " << callIdAndCSeq;
 
@@ -2578,19 +2574,116 @@ namespace drachtio {
         DR_LOG(bDetail ? log_info : log_debug) << "RIP size:                                                        " <<
             m_mapOrq2RIP.size();
         if (bDetail) {
-            for (const auto& pair : m_mapOrq2RIP) {
-                nta_outgoing_t* orq = pair.first;
-                std::shared_ptr<RIP> p = pair.second;
+            m_mapOrq2RIP.forEach([](nta_outgoing_t* const& orq, const std::shared_ptr<RIP>& p) {
                 sip_time_t age = sip_now() - p->getCreated();
                 DR_LOG(log_debug) << "    orq: " << std::hex << (void *) orq
                     << " dialogId: " << p->getDialogId()
                     << " txnId: " << p->getTransactionId()
                     << " created: " << formatSipTime(p->getCreated())
                     << " alive: " << std::dec << age << "s";
-            }
+            });
         }
     }
 
+    // dialog journal
+    size_t SipDialogController::restoreDialogs( const string& path ) {
+        m_pJournal.reset( new DialogJournal( path ) ) ;
+
+        size_t nOverdue = 0 ;
+        size_t count = m_pJournal->replay( [this, &nOverdue]( const DialogJournal::Record_t& rec ) {
+            return restoreDialog( rec, nOverdue ) ;
+        }) ;
+        if( nOverdue ) {
+            DR_LOG(log_info) << "SipDialogController::restoreDialogs - " << nOverdue << " restored dialogs had session timers that went off while we were down" ;
+        }
+
+        if( !m_pJournal->start() ) {
+            DR_LOG(log_error) << "SipDialogController::restoreDialogs - unable to write dialog journal " << path << ", dialogs will not be journaled" ;
+            m_pJournal.reset() ;
+            return count ;
+        }
+        m_dialogs.journal = m_pJournal.get() ;
+        return count ;
+    }
+
+    bool SipDialogController::restoreDialog( const DialogJournal::Record_t& rec, size_t& nOverdue ) {
+        /* requests we send within a dialog are not journaled, only session refreshes, so skip well past the last CSeq we know of */
+        static const uint32_t CSEQ_GAP = 1000 ;
+
+        su_home_t* home = m_pController->getHome() ;
+        sip_call_id_t* callId = sip_call_id_make( home, rec.callId.c_str() ) ;
+        sip_from_t* from = sip_from_make( home, rec.local.c_str() ) ;
+        sip_to_t* to = sip_to_make( home, rec.remote.c_str() ) ;
+        sip_cseq_t* cseq = sip_cseq_create( home, rec.localSeq + CSEQ_GAP, SIP_METHOD_INVITE ) ;
+        sip_route_t* route = rec.routeSet.empty() ? NULL : sip_route_make( home, rec.routeSet.c_str() ) ;
+        sip_contact_t* target = rec.target.empty() ? NULL : sip_contact_make( home, rec.target.c_str() ) ;
+
+        nta_leg_t* leg = NULL ;
+        if( callId && from && to && cseq ) {
+            leg = nta_leg_tcreate( m_agent, uacLegCallback, (nta_leg_magic_t *) m_pController,
+                SIPTAG_CALL_ID(callId),
+                SIPTAG_FROM(from),
+                SIPTAG_TO(to),
+                SIPTAG_CSEQ(cseq),
+                TAG_IF(route, SIPTAG_ROUTE(route)),
+                TAG_IF(target, NTATAG_TARGET(target)),
+                TAG_IF(rec.remoteSeq, NTATAG_REMOTE_CSEQ(rec.remoteSeq)),
+                TAG_END() ) ;
+        }
+        su_free( home, callId ) ;
+        su_free( home, from ) ;
+        su_free( home, to ) ;
+        su_free( home, cseq ) ;
+        su_free( home, route ) ;
+        su_free( home, target ) ;
+
+        if( !leg || !nta_leg_tag( leg, rec.localTag.c_str() ) || !nta_leg_rtag( leg, rec.remoteTag.c_str() ) ) {
+            DR_LOG(log_error) << "SipDialogController::restoreDialog - unable to rebuild the leg for dialog " << rec.dialogId ;
+            if( leg ) nta_leg_destroy( leg ) ;
+            return false ;
+        }
+
+        std::shared_ptr<SipDialog> dlg = std::make_shared<SipDialog>( leg, rec ) ;
+        SD_Insert( m_dialogs, dlg ) ;
+        if( !rec.appName.empty() ) m_pClientController->addDialogForApp( rec.dialogId, rec.appName ) ;
+
+        if( rec.sessionExpires && SipDialog::no_refresher != rec.refresher ) {
+            /* timers that went off while we were down are spread over the first minute rather than all run at once */
+            time_t now = time( 0 ) ;
+            su_duration_t msecs = rec.sessionDue > now ? (rec.sessionDue - now) * 1000 : 1000 + (nOverdue++ % 60) * 1000 ;
+            dlg->setSessionTimer( rec.sessionExpires, (SipDialog::SessionRefresher_t) rec.refresher, msecs ) ;
+        }
+        return true ;
+    }
+
+    void SipDialogController::journalCreate( std::shared_ptr<SipDialog>& dlg, sip_t const* sip ) {
+        /* a reliable provisional response adds a uac dialog too, but it is journaled once it is answered */
+        if( sip->sip_status && sip->sip_status->st_status < 200 ) return ;
+
+        /* sip is the response for a uac dialog, and the request for a uas dialog */
+        bool uac = SipDialog::we_are_uac == dlg->getRole() ;
+        su_home_t* home = m_pController->getHome() ;
+        char* local = sip_header_as_string( home, (sip_header_t const *) (uac ? sip->sip_from : sip->sip_to) ) ;
+        char* remote = sip_header_as_string( home, (sip_header_t const *) (uac ? sip->sip_to : sip->sip_from) ) ;
+        if( local && remote ) {
+            DialogJournal::Record_t rec ;
+            dlg->journalRecord( rec ) ;
+            rec.local = local ;
+            rec.remote = remote ;
+            m_pClientController->findAppForDialog( rec.dialogId, rec.appName ) ;
+            m_dialogs.journal->append( DialogJournal::rec_create, rec ) ;
+        }
+        su_free( home, local ) ;
+        su_free( home, remote ) ;
+    }
+
+    void SipDialogController::journalRefresh( SipDialog& dlg ) {
+        if( !m_dialogs.journal ) return ;
+        DialogJournal::Record_t rec ;
+        dlg.journalRecord( rec ) ;
+        m_dialogs.journal->append( DialogJournal::rec_refresh, rec ) ;
+    }
+
     // logging / metrics
     void SipDialogController::logStorageCount(bool bDetail)  {
 
@@ -2598,23 +2691,23 @@ namespace drachtio {
         DR_LOG(bDetail ? log_info : log_debug) << "----------------------------------"  ;
         IIP_Log(m_invitesInProgress, bDetail);
         SD_Log(m_dialogs, bDetail);
+        if (theOneAndOnlyController->isDialogMemoryReportEnabled()) SD_MemoryReport(m_dialogs);
 
         {
-            std::lock_guard<std::mutex> lock(m_mutex) ;
             DR_LOG(bDetail ? log_info : log_debug) << "m_mapTransactionId2Irq size:                                     " << m_mapTransactionId2Irq.size()  ;
             if (bDetail) {
-                int count = 0;
-                for (const auto& kv : m_mapTransactionId2Irq) {
-                    const char* method = nta_incoming_method_name(kv.second.irq);
-                    sip_time_t age = sip_now() - kv.second.created;
-                    DR_LOG(log_info) << "    txnId: " << kv.first
+                size_t count = 0;
+                m_mapTransactionId2Irq.forEach([&count](const string& txnId, const IrqEntry& entry) {
+                    if (count++ >= 50) return;
+                    const char* method = nta_incoming_method_name(entry.irq);
+                    sip_time_t age = sip_now() - entry.created;
+                    DR_LOG(log_info) << "    txnId: " << txnId
                         << " method: " << (method ? method : "unknown")
-                        << " created: " << formatSipTime(kv.second.created)
+                        << " created: " << formatSipTime(entry.created)
                         << " alive: " << age << "s";
-                    if (++count >= 50) {
-                        DR_LOG(log_info) << "    ... and " << (m_mapTransactionId2Irq.size() - 50) << " more";
-                        break;
-                    }
+                });
+                if (count > 50) {
+                    DR_LOG(log_info) << "    ... and " << (count - 50) << " more";
                 }
             }
             DR_LOG(bDetail ? log_info : log_debug) << "number of outgoing transactions held for timerD:                 " << m_timerDHandler.countTimerD()  ;
@@ -2622,6 +2715,11 @@ namespace drachtio {
             logRIP(bDetail);
         }
         m_pTQM->logQueueSizes() ;
+        DR_LOG(bDetail ? log_info : log_debug) << "number of dialogs with a session timer:                          " << m_pSessionTimers->size()  ;
+        if (m_dialogs.journal) {
+            DR_LOG(bDetail ? log_info : log_debug) << "dialog journal dialogs / file size / records dropped:           " << m_dialogs.journal->getDialogCount() <<
+                " / " << m_dialogs.journal->getFileSize() << " / " << m_dialogs.journal->getDroppedCount() ;
+        }
 
         // stats
         if (theOneAndOnlyController->getStatsCollector().enabled()) {
@@ -2662,11 +2760,9 @@ namespace drachtio {
 
         // 2. Orphaned RIPs: dialog no longer exists in StableDialogs
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
             int orphanCount = 0;
             int totalWithDialog = 0;
-            for (const auto& pair : m_mapOrq2RIP) {
-                std::shared_ptr<RIP> rip = pair.second;
+            m_mapOrq2RIP.forEach([&](nta_outgoing_t* const&, const std::shared_ptr<RIP>& rip) {
                 if (!rip->getDialogId().empty()) {
                     totalWithDialog++;
                     std::shared_ptr<SipDialog> dlg;
@@ -2682,7 +2778,7 @@ namespace drachtio {
                         orphanCount++;
                     }
                 }
-            }
+            });
             DR_LOG(log_info) << "RIPs: " << m_mapOrq2RIP.size()
                 << " total, " << totalWithDialog << " with dialogId, "
                 << orphanCount << " orphaned (dialog gone)";
@@ -2694,9 +2790,9 @@ namespace drachtio {
             m_pClientController->getNetTransactionIds(netTxnIds);
             int orphanCount = 0;
             {
-                std::lock_guard<std::mutex> lock(m_mutex);
+                IrqEntry entry;
                 for (const auto& txnId : netTxnIds) {
-                    if (m_mapTransactionId2Irq.find(txnId) != m_mapTransactionId2Irq.end()) continue;
+                    if (m_mapTransactionId2Irq.find(txnId, entry)) continue;
                     std::shared_ptr<IIP> iip;
                     if (IIP_FindByTransactionId(m_invitesInProgress, txnId, iip)) continue;
                     string method;
@@ -2717,21 +2813,20 @@ namespace drachtio {
             m_pClientController->getNetTransactionIds(netTxnIds);
             std::unordered_set<std::string> netTxnSet(netTxnIds.begin(), netTxnIds.end());
 
-            std::lock_guard<std::mutex> lock(m_mutex);
             int orphanCount = 0;
-            for (const auto& kv : m_mapTransactionId2Irq) {
-                if (netTxnSet.find(kv.first) == netTxnSet.end()) {
+            m_mapTransactionId2Irq.forEach([&](const string& txnId, const IrqEntry& entry) {
+                if (netTxnSet.find(txnId) == netTxnSet.end()) {
                     if (orphanCount < 50) {
-                        const char* method = nta_incoming_method_name(kv.second.irq);
-                        sip_time_t age = now - kv.second.created;
-                        DR_LOG(log_warning) << "  ORPHAN irq (no net transaction): txnId: " << kv.first
+                        const char* method = nta_incoming_method_name(entry.irq);
+                        sip_time_t age = now - entry.created;
+                        DR_LOG(log_warning) << "  ORPHAN irq (no net transaction): txnId: " << txnId
                             << " method: " << (method ? method : "unknown")
-                            << " created: " << formatSipTime(kv.second.created)
+                            << " created: " << formatSipTime(entry.created)
                             << " alive: " << age << "s";
                     }
                     orphanCount++;
                 }
-            }
+            });
             DR_LOG(log_info) << "Irqs: " << m_mapTransactionId2Irq.size()
                 << " total, " << orphanCount << " orphaned (no net transaction)";
         }
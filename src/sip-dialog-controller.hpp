@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include <mutex>
 #include <algorithm>
 #include <vector>
+#include <chrono>
 
 #include <sofia-sip/su_wait.h>
 #include <sofia-sip/nta.h>
@@ -41,10 +42,7 @@ THE SOFTWARE.
 #include "timer-queue.hpp"
 #include "timer-queue-manager.hpp"
 #include "invite-in-progress.hpp"
-
-#define START_LEN (512)
-#define HDR_LEN (8400)
-#define BODY_LEN (12288)
+#include "packed-message.hpp"
 
 namespace drachtio {
 
@@ -107,77 +105,14 @@ namespace drachtio {
 		SipDialogController(DrachtioController* pController, su_clone_r* pClone );
 		~SipDialogController() ;
 
-		class SipMessageData {
-		public:
-			SipMessageData() {
-				memset(m_szClientMsgId, 0, sizeof(m_szClientMsgId) ) ;
-				memset(m_szTransactionId, 0, sizeof(m_szTransactionId) ) ;
-				memset(m_szRequestId, 0, sizeof(m_szRequestId) ) ;
-				memset(m_szDialogId, 0, sizeof(m_szDialogId) ) ;
-				memset(m_szStartLine, 0, sizeof(m_szStartLine) ) ;
-				memset(m_szHeaders, 0, sizeof(m_szHeaders) ) ;
-				memset(m_szBody, 0, sizeof(m_szBody) ) ;
-				memset(m_szRouteUrl, 0, sizeof(m_szRouteUrl) ) ;
-			}
-			SipMessageData(const string& clientMsgId, const string& transactionId, const string& requestId, const string& dialogId,
-				const string& startLine, const string& headers, const string& body ) : SipMessageData() {
-				memcpy( m_szClientMsgId, clientMsgId.c_str(), std::min(MSG_ID_LEN, (int) clientMsgId.length()) ) ;
-				if( !transactionId.empty() ) memcpy( m_szTransactionId, transactionId.c_str(), std::min(MSG_ID_LEN, (int) transactionId.length())) ;
-				if( !requestId.empty() ) memcpy( m_szRequestId, requestId.c_str(), std::min(MSG_ID_LEN, (int) requestId.length()));
-				if( !dialogId.empty() )  memcpy( m_szDialogId, dialogId.c_str(), std::min(MAX_DIALOG_ID_LEN, (int) dialogId.length()));
-				memcpy( m_szStartLine, startLine.c_str(), std::min(START_LEN, (int) startLine.length()));
-				memcpy( m_szHeaders, headers.c_str(), std::min(HDR_LEN, (int) headers.length())) ;
-				memcpy( m_szBody, body.c_str(), std::min(BODY_LEN, (int) body.length()));
-			}
-			SipMessageData(const string& clientMsgId, const string& transactionId, const string& requestId, const string& dialogId,
-				const string& startLine, const string& headers, const string& body, const string& routeUrl )  : SipMessageData() {
-				memcpy( m_szClientMsgId, clientMsgId.c_str(), std::min(MSG_ID_LEN, (int) clientMsgId.length())) ;
-				if( !transactionId.empty() ) memcpy( m_szTransactionId, transactionId.c_str(), std::min(MSG_ID_LEN, (int) transactionId.length())) ;
-				if( !requestId.empty() ) memcpy( m_szRequestId, requestId.c_str(), std::min(MSG_ID_LEN, (int) requestId.length())) ;
-				if( !dialogId.empty() ) memcpy( m_szDialogId, dialogId.c_str(), std::min(MSG_ID_LEN, (int) dialogId.length()) ) ;
-				memcpy( m_szStartLine, startLine.c_str(), std::min(START_LEN, (int) startLine.length()) ) ;
-				memcpy( m_szHeaders, headers.c_str(), std::min(HDR_LEN, (int) headers.length()) ) ;
-				memcpy( m_szBody, body.c_str(), std::min(BODY_LEN, (int) body.length()) ) ;
-				memcpy( m_szRouteUrl, routeUrl.c_str(), std::min(START_LEN, (int) routeUrl.length()) ) ;
-			}
-			~SipMessageData() {}
-			SipMessageData& operator=(const SipMessageData& md) {
-				strncpy( m_szClientMsgId, md.m_szClientMsgId, MSG_ID_LEN) ;
-				strncpy( m_szTransactionId, md.m_szTransactionId, MSG_ID_LEN) ;
-				strncpy( m_szDialogId, md.m_szDialogId, MSG_ID_LEN) ;
-				strncpy( m_szRequestId, md.m_szRequestId, MSG_ID_LEN) ;
-				strncpy( m_szStartLine, md.m_szStartLine, START_LEN ) ;
-				strncpy( m_szHeaders, md.m_szHeaders, HDR_LEN ) ;
-				strncpy( m_szBody, md.m_szBody, BODY_LEN ) ;
-				strncpy( m_szRouteUrl, md.m_szRouteUrl, START_LEN ) ;
-				return *this ;
-			}
-
-			const char* getClientMsgId() { return m_szClientMsgId; } 
-			const char* getTransactionId() { return m_szTransactionId; } 
-			const char* getDialogId() { return m_szDialogId; } 
-			const char* getRequestId() { return m_szRequestId; } 
-			const char* getHeaders() { return m_szHeaders; } 
-			const char* getStartLine() { return m_szStartLine; } 
-			const char* getBody() { return m_szBody; } 
-			const char* getRouteUrl() { return m_szRouteUrl; } 
-
-		private:
-			char	m_szClientMsgId[MSG_ID_LEN+1];
-			char	m_szTransactionId[MSG_ID_LEN+1];
-			char	m_szRequestId[MSG_ID_LEN+1];
-			char	m_szDialogId[MAX_DIALOG_ID_LEN+1];
-			char	m_szStartLine[START_LEN+1];
-			char	m_szHeaders[HDR_LEN+1];
-			char	m_szBody[BODY_LEN+1];
-			char	m_szRouteUrl[START_LEN+1];
-		} ;
+		// what the client thread hands to the stack thread for an application's request or response
+		typedef drachtio::SipMessageData SipMessageData ;
 
 		//NB: sendXXXX are called when client is sending a message
-		bool sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, const string& startLine, const string& headers, const string& body, string& transactionId ) ;
-		bool sendRequestOutsideDialog( const string& clientMsgId, const string& startLine, const string& headers, const string& body, string& transactionId, string& dialogId, string& routeUrl ) ;
-    bool respondToSipRequest( const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;		
-		bool sendCancelRequest( const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;
+		bool sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, std::string_view startLine, std::string_view headers, std::string_view body, string& transactionId ) ;
+		bool sendRequestOutsideDialog( const string& clientMsgId, std::string_view startLine, std::string_view headers, std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) ;
+    bool respondToSipRequest( const string& msgId, const string& transactionId, std::string_view startLine, std::string_view headers, std::string_view body ) ;		
+		bool sendCancelRequest( const string& msgId, const string& transactionId, std::string_view startLine, std::string_view headers, std::string_view body ) ;
 
 		//NB: doSendXXX correspond to the above, and are run in the stack thread
 		void doSendRequestInsideDialog( SipMessageData* pData ) ;
@@ -208,13 +143,14 @@ namespace drachtio {
 
 
 		/// Dialog helpers
-		void addDialog( std::shared_ptr<SipDialog> dlg ) {
+		void addDialog( std::shared_ptr<SipDialog> dlg, sip_t const* sip ) {
 			const string strDialogId = dlg->getDialogId() ;
 			nta_leg_t *leg = nta_leg_by_call_id( m_agent, dlg->getCallId().c_str() );
 			assert( leg ) ;
 
 			SD_Insert(m_dialogs, dlg);
       m_pClientController->addDialogForTransaction( dlg->getTransactionId(), strDialogId ) ;		
+			if( m_dialogs.journal ) journalCreate( dlg, sip ) ;
 		}
 		bool findDialogByLeg( nta_leg_t* leg, std::shared_ptr<SipDialog>& dlg ) {
 			/* look in invites-in-progress first */
@@ -257,26 +193,37 @@ namespace drachtio {
 		// timers
 		void clearSipTimers(std::shared_ptr<SipDialog>& dlg);
 		bool stopTimerD(nta_outgoing_t* invite);
+
+		// session timers of every dialog share one coarse wheel; stack thread only
+		TimerEventHandle addSessionTimer(TimerFunc f, uint32_t milliseconds) {
+			return m_pSessionTimers->add(std::move(f), NULL, milliseconds) ;
+		}
+		void removeSessionTimer(TimerEventHandle handle) {
+			m_pSessionTimers->remove(handle) ;
+		}
         
     void clearDanglingIncomingRequests(std::vector<std::string> txnIds);
 
+		/// dialog journal (--dialog-journal); stack thread only
+		size_t restoreDialogs( const string& path ) ;
+		void journalRefresh( SipDialog& dlg ) ;
+
 	protected:
  		bool searchForHeader( tagi_t* tags, tag_type_t header, string& value ) ;
 		void bindIrq( nta_incoming_t* irq ) ;
 		void trackTportLiveness(nta_outgoing_t* orq, sip_t const* sip);
+		void journalCreate( std::shared_ptr<SipDialog>& dlg, sip_t const* sip ) ;
+		bool restoreDialog( const DialogJournal::Record_t& rec, size_t& nOverdue ) ;
 
 
 	private:
 		DrachtioController* m_pController ;
 		su_clone_r*			m_pClone ;
 
-		/* since access to the various maps below can be triggered either by arriva or network message, or client message - 
-			each in a different thread - we use this mutex to protect them.  To keep things straight, the mutex lock operations
-			are utilized in the low-level addXX, findXX, and clearXX methods that appear in this header file.  There should be
-			NO direct access to the maps nor use of the mutex in the .cpp (the exception being the method to log storage counts)
+		/* the maps below are reached from the stack thread (network messages) as well as the client threads (application
+			messages), so each one is striped, with a lock per stripe.  They are only touched by the low-level addXX, findXX, 
+			and clearXX methods, and the methods that log storage counts.
 		*/
-   	std::mutex 		m_mutex ;
-
 		nta_agent_t*		m_agent ;
 		std::shared_ptr< ClientController > m_pClientController ;
 
@@ -288,7 +235,7 @@ namespace drachtio {
 		// Requests sent by client
 
 		/* we need to lookup responses to requests sent by the client inside a dialog */
-		typedef std::unordered_map<nta_outgoing_t*, std::shared_ptr<RIP> > mapOrq2RIP ;
+		typedef StripedMap<nta_outgoing_t*, std::shared_ptr<RIP> > mapOrq2RIP ;
 		mapOrq2RIP m_mapOrq2RIP ;
         void logRIP(bool detail);
         
@@ -298,15 +245,24 @@ namespace drachtio {
 		struct IrqEntry {
 			nta_incoming_t* irq;
 			sip_time_t created;
+			IrqEntry() : irq(nullptr), created(0) {}
 			IrqEntry(nta_incoming_t* i) : irq(i), created(sip_now()) {}
 		};
-		typedef std::unordered_map<string, IrqEntry> mapTransactionId2Irq ;
+		typedef StripedMap<string, IrqEntry> mapTransactionId2Irq ;
 		mapTransactionId2Irq m_mapTransactionId2Irq ;
 
 
 		// timers for dialogs and leg that we can remove after suitable timeout period waiting for retransmissions
     std::shared_ptr<TimerQueueManager> m_pTQM ;
 
+		/* session refresh and expiry for all dialogs: seconds-long intervals, so a one second tick is plenty, and everything
+			due in the same second is dispatched in a single wakeup rather than one su_timer_t per dialog */
+		static constexpr unsigned int SESSION_TIMER_TICK_MSECS = 1000 ;
+		std::unique_ptr<TimerWheel> m_pSessionTimers ;
+
+		/* stable dialogs journaled for a warm restart, if enabled; the stack thread only queues records to it */
+		std::unique_ptr<DialogJournal> m_pJournal ;
+
 		// per-tport count of consecutive internally-generated request timeouts (408s); accessed only on the su_root thread
 		std::unordered_map<std::string, unsigned int> m_mapTportConsecutiveTimeouts;
 	} ;
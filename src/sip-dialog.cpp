@@ -21,6 +21,9 @@ THE SOFTWARE.
 */
 #include <stdexcept>
 #include <mutex>
+#include <algorithm>
+#include <vector>
+#include <iomanip>
 
 #include <boost/functional/hash.hpp>
 
@@ -51,22 +54,15 @@ namespace {
         boost::hash_combine(seed, d.getRemoteEndpoint().m_strTag.c_str());
         return seed;
     }
-
-    void session_timer_handler( su_root_magic_t* magic, su_timer_t* timer, su_timer_arg_t* args) {
-    	std::weak_ptr<drachtio::SipDialog> *p = reinterpret_cast< std::weak_ptr<drachtio::SipDialog> *>( args ) ;
-    	std::shared_ptr<drachtio::SipDialog> pDialog = p->lock() ;
-    	if( pDialog ) pDialog->doSessionTimerHandling() ;
-    	else assert(0) ;
-    }
-
-  	std::mutex sd_mutex;
 }
 
 namespace drachtio {
+
+	bool SipDialog::s_bKeepRemoteSdp = false ;
 	
 	/* dialog generated by an incoming INVITE */
 	SipDialog::SipDialog( nta_leg_t* leg, nta_incoming_t* irq, sip_t const *sip, msg_t* msg ) : m_type(we_are_uas), m_recentSipStatus(100), 
-		m_startTime(time(NULL)), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),m_ppSelf(NULL),
+		m_startTime(time(NULL)), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),
 		m_nSessionExpiresSecs(0), m_nMinSE(90), m_tp(nta_incoming_transport(theOneAndOnlyController->getAgent(), irq, msg) ), 
     m_leg( leg ), m_timerG(NULL), m_durationTimerG(0), m_timerH(NULL), m_orqAck(nullptr), m_orq(nullptr), m_seq(0),
 		m_bInviteDialog(sip->sip_request->rq_method == sip_method_invite), m_bAlerting(false), m_nSessionTimerDuration(0),
@@ -108,7 +104,7 @@ namespace drachtio {
 			}
 			else if (!theOneAndOnlyController->isNatDetectionDisabled() && sip->sip_contact && !sip->sip_record_route) {
 				const url_t* url = sip->sip_contact->m_url;
-				if (url && (0 != m_sourceAddress.compare(url->url_host) || (url->url_port && atoi(url->url_port) != m_sourcePort))) {
+				if (url && (0 != m_sourceAddress.str().compare(url->url_host) || (url->url_port && atoi(url->url_port) != m_sourcePort))) {
 					DR_LOG(log_info) << "SipDialog::SipDialog - (UAS) detected client behind nat, using  " << m_sourceAddress << ":" << m_sourcePort << " as route for requests within this dialog";
 					nat = true;
 				}
@@ -116,11 +112,12 @@ namespace drachtio {
 
 			if (nat) {
 				url_t const * url = nta_incoming_url(irq);
-				m_routeUri = url->url_scheme;
-				m_routeUri.append(":");
-				m_routeUri.append(m_sourceAddress); 
-				m_routeUri.append(":");
-				m_routeUri.append(boost::lexical_cast<string>(m_sourcePort));
+				string routeUri = url->url_scheme;
+				routeUri.append(":");
+				routeUri.append(m_sourceAddress.str()); 
+				routeUri.append(":");
+				routeUri.append(boost::lexical_cast<string>(m_sourcePort));
+				m_routeUri = routeUri;
 			}
 		}
 
@@ -131,7 +128,7 @@ namespace drachtio {
 	/* dialog generated by an outgoing INVITE */
 	SipDialog::SipDialog( const string& transactionId, nta_leg_t* leg, 
 		nta_outgoing_t* orq, sip_t const *sip, msg_t *msg, const string& transport) : m_type(we_are_uac), m_recentSipStatus(0), 
-		m_startTime(0), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),m_ppSelf(NULL),
+		m_startTime(0), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),
 		m_nSessionExpiresSecs(0), m_nMinSE(90), m_tp(NULL), m_leg(leg), m_orqAck(nullptr), m_orq(orq), m_seq(0),
     m_timerG(NULL), m_durationTimerG(0), m_timerH(NULL), m_nSessionTimerDuration(0),
 		m_bInviteDialog(sip->sip_request->rq_method == sip_method_invite), m_bAlerting(false), m_transactionId(transactionId),
@@ -155,7 +152,11 @@ namespace drachtio {
       m_protocol = tpn->tpn_proto ;      
     }
     else {
-      parseTransportDescription(transport, m_protocol, m_transportAddress, m_transportPort ) ;
+      string proto, host, port ;
+      parseTransportDescription(transport, proto, host, port ) ;
+      m_protocol = proto ;
+      m_transportAddress = host ;
+      m_transportPort = port ;
     }
 
 		const char *ltag = nta_leg_get_tag( leg ) ;
@@ -195,15 +196,37 @@ namespace drachtio {
 		DR_LOG(log_debug) << "SipDialog::SipDialog - creating dialog for outbound INVITE sent from " << m_protocol << "/" << m_transportAddress << ":" << m_transportPort << " to " << name << ":" << std::dec << port ;
 
 	}	
+	/* dialog rebuilt from the journal at startup; its transport is found again when the next request is sent */
+	SipDialog::SipDialog( nta_leg_t* leg, const DialogJournal::Record_t& rec ) : m_type((DialogType_t) rec.role), m_recentSipStatus(200),
+		m_startTime(rec.startTime), m_connectTime(rec.connectTime), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),
+		m_nSessionExpiresSecs(0), m_nMinSE(rec.minSE), m_tp(NULL), m_leg(leg), m_orqAck(nullptr), m_orq(nullptr), m_seq(0),
+    m_timerG(NULL), m_durationTimerG(0), m_timerH(NULL), m_nSessionTimerDuration(0),
+		m_bInviteDialog(0 != rec.inviteDialog), m_bAlerting(false), m_sourcePort(rec.sourcePort),
+		m_timeArrive(std::chrono::steady_clock::now()), m_bAckBye(false), m_tmArrival(sip_now()), m_bDestroyAckOnClose(false), m_irqUpdate(NULL)
+	{
+		m_dialogId = rec.dialogId ;
+		m_strCallId = rec.callId ;
+		this->setLocalTag( rec.localTag.c_str() ) ;
+		this->setRemoteTag( rec.remoteTag.c_str() ) ;
+		if( !rec.localSdp.empty() ) this->setLocalSdp( rec.localSdp.data(), rec.localSdp.length() ) ;
+		if( !rec.localContentType.empty() ) m_localEndpoint.m_strContentType = rec.localContentType ;
+		if( !rec.localContact.empty() ) m_strLocalContact = rec.localContact ;
+		if( !rec.routeUri.empty() ) m_routeUri = rec.routeUri ;
+
+		m_protocol = rec.protocol ;
+		m_transportAddress = rec.transportAddress ;
+		m_transportPort = rec.transportPort ;
+		m_sourceAddress = rec.sourceAddress ;
+
+		DR_LOG(log_debug) << "SipDialog::SipDialog - restored " << (we_are_uac == m_type ? "UAC" : "UAS") << " sip dialog with call-id " << getCallId() <<
+			" leg " << std::hex << (void *) m_leg;
+	}
+
 	SipDialog::~SipDialog() {
 		DR_LOG(log_debug) << "SipDialog::~SipDialog - destroying sip dialog with call-id " << getCallId() <<
             " leg " << std::hex << (void *) m_leg;
 		if( NULL != m_timerSessionRefresh ) {
 			cancelSessionTimer() ;
-			assert( m_ppSelf ) ;
-		}
-		if( m_ppSelf ) {
-			delete m_ppSelf ;
 		}
 
     if (m_leg) {
@@ -263,6 +286,68 @@ namespace drachtio {
     return os;
   }
 
+  void SipDialog::memoryUsage(MemoryUsage_t& usage) const {
+    usage[mem_object] += sizeof(SipDialog);
+    usage[mem_dialog_id] += stringHeapBytes(m_dialogId) + stringHeapBytes(m_transactionId);
+    usage[mem_call_id] += stringHeapBytes(m_strCallId);
+    usage[mem_tags] += stringHeapBytes(m_localEndpoint.m_strTag) + stringHeapBytes(m_remoteEndpoint.m_strTag);
+    usage[mem_local_sdp] += stringHeapBytes(m_localEndpoint.m_strSdp);
+    usage[mem_remote_sdp] += stringHeapBytes(m_remoteEndpoint.m_strSdp);
+    usage[mem_transaction_ids] += m_incomingRequestTransactionIds.capacity() * sizeof(std::string) + stringHeapBytes(m_updateTransactionId);
+    for (const auto& txnId : m_incomingRequestTransactionIds) usage[mem_transaction_ids] += stringHeapBytes(txnId);
+    if (m_timerSessionRefresh) usage[mem_session_timer] += sizeof(queueEntry_t);
+  }
+
+  void SipDialog::journalRecord(DialogJournal::Record_t& rec) {
+    rec.dialogId = getDialogId();
+    rec.callId = m_strCallId;
+    rec.role = m_type;
+    rec.inviteDialog = m_bInviteDialog;
+    rec.localContact = m_strLocalContact.str();
+    rec.routeUri = m_routeUri.str();
+    rec.protocol = m_protocol.str();
+    rec.transportAddress = m_transportAddress.str();
+    rec.transportPort = m_transportPort.str();
+    rec.sourceAddress = m_sourceAddress.str();
+    rec.sourcePort = m_sourcePort;
+    rec.localSdp = m_localEndpoint.m_strSdp;
+    rec.localContentType = m_localEndpoint.m_strContentType.str();
+    rec.sessionExpires = m_nSessionExpiresSecs;
+    rec.refresher = m_refresher;
+    rec.minSE = m_nMinSE;
+    rec.sessionDue = m_timerSessionRefresh ? time(0) + m_nSessionTimerDuration / 1000 : 0;
+    rec.startTime = m_startTime;
+    rec.connectTime = m_connectTime;
+
+    /* the tags, route set and remote target are the leg's; nta keeps the route set in the order requests are sent */
+    const char* tag = nta_leg_get_tag(m_leg);
+    const char* rtag = nta_leg_get_rtag(m_leg);
+    rec.localTag = tag ? tag : "";
+    rec.remoteTag = rtag ? rtag : "";
+    rec.localSeq = nta_leg_get_seq(m_leg);
+    rec.remoteSeq = nta_leg_get_rseq(m_leg);
+    rec.routeSet.clear();
+    rec.target.clear();
+    const sip_route_t* route = NULL;
+    const sip_contact_t* target = NULL;
+    if (nta_leg_get_route(m_leg, &route, &target) < 0) return;
+    su_home_t* home = theOneAndOnlyController->getHome();
+    for (const sip_route_t* r = route; r; r = r->r_next) {
+      char* s = sip_header_as_string(home, (sip_header_t const *) r);
+      if (!s) continue;
+      if (!rec.routeSet.empty()) rec.routeSet.append(", ");
+      rec.routeSet.append(s);
+      su_free(home, s);
+    }
+    if (target) {
+      char* s = sip_header_as_string(home, (sip_header_t const *) target);
+      if (s) {
+        rec.target = s;
+        su_free(home, s);
+      }
+    }
+  }
+
   void SipDialog::checkTportState(void) {
     if (m_tp && tport_is_closed(m_tp)) {
       DR_LOG(log_debug) << "SipDialog::checkTportState: tport(" << std::hex << (void *) m_tp << ") has been closed, releasing";
@@ -303,7 +388,7 @@ namespace drachtio {
 		return tp;
 	}
 
-	void SipDialog::setSessionTimer( unsigned long nSecs, SessionRefresher_t whoIsResponsible ) {
+	void SipDialog::setSessionTimer( unsigned long nSecs, SessionRefresher_t whoIsResponsible, su_duration_t firstMsecs ) {
 		if (m_timerSessionRefresh) cancelSessionTimer();
 		m_refresher = whoIsResponsible ;
 		m_nSessionTimerDuration = nSecs * 1000  ;
@@ -316,20 +401,29 @@ namespace drachtio {
 			m_nSessionTimerDuration /= 2 ;
 			m_nSessionTimerDuration += (rand() % 10000) - 5000 ;
 		}
-		m_timerSessionRefresh = su_timer_create( su_root_task(theOneAndOnlyController->getRoot()), m_nSessionTimerDuration ) ;
 
-		m_ppSelf = new std::weak_ptr<SipDialog>( shared_from_this() ) ;
-		su_timer_set(m_timerSessionRefresh, session_timer_handler, (su_timer_arg_t *) m_ppSelf );
+		/* a dialog restored from the journal picks up where its timer was when we went down */
+		if( firstMsecs > 0 ) m_nSessionTimerDuration = firstMsecs ;
+
+		std::weak_ptr<SipDialog> self = shared_from_this() ;
+		m_timerSessionRefresh = theOneAndOnlyController->getDialogController()->addSessionTimer( [self](void*) {
+			std::shared_ptr<SipDialog> pDialog = self.lock() ;
+			if( pDialog ) pDialog->doSessionTimerHandling() ;
+		}, m_nSessionTimerDuration ) ;
+		theOneAndOnlyController->getDialogController()->journalRefresh( *this ) ;
 	}
 	void SipDialog::cancelSessionTimer() {
 		assert( NULL != m_timerSessionRefresh ) ;
-		if (m_timerSessionRefresh) su_timer_destroy( m_timerSessionRefresh ) ;
+		if (m_timerSessionRefresh) theOneAndOnlyController->getDialogController()->removeSessionTimer( m_timerSessionRefresh ) ;
 		m_timerSessionRefresh = NULL ;
 		m_refresher = no_refresher ;
 		m_nSessionExpiresSecs = 0 ;
 	}
 	void SipDialog::doSessionTimerHandling() {
 		bool bWeAreRefresher = areWeRefresher()  ;
+
+		/* the wheel frees the entry once we return, so it must not be cancelled from here on */
+		m_timerSessionRefresh = NULL ;
 		
 		if( bWeAreRefresher ) {
 			//send a refreshing reINVITE, and notify the client
@@ -343,72 +437,90 @@ namespace drachtio {
 			theOneAndOnlyController->getDialogController()->notifyTerminateStaleDialog( shared_from_this() ) ;
 		}
 
-		assert( m_ppSelf ) ;
-		delete m_ppSelf ; m_ppSelf = NULL ; m_timerSessionRefresh = NULL ; m_refresher = no_refresher ; m_nSessionExpiresSecs = 0 ;
+		m_refresher = no_refresher ; m_nSessionExpiresSecs = 0 ;
 	}
 
 	void SD_Insert(StableDialogs_t& dialogs, std::shared_ptr<SipDialog>& dlg) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
-		auto& idx = dialogs.get<DlgPtrTag>();
-    auto res = idx.insert(dlg);
-		if (!res.second) {
+		const std::string& dialogId = dlg->getDialogId();
+		if (!dialogs.byDialogId.insert(dialogId, dlg)) {
+	    DR_LOG(log_error) << "SD_Insert failed to insert dialog " << *dlg;
+			return;
+		}
+		if (!dialogs.byLeg.insert(dlg->getNtaLeg(), dlg)) {
+			dialogs.byDialogId.erase(dialogId);
 	    DR_LOG(log_error) << "SD_Insert failed to insert dialog " << *dlg;
 		}
 	}
 
 	bool SD_FindByLeg(const StableDialogs_t& dialogs, nta_leg_t* leg, std::shared_ptr<SipDialog>& dlg) {
-		std::lock_guard<std::mutex> lock(sd_mutex) ;
-    auto &idx = dialogs.get<DlgLegTag>();
-    auto it = idx.find(leg);
-    if (it == idx.end()) return false;
-    dlg = *it;
-    return true;
+    return dialogs.byLeg.find(leg, dlg);
 	}
 	bool SD_FindByDialogId(const StableDialogs_t& dialogs, const std::string& dialogId, std::shared_ptr<SipDialog>& dlg) {
-		std::lock_guard<std::mutex> lock(sd_mutex) ;
-    auto &idx = dialogs.get<DialogIdTag>();
-    auto it = idx.find(dialogId);
-    if (it == idx.end()) return false;
-    dlg = *it;
-    return true;
+    return dialogs.byDialogId.find(dialogId, dlg);
 	}
   void SD_Clear(StableDialogs_t& dialogs, std::shared_ptr<SipDialog>& dlg) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
-
-    auto &idx = dialogs.get<DlgPtrTag>();
-    idx.erase(dlg);
+    auto same = [&dlg](const std::shared_ptr<SipDialog>& p) { return p == dlg; };
+    if (dialogs.byDialogId.eraseIf(dlg->getDialogId(), same) && dialogs.journal) dialogs.journal->appendDestroy(dlg->getDialogId());
+    dialogs.byLeg.eraseIf(dlg->getNtaLeg(), same);
 	}
 
   void SD_Clear(StableDialogs_t& dialogs, const std::string& dialogId) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
-
-    auto &idx = dialogs.get<DialogIdTag>();
-    idx.erase(dialogId);
+    std::shared_ptr<SipDialog> dlg;
+    if (dialogs.byDialogId.erase(dialogId, dlg)) {
+      dialogs.byLeg.eraseIf(dlg->getNtaLeg(), [&dlg](const std::shared_ptr<SipDialog>& p) { return p == dlg; });
+      if (dialogs.journal) dialogs.journal->appendDestroy(dialogId);
+    }
 	}
 
   void SD_Clear(StableDialogs_t& dialogs, nta_leg_t* leg) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
-
-    auto &idx = dialogs.get<DlgLegTag>();
-    idx.erase(leg);
+    std::shared_ptr<SipDialog> dlg;
+    if (dialogs.byLeg.erase(leg, dlg)) {
+      if (dialogs.byDialogId.eraseIf(dlg->getDialogId(), [&dlg](const std::shared_ptr<SipDialog>& p) { return p == dlg; }) && dialogs.journal) {
+        dialogs.journal->appendDestroy(dlg->getDialogId());
+      }
+    }
 	}
 
   size_t SD_Size(const StableDialogs_t& dialogs) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
-    auto &idx = dialogs.get<DlgPtrTag>();
-    return idx.size();
+    return dialogs.byDialogId.size();
 	}
 
   size_t SD_Size(const StableDialogs_t& dialogs, size_t& nUac, size_t& nUas) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
-    auto &idx = dialogs.get<DlgPtrTag>();
-    size_t total = idx.size();
-		auto &idxRole = dialogs.get<DlgRoleTag>();
-		nUac = idxRole.count(SipDialog::we_are_uac);
-		nUas = idxRole.count(SipDialog::we_are_uas);
-		return total;
+    nUac = nUas = 0;
+    dialogs.byDialogId.forEach([&nUac, &nUas](const std::string&, const std::shared_ptr<SipDialog>& p) {
+      if (SipDialog::we_are_uac == p->getRole()) nUac++;
+      else nUas++;
+    });
+		return nUac + nUas;
 	}
 
+  void SD_MemoryReport(const StableDialogs_t& dialogs) {
+    static const char* names[SipDialog::mem_field_count] = {
+      "SipDialog object", "dialog and transaction id", "call-id", "tags", "local sdp", "remote sdp", 
+      "open transaction ids", "session timer"
+    };
+    SipDialog::MemoryUsage_t usage = {};
+    size_t count = 0;
+    dialogs.byDialogId.forEach([&usage, &count](const std::string&, const std::shared_ptr<SipDialog>& p) {
+      p->memoryUsage(usage);
+      count++;
+    });
+    InternedString::PoolStats pool = InternedString::poolStats();
+
+    DR_LOG(log_info) << "StableDialogs memory report, bytes per dialog over " << count << " dialogs (remote sdp " << 
+      (SipDialog::keepRemoteSdp() ? "kept" : "not kept") << ")";
+    if (0 == count) return;
+    size_t total = 0;
+    for (int i = 0; i < SipDialog::mem_field_count; i++) {
+      DR_LOG(log_info) << "    " << std::left << std::setw(60) << names[i] << std::right << std::setw(8) << usage[i] / count;
+      total += usage[i];
+    }
+    DR_LOG(log_info) << "    " << std::left << std::setw(60) << "interned strings (shared pool, all dialogs)" << std::right << std::setw(8) << pool.bytes / count;
+    DR_LOG(log_info) << "    " << std::left << std::setw(60) << "total" << std::right << std::setw(8) << (total + pool.bytes) / count;
+    DR_LOG(log_info) << "    interned strings: " << pool.entries << " distinct values, " << pool.references << " references";
+    DR_LOG(log_info) << "    (sofia's nta_leg_t is not included)";
+  }
+
   void SD_Log(const StableDialogs_t& dialogs, bool full) {
 		size_t count, nUac, nUas;
 		count = SD_Size(dialogs, nUac, nUas);
@@ -416,14 +528,14 @@ namespace drachtio {
     DR_LOG(log_debug) << "StableDialogs uac:                                               " << nUac;
     DR_LOG(log_debug) << "StableDialogs uas:                                               " << nUas;
     if (full && count) {
-      std::lock_guard<std::mutex> lock(sd_mutex) ;
-      auto &idx = dialogs.get<DlgTimeTag>();
-      for (auto it = idx.begin(); it != idx.end(); ++it) {
-				std::shared_ptr<SipDialog> p = *it;
+      std::vector<std::shared_ptr<SipDialog>> v;
+      dialogs.byDialogId.forEach([&v](const std::string&, const std::shared_ptr<SipDialog>& p) { v.push_back(p); });
+      std::sort(v.begin(), v.end(), [](const std::shared_ptr<SipDialog>& a, const std::shared_ptr<SipDialog>& b) { return *a < *b; });
+      for (const auto& p : v) {
         DR_LOG(log_debug) << *p;
       }
     }
 
 	}
 
-} 
+}
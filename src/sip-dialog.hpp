@@ -25,14 +25,9 @@ THE SOFTWARE.
 #include <sys/time.h>
 #include <chrono>
 #include <iostream>
-#include <set>
-
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/identity.hpp>
+#include <algorithm>
+#include <vector>
+#include <array>
 
 #include <sofia-sip/nta.h>
 #include <sofia-sip/nta_tport.h>
@@ -43,22 +38,18 @@ THE SOFTWARE.
 
 
 #include "timer-queue.hpp"
-
-using namespace ::boost::multi_index;
+#include "striped-map.hpp"
+#include "interned-string.hpp"
+#include "dialog-journal.hpp"
 
 namespace drachtio {
 
-  struct DlgPtrTag{};
-  struct DlgTimeTag{};
-  struct DlgLegTag{};
-  struct DialogIdTag{};
-  struct DlgRoleTag{};
-
 	class SipDialog : public std::enable_shared_from_this<SipDialog> {
 	public:
 		SipDialog( nta_leg_t* leg, nta_incoming_t* irq, sip_t const *sip, msg_t *msg  ) ;
 		SipDialog( const std::string& transactionId, nta_leg_t* leg, 
 			nta_outgoing_t* orq, sip_t const *sip, msg_t *msg, const std::string& transport ) ;
+		SipDialog( nta_leg_t* leg, const DialogJournal::Record_t& rec ) ;
 		~SipDialog() ;
 
 		bool operator <(const SipDialog& a) const { return m_tmArrival < a.m_tmArrival; }
@@ -67,16 +58,31 @@ namespace drachtio {
 
 		int processRequest( nta_leg_t* leg, nta_incoming_t* irq, sip_t const *sip ) ;
 
+		/* values shared by many dialogs (addresses, content type) are interned; the tag and sdp are not */
 		struct Endpoint_t {
 			Endpoint_t() : m_signalingPort(0) {}
 
-			std::string			m_strSignalingAddress ;
+			InternedString	m_strSignalingAddress ;
 			unsigned int 	m_signalingPort ;
 			std::string			m_strSdp ;
-			std::string 			m_strContentType ;
+			InternedString 	m_strContentType ;
 			std::string			m_strTag ;
 		} ;
 
+		/* what each dialog holds in memory, in bytes, by field; see SD_MemoryReport */
+		enum MemoryField_t {
+			mem_object = 0
+			,mem_dialog_id
+			,mem_call_id
+			,mem_tags
+			,mem_local_sdp
+			,mem_remote_sdp
+			,mem_transaction_ids
+			,mem_session_timer
+			,mem_field_count
+		} ;
+		typedef std::array<size_t, mem_field_count> MemoryUsage_t ;
+
 		enum DialogType_t {
 			we_are_uac = 0
 			,we_are_uas
@@ -119,24 +125,24 @@ namespace drachtio {
 		bool hasRemoteSdp(void) const { return !m_remoteEndpoint.m_strSdp.empty(); }
 		void setLocalSdp(const char* sdp) { m_localEndpoint.m_strSdp.assign( sdp );}
 		void setLocalSdp(const char* data, unsigned int len) { m_localEndpoint.m_strSdp.assign( data, len );}
-		void setRemoteSdp(const char* sdp) { m_remoteEndpoint.m_strSdp.assign( sdp );}
-		void setRemoteSdp(const char* data, unsigned int len) { m_remoteEndpoint.m_strSdp.assign( data, len );}
-		void setRemoteContentType( std::string& type ) { m_remoteEndpoint.m_strContentType = type ; }
+		void setRemoteSdp(const char* sdp) { if (s_bKeepRemoteSdp) m_remoteEndpoint.m_strSdp.assign( sdp );}
+		void setRemoteSdp(const char* data, unsigned int len) { if (s_bKeepRemoteSdp) m_remoteEndpoint.m_strSdp.assign( data, len );}
+		void setRemoteContentType( std::string& type ) { if (s_bKeepRemoteSdp) m_remoteEndpoint.m_strContentType = type ; }
 		void setLocalContentType( std::string& type ) { m_localEndpoint.m_strContentType = type ; }
 		void setRemoteSignalingAddress( const char* szAddress ) { m_remoteEndpoint.m_strSignalingAddress = szAddress; }
 		void setLocalSignalingAddress( const char* szAddress ) { m_localEndpoint.m_strSignalingAddress = szAddress; }
 		void setRemoteSignalingPort( unsigned int port ) { m_remoteEndpoint.m_signalingPort = port; }
 		void setLocalSignalingPort( unsigned int port ) { m_localEndpoint.m_signalingPort = port; }
-		const std::string& getLocalSignalingAddress(void) { return m_localEndpoint.m_strSignalingAddress; }
+		const std::string& getLocalSignalingAddress(void) { return m_localEndpoint.m_strSignalingAddress.str(); }
 		unsigned int getLocalSignalingPort(void) { return m_localEndpoint.m_signalingPort; }
 		void setLocalContactHeader(const char* szContact) { m_strLocalContact = szContact;}
-		const std::string& getLocalContactHeader(void) { return m_strLocalContact; }
-		const std::string& getTransportAddress(void) const { return m_transportAddress; }
-		const std::string& getTransportPort(void) const { return m_transportPort; }
-		const std::string& getProtocol(void) const { return m_protocol; }
-		void getTransportDesc(std::string desc) const { desc = m_protocol + "/" + m_transportAddress + ":" + m_transportPort; }
+		const std::string& getLocalContactHeader(void) { return m_strLocalContact.str(); }
+		const std::string& getTransportAddress(void) const { return m_transportAddress.str(); }
+		const std::string& getTransportPort(void) const { return m_transportPort.str(); }
+		const std::string& getProtocol(void) const { return m_protocol.str(); }
+		void getTransportDesc(std::string desc) const { desc = m_protocol.str() + "/" + m_transportAddress.str() + ":" + m_transportPort.str(); }
 
-		const std::string& getSourceAddress(void) const { return m_sourceAddress;}
+		const std::string& getSourceAddress(void) const { return m_sourceAddress.str();}
 		unsigned int getSourcePort(void) const { return m_sourcePort; }
 		void setSourceAddress( const std::string& host ) { m_sourceAddress = host; }
 		void setSourcePort( unsigned int port ) { m_sourcePort = port; }
@@ -153,7 +159,7 @@ namespace drachtio {
 
 		void setTransactionId(const std::string& strValue) { m_transactionId = strValue; }
 
-		void setSessionTimer( unsigned long nSecs, SessionRefresher_t whoIsResponsible ) ;
+		void setSessionTimer( unsigned long nSecs, SessionRefresher_t whoIsResponsible, su_duration_t firstMsecs = 0 ) ;
 		bool hasSessionTimer(void) { return NULL != m_timerSessionRefresh; }
 		void cancelSessionTimer(void) ;
 		void doSessionTimerHandling(void) ;
@@ -196,7 +202,7 @@ namespace drachtio {
 
 		bool getRouteUri(std::string& routeUri) {
 			if (!m_routeUri.empty()) {
-				routeUri = m_routeUri;
+				routeUri = m_routeUri.str();
 				return true;
 			}
 			return false;
@@ -223,14 +229,18 @@ namespace drachtio {
 		uint32_t getSeq(void) { return m_seq; }
 		void clearSeq(void) {m_seq = 0;}
         
+    /* rarely more than one or two are open at a time, so a vector beats a set in both space and speed */
     void addIncomingRequestTransaction(std::string& txnId) {
-        m_incomingRequestTransactionIds.insert(txnId);
+        if (m_incomingRequestTransactionIds.end() == std::find(m_incomingRequestTransactionIds.begin(), m_incomingRequestTransactionIds.end(), txnId)) {
+          m_incomingRequestTransactionIds.push_back(txnId);
+        }
     }
     void removeIncomingRequestTransaction(std::string& txnId) {
-        m_incomingRequestTransactionIds.erase(txnId);
+        auto it = std::find(m_incomingRequestTransactionIds.begin(), m_incomingRequestTransactionIds.end(), txnId);
+        if (m_incomingRequestTransactionIds.end() != it) m_incomingRequestTransactionIds.erase(it);
     }
     std::vector<std::string> getIncomingRequestTransactionIds(void) {
-        return std::vector<std::string>(m_incomingRequestTransactionIds.begin(), m_incomingRequestTransactionIds.end());
+        return m_incomingRequestTransactionIds;
     }
 
     void setUpdateIrq(nta_incoming_t* irq, const std::string& transactionId) {
@@ -247,9 +257,20 @@ namespace drachtio {
       m_irqUpdate = NULL;
       m_updateTransactionId.clear();
     }
+
+		void memoryUsage(MemoryUsage_t& usage) const ;
+
+		/* fills in what the journal needs to rebuild this dialog, other than the From and To */
+		void journalRecord(DialogJournal::Record_t& rec) ;
+
+		/* the remote offer/answer is not needed once the dialog is up, so by default it is not kept */
+		static void setKeepRemoteSdp(bool keep) { s_bKeepRemoteSdp = keep; }
+		static bool keepRemoteSdp(void) { return s_bKeepRemoteSdp; }
 		
 	protected:
 
+		static bool s_bKeepRemoteSdp ;
+
     void          checkTportState(void);
 
 		bool 				m_bInviteDialog;
@@ -267,22 +288,20 @@ namespace drachtio {
 		time_t					m_endTime ;
 		ReleaseCause_t	m_releaseCause ;
 
-		std::string 			m_transportAddress ;
-		std::string 			m_transportPort ;
-		std::string 			m_transportProtocol ;
+		InternedString 	m_transportAddress ;
+		InternedString 	m_transportPort ;
 
-		std::string			m_strLocalContact;
+		InternedString	m_strLocalContact;
 
     /* session timer */
     unsigned long 	m_nSessionExpiresSecs ;
     unsigned long 	m_nMinSE ;
-    su_timer_t*     m_timerSessionRefresh ;
+    TimerEventHandle  m_timerSessionRefresh ;   // entry in SipDialogController's session timer wheel
     SessionRefresher_t	m_refresher ;
-    std::weak_ptr<SipDialog>* m_ppSelf ;
 
-		std::string 			m_sourceAddress ;
+		InternedString 	m_sourceAddress ;
 		unsigned int 	m_sourcePort ;
-		std::string      m_protocol ;
+		InternedString  m_protocol ;
 
 		nta_leg_t* 	m_leg; 
 		tport_t* 	m_tp;
@@ -297,13 +316,12 @@ namespace drachtio {
     // irq for the original INVITE, used to validate Timer G/H callbacks
     nta_incoming_t* m_irqInvite = nullptr;
 
-		std::string 		m_routeUri;
+		InternedString 	m_routeUri;
 
 		// sip timers
     TimerEventHandle  m_timerG ;
     TimerEventHandle  m_timerH ;
     uint32_t					m_durationTimerG;
-    uint32_t					m_countTimerG;
 
 		//timing
 		std::chrono::time_point<std::chrono::steady_clock> m_timeArrive;
@@ -317,34 +335,19 @@ namespace drachtio {
 		// arrival time
 		sip_time_t m_tmArrival;
         
-    std::set<std::string> m_incomingRequestTransactionIds;
+    std::vector<std::string> m_incomingRequestTransactionIds;
 	}  ;
 
-  typedef multi_index_container<
-    std::shared_ptr<SipDialog>,
-    indexed_by<
-      hashed_unique<
-        boost::multi_index::tag<DlgPtrTag>,
-        boost::multi_index::identity< std::shared_ptr<SipDialog> >
-      >,
-      ordered_non_unique<
-        boost::multi_index::tag<DlgTimeTag>,
-        boost::multi_index::identity<SipDialog> 
-      >,
-      hashed_unique<
-        boost::multi_index::tag<DlgLegTag>,
-        boost::multi_index::const_mem_fun<SipDialog, const nta_leg_t*, &SipDialog::getNtaLeg>
-      >,
-      hashed_unique<
-        boost::multi_index::tag<DialogIdTag>,
-        boost::multi_index::mem_fun<SipDialog, const std::string&, &SipDialog::getDialogId>
-      >,
-      hashed_non_unique<
-        boost::multi_index::tag<DlgRoleTag>,
-        boost::multi_index::const_mem_fun<SipDialog, SipDialog::DialogType_t, &SipDialog::getRole>
-      >
-    >
-  > StableDialogs_t;
+  /**
+   * Stable dialogs, indexed by leg and by dialog id.  Like InvitesInProgress_t each index is a StripedMap,
+   * so that lookups from the stack thread and the client threads rarely wait on each other; use the SD_* 
+   * helpers rather than the indexes.  When dialogs are journaled, SD_Clear journals the destroy.
+   */
+  struct StableDialogs_t {
+    StripedMap<std::string, std::shared_ptr<SipDialog>>         byDialogId ;
+    StripedMap<const nta_leg_t*, std::shared_ptr<SipDialog>>    byLeg ;
+    DialogJournal*                                              journal = nullptr ;   // set when --dialog-journal is in use
+  } ;
 
 	void SD_Insert(StableDialogs_t& dialogs, std::shared_ptr<SipDialog>& dlg);
 
@@ -357,6 +360,7 @@ namespace drachtio {
   size_t SD_Size(const StableDialogs_t& dialogs, size_t& nUac, size_t& nUas);
 
   void SD_Log(const StableDialogs_t& dialogs, bool full = false);
+  void SD_MemoryReport(const StableDialogs_t& dialogs);
 
 }
 
@@ -0,0 +1,93 @@
+#include <sofia-sip/sip_header.h>
+
+#include "sip-metrics.hpp"
+#include "drachtio.h"
+
+namespace drachtio {
+
+  SipMetrics::SipMetrics() : m_stats(nullptr) {
+    for( int m = 0; m < METHOD_COUNT; m++ ) {
+      for( int s = 0; s < STATUS_COUNT; s++ ) {
+        m_responsesIn[m][s].store( CounterHandle(), std::memory_order_relaxed ) ;
+        m_responsesOut[m][s].store( CounterHandle(), std::memory_order_relaxed ) ;
+      }
+    }
+  }
+
+  void SipMetrics::init( StatsCollector& stats ) {
+    m_stats = &stats ;
+    if( !stats.enabled() ) return ;
+
+    for( int m = sip_method_unknown + 1; m < METHOD_COUNT; m++ ) {
+      const char* name = sip_method_name( static_cast<sip_method_t>( m ), NULL ) ;
+      if( !name ) continue ;
+      m_requestsIn[m] = stats.counterHandle( STATS_COUNTER_SIP_REQUESTS_IN, {{"method", name}} ) ;
+      m_requestsOut[m] = stats.counterHandle( STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", name}} ) ;
+    }
+
+    m_histograms[invite_pdd_in] = stats.histogramHandle( STATS_HISTOGRAM_INVITE_PDD_IN ) ;
+    m_histograms[invite_pdd_out] = stats.histogramHandle( STATS_HISTOGRAM_INVITE_PDD_OUT ) ;
+    m_histograms[invite_answer_in] = stats.histogramHandle( STATS_HISTOGRAM_INVITE_RESPONSE_TIME_IN ) ;
+    m_histograms[invite_answer_out] = stats.histogramHandle( STATS_HISTOGRAM_INVITE_RESPONSE_TIME_OUT ) ;
+    for( int h = hop_sip_to_client_queue; h < histogram_count; h++ ) {
+      m_histograms[h] = stats.histogramHandle( STATS_HISTOGRAM_HOP_LATENCY, {{"hop", hopName( static_cast<Histogram_t>( h ) )}} ) ;
+    }
+  }
+
+  const char* SipMetrics::hopName( Histogram_t which ) {
+    switch( which ) {
+      case hop_sip_to_client_queue: return "sip_to_client_queue" ;
+      case hop_client_write: return "client_write" ;
+      case hop_client_dispatch: return "client_dispatch" ;
+      case hop_client_to_sip_queue: return "client_to_sip_queue" ;
+      case hop_http_route_queue: return "http_route_queue" ;
+      case hop_http_route_request: return "http_route_request" ;
+      case hop_http_route_complete: return "http_route_complete" ;
+      default: return "" ;
+    }
+  }
+
+  void SipMetrics::request( const string& family, CounterHandle* handles, sip_method_t method, const char* name ) {
+    if( !m_stats ) return ;
+    if( isKnown( method ) && handles[method] ) {
+      m_stats->counterIncrement( handles[method] ) ;
+    }
+    else if( name ) {
+      m_stats->counterIncrement( family, {{"method", name}} ) ;
+    }
+  }
+
+  void SipMetrics::response( const string& family, ResponseTable_t& table, sip_method_t method, const char* name, int status ) {
+    if( !m_stats || !name ) return ;
+    if( !isKnown( method ) || status < MIN_STATUS || status > MAX_STATUS ) {
+      m_stats->counterIncrement( family, {{"method", name}, {"code", std::to_string( status )}} ) ;
+      return ;
+    }
+
+    // resolving the same labels twice yields the same counter, so a race here is harmless
+    std::atomic<CounterHandle>& slot = table[method][status - MIN_STATUS] ;
+    CounterHandle handle = slot.load( std::memory_order_acquire ) ;
+    if( !handle ) {
+      handle = m_stats->counterHandle( family, {{"method", name}, {"code", std::to_string( status )}} ) ;
+      slot.store( handle, std::memory_order_release ) ;
+    }
+    m_stats->counterIncrement( handle ) ;
+  }
+
+  void SipMetrics::requestIn( sip_method_t method, const char* name ) {
+    request( STATS_COUNTER_SIP_REQUESTS_IN, m_requestsIn, method, name ) ;
+  }
+  void SipMetrics::requestOut( sip_method_t method, const char* name ) {
+    request( STATS_COUNTER_SIP_REQUESTS_OUT, m_requestsOut, method, name ) ;
+  }
+  void SipMetrics::responseIn( sip_method_t method, const char* name, int status ) {
+    response( STATS_COUNTER_SIP_RESPONSES_IN, m_responsesIn, method, name, status ) ;
+  }
+  void SipMetrics::responseOut( sip_method_t method, const char* name, int status ) {
+    response( STATS_COUNTER_SIP_RESPONSES_OUT, m_responsesOut, method, name, status ) ;
+  }
+
+  void SipMetrics::observe( Histogram_t which, double val ) {
+    if( m_stats ) m_stats->histogramObserve( m_histograms[which], val ) ;
+  }
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __SIP_METRICS_HPP__
+#define __SIP_METRICS_HPP__
+
+#include <atomic>
+#include <chrono>
+
+#include <sofia-sip/sip.h>
+
+#include "stats-collector.hpp"
+
+namespace drachtio {
+
+  /**
+   * The sip request/response counters and call setup histograms sit on the message path, so rather
+   * than looking up the metric family and building a label map on every message we resolve a
+   * handle for each (method) or (method, status) label set once and keep it in a fixed table.
+   * Request counters and histograms are resolved up front by init(); response counters are resolved
+   * the first time a given status is seen, so that we do not export a zero series for every code.
+   * Methods sofia does not know by enum (extension methods) fall back to the string-keyed api.
+   *
+   * It also holds the internal hop latency histograms, which time each leg a message takes between
+   * the sip stack thread, the client (application) thread and the http routing thread.
+   */
+  class SipMetrics {
+  public:
+    enum Histogram_t {
+      invite_pdd_in = 0,
+      invite_pdd_out,
+      invite_answer_in,
+      invite_answer_out,
+
+      // internal hops, exported as STATS_HISTOGRAM_HOP_LATENCY with a "hop" label
+      hop_sip_to_client_queue,    // posted by the sip thread until run by the client thread
+      hop_client_write,           // written to an application socket until the write completes
+      hop_client_dispatch,        // read from an application socket until handed off to the sip thread
+      hop_client_to_sip_queue,    // su_msg_send by the client thread until run by the sip thread
+      hop_http_route_queue,       // makeRequestForRoute until the http thread starts the request
+      hop_http_route_request,     // http request started until curl completes it
+      hop_http_route_complete,    // curl completion until httpCallRoutingComplete returns
+      histogram_count
+    } ;
+
+    SipMetrics() ;
+    SipMetrics( const SipMetrics& ) = delete ;
+
+    // call after the metric families have been created
+    void init( StatsCollector& stats ) ;
+
+    void requestIn( sip_method_t method, const char* name ) ;
+    void requestOut( sip_method_t method, const char* name ) ;
+    void responseIn( sip_method_t method, const char* name, int status ) ;
+    void responseOut( sip_method_t method, const char* name, int status ) ;
+
+    void observe( Histogram_t which, double val ) ;
+    void observeSince( Histogram_t which, std::chrono::steady_clock::time_point since ) {
+      observe( which, std::chrono::duration<double>( std::chrono::steady_clock::now() - since ).count() ) ;
+    }
+
+    static const char* hopName( Histogram_t which ) ;
+
+  private:
+    static const int METHOD_COUNT = sip_method_publish + 1 ;
+    static const int MIN_STATUS = 100 ;
+    static const int MAX_STATUS = 699 ;
+    static const int STATUS_COUNT = MAX_STATUS - MIN_STATUS + 1 ;
+
+    typedef StatsCollector::CounterHandle CounterHandle ;
+    typedef std::atomic<CounterHandle> ResponseTable_t[METHOD_COUNT][STATUS_COUNT] ;
+
+    static bool isKnown( sip_method_t method ) { return method > sip_method_unknown && method < METHOD_COUNT ; }
+
+    void request( const string& family, CounterHandle* handles, sip_method_t method, const char* name ) ;
+    void response( const string& family, ResponseTable_t& table, sip_method_t method, const char* name, int status ) ;
+
+    StatsCollector*   m_stats ;
+
+    CounterHandle     m_requestsIn[METHOD_COUNT] ;
+    CounterHandle     m_requestsOut[METHOD_COUNT] ;
+    ResponseTable_t   m_responsesIn ;
+    ResponseTable_t   m_responsesOut ;
+
+    StatsCollector::HistogramHandle m_histograms[histogram_count] ;
+  } ;
+
+}
+
+#endif
@@ -271,20 +271,17 @@ namespace drachtio {
         // stats
         if (theOneAndOnlyController->getStatsCollector().enabled()) {
             if (m_sipStatus >= 200) {
-                STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {
-                    {"method", sip->sip_cseq->cs_method_name},
-                    {"code", boost::lexical_cast<std::string>(sip->sip_status->st_status)}
-                })
+                STATS_SIP_RESPONSE_OUT(sip->sip_cseq->cs_method, sip->sip_cseq->cs_method_name, sip->sip_status->st_status)
             }
             if (sip->sip_cseq->cs_method == sip_method_invite) {
                 auto now = std::chrono::steady_clock::now();
                 std::chrono::duration<double> diff = now - this->getArrivalTime();
                 if (!this->hasAlerted() && m_sipStatus >= 180) {
                     this->alerting();
-                    STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_PDD_IN, diff.count())
+                    STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_pdd_in, diff.count())
                 }
                 if (m_sipStatus == 200) {
-                    STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_RESPONSE_TIME_IN, diff.count())
+                    STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_answer_in, diff.count())
                 }
 
             }
@@ -335,14 +332,14 @@ namespace drachtio {
     }
     ProxyCore::ClientTransaction::~ClientTransaction() {
         DR_LOG(log_debug) << "ClientTransaction::~ClientTransaction" ;
-        removeTimer( m_timerA, "timerA" ) ;
-        removeTimer( m_timerB, "timerB" ) ;
-        removeTimer( m_timerC, "timerC" ) ;
-        removeTimer( m_timerD, "timerD" ) ;
-        removeTimer( m_timerE, "timerE" ) ;
-        removeTimer( m_timerF, "timerF" ) ;
-        removeTimer( m_timerK, "timerK" ) ;
-        removeTimer( m_timerProvisional, "timerProvisional" ) ;
+        removeTimer( m_timerA, sip_timer_A ) ;
+        removeTimer( m_timerB, sip_timer_B ) ;
+        removeTimer( m_timerC, sip_timer_C ) ;
+        removeTimer( m_timerD, sip_timer_D ) ;
+        removeTimer( m_timerE, sip_timer_E ) ;
+        removeTimer( m_timerF, sip_timer_F ) ;
+        removeTimer( m_timerK, sip_timer_K ) ;
+        removeTimer( m_timerProvisional, sip_timer_provisional ) ;
 
         if( m_msgFinal ) { 
             msg_destroy( m_msgFinal ) ;
@@ -360,9 +357,9 @@ namespace drachtio {
         } ;
         return szNames[ static_cast<int>( state ) ] ;
     }
-    void ProxyCore::ClientTransaction::removeTimer( TimerEventHandle& handle, const char* szTimer ) {
+    void ProxyCore::ClientTransaction::removeTimer( TimerEventHandle& handle, SipTimerClass timerClass ) {
         if( NULL == handle ) return ;
-        m_pTQM->removeTimer( handle, szTimer ) ;
+        m_pTQM->removeTimer( handle, timerClass ) ;
         handle = NULL ;
     }
     void ProxyCore::ClientTransaction::setState( State_t newState ) {
@@ -384,19 +381,19 @@ namespace drachtio {
                     assert( !m_timerC ) ;
 
                     //timer A = retransmission timer 
-                    m_timerA = m_pTQM->addTimer("timerA", 
+                    m_timerA = m_pTQM->addTimer(sip_timer_A, 
                         std::bind(&ProxyCore::timerA, pCore, shared_from_this()), NULL, m_durationTimerA = NTA_SIP_T1 ) ;
 
                     //timer B = timeout when all invite retransmissions have been exhausted
-                    m_timerB = m_pTQM->addTimer("timerB", 
+                    m_timerB = m_pTQM->addTimer(sip_timer_B, 
                         std::bind(&ProxyCore::timerB, pCore, shared_from_this()), NULL, TIMER_B_MSECS ) ;
                     
                     //timer C - timeout to wait for final response before returning 408 Request Timeout. 
-                    m_timerC = m_pTQM->addTimer("timerC", 
+                    m_timerC = m_pTQM->addTimer(sip_timer_C, 
                         std::bind(&ProxyCore::timerC, pCore, shared_from_this()), NULL, TIMER_C_MSECS ) ;
 
                     if( pCore->getProvisionalTimeout() > 0 ) {
-                        m_timerProvisional = m_pTQM->addTimer("timerProvisional", 
+                        m_timerProvisional = m_pTQM->addTimer(sip_timer_provisional, 
                             std::bind(&ProxyCore::timerProvisional, pCore, shared_from_this()), NULL, pCore->getProvisionalTimeout() ) ;
                     }
                     m_timeArrive = std::chrono::steady_clock::now();
@@ -404,31 +401,31 @@ namespace drachtio {
                 break ;
 
                 case proceeding:
-                    removeTimer( m_timerA, "timerA" ) ;
-                    removeTimer( m_timerB, "timerB" ) ;
-                    removeTimer( m_timerProvisional, "timerProvisional" ) ;
+                    removeTimer( m_timerA, sip_timer_A ) ;
+                    removeTimer( m_timerB, sip_timer_B ) ;
+                    removeTimer( m_timerProvisional, sip_timer_provisional ) ;
                 break; 
 
                 case completed:
-                    removeTimer( m_timerA, "timerA" ) ;
-                    removeTimer( m_timerB, "timerB" ) ;
-                    removeTimer( m_timerC, "timerC" ) ;
-                    removeTimer( m_timerProvisional, "timerProvisional" ) ;
+                    removeTimer( m_timerA, sip_timer_A ) ;
+                    removeTimer( m_timerB, sip_timer_B ) ;
+                    removeTimer( m_timerC, sip_timer_C ) ;
+                    removeTimer( m_timerProvisional, sip_timer_provisional ) ;
 
                     //timer D - timeout when transaction can move from completed state to terminated
                     //note: in the case of a late-arriving provisional response after we've decided to cancel an invite, 
                     //we can have a timer D set when we get here as state will go 
                     //CALLING --> COMPLETED (when decide to cancel) --> PROCEEDING (when late response arrives) --> COMPLETED (as we send the CANCEL)
-                    removeTimer( m_timerD, "timerD" ) ;
-                    m_timerD = m_pTQM->addTimer("timerD", std::bind(&ProxyCore::timerD, pCore, shared_from_this()), 
+                    removeTimer( m_timerD, sip_timer_D ) ;
+                    m_timerD = m_pTQM->addTimer(sip_timer_D, std::bind(&ProxyCore::timerD, pCore, shared_from_this()), 
                         NULL, TIMER_D_MSECS ) ;
                 break ;
 
                 case terminated:
-                    removeTimer( m_timerA, "timerA" ) ;
-                    removeTimer( m_timerB, "timerB" ) ;
-                    removeTimer( m_timerC, "timerC" ) ;
-                    removeTimer( m_timerProvisional, "timerProvisional" ) ;
+                    removeTimer( m_timerA, sip_timer_A ) ;
+                    removeTimer( m_timerB, sip_timer_B ) ;
+                    removeTimer( m_timerC, sip_timer_C ) ;
+                    removeTimer( m_timerProvisional, sip_timer_provisional ) ;
                 break ;
 
                 default:
@@ -444,29 +441,29 @@ namespace drachtio {
 
                     assert( !m_timerE ) ; //TODO: should only be doing this on unreliable transports
                     assert( !m_timerF ) ;
-                    m_timerE = m_pTQM->addTimer("timerE", 
+                    m_timerE = m_pTQM->addTimer(sip_timer_E, 
                         std::bind(&ProxyCore::timerE, pCore, shared_from_this()), NULL, m_durationTimerA = NTA_SIP_T1 ) ;
-                    m_timerF = m_pTQM->addTimer("timerF", 
+                    m_timerF = m_pTQM->addTimer(sip_timer_F, 
                         std::bind(&ProxyCore::timerF, pCore, shared_from_this()), NULL, 64 * NTA_SIP_T1 ) ;
                 break ;
 
                 case proceeding: 
                     //we've received a provisional response to a non-INVITE (rare, but possible)
-                    removeTimer( m_timerE, "timerE" ) ;
+                    removeTimer( m_timerE, sip_timer_E ) ;
                 break ;
 
                 case completed: 
                     //we've received a final response to a non-INVITE request
-                    removeTimer( m_timerE, "timerE" ) ;
-                    removeTimer( m_timerF, "timerF" ) ;
-                    m_timerK = m_pTQM->addTimer("timerK", std::bind(&ProxyCore::timerK, pCore, shared_from_this()), 
+                    removeTimer( m_timerE, sip_timer_E ) ;
+                    removeTimer( m_timerF, sip_timer_F ) ;
+                    m_timerK = m_pTQM->addTimer(sip_timer_K, std::bind(&ProxyCore::timerK, pCore, shared_from_this()), 
                         NULL, NTA_SIP_T4 ) ;
                 break ;
 
                 case terminated:
-                    removeTimer( m_timerE, "timerE" ) ;
-                    removeTimer( m_timerF, "timerF" ) ;
-                    removeTimer( m_timerK, "timerK" ) ;
+                    removeTimer( m_timerE, sip_timer_E ) ;
+                    removeTimer( m_timerF, sip_timer_F ) ;
+                    removeTimer( m_timerK, sip_timer_K ) ;
                 break ;
 
                 default:
@@ -520,7 +517,7 @@ namespace drachtio {
             return false ;
         }
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "PRACK"}})
+        STATS_SIP_REQUEST_OUT(sip_method_prack, "PRACK")
 
         return true ;
     }
@@ -620,7 +617,7 @@ namespace drachtio {
             return true ;
         }
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", sip->sip_request->rq_method_name}})
+        STATS_SIP_REQUEST_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
 
         if( 1 == m_transmitCount && this->isInviteTransaction() ) {
             Cdr::postCdr( std::make_shared<CdrAttempt>( msg, "application" ) );
@@ -637,11 +634,11 @@ namespace drachtio {
             std::shared_ptr<ProxyCore> pCore = m_pCore.lock() ;
             assert( pCore ) ;
             if( this->isInviteTransaction() ) {
-                m_timerA = m_pTQM->addTimer("timerA", 
+                m_timerA = m_pTQM->addTimer(sip_timer_A, 
                     std::bind(&ProxyCore::timerA, pCore, shared_from_this()), NULL, m_durationTimerA) ;
             }
             else {
-                m_timerE = m_pTQM->addTimer("timerE", 
+                m_timerE = m_pTQM->addTimer(sip_timer_E, 
                     std::bind(&ProxyCore::timerE, pCore, shared_from_this()), NULL, m_durationTimerA) ;                
             }
             return true ;
@@ -698,15 +695,15 @@ namespace drachtio {
 
                 if( 100 != m_sipStatus && this->isInviteTransaction() ) {
                     assert( m_timerC ) ;
-                    removeTimer( m_timerC, "timerC" ) ;
-                    m_timerC = m_pTQM->addTimer("timerC", std::bind(&ProxyCore::timerC, pCore, shared_from_this()), 
+                    removeTimer( m_timerC, sip_timer_C ) ;
+                    m_timerC = m_pTQM->addTimer(sip_timer_C, std::bind(&ProxyCore::timerC, pCore, shared_from_this()), 
                         NULL, TIMER_C_MSECS ) ;
 
                     if (theOneAndOnlyController->getStatsCollector().enabled() && !this->hasAlerted()) {
                         this->alerting();
                         auto now = std::chrono::steady_clock::now();
                         std::chrono::duration<double> diff = now - this->getArrivalTime();
-                        STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_PDD_OUT, diff.count())
+                        STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_pdd_out, diff.count())
                     }
                 }                  
             }
@@ -720,10 +717,10 @@ namespace drachtio {
                 if (theOneAndOnlyController->getStatsCollector().enabled() && this->isInviteTransaction() && 200 == m_sipStatus) {
                     auto now = std::chrono::steady_clock::now();
                     std::chrono::duration<double> diff = now - this->getArrivalTime();
-                    STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_RESPONSE_TIME_OUT, diff.count())
+                    STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_answer_out, diff.count())
 
                     if (!this->hasAlerted()) {
-                        STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_INVITE_PDD_OUT, diff.count())
+                        STATS_SIP_HISTOGRAM_OBSERVE_NOCHECK(invite_pdd_out, diff.count())
                     }
                 }
             }
@@ -732,7 +729,7 @@ namespace drachtio {
             }
 
             if( m_sipStatus >= 200 && this->isInviteTransaction() ) {
-                removeTimer(m_timerC, "timerC") ;
+                removeTimer(m_timerC, sip_timer_C) ;
             }
 
             //determine whether to forward this response upstream
@@ -820,12 +817,12 @@ namespace drachtio {
     int ProxyCore::ClientTransaction::cancelRequest(msg_t* msg) {
 
         //cancel retransmission timers 
-        removeTimer( m_timerA, "timerA" ) ;
-        removeTimer( m_timerB, "timerB" ) ;
-        removeTimer( m_timerC, "timerC" ) ;
-        removeTimer( m_timerC, "timerE" ) ;
-        removeTimer( m_timerC, "timerF" ) ;
-        removeTimer( m_timerC, "timerK" ) ;
+        removeTimer( m_timerA, sip_timer_A ) ;
+        removeTimer( m_timerB, sip_timer_B ) ;
+        removeTimer( m_timerC, sip_timer_C ) ;
+        removeTimer( m_timerE, sip_timer_E ) ;
+        removeTimer( m_timerF, sip_timer_F ) ;
+        removeTimer( m_timerK, sip_timer_K ) ;
 
         if( calling == m_state ) {
             DR_LOG(log_debug) << "ClientTransaction::cancelRequest - client request in CALLING state has not received a response so not sending CANCEL" ;
@@ -879,7 +876,7 @@ namespace drachtio {
  
             goto err ;
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "CANCEL"}})
+        STATS_SIP_REQUEST_OUT(sip_method_cancel, "CANCEL")
 
         m_canceled = true ;
         return 0;
@@ -1198,7 +1195,7 @@ namespace drachtio {
 
             assert(m_agent) ;
             theProxyController = this ;
-            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot() ) ;
+            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot(), pController->getTimerSettings(), "proxy" ) ;
     }
     SipProxyController::~SipProxyController() {
     }
@@ -1210,14 +1207,15 @@ namespace drachtio {
         DR_LOG(log_debug) << "SipProxyController::proxyRequest - transactionId: " << transactionId ;
        
         su_msg_r m = SU_MSG_R_INIT ;
-        int rv = su_msg_create( m, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneProxy, sizeof( SipProxyController::ProxyData ) );
+        int rv = su_msg_create( m, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneProxy, 
+            ProxyData::size( clientMsgId, transactionId, provisionalTimeout, finalTimeout, vecDestinations, headers ) );
         if( rv < 0 ) {
             m_pController->getClientController()->route_api_response( clientMsgId, "NOK", "Internal server error allocating message") ;
             return  ;
         }
         void* place = su_msg_data( m ) ;
 
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
+        /* placement new into the su_msg block, which is sized for the object and the fields packed after it; the stack thread destroys it */
         ProxyData* msgData = new(place) ProxyData( clientMsgId, transactionId, recordRoute, fullResponse, followRedirects, 
             simultaneous, provisionalTimeout, finalTimeout, vecDestinations, headers ) ;
         rv = su_msg_send(m);  
@@ -1313,18 +1311,12 @@ namespace drachtio {
         string callId = sip->sip_call_id->i_id ;
         DR_LOG(log_debug) << "SipProxyController::processResponse " << std::dec << sip->sip_status->st_status << " " << callId ;
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_IN, {
-            {"method", sip->sip_cseq->cs_method_name},
-            {"code", boost::lexical_cast<std::string>(sip->sip_status->st_status)}
-        }) 
+        STATS_SIP_RESPONSE_IN(sip->sip_cseq->cs_method, sip->sip_cseq->cs_method_name, sip->sip_status->st_status) 
 
         // responses to PRACKs we forward downstream
         if( sip_method_prack == sip->sip_cseq->cs_method ) {
             DR_LOG(log_debug)<< "processResponse - forwarding response to PRACK downstream " << callId ;
-            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {
-                {"method", sip->sip_cseq->cs_method_name},
-                {"code", boost::lexical_cast<std::string>(sip->sip_status->st_status)}
-            }) 
+            STATS_SIP_RESPONSE_OUT(sip->sip_cseq->cs_method, sip->sip_cseq->cs_method_name, sip->sip_status->st_status) 
             nta_msg_tsend( NTA, msg, NULL, TAG_END() ) ;  
             return true ;                      
         }
@@ -1338,10 +1330,7 @@ namespace drachtio {
         //search for a matching client transaction to handle the response
         if( !p->processResponse( msg, sip ) ) {
             DR_LOG(log_debug)<< "processResponse - forwarding upstream (not handled by client transactions)" << callId ;
-            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {
-                {"method", sip->sip_cseq->cs_method_name},
-                {"code", boost::lexical_cast<std::string>(sip->sip_status->st_status)}
-            }) 
+            STATS_SIP_RESPONSE_OUT(sip->sip_cseq->cs_method, sip->sip_cseq->cs_method_name, sip->sip_status->st_status) 
             nta_msg_tsend( NTA, msg, NULL, TAG_END() ) ;  
             return true ;          
         }
@@ -1367,7 +1356,7 @@ namespace drachtio {
 
         DR_LOG(log_debug) << "SipProxyController::processRequestWithRouteHeader " << callId ;
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", sip->sip_request->rq_method_name}})
+        STATS_SIP_REQUEST_IN(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
 
         sip_route_remove( msg, sip) ;
 
@@ -1432,7 +1421,7 @@ namespace drachtio {
             DR_LOG(log_error) << "SipProxyController::processRequestWithRouteHeader failed proxying request " << callId << ": error " << rc ; 
             return false ;
         }
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", sip->sip_request->rq_method_name}})
+        STATS_SIP_REQUEST_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
 
         if( sip_method_bye == sip->sip_request->rq_method ) {
             Cdr::postCdr( std::make_shared<CdrStop>( msg, "application", Cdr::normal_release ) );            
@@ -1445,7 +1434,7 @@ namespace drachtio {
     bool SipProxyController::processRequestWithoutRouteHeader( msg_t* msg, sip_t* sip ) {
         string callId = sip->sip_call_id->i_id ;
 
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", sip->sip_request->rq_method_name}})
+        STATS_SIP_REQUEST_IN(sip->sip_request->rq_method, sip->sip_request->rq_method_name)
 
         std::shared_ptr<ProxyCore> p = getProxy( sip ) ;
         if( !p ) {
@@ -1475,10 +1464,7 @@ namespace drachtio {
         if(  sip_method_cancel == sip->sip_request->rq_method ) {
             p->setCanceled(true) ;
 
-            STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {
-                {"method", sip->sip_request->rq_method_name},
-                {"code", "200"}
-            }) 
+            STATS_SIP_RESPONSE_OUT(sip->sip_request->rq_method, sip->sip_request->rq_method_name, 200) 
 
             nta_msg_treply( NTA, msg, 200, NULL, TAG_END() ) ;  //200 OK to the CANCEL
             p->generateResponse( 487 ) ;   //487 to INVITE
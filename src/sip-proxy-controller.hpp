@@ -40,9 +40,7 @@ THE SOFTWARE.
 #include "pending-request-controller.hpp"
 #include "timer-queue.hpp"
 #include "timer-queue-manager.hpp"
-
-#define MAX_DESTINATIONS (10)
-#define HDR_STR_LEN (1024)
+#include "packed-message.hpp"
 
 namespace drachtio {
 
@@ -135,13 +133,13 @@ namespace drachtio {
           m_msgFinal = NULL ;
         }
         //cancel  timers 
-        removeTimer( m_timerA, "timerA" ) ;
-        removeTimer( m_timerB, "timerB" ) ;
-        removeTimer( m_timerC, "timerC" ) ;
-        removeTimer( m_timerD, "timerD" ) ;
-        removeTimer( m_timerE, "timerE" ) ;
-        removeTimer( m_timerF, "timerF" ) ;
-        removeTimer( m_timerK, "timerK" ) ;
+        removeTimer( m_timerA, sip_timer_A ) ;
+        removeTimer( m_timerB, sip_timer_B ) ;
+        removeTimer( m_timerC, sip_timer_C ) ;
+        removeTimer( m_timerD, sip_timer_D ) ;
+        removeTimer( m_timerE, sip_timer_E ) ;
+        removeTimer( m_timerF, sip_timer_F ) ;
+        removeTimer( m_timerK, sip_timer_K ) ;
       }
 
 
@@ -174,7 +172,7 @@ namespace drachtio {
       }
       void writeCdr( msg_t* msg, sip_t* sip ) ;
       const char* getStateName( State_t state) ;
-      void removeTimer( TimerEventHandle& handle, const char *szTimer = NULL ) ;
+      void removeTimer( TimerEventHandle& handle, SipTimerClass timerClass ) ;
 
       std::weak_ptr<ProxyCore>  m_pCore ;
       msg_t*  m_msgFinal ;
@@ -322,82 +320,8 @@ namespace drachtio {
       TimerEventHandle m_handle ;
     } ;
 
-    class ProxyData {
-    public:
-      ProxyData() {
-        memset(m_szClientMsgId, 0, sizeof(m_szClientMsgId) ) ;
-        memset(m_szTransactionId, 0, sizeof(m_szTransactionId) ) ;
-        memset(m_szProvisionalTimeout, 0, sizeof(m_szProvisionalTimeout)) ;
-        memset(m_szFinalTimeout, 0, sizeof(m_szFinalTimeout)) ;
-        memset(m_szDestination, 0, MAX_DESTINATIONS * URI_LEN) ;
-        memset(m_szHeaders, 0, sizeof(m_szHeaders)) ;
-        m_bRecordRoute = m_bFullResponse = m_bSimultaneous = m_bFollowRedirects = false ;
-      }
-      ProxyData(const string& clientMsgId, const string& transactionId, bool recordRoute, 
-        bool fullResponse, bool followRedirects, bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, 
-        const vector<string>& vecDestinations, const string& headers ) {
-
-        strncpy( m_szClientMsgId, clientMsgId.c_str(), MSG_ID_LEN - 1) ;
-        strncpy( m_szTransactionId, transactionId.c_str(), MSG_ID_LEN -1 ) ;
-        m_bRecordRoute = recordRoute ;
-        m_bFullResponse = fullResponse ;
-        m_bFollowRedirects = followRedirects ;
-        m_bSimultaneous = simultaneous ;
-        strncpy( m_szProvisionalTimeout, provisionalTimeout.c_str(), 15) ;
-        strncpy( m_szFinalTimeout, finalTimeout.c_str(), 15) ;
-        strncpy( m_szHeaders, headers.c_str(), HDR_STR_LEN - 1) ;
-        int i = 0 ;
-        BOOST_FOREACH( const string& dest, vecDestinations ) {
-          strncpy( m_szDestination[i++], dest.c_str(), URI_LEN - 1) ;
-        }
-       }
-      ~ProxyData() {}
-      ProxyData& operator=(const ProxyData& md) {
-        strncpy( m_szClientMsgId, md.m_szClientMsgId, MSG_ID_LEN) ;
-        strncpy( m_szTransactionId, md.m_szTransactionId, MSG_ID_LEN) ;
-        m_bRecordRoute = md.m_bRecordRoute ;
-        m_bFullResponse = md.m_bFullResponse ;
-        m_bFollowRedirects = md.m_bFollowRedirects ;
-        m_bSimultaneous = md.m_bSimultaneous ;
-        strncpy( m_szProvisionalTimeout, md.m_szProvisionalTimeout, 15) ;
-        strncpy( m_szFinalTimeout, md.m_szFinalTimeout, 15) ;
-        strncpy( m_szHeaders, md.m_szHeaders, HDR_STR_LEN - 1) ;
-        memset(m_szDestination, 0, MAX_DESTINATIONS * URI_LEN) ;
-        for( int i = 0; i < MAX_DESTINATIONS && *md.m_szDestination[i]; i++ ) {
-          strcpy( m_szDestination[i], md.m_szDestination[i] ) ;
-        }
-        return *this ;
-      }
-
-      const char* getClientMsgId() { return m_szClientMsgId; } 
-      bool hasClientMsgId() { return m_szClientMsgId[0] != '\0'; }
-      const char* getTransactionId() { return m_szTransactionId; } 
-      bool getRecordRoute() { return m_bRecordRoute;}
-      bool getFullResponse() { return m_bFullResponse;}
-      bool getFollowRedirects() { return m_bFollowRedirects;}
-      bool getSimultaneous() { return m_bSimultaneous;}
-      const char* getProvisionalTimeout() { return m_szProvisionalTimeout;}
-      const char* getFinalTimeout() { return m_szFinalTimeout;}
-      void getDestinations( vector<string>& vecDestination ) {
-        vecDestination.clear() ;
-        for( int i = 0; i < MAX_DESTINATIONS && *m_szDestination[i]; i++ ) {
-          vecDestination.push_back( m_szDestination[i] ) ;
-        }
-      }
-      const char* getHeaders() { return m_szHeaders;}
-
-    private:
-      char  m_szClientMsgId[MSG_ID_LEN];
-      char  m_szTransactionId[MSG_ID_LEN];
-      bool  m_bRecordRoute ;
-      bool  m_bFullResponse ;
-      bool  m_bFollowRedirects ;
-      bool  m_bSimultaneous ;
-      char  m_szProvisionalTimeout[16] ;
-      char  m_szFinalTimeout[16] ;
-      char  m_szDestination[MAX_DESTINATIONS][URI_LEN] ;
-      char  m_szHeaders[HDR_STR_LEN] ;
-    } ;
+    // what the client thread hands to the stack thread for a request an application wants proxied
+    typedef drachtio::ProxyData ProxyData ;
 
     void proxyRequest( const string& clientMsgId, const string& transactionId, bool recordRoute, bool fullResponse,
       bool followRedirects, bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, 
@@ -1,5 +1,10 @@
 #include <assert.h>
 #include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <algorithm>
 
 #include "stats-collector.hpp"
 #include "drachtio.h"
@@ -13,6 +18,64 @@
 
 using namespace prometheus;
 
+namespace {
+
+  /*
+   * Metrics updated through handles are not written to the prometheus objects directly, since those
+   * are shared by the sip, client and http threads and every update would bounce the same cache lines
+   * between cores.  Instead each thread accumulates into a shard of its own, without locks or atomic
+   * read-modify-writes, and the shards are folded into the registry when the exposer is scraped.
+   *
+   * A shard is a chunked array of cells; each handle owns a fixed range of cell indexes in every
+   * shard (1 cell for a counter, one per bucket plus one for the sum for a histogram).  A cell holds
+   * the running total for its thread, and the scrape keeps a copy of what it has already merged.
+   */
+  const size_t SHARD_CHUNK_CELLS = 4096 ;
+  const size_t SHARD_MAX_CHUNKS = 256 ;
+
+  class Shard {
+  public:
+    Shard() {
+      for (auto& chunk : m_chunks) chunk.store(nullptr, std::memory_order_relaxed) ;
+    }
+    ~Shard() {
+      for (auto& chunk : m_chunks) delete [] chunk.load(std::memory_order_relaxed) ;
+    }
+
+    // owning thread only
+    std::atomic<double>* cells(size_t index) {
+      std::atomic<double>* chunk = m_chunks[index / SHARD_CHUNK_CELLS].load(std::memory_order_relaxed) ;
+      if (nullptr == chunk) {
+        chunk = new std::atomic<double>[SHARD_CHUNK_CELLS] ;
+        for (size_t i = 0; i < SHARD_CHUNK_CELLS; i++) chunk[i].store(0.0, std::memory_order_relaxed) ;
+        m_chunks[index / SHARD_CHUNK_CELLS].store(chunk, std::memory_order_release) ;
+      }
+      return chunk + index % SHARD_CHUNK_CELLS ;
+    }
+    static void add(std::atomic<double>& cell, double val) {
+      cell.store(cell.load(std::memory_order_relaxed) + val, std::memory_order_relaxed) ;
+    }
+
+    // scrape only; returns false if the owning thread has never touched the cells
+    bool read(size_t index, size_t width, double* values) const {
+      const std::atomic<double>* chunk = m_chunks[index / SHARD_CHUNK_CELLS].load(std::memory_order_acquire) ;
+      if (nullptr == chunk) return false ;
+      chunk += index % SHARD_CHUNK_CELLS ;
+      for (size_t i = 0; i < width; i++) values[i] = chunk[i].load(std::memory_order_relaxed) ;
+      return true ;
+    }
+
+    // scrape only: the totals already merged into the registry, by cell index
+    std::vector<double> m_merged ;
+
+  private:
+    std::atomic<std::atomic<double>*> m_chunks[SHARD_MAX_CHUNKS] ;
+  } ;
+
+  // there is a single StatsCollector per process
+  thread_local Shard* tlsShard = nullptr ;
+}
+
 namespace drachtio {
   
   //using BucketBoundaries = std::vector<double>;
@@ -33,9 +96,36 @@ namespace drachtio {
     typedef std::unordered_map<string, std::shared_ptr<Family<Gauge> > > mapGauge_t;
     typedef std::unordered_map<string, HistogramSpec_t > mapHistogram_t;
 
+    // the metric behind a handle, and where it lives in each shard
+    class ShardedMetric {
+    public:
+      ShardedMetric(Counter* c, size_t idx) : counter(c), histogram(nullptr), index(idx), width(1) {}
+      ShardedMetric(Histogram* h, const BucketBoundaries& b, size_t idx) : 
+        counter(nullptr), histogram(h), buckets(b), index(idx), width(b.size() + 2) {}
+      Counter* counter;
+      Histogram* histogram;
+      BucketBoundaries buckets;
+      size_t index;
+      size_t width;
+    };
+
+    // registered ahead of the registry so that shards are folded in before the registry is collected
+    class ShardMerger : public Collectable {
+    public:
+      ShardMerger(PromImpl& impl) : m_impl(impl) {}
+      std::vector<MetricFamily> Collect() const override {
+        m_impl.mergeShards();
+        return {};
+      }
+    private:
+      PromImpl& m_impl;
+    };
+
     PromImpl() = delete;
-    PromImpl(const char* szHostport) : m_exposer(szHostport) {
+    PromImpl(const char* szHostport) : m_exposer(szHostport), m_nextCell(0) {
       m_registry = std::make_shared<Registry>();
+      m_merger = std::make_shared<ShardMerger>(*this);
+      m_exposer.RegisterCollectable(m_merger);
       m_exposer.RegisterCollectable(m_registry);
     }
     ~PromImpl() {}
@@ -63,6 +153,25 @@ namespace drachtio {
       }
     }
 
+    ShardedMetric* counterHandle(const string& name, mapLabels_t& labels) {
+      mapCounter_t::const_iterator it = m_mapCounter.find(name) ;
+      if (m_mapCounter.end() != it) {
+        Counter* counter = &it->second->Add(labels) ;
+        std::lock_guard<std::mutex> lock(m_shardMutex) ;
+        auto resolved = m_mapResolved.find(counter) ;
+        if (m_mapResolved.end() != resolved) return resolved->second ;
+        size_t index ;
+        if (!allocateCells(1, index)) return nullptr ;
+        m_metrics.emplace_back(counter, index) ;
+        return m_mapResolved[counter] = &m_metrics.back() ;
+      }
+      return nullptr ;
+    }
+
+    void counterIncrement(const ShardedMetric& metric, const double val) {
+      Shard::add(*localShard()->cells(metric.index), val) ;
+    }
+
     void buildGauge(const string& name, const char* desc) {
       auto& m = BuildGauge()
         .Name(name)
@@ -115,6 +224,13 @@ namespace drachtio {
       }
     }
 
+    void gaugeRemove(const string& name, mapLabels_t& labels) {
+       mapGauge_t::const_iterator it = m_mapGauge.find(name) ;
+      if (m_mapGauge.end() != it) {
+        it->second->Remove(&it->second->Add(labels)) ;
+      }
+    }
+
     void buildHistogram(const string& name, const char* desc, const BucketBoundaries& buckets) {
       auto& m = BuildHistogram()
         .Name(name)
@@ -134,8 +250,85 @@ namespace drachtio {
       }
     }
 
+    ShardedMetric* histogramHandle(const string& name, mapLabels_t& labels) {
+       mapHistogram_t::const_iterator it = m_mapHistogram.find(name) ;
+      if (m_mapHistogram.end() != it) {
+        const HistogramSpec_t& spec = it->second;
+        Histogram* histogram = &spec.p->Add(labels, spec.buckets);
+        std::lock_guard<std::mutex> lock(m_shardMutex) ;
+        auto resolved = m_mapResolved.find(histogram) ;
+        if (m_mapResolved.end() != resolved) return resolved->second ;
+        size_t index ;
+        if (!allocateCells(spec.buckets.size() + 2, index)) return nullptr ;
+        m_metrics.emplace_back(histogram, spec.buckets, index) ;
+        return m_mapResolved[histogram] = &m_metrics.back() ;
+      }
+      return nullptr ;
+    }
+
+    void histogramObserve(const ShardedMetric& metric, const double val) {
+      // same bucket selection as prometheus: the first upper bound that is >= val, else +Inf
+      size_t bucket = std::distance(metric.buckets.begin(), 
+        std::lower_bound(metric.buckets.begin(), metric.buckets.end(), val)) ;
+      std::atomic<double>* cells = localShard()->cells(metric.index) ;
+      Shard::add(cells[bucket], 1.0) ;
+      Shard::add(cells[metric.width - 1], val) ;
+    }
+
+    // fold whatever each thread has accumulated since the last scrape into the registry
+    void mergeShards() {
+      std::lock_guard<std::mutex> lock(m_shardMutex) ;
+      std::vector<double> values, deltas ;
+      for (auto& shard : m_shards) {
+        if (shard->m_merged.size() < m_nextCell) shard->m_merged.resize(m_nextCell, 0.0) ;
+        for (const ShardedMetric& metric : m_metrics) {
+          values.resize(metric.width) ;
+          if (!shard->read(metric.index, metric.width, values.data())) continue ;
+
+          double* merged = &shard->m_merged[metric.index] ;
+          deltas.resize(metric.width) ;
+          bool changed = false ;
+          for (size_t i = 0; i < metric.width; i++) {
+            deltas[i] = values[i] - merged[i] ;
+            merged[i] = values[i] ;
+            if (deltas[i] != 0.0) changed = true ;
+          }
+          if (!changed) continue ;
+
+          if (metric.counter) metric.counter->Increment(deltas[0]) ;
+          else {
+            double sum = deltas.back() ;
+            deltas.pop_back() ;
+            metric.histogram->ObserveMultiple(deltas, sum) ;
+          }
+        }
+      }
+    }
   
   private:
+    // caller holds m_shardMutex
+    bool allocateCells(size_t width, size_t& index) {
+      // a metric's cells never straddle two chunks
+      if (m_nextCell % SHARD_CHUNK_CELLS + width > SHARD_CHUNK_CELLS) {
+        m_nextCell += SHARD_CHUNK_CELLS - m_nextCell % SHARD_CHUNK_CELLS ;
+      }
+      if (width > SHARD_CHUNK_CELLS || m_nextCell + width > SHARD_CHUNK_CELLS * SHARD_MAX_CHUNKS) {
+        DR_LOG(log_error) << "StatsCollector: no room left for per-thread metrics, update will be dropped" ;
+        return false ;
+      }
+      index = m_nextCell ;
+      m_nextCell += width ;
+      return true ;
+    }
+
+    Shard* localShard() {
+      if (nullptr == tlsShard) {
+        std::lock_guard<std::mutex> lock(m_shardMutex) ;
+        m_shards.emplace_back(new Shard()) ;
+        tlsShard = m_shards.back().get() ;
+      }
+      return tlsShard ;
+    }
 
     Exposer m_exposer;
     std::shared_ptr<Registry> m_registry;
@@ -143,6 +336,14 @@ namespace drachtio {
     mapCounter_t  m_mapCounter;
     mapGauge_t  m_mapGauge;
     mapHistogram_t  m_mapHistogram;
+
+    // per-thread metrics, see Shard above
+    std::shared_ptr<ShardMerger> m_merger;
+    std::mutex m_shardMutex;
+    std::deque<ShardedMetric> m_metrics;
+    std::unordered_map<void*, ShardedMetric*> m_mapResolved;
+    std::vector<std::unique_ptr<Shard> > m_shards;
+    size_t m_nextCell;
   };
 
   StatsCollector::StatsCollector() : m_pimpl(nullptr) {
@@ -168,6 +369,14 @@ namespace drachtio {
   void StatsCollector::counterIncrement(const string& name, const double val, mapLabels_t labels) {
     if (nullptr != m_pimpl) m_pimpl->counterIncrement(name, val, labels); 
   }
+  StatsCollector::CounterHandle StatsCollector::counterHandle(const string& name, mapLabels_t labels) {
+    CounterHandle handle;
+    if (nullptr != m_pimpl) handle.m_p = m_pimpl->counterHandle(name, labels);
+    return handle;
+  }
+  void StatsCollector::counterIncrement(const CounterHandle& handle, const double val) {
+    if (nullptr != handle.m_p) m_pimpl->counterIncrement(*static_cast<PromImpl::ShardedMetric*>(handle.m_p), val);
+  }
 
   // gauges
   void StatsCollector::gaugeCreate(const string& name, const char* desc) {
@@ -191,6 +400,9 @@ namespace drachtio {
   void StatsCollector::gaugeSetToCurrentTime(const string& name, mapLabels_t labels) {
     if (nullptr != m_pimpl) m_pimpl->gaugeSetToCurrentTime(name, labels); 
   }
+  void StatsCollector::gaugeRemove(const string& name, mapLabels_t labels) {
+    if (nullptr != m_pimpl) m_pimpl->gaugeRemove(name, labels); 
+  }
 
   // histograms
   void StatsCollector::histogramCreate(const string& name, const char* desc, const BucketBoundaries& buckets) {
@@ -199,5 +411,13 @@ namespace drachtio {
   void StatsCollector::histogramObserve(const string& name, double val, mapLabels_t labels) {
     if (nullptr != m_pimpl) m_pimpl->histogramObserve(name, val, labels); 
   }
+  StatsCollector::HistogramHandle StatsCollector::histogramHandle(const string& name, mapLabels_t labels) {
+    HistogramHandle handle;
+    if (nullptr != m_pimpl) handle.m_p = m_pimpl->histogramHandle(name, labels);
+    return handle;
+  }
+  void StatsCollector::histogramObserve(const HistogramHandle& handle, double val) {
+    if (nullptr != handle.m_p) m_pimpl->histogramObserve(*static_cast<PromImpl::ShardedMetric*>(handle.m_p), val);
+  }
 
 }
@@ -42,6 +42,25 @@ namespace drachtio {
       SUMMARY
     };
 
+    // a metric whose family and label set have been resolved once, up front, so that updating
+    // it does no map lookups, label copies or hashing; empty if stats are disabled
+    class CounterHandle {
+    public:
+      CounterHandle() : m_p(nullptr) {}
+      explicit operator bool() const { return nullptr != m_p; }
+    private:
+      friend class StatsCollector;
+      void* m_p;
+    };
+    class HistogramHandle {
+    public:
+      HistogramHandle() : m_p(nullptr) {}
+      explicit operator bool() const { return nullptr != m_p; }
+    private:
+      friend class StatsCollector;
+      void* m_p;
+    };
+
     //static std::shared_ptr<Cdr> postCdr( std::shared_ptr<Cdr> cdr, const string& encodedMsg = "" ) ;
 
     StatsCollector( const StatsCollector& ) = delete;
@@ -56,6 +75,8 @@ namespace drachtio {
     void counterCreate(const string& name, const char* desc);
     void counterIncrement(const string& name, mapLabels_t labels = {});
     void counterIncrement(const string& name, double val, mapLabels_t labels = {});
+    CounterHandle counterHandle(const string& name, mapLabels_t labels = {});
+    void counterIncrement(const CounterHandle& handle, double val = 1.0);
 
     // gauges
     void gaugeCreate(const string& name, const char* desc);
@@ -65,10 +86,13 @@ namespace drachtio {
     void gaugeDecrement(const string& name, double val, mapLabels_t labels = {});
     void gaugeSet(const string& name, double val, mapLabels_t labels = {});
     void gaugeSetToCurrentTime(const string& name, mapLabels_t labels = {});
+    void gaugeRemove(const string& name, mapLabels_t labels);
 
     // histogram
     void histogramCreate(const string& name, const char* desc, const BucketBoundaries& buckets);
     void histogramObserve(const string& name, double val, mapLabels_t labels = {}) ;
+    HistogramHandle histogramHandle(const string& name, mapLabels_t labels = {});
+    void histogramObserve(const HistogramHandle& handle, double val) ;
 
     // summary
     //void summaryObserve(const string& name, const double val) ;
@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2013-2019, David C Horton
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __STRIPED_MAP_HPP__
+#define __STRIPED_MAP_HPP__
+
+#include <atomic>
+#include <mutex>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace drachtio {
+
+  /**
+   * An unordered_map split into independently locked stripes, chosen by the hash of the key.
+   * Threads working on different keys rarely contend: the sip thread adding a transaction does
+   * not wait on a client thread removing another one, as it would with one lock over the map.
+   *
+   * Each operation holds at most one stripe lock, so there is no ordering to get wrong, but there
+   * is also no atomicity across keys (or across maps): callers that find in one map and insert
+   * into another must tolerate the first entry going away in between.
+   *
+   * Mutex is only there so that a benchmark can substitute a lock that times how long it waits.
+   */
+  template<typename K, typename V, size_t N = 32, typename Hash = std::hash<K>, typename Mutex = std::mutex>
+  class StripedMap {
+  public:
+    static_assert( N > 0 && 0 == (N & (N - 1)), "stripe count must be a power of two" ) ;
+
+    StripedMap() {}
+    StripedMap( const StripedMap& ) = delete ;
+
+    // inserts if the key is not present; returns false if it was
+    bool insert( const K& key, const V& value ) {
+      Stripe& s = stripe( key ) ;
+      std::lock_guard<Mutex> l( s.lock ) ;
+      if( !s.map.emplace( key, value ).second ) return false ;
+      s.count.store( s.map.size(), std::memory_order_relaxed ) ;
+      return true ;
+    }
+
+    // copies out the value for key, if present
+    bool find( const K& key, V& value ) const {
+      const Stripe& s = stripe( key ) ;
+      std::lock_guard<Mutex> l( s.lock ) ;
+      auto it = s.map.find( key ) ;
+      if( s.map.end() == it ) return false ;
+      value = it->second ;
+      return true ;
+    }
+
+    bool erase( const K& key ) {
+      Stripe& s = stripe( key ) ;
+      std::lock_guard<Mutex> l( s.lock ) ;
+      if( 0 == s.map.erase( key ) ) return false ;
+      s.count.store( s.map.size(), std::memory_order_relaxed ) ;
+      return true ;
+    }
+
+    // erases and hands back the value for key, if present
+    bool erase( const K& key, V& value ) {
+      Stripe& s = stripe( key ) ;
+      std::lock_guard<Mutex> l( s.lock ) ;
+      auto it = s.map.find( key ) ;
+      if( s.map.end() == it ) return false ;
+      value = std::move( it->second ) ;
+      s.map.erase( it ) ;
+      s.count.store( s.map.size(), std::memory_order_relaxed ) ;
+      return true ;
+    }
+
+    // erases the entry for key only if pred holds for its value; pred runs with the stripe locked
+    template<typename Pred>
+    bool eraseIf( const K& key, Pred pred ) {
+      Stripe& s = stripe( key ) ;
+      std::lock_guard<Mutex> l( s.lock ) ;
+      auto it = s.map.find( key ) ;
+      if( s.map.end() == it || !pred( it->second ) ) return false ;
+      s.map.erase( it ) ;
+      s.count.store( s.map.size(), std::memory_order_relaxed ) ;
+      return true ;
+    }
+
+    // runs fn on the value for key with the stripe locked, default-constructing it first if absent; 
+    // the entry is dropped again if fn returns false.  For values that hold several items per key.
+    template<typename Fn>
+    void update( const K& key, Fn fn ) {
+      Stripe& s = stripe( key ) ;
+      std::lock_guard<Mutex> l( s.lock ) ;
+      auto it = s.map.emplace( key, V() ).first ;
+      if( !fn( it->second ) ) s.map.erase( it ) ;
+      s.count.store( s.map.size(), std::memory_order_relaxed ) ;
+    }
+
+    // approximate while other threads are modifying the map
+    size_t size(void) const {
+      size_t n = 0 ;
+      for( const Stripe& s : m_stripes ) n += s.count.load( std::memory_order_relaxed ) ;
+      return n ;
+    }
+
+    // visits every entry, one stripe at a time with that stripe locked; fn must not call back into the map
+    void forEach( const std::function<void(const K&, const V&)>& fn ) const {
+      for( const Stripe& s : m_stripes ) {
+        std::lock_guard<Mutex> l( s.lock ) ;
+        for( const auto& kv : s.map ) fn( kv.first, kv.second ) ;
+      }
+    }
+
+  private:
+    // a stripe per cache line, so that taking one lock does not bounce its neighbours; the count is 
+    // kept here rather than in one shared counter for the same reason, and is only written under the lock
+    struct alignas(64) Stripe {
+      Stripe() : count(0) {}
+      mutable Mutex                   lock ;
+      std::unordered_map<K, V, Hash>  map ;
+      std::atomic<size_t>             count ;
+    } ;
+
+    // the high bits pick the stripe: the buckets inside a stripe are chosen from the low bits
+    static size_t index( const K& key ) {
+      uint64_t h = static_cast<uint64_t>( Hash()( key ) ) * 0x9e3779b97f4a7c15ULL ;
+      return static_cast<size_t>( h >> 32 ) & (N - 1) ;
+    }
+    Stripe& stripe( const K& key ) { return m_stripes[ index( key ) ] ; }
+    const Stripe& stripe( const K& key ) const { return m_stripes[ index( key ) ] ; }
+
+    std::array<Stripe, N>   m_stripes ;
+  } ;
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdexcept>
 #include <string>
+#include <cstring>
 #include <iostream>
 #include <cassert>
 
@@ -22,12 +23,23 @@ su_root_t* root ;
 int counter1 = 1 ;
 int counter2 = 2 ;
 int idx = 0 ;
+bool useWheel = false ;
 
 void finish() {
   su_timer_destroy(timer) ;
   su_root_break(root) ;
 }
 
+int batched = 0 ;
+void func4(void* arg) {
+  // the whole batch is detached from the queue before any callback runs
+  assert( 0 == queue->size() ) ;
+  if( 3 == ++batched ) {
+    cout << "OK" << endl ;
+    finish() ;
+  }
+}
+
 void func3(void*arg){
   assert( arg ) ;
   assert( 0 == queue->size() ) ;
@@ -42,7 +54,17 @@ void func3(void*arg){
   assert( 0 == queue->size() ) ;
   cout << "OK" << endl ;
 
-  finish() ;
+  cout << "should count timers armed, fired and cancelled.." ;
+  assert( 8 == queue->numArmed() ) ;
+  assert( 4 == queue->numFired() ) ;
+  assert( 4 == queue->numCancelled() ) ;
+  cout << "OK" << endl ;
+
+  cout << "should fire all timers that are due in a single pass.." ;
+  queue->setCoalescing( 50 ) ;
+  queue->add( func4, NULL, 10) ;
+  queue->add( func4, NULL, 11) ;
+  queue->add( func4, NULL, 12) ;
 }
 
 void func2( void* arg ) {
@@ -91,9 +113,15 @@ void func1( void* arg ) {
 void
 start_test(su_root_magic_t * p, su_timer_t *t, su_timer_arg_t *a)
 {
-	cout << "Creating a queue" << endl ;
   root = static_cast<su_root_t*>( a )  ;
-  queue = new TimerQueue( root ) ;
+  if( useWheel ) {
+    cout << "Creating a timer wheel" << endl ;
+    queue = new TimerWheel( root ) ;
+  }
+  else {
+    cout << "Creating a queue" << endl ;
+    queue = new TimerQueue( root ) ;
+  }
   assert( queue ) ;
 
   cout << "should be able to invoke a single task..."  ;
@@ -101,8 +129,11 @@ start_test(su_root_magic_t * p, su_timer_t *t, su_timer_arg_t *a)
 
 }
 
+// usage: test_timer [list|wheel]
 int main( int argc, char **argv) {
 
+  useWheel = argc > 1 && 0 == strcmp( argv[1], "wheel" ) ;
+
 	su_init() ;
   root = su_root_create( NULL ) ;
   timer = su_timer_create( su_root_task(root), 100) ;
@@ -1,17 +1,97 @@
+#include <algorithm>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
 #include "timer-queue-manager.hpp"
 #include "drachtio.h"
 #include "controller.hpp"
 
+namespace {
+  void logQueue(const char* szLabel, drachtio::TimerQueue* queue) {
+    const drachtio::TimerEntryPool& pool = queue->getEntryPool() ;
+    DR_LOG(log_debug) << szLabel << queue->size() << 
+      " (pool in use: " << pool.inUse() << ", high water: " << pool.highWater() << ", capacity: " << pool.capacity() << ")" ;
+  }
+}
+
 namespace drachtio {
+  const char* sipTimerClassName( SipTimerClass timerClass ) {
+    static const char* szNames[] = {
+      "general-sip",
+      "timerA",
+      "timerB",
+      "timerC",
+      "timerD",
+      "timerE",
+      "timerF",
+      "timerG",
+      "timerH",
+      "timerK",
+      "timerProvisional"
+    } ;
+    static_assert( sizeof(szNames) / sizeof(szNames[0]) == SIP_TIMER_CLASS_COUNT, "timer class names out of sync with SipTimerClass" ) ;
+    return szNames[ static_cast<int>( timerClass ) ] ;
+  }
+
+  bool SipTimerSettings::parseCoalescing( const char* szSpec ) {
+    unsigned int msecs[SIP_TIMER_CLASS_COUNT] ;
+    std::copy( m_coalesceMsecs, m_coalesceMsecs + SIP_TIMER_CLASS_COUNT, msecs ) ;
+
+    std::vector<string> items ;
+    string spec( szSpec ) ;
+    boost::split( items, spec, boost::is_any_of(",") ) ;
+    for( string& item : items ) {
+      boost::trim( item ) ;
+      if( item.empty() ) continue ;
+
+      size_t pos = item.find('=') ;
+      if( string::npos == pos ) return false ;
+      string name = boost::to_lower_copy( boost::trim_copy( item.substr(0, pos) ) ) ;
+      string value = boost::trim_copy( item.substr(pos + 1) ) ;
+      if( value.empty() || value.length() > 6 || string::npos != value.find_first_not_of("0123456789") ) return false ;
+
+      int idx = -1 ;
+      if( "general" == name ) idx = sip_timer_general ;
+      else if( "provisional" == name ) idx = sip_timer_provisional ;
+      else {
+        for( int i = sip_timer_A; i <= sip_timer_K; i++ ) {
+          string letter = boost::to_lower_copy( string( sipTimerClassName( static_cast<SipTimerClass>(i) ) + 5 ) ) ; // "timerX"
+          if( name == letter || name == "timer" + letter ) idx = i ;
+        }
+      }
+      if( -1 == idx ) return false ;
+      msecs[idx] = std::stoul( value ) ;
+    }
+
+    std::copy( msecs, msecs + SIP_TIMER_CLASS_COUNT, m_coalesceMsecs ) ;
+    return true ;
+  }
+
   void SipTimerQueueManager::logQueueSizes(void) {
-    DR_LOG(log_debug) << "general queue size:                                              " << m_queue.size() ;
-    DR_LOG(log_debug) << "timer A queue size:                                              " << m_queueA.size() ;
-    DR_LOG(log_debug) << "timer B queue size:                                              " << m_queueB.size() ;
-    DR_LOG(log_debug) << "timer C queue size:                                              " << m_queueC.size() ;
-    DR_LOG(log_debug) << "timer D queue size:                                              " << m_queueD.size() ;
-    DR_LOG(log_debug) << "timer E queue size:                                              " << m_queueE.size() ;
-    DR_LOG(log_debug) << "timer F queue size:                                              " << m_queueF.size() ;
-    DR_LOG(log_debug) << "timer G queue size:                                              " << m_queueF.size() ;
-    DR_LOG(log_debug) << "timer K queue size:                                              " << m_queueK.size() ;
+    DR_LOG(log_debug) << "timer queue implementation:                                      " << (timer_queue_wheel == m_type ? "wheel" : "list") ;
+    logQueue("general queue size:                                              ", m_queues[sip_timer_general].get()) ;
+    logQueue("timer A queue size:                                              ", m_queues[sip_timer_A].get()) ;
+    logQueue("timer B queue size:                                              ", m_queues[sip_timer_B].get()) ;
+    logQueue("timer C queue size:                                              ", m_queues[sip_timer_C].get()) ;
+    logQueue("timer D queue size:                                              ", m_queues[sip_timer_D].get()) ;
+    logQueue("timer E queue size:                                              ", m_queues[sip_timer_E].get()) ;
+    logQueue("timer F queue size:                                              ", m_queues[sip_timer_F].get()) ;
+    logQueue("timer G queue size:                                              ", m_queues[sip_timer_G].get()) ;
+    logQueue("timer H queue size:                                              ", m_queues[sip_timer_H].get()) ;
+    logQueue("timer K queue size:                                              ", m_queues[sip_timer_K].get()) ;
+    logQueue("provisional timer queue size:                                    ", m_queues[sip_timer_provisional].get()) ;
+
+    // stats
+    if (theOneAndOnlyController->getStatsCollector().enabled()) {
+      for( int i = 0; i < SIP_TIMER_CLASS_COUNT; i++ ) {
+        TimerQueue* queue = m_queues[i].get() ;
+        StatsCollector::mapLabels_t labels = {{"controller", m_owner}, {"timer", queue->getName()}} ;
+        STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_SIP_TIMERS_ARMED, queue->numArmed(), labels)
+        STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_SIP_TIMERS_FIRED, queue->numFired(), labels)
+        STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_SIP_TIMERS_CANCELLED, queue->numCancelled(), labels)
+        STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_SIP_TIMERS_QUEUED, queue->size(), labels)
+      }
+    }
   }
-}
\ No newline at end of file
+}
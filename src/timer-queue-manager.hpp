@@ -22,66 +22,96 @@ THE SOFTWARE.
 #ifndef __TIMER_QUEUE_MANAGER_H__
 #define __TIMER_QUEUE_MANAGER_H__
 
-#include <cstring> 
+#include <cassert>
+#include <memory>
 
 #include "timer-queue.hpp"
 
 namespace drachtio {
 
+  // classes of timer managed by a TimerQueueManager; each class is served by its own queue
+  enum SipTimerClass {
+    sip_timer_general = 0,    // anything that is not an RFC 3261 transaction timer
+    sip_timer_A,
+    sip_timer_B,
+    sip_timer_C,
+    sip_timer_D,
+    sip_timer_E,
+    sip_timer_F,
+    sip_timer_G,
+    sip_timer_H,
+    sip_timer_K,
+    sip_timer_provisional,    // proxy: give up on a target that has not sent a provisional response
+
+    SIP_TIMER_CLASS_COUNT
+  } ;
+
+  const char* sipTimerClassName( SipTimerClass timerClass ) ;
+
+  // how the sip timer queues are built and tuned; see --timer-queue, --timer-slack and --timer-coalesce
+  struct SipTimerSettings {
+    SipTimerSettings() : m_type(timer_queue_list), m_slackMsecs(0) {
+      for( int i = 0; i < SIP_TIMER_CLASS_COUNT; i++ ) m_coalesceMsecs[i] = 0 ;
+    }
+
+    /**
+     * parse a per-class coalescing spec such as "D=100,K=100,C=1000"; a class is named by
+     * its letter, "general" or "provisional".  Returns false (leaving settings unchanged) if malformed.
+     */
+    bool parseCoalescing( const char* szSpec ) ;
+
+    TimerQueueType  m_type ;
+    unsigned int    m_slackMsecs ;
+    unsigned int    m_coalesceMsecs[SIP_TIMER_CLASS_COUNT] ;
+  } ;
+
   class TimerQueueManager {
   public:
-    virtual TimerEventHandle addTimer( const char* szTimerClass, TimerFunc f, void* functionArgs, uint32_t milliseconds ) = 0 ;
-    virtual void removeTimer( TimerEventHandle handle, const char* szTimer ) = 0 ;
+    virtual TimerEventHandle addTimer( SipTimerClass timerClass, TimerFunc f, void* functionArgs, uint32_t milliseconds ) = 0 ;
+    virtual void removeTimer( TimerEventHandle handle, SipTimerClass timerClass ) = 0 ;
     virtual void logQueueSizes(void) {}
   } ;
 
   class SipTimerQueueManager : public TimerQueueManager {
   public:
-    SipTimerQueueManager(su_root_t* root) : 
-        m_queue(root, "general-sip"), m_queueA(root,"timerA"), m_queueB(root,"timerB"),
-        m_queueC(root, "timerC"), m_queueD(root, "timerD"), m_queueE(root, "timerE"), 
-        m_queueF(root, "timerF"), m_queueG(root, "timerG"), m_queueH(root, "timerH"), m_queueK(root, "timerK") {}
+    /** 
+     * @param root      sofia root the queues run on
+     * @param settings  queue implementation, expiry slack and per-class coalescing
+     * @param szOwner   value of the "controller" label on the per-class timer metrics
+     */
+    SipTimerQueueManager(su_root_t* root, const SipTimerSettings& settings = SipTimerSettings(), const char* szOwner = "sip") : 
+      m_type(settings.m_type), m_owner(szOwner) {
+      for( int i = 0; i < SIP_TIMER_CLASS_COUNT; i++ ) {
+        m_queues[i] = makeQueue( root, sipTimerClassName( static_cast<SipTimerClass>(i) ) ) ;
+        m_queues[i]->setSlack( settings.m_slackMsecs ) ;
+        m_queues[i]->setCoalescing( settings.m_coalesceMsecs[i] ) ;
+        m_queues[i]->setOwner( szOwner ) ;
+      }
+    }
     ~SipTimerQueueManager() {}
 
-    TimerEventHandle addTimer( const char* szTimerClass, TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
-        TimerEventHandle handle ;
-        if( 0 == strcmp("timerA", szTimerClass) ) handle = m_queueA.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerB", szTimerClass) ) handle = m_queueB.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerC", szTimerClass) ) handle = m_queueC.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerD", szTimerClass) ) handle = m_queueD.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerE", szTimerClass) ) handle = m_queueE.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerF", szTimerClass) ) handle = m_queueF.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerG", szTimerClass) ) handle = m_queueG.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerH", szTimerClass) ) handle = m_queueH.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerK", szTimerClass) ) handle = m_queueK.add( f, functionArgs, milliseconds );
-        else handle = m_queue.add( f, functionArgs, milliseconds );
-        return handle ;
+    TimerEventHandle addTimer( SipTimerClass timerClass, TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
+      return queueFor( timerClass )->add( std::move(f), functionArgs, milliseconds ) ;
     }
-    void removeTimer( TimerEventHandle handle, const char* szTimerClass ) {
-        if( 0 == strcmp("timerA", szTimerClass) ) m_queueA.remove( handle ) ;
-        else if( 0 == strcmp("timerB", szTimerClass) ) m_queueB.remove( handle ) ;
-        else if( 0 == strcmp("timerC", szTimerClass) ) m_queueC.remove( handle ) ;
-        else if( 0 == strcmp("timerD", szTimerClass) ) m_queueD.remove( handle ) ;
-        else if( 0 == strcmp("timerE", szTimerClass) ) m_queueE.remove( handle ) ;
-        else if( 0 == strcmp("timerF", szTimerClass) ) m_queueF.remove( handle ) ;
-        else if( 0 == strcmp("timerG", szTimerClass) ) m_queueG.remove( handle ) ;
-        else if( 0 == strcmp("timerH", szTimerClass) ) m_queueH.remove( handle ) ;
-        else if( 0 == strcmp("timerK", szTimerClass) ) m_queueK.remove( handle ) ;
-        else m_queue.remove( handle ) ;
+    void removeTimer( TimerEventHandle handle, SipTimerClass timerClass ) {
+      queueFor( timerClass )->remove( handle ) ;
     }
+
     void logQueueSizes(void) ;
 
   protected:
-    TimerQueue      m_queue ;
-    TimerQueue      m_queueA ;
-    TimerQueue      m_queueB ;
-    TimerQueue      m_queueC ;
-    TimerQueue      m_queueD ;    
-    TimerQueue      m_queueE ;    
-    TimerQueue      m_queueF ;    
-    TimerQueue      m_queueG ;    
-    TimerQueue      m_queueH ;    
-    TimerQueue      m_queueK ;    
+    std::unique_ptr<TimerQueue> makeQueue(su_root_t* root, const char* szName) {
+        if( timer_queue_wheel == m_type ) return std::unique_ptr<TimerQueue>( new TimerWheel(root, szName) ) ;
+        return std::unique_ptr<TimerQueue>( new TimerQueue(root, szName) ) ;
+    }
+    TimerQueue* queueFor( SipTimerClass timerClass ) {
+      assert( timerClass >= 0 && timerClass < SIP_TIMER_CLASS_COUNT ) ;
+      return m_queues[timerClass].get() ;
+    }
+
+    TimerQueueType  m_type ;
+    std::string     m_owner ;
+    std::unique_ptr<TimerQueue>  m_queues[SIP_TIMER_CLASS_COUNT] ;
   } ;
 
 }
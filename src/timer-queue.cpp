@@ -14,16 +14,58 @@ namespace {
     drachtio::TimerQueue* queue = static_cast<drachtio::TimerQueue*>( p ) ;
     queue->doTimer( timer ) ;
   }
+
+  // round t up to the next multiple of msecs (measured from the su_time_t epoch)
+  su_time_t alignUp( su_time_t t, unsigned int msecs ) {
+    uint64_t ms = static_cast<uint64_t>( t.tv_sec ) * 1000 + (t.tv_usec + 999) / 1000 ;
+    ms = ((ms + msecs - 1) / msecs) * msecs ;
+    su_time_t aligned ;
+    aligned.tv_sec = ms / 1000 ;
+    aligned.tv_usec = (ms % 1000) * 1000 ;
+    return aligned ;
+  }
 }
 
 namespace drachtio {
  queueEntry_t::queueEntry_t(TimerQueue* queue, TimerFunc f, void * functionArgs, su_time_t when) : m_queue(queue), 
-  m_functionArgs(functionArgs), m_when(when), m_next(NULL), m_prev(NULL), m_function(f) {
+  m_functionArgs(functionArgs), m_when(when), m_next(NULL), m_prev(NULL), m_function(std::move(f)), m_tick(0), m_slot(-1) {
+  }
+
+  // TimerEntryPool
+  TimerEntryPool::TimerEntryPool() : m_free(NULL), m_inUse(0), m_highWater(0), m_capacity(0) {
+  }
+  TimerEntryPool::~TimerEntryPool() {
+    assert( 0 == m_inUse ) ;
+    for( slot_t* slab : m_slabs ) delete [] slab ;
+  }
+  void TimerEntryPool::grow(void) {
+    slot_t* slab = new slot_t[SLAB_SIZE] ;
+    for( unsigned int i = 0; i < SLAB_SIZE - 1; i++ ) slab[i].m_next = &slab[i+1] ;
+    slab[SLAB_SIZE - 1].m_next = m_free ;
+    m_free = slab ;
+    m_slabs.push_back( slab ) ;
+    m_capacity += SLAB_SIZE ;
+  }
+  queueEntry_t* TimerEntryPool::allocate(TimerQueue* queue, TimerFunc&& f, void* functionArgs, su_time_t when) {
+    if( NULL == m_free ) grow() ;
+    slot_t* slot = m_free ;
+    m_free = slot->m_next ;
+    queueEntry_t* entry = new (slot->m_storage) queueEntry_t(queue, std::move(f), functionArgs, when) ;
+    if( ++m_inUse > m_highWater ) m_highWater = m_inUse ;
+    return entry ;
+  }
+  void TimerEntryPool::release(queueEntry_t* entry) {
+    entry->~queueEntry_t() ;
+    slot_t* slot = reinterpret_cast<slot_t*>( entry ) ;
+    slot->m_next = m_free ;
+    m_free = slot ;
+    m_inUse-- ;
   }
 
-  TimerQueue::TimerQueue(su_root_t* root, const char* szName) : m_root(root), m_head(NULL), m_tail(NULL), 
-    m_length(0), m_in_timer(0) {
+  TimerQueue::TimerQueue(su_root_t* root, const char* szName) : m_root(root), m_head(NULL), m_tail(NULL), m_expiring(NULL),
+    m_length(0), m_in_timer(0), m_armed(0), m_fired(0), m_cancelled(0), m_slackMsecs(0), m_coalesceMsecs(0) {
     m_name.assign( szName ? szName : "timer") ;
+    m_owner.assign( "sip" ) ;
     m_timer = su_timer_create(su_root_task(m_root), NTA_SIP_T1 / 8 ) ;
   }
   TimerQueue::~TimerQueue() {
@@ -31,14 +73,19 @@ namespace drachtio {
     while( ptr ) {
       queueEntry_t* p = ptr ;
       ptr = ptr->m_next ;
-      delete p ;
+      m_pool.release( p ) ;
       m_length-- ;
       m_head = ptr ;
     }
+    while( m_expiring ) {
+      queueEntry_t* p = m_expiring ;
+      m_expiring = p->m_next ;
+      m_pool.release( p ) ;
+    }
   }
 
   TimerEventHandle TimerQueue::add( TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
-    return TimerQueue::add( f, functionArgs, milliseconds, su_now() ) ;
+    return TimerQueue::add( std::move(f), functionArgs, milliseconds, su_now() ) ;
   }
 
   TimerEventHandle TimerQueue::add( TimerFunc f, void* functionArgs, uint32_t milliseconds, su_time_t now ) {
@@ -52,9 +99,10 @@ namespace drachtio {
     assert( !(NULL == m_tail && NULL != m_head)) ;
     */
   
-    su_time_t when = su_time_add(now, milliseconds) ;
-    queueEntry_t* entry = new queueEntry_t(this, f, functionArgs, when) ;
+    su_time_t when = expiryTime(now, milliseconds) ;
+    queueEntry_t* entry = m_pool.allocate(this, std::move(f), functionArgs, when) ;
     TimerEventHandle handle = entry ;
+    m_armed++ ;
     assert(handle) ;
 
     if( entry ) {
@@ -71,7 +119,7 @@ namespace drachtio {
 #endif
         //std::cout << "Adding entry to the head of the queue (it was empty)" << std::endl ;
       }
-      else if( NULL != m_tail && su_time_cmp( when, m_tail->m_when ) > 0) {
+      else if( NULL != m_tail && su_time_cmp( when, m_tail->m_when ) >= 0) {
         //one class of timer queues will always be appending entries, so check the tail
         //before starting to iterate through
 #ifndef TEST
@@ -141,6 +189,7 @@ namespace drachtio {
 #ifndef TEST
         DR_LOG(log_debug) << m_name << ": removing entry, prior to removal length: " << dec << m_length;
 #endif
+    if( removeExpired( entry ) ) return ;
 
     {
       if( m_head == entry ) {
@@ -161,7 +210,7 @@ namespace drachtio {
 #ifndef TEST
           DR_LOG(log_warning) << m_name << ": remove() called on entry not in queue, ignoring";
 #endif
-          delete entry;
+          m_pool.release( entry ) ;
           return;
         }
         assert( entry->m_prev ) ;
@@ -170,6 +219,7 @@ namespace drachtio {
         entry->m_next->m_prev = entry->m_prev ;
       }
       m_length-- ;
+      m_cancelled++ ;
       assert( m_length >= 0 ) ;
 
       if( NULL == m_head ) {
@@ -189,7 +239,7 @@ namespace drachtio {
       }      
     }
 
-    delete entry ;
+    m_pool.release( entry ) ;
   }
 
   void TimerQueue::doTimer(su_timer_t* timer) {
@@ -202,31 +252,33 @@ namespace drachtio {
     if( m_in_timer ) return ;
     m_in_timer = 1 ;
 
-    queueEntry_t* expired = NULL ;
-    queueEntry_t* tailExpired = NULL ;
+    queueEntry_t* tailExpired = m_expiring ;
+    while( tailExpired && tailExpired->m_next ) tailExpired = tailExpired->m_next ;
+    unsigned int count = 0 ;
 
+    // drain everything due now or within the slack window in this one pass
     su_time_t now = su_now() ;
+    su_time_t horizon = m_slackMsecs ? su_time_add( now, m_slackMsecs ) : now ;
     assert( NULL != m_head ) ;
 
     queueEntry_t* ptr = m_head ;
-    while( ptr && su_time_cmp( ptr->m_when, now ) < 0 ) {
+    while( ptr && su_time_cmp( ptr->m_when, horizon ) < 0 ) {
       //std::cout << "expiring a timer" << std::endl ;
+      queueEntry_t* next = ptr->m_next ;
       m_length-- ;
-      m_head = ptr->m_next ;
+      count++ ;
+      m_head = next ;
       if( m_head ) m_head->m_prev = NULL ;
       else m_tail = NULL ;
 
       //detach and assemble them into a new queue temporarily
-      if( !expired ) {
-        expired = tailExpired = ptr ;
-        ptr->m_prev = ptr->m_next = NULL ;
-      }
-      else {
-        tailExpired->m_next = ptr ;
-        ptr->m_prev = tailExpired ;
-        tailExpired = ptr ;
-      }
-      ptr = ptr->m_next ;
+      ptr->m_slot = EXPIRING ;
+      ptr->m_next = NULL ;
+      ptr->m_prev = tailExpired ;
+      if( tailExpired ) tailExpired->m_next = ptr ;
+      else m_expiring = ptr ;
+      tailExpired = ptr ;
+      ptr = next ;
     }
 
     if( NULL == m_head ) {
@@ -243,13 +295,53 @@ namespace drachtio {
       int rc = su_timer_set_at(m_timer, timer_function, this, m_head->m_when);      
     }
     m_in_timer = 0 ;
+    reportBatch( count ) ;
 
-    while( NULL != expired ) {
-      expired->m_function( expired->m_functionArgs ) ;
-      queueEntry_t* p = expired ;
-      expired = expired->m_next ;
-      delete p ;
-    }    
+    fireExpired() ;
+  }
+
+  bool TimerQueue::removeExpired(queueEntry_t* entry) {
+    if( FIRING == entry->m_slot ) {
+      // its callback is running right now; doTimer frees it when the callback returns
+      return true ;
+    }
+    if( EXPIRING == entry->m_slot ) {
+      // expired in the same pass as the timer whose callback is cancelling it
+      if( entry->m_prev ) entry->m_prev->m_next = entry->m_next ;
+      else m_expiring = entry->m_next ;
+      if( entry->m_next ) entry->m_next->m_prev = entry->m_prev ;
+      m_cancelled++ ;
+      m_pool.release( entry ) ;
+      return true ;
+    }
+    return false ;
+  }
+
+  void TimerQueue::fireExpired(void) {
+    // callbacks may cancel entries that expired in this same pass, so detach each one as it is fired
+    while( NULL != m_expiring ) {
+      queueEntry_t* p = m_expiring ;
+      m_expiring = p->m_next ;
+      if( m_expiring ) m_expiring->m_prev = NULL ;
+      p->m_next = NULL ;
+      p->m_slot = FIRING ;
+      m_fired++ ;
+      p->m_function( p->m_functionArgs ) ;
+      m_pool.release( p ) ;
+    }
+  }
+
+  su_time_t TimerQueue::expiryTime(su_time_t now, uint32_t milliseconds) const {
+    su_time_t when = su_time_add(now, milliseconds) ;
+    return m_coalesceMsecs ? alignUp( when, m_coalesceMsecs ) : when ;
+  }
+
+  void TimerQueue::reportBatch(unsigned int count) {
+    if( 0 == count ) return ;
+#ifndef TEST
+    DR_LOG(log_debug) << m_name << ": fired " << std::dec << count << " expired timers in one pass" ;
+    STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_TIMER_BATCH_SIZE, count, {{"controller", m_owner}, {"timer", m_name}})
+#endif
   }
 
   int TimerQueue::positionOf(TimerEventHandle handle) {
@@ -276,11 +368,11 @@ namespace drachtio {
 
   // LockingTimerQueue
    TimerEventHandle LockingTimerQueue::add( TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
-    return add(f, functionArgs, milliseconds,  su_now());
+    return add(std::move(f), functionArgs, milliseconds,  su_now());
   }
   TimerEventHandle LockingTimerQueue::add( TimerFunc f, void* functionArgs, uint32_t milliseconds, su_time_t now ) {
     std::lock_guard<std::mutex> guard(m_mutex);
-    return TimerQueue::add(f, functionArgs, milliseconds, now);
+    return TimerQueue::add(std::move(f), functionArgs, milliseconds, now);
   }
   void LockingTimerQueue::remove( TimerEventHandle handle) {
     std::lock_guard<std::mutex> guard(m_mutex);
@@ -303,4 +395,247 @@ namespace drachtio {
     return TimerQueue::doTimer(timer);
   }    
 
+
+  // TimerWheel
+  TimerWheel::TimerWheel(su_root_t* root, const char* szName, unsigned int tickMsecs) : TimerQueue(root, szName),
+    m_tickMsecs(tickMsecs ? tickMsecs : DEFAULT_TICK_MSECS), m_currentTick(0), m_currentTickTime(su_now()), 
+    m_armedTick(NOT_ARMED) {
+    for( unsigned int i = 0; i < NUM_SLOTS; i++ ) m_slots[i] = NULL ;
+  }
+  TimerWheel::~TimerWheel() {
+    for( unsigned int i = 0; i < NUM_SLOTS; i++ ) {
+      queueEntry_t* ptr = m_slots[i] ;
+      while( ptr ) {
+        queueEntry_t* p = ptr ;
+        ptr = ptr->m_next ;
+        m_pool.release( p ) ;
+        m_length-- ;
+      }
+      m_slots[i] = NULL ;
+    }
+  }
+
+  TimerEventHandle TimerWheel::add( TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
+    return TimerWheel::add( std::move(f), functionArgs, milliseconds, su_now() ) ;
+  }
+
+  TimerEventHandle TimerWheel::add( TimerFunc f, void* functionArgs, uint32_t milliseconds, su_time_t now ) {
+    su_time_t when = expiryTime(now, milliseconds) ;
+
+    // an empty wheel has nothing to catch up on, so re-anchor the current tick to the present
+    if( 0 == m_length ) m_currentTickTime = now ;
+
+    queueEntry_t* entry = m_pool.allocate(this, std::move(f), functionArgs, when) ;
+    su_duration_t delta = su_duration( when, m_currentTickTime ) ;
+    entry->m_tick = m_currentTick ;
+    if( delta > 0 ) entry->m_tick += (delta + m_tickMsecs - 1) / m_tickMsecs ;
+
+    link( entry ) ;
+    ++m_length ;
+    m_armed++ ;
+
+#ifndef TEST
+    DR_LOG(log_debug) << m_name << ": Adding entry to go off in " << std::dec << milliseconds << "ms at tick " << 
+      entry->m_tick << ", length: " << m_length ;
+#endif
+
+    if( entry->m_tick < m_armedTick ) armTimer( entry->m_tick ) ;
+
+    return entry ;
+  }
+
+  void TimerWheel::remove( TimerEventHandle entry ) {
+#ifndef TEST
+    DR_LOG(log_debug) << m_name << ": removing entry, prior to removal length: " << dec << m_length;
+#endif
+    if( removeExpired( entry ) ) return ;
+    if( entry->m_slot < 0 ) {
+#ifndef TEST
+      DR_LOG(log_warning) << m_name << ": remove() called on entry not in queue, ignoring";
+#endif
+      m_pool.release( entry ) ;
+      return ;
+    }
+    unlink( entry ) ;
+    m_length-- ;
+    m_cancelled++ ;
+    assert( m_length >= 0 ) ;
+
+    // leave the timer armed otherwise; an early wakeup simply finds nothing due
+    if( 0 == m_length ) {
+      su_timer_reset( m_timer ) ;
+      m_armedTick = NOT_ARMED ;
+    }
+    m_pool.release( entry ) ;
+  }
+
+  void TimerWheel::doTimer(su_timer_t* timer) {
+#ifndef TEST
+    DR_LOG(log_debug) << m_name << ": running timer function" ;
+#endif
+    if( m_in_timer ) return ;
+    m_in_timer = 1 ;
+    m_armedTick = NOT_ARMED ;
+
+    queueEntry_t* tailExpiring = m_expiring ;
+    while( tailExpiring && tailExpiring->m_next ) tailExpiring = tailExpiring->m_next ;
+
+    // with a slack window, also drain the slots for ticks that fall due within it
+    su_time_t now = su_now() ;
+    int lengthBefore = m_length ;
+    su_duration_t elapsed = su_duration( m_slackMsecs ? su_time_add( now, m_slackMsecs ) : now, m_currentTickTime ) ;
+    if( elapsed >= 0 ) {
+      uint64_t lastTick = m_currentTick + elapsed / m_tickMsecs ;
+      while( m_currentTick <= lastTick && m_length > 0 ) {
+        unsigned int index = m_currentTick & (INNER_SIZE - 1) ;
+
+        // inner wheel has wrapped: pull the next span of entries in from the outer wheels
+        if( 0 == index ) {
+          unsigned int shift = INNER_BITS ;
+          for( unsigned int wheel = 0; wheel < OUTER_WHEELS; wheel++, shift += OUTER_BITS ) {
+            unsigned int outer = (m_currentTick >> shift) & (OUTER_SIZE - 1) ;
+            cascade( wheel, outer ) ;
+            if( 0 != outer ) break ;
+          }
+        }
+
+        // slot lists are built by pushing onto the front, so reversing them yields the order they were armed
+        queueEntry_t* ptr = m_slots[index] ;
+        queueEntry_t* batch = NULL ;
+        queueEntry_t* tailBatch = ptr ;
+        m_slots[index] = NULL ;
+        while( ptr ) {
+          queueEntry_t* next = ptr->m_next ;
+          ptr->m_slot = EXPIRING ;
+          ptr->m_prev = NULL ;
+          ptr->m_next = batch ;
+          if( batch ) batch->m_prev = ptr ;
+          batch = ptr ;
+          m_length-- ;
+          ptr = next ;
+        }
+        if( batch ) {
+          if( tailExpiring ) {
+            tailExpiring->m_next = batch ;
+            batch->m_prev = tailExpiring ;
+          }
+          else m_expiring = batch ;
+          tailExpiring = tailBatch ;
+        }
+
+        m_currentTick++ ;
+        m_currentTickTime = su_time_add( m_currentTickTime, m_tickMsecs ) ;
+      }
+    }
+
+    if( 0 == m_length ) {
+#ifndef TEST
+      DR_LOG(log_debug) << m_name << ": timer not set (wheel is empty after processing expired timers)" ;
+#endif
+      m_currentTickTime = now ;
+    }
+    else {
+      armForNextExpiry() ;
+#ifndef TEST
+      DR_LOG(log_debug) << m_name << ": Setting timer for tick " << m_armedTick << 
+        " after processing expired timers, length: "  << dec << m_length ;
+#endif
+    }
+    m_in_timer = 0 ;
+    reportBatch( lengthBefore - m_length ) ;
+
+    fireExpired() ;
+  }
+
+  int TimerWheel::positionOf(TimerEventHandle handle) {
+    bool found = false ;
+    for( unsigned int i = 0; i < NUM_SLOTS && !found; i++ ) {
+      for( queueEntry_t* ptr = m_slots[i]; ptr && !found; ptr = ptr->m_next ) found = ptr == handle ;
+    }
+    if( !found ) return -1 ;
+
+    int pos = 0 ;
+    for( unsigned int i = 0; i < NUM_SLOTS; i++ ) {
+      for( queueEntry_t* ptr = m_slots[i]; ptr; ptr = ptr->m_next ) {
+        if( ptr != handle && su_time_cmp( ptr->m_when, handle->m_when ) < 0 ) pos++ ;
+      }
+    }
+    return pos ;
+  }
+
+  void TimerWheel::link( queueEntry_t* entry ) {
+    if( entry->m_tick < m_currentTick ) entry->m_tick = m_currentTick ;
+
+    // anything beyond the reach of the outermost wheel is parked in its furthest slot and 
+    // re-hashed each time that slot is cascaded
+    uint64_t delta = entry->m_tick - m_currentTick ;
+    uint64_t tick = entry->m_tick ;
+    if( delta >= MAX_SPAN ) {
+      delta = MAX_SPAN - 1 ;
+      tick = m_currentTick + delta ;
+    }
+
+    unsigned int slot ;
+    if( delta < INNER_SIZE ) {
+      slot = tick & (INNER_SIZE - 1) ;
+    }
+    else {
+      unsigned int wheel = 0 ;
+      unsigned int shift = INNER_BITS ;
+      uint64_t span = (uint64_t) INNER_SIZE << OUTER_BITS ;
+      while( delta >= span ) {
+        wheel++ ;
+        shift += OUTER_BITS ;
+        span <<= OUTER_BITS ;
+      }
+      slot = INNER_SIZE + wheel * OUTER_SIZE + ((tick >> shift) & (OUTER_SIZE - 1)) ;
+    }
+
+    entry->m_slot = slot ;
+    entry->m_prev = NULL ;
+    entry->m_next = m_slots[slot] ;
+    if( entry->m_next ) entry->m_next->m_prev = entry ;
+    m_slots[slot] = entry ;
+  }
+
+  void TimerWheel::unlink( queueEntry_t* entry ) {
+    if( entry->m_prev ) entry->m_prev->m_next = entry->m_next ;
+    else m_slots[entry->m_slot] = entry->m_next ;
+    if( entry->m_next ) entry->m_next->m_prev = entry->m_prev ;
+    entry->m_next = entry->m_prev = NULL ;
+    entry->m_slot = -1 ;
+  }
+
+  void TimerWheel::cascade( unsigned int wheel, unsigned int index ) {
+    unsigned int slot = INNER_SIZE + wheel * OUTER_SIZE + index ;
+    queueEntry_t* ptr = m_slots[slot] ;
+    m_slots[slot] = NULL ;
+    while( ptr ) {
+      queueEntry_t* next = ptr->m_next ;
+      link( ptr ) ;
+      ptr = next ;
+    }
+  }
+
+  void TimerWheel::armForNextExpiry(void) {
+    // entries only move in from the outer wheels when the inner wheel wraps, so the next wakeup
+    // is the first occupied inner slot before the wrap, or the wrap itself
+    uint64_t tick = m_currentTick ;
+    if( 0 != (tick & (INNER_SIZE - 1)) ) {
+      uint64_t wrap = (tick | (INNER_SIZE - 1)) + 1 ;
+      while( tick < wrap && NULL == m_slots[tick & (INNER_SIZE - 1)] ) tick++ ;
+    }
+    armTimer( tick ) ;
+  }
+
+  void TimerWheel::armTimer( uint64_t tick ) {
+    m_armedTick = tick ;
+    int rc = su_timer_set_at(m_timer, timer_function, this, timeOfTick( tick ));
+    assert( 0 == rc ) ;
+  }
+
+  su_time_t TimerWheel::timeOfTick( uint64_t tick ) {
+    return su_time_add( m_currentTickTime, (su_duration_t) ((tick - m_currentTick) * m_tickMsecs) ) ;
+  }
+
 }
@@ -22,17 +22,115 @@ THE SOFTWARE.
 #ifndef __QUEUE_H__
 #define __QUEUE_H__
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <new>
 #include <thread>
 #include <string>
 #include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <sofia-sip/su_wait.h>
 
 namespace drachtio {
 
   class TimerQueue;
 
-  typedef std::function<void (void*)> TimerFunc ;
+  /**
+   * Timer callback with inline storage.
+   * 
+   * Behaves like std::function<void (void*)>, but the callable is always stored in a
+   * fixed buffer inside the object, so arming a timer never allocates.  The buffer
+   * is sized for the binds used by the proxy and dialog controllers (a member function
+   * plus a couple of pointers, shared_ptrs or a string); a larger callable is a compile error.
+   */
+  class TimerFunc {
+  public:
+    static constexpr size_t CAPACITY = 64 ;
+
+    TimerFunc() : m_ops(NULL) {}
+    TimerFunc(std::nullptr_t) : m_ops(NULL) {}
+
+    template<typename F, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, TimerFunc>::value>::type>
+    TimerFunc(F&& f) {
+      typedef typename std::decay<F>::type Callable ;
+      static_assert( sizeof(Callable) <= CAPACITY, "timer callback is too large to store inline; bind fewer or smaller arguments" ) ;
+      static_assert( alignof(Callable) <= alignof(std::max_align_t), "timer callback is over-aligned" ) ;
+      new (m_storage) Callable( std::forward<F>(f) ) ;
+      m_ops = &Ops<Callable>::table ;
+    }
+    TimerFunc(const TimerFunc& other) : m_ops(other.m_ops) {
+      if( m_ops ) m_ops->copy( m_storage, other.m_storage ) ;
+    }
+    TimerFunc(TimerFunc&& other) : m_ops(other.m_ops) {
+      if( m_ops ) m_ops->move( m_storage, other.m_storage ) ;
+      other.m_ops = NULL ;
+    }
+    ~TimerFunc() { reset() ; }
+
+    TimerFunc& operator=(const TimerFunc& other) {
+      if( this != &other ) {
+        reset() ;
+        if( other.m_ops ) other.m_ops->copy( m_storage, other.m_storage ) ;
+        m_ops = other.m_ops ;
+      }
+      return *this ;
+    }
+    TimerFunc& operator=(TimerFunc&& other) {
+      if( this != &other ) {
+        reset() ;
+        if( other.m_ops ) other.m_ops->move( m_storage, other.m_storage ) ;
+        m_ops = other.m_ops ;
+        other.m_ops = NULL ;
+      }
+      return *this ;
+    }
+
+    void operator()(void* arg) const { m_ops->invoke( m_storage, arg ) ; }
+    explicit operator bool() const { return NULL != m_ops ; }
+
+    void reset(void) {
+      if( m_ops ) m_ops->destroy( m_storage ) ;
+      m_ops = NULL ;
+    }
+
+  private:
+    struct ops_t {
+      void (*invoke)(void* storage, void* arg) ;
+      void (*copy)(void* dst, const void* src) ;
+      void (*move)(void* dst, void* src) ;    // move-constructs into dst and destroys src
+      void (*destroy)(void* storage) ;
+    } ;
+
+    template<typename Callable> struct Ops {
+      static void invoke(void* storage, void* arg) { (*static_cast<Callable*>(storage))(arg) ; }
+      static void copy(void* dst, const void* src) { new (dst) Callable( *static_cast<const Callable*>(src) ) ; }
+      static void move(void* dst, void* src) {
+        Callable* p = static_cast<Callable*>(src) ;
+        new (dst) Callable( std::move(*p) ) ;
+        p->~Callable() ;
+      }
+      static void destroy(void* storage) { static_cast<Callable*>(storage)->~Callable() ; }
+      static const ops_t table ;
+    } ;
+
+    const ops_t*  m_ops ;
+    alignas(std::max_align_t) mutable unsigned char m_storage[CAPACITY] ;
+  } ;
+
+  template<typename Callable> const TimerFunc::ops_t TimerFunc::Ops<Callable>::table = {
+    &TimerFunc::Ops<Callable>::invoke, &TimerFunc::Ops<Callable>::copy, 
+    &TimerFunc::Ops<Callable>::move, &TimerFunc::Ops<Callable>::destroy
+  } ;
+
+  // which TimerQueue implementation a TimerQueueManager should build its queues from
+  enum TimerQueueType {
+    timer_queue_list,     // sorted doubly-linked list (O(n) insert)
+    timer_queue_wheel     // hierarchical timing wheel (O(1) insert/remove)
+  } ;
 
   struct queueEntry_t {
     queueEntry_t(TimerQueue* queue, TimerFunc f, void* functionArgs, su_time_t when) ;
@@ -43,9 +141,49 @@ namespace drachtio {
     TimerFunc         m_function ;
     void*             m_functionArgs ;
     su_time_t         m_when ;
+    uint64_t          m_tick ;    // expiry tick, only used by TimerWheel
+    int               m_slot ;    // wheel slot holding this entry, EXPIRING/FIRING while being fired, else -1
   } ;
 
   typedef queueEntry_t * TimerEventHandle ;
+
+  /**
+   * Slab allocator for queueEntry_t.
+   * 
+   * Entries are carved out of slabs of SLAB_SIZE and recycled through a free list, so
+   * arming and cancelling timers does not go to the global heap once the pool has grown
+   * to the working-set size.  Slabs are kept until the pool is destroyed.  Not thread-safe;
+   * callers serialize access the same way they serialize access to the owning queue.
+   */
+  class TimerEntryPool {
+  public:
+    static constexpr unsigned int SLAB_SIZE = 256 ;
+
+    TimerEntryPool() ;
+    TimerEntryPool( const TimerEntryPool& ) = delete;
+    ~TimerEntryPool() ;
+
+    queueEntry_t* allocate(TimerQueue* queue, TimerFunc&& f, void* functionArgs, su_time_t when) ;
+    void release(queueEntry_t* entry) ;
+
+    unsigned int inUse(void) const { return m_inUse; }
+    unsigned int highWater(void) const { return m_highWater; }
+    unsigned int capacity(void) const { return m_capacity; }
+
+  private:
+    union slot_t {
+      slot_t* m_next ;
+      alignas(queueEntry_t) unsigned char m_storage[sizeof(queueEntry_t)] ;
+    } ;
+
+    void grow(void) ;
+
+    std::vector<slot_t*>  m_slabs ;
+    slot_t*               m_free ;
+    unsigned int          m_inUse ;
+    unsigned int          m_highWater ;
+    unsigned int          m_capacity ;
+  } ;
  
   class TimerQueue {
   public:
@@ -65,16 +203,57 @@ namespace drachtio {
 
     virtual void doTimer(su_timer_t* timer) ;      
 
+    const TimerEntryPool& getEntryPool(void) const { return m_pool; }
+    const std::string& getName(void) const { return m_name; }
+
+    /**
+     * When the queue wakes up, also fire entries that are due within the next msecs milliseconds,
+     * trading up to that much early expiry for fewer wakeups.  Default 0: never fire early.
+     */
+    void setSlack(unsigned int msecs) { m_slackMsecs = msecs; }
+    /**
+     * Round each new expiry up to a multiple of msecs so that timers armed close together share
+     * a single wakeup; entries may fire up to msecs late.  Default 0: no rounding.
+     */
+    void setCoalescing(unsigned int msecs) { m_coalesceMsecs = msecs; }
+    /**
+     * Value of the "controller" label on the queue's batch-size histogram, so that queues of the same
+     * name owned by different controllers report separate series.  Default "sip".
+     */
+    void setOwner(const char* szOwner) { m_owner.assign( szOwner ); }
+    unsigned int getSlack(void) const { return m_slackMsecs; }
+    unsigned int getCoalescing(void) const { return m_coalesceMsecs; }
+
+    // lifetime totals: entries added, entries whose callback ran, entries removed before they fired
+    uint64_t numArmed(void) const { return m_armed; }
+    uint64_t numFired(void) const { return m_fired; }
+    uint64_t numCancelled(void) const { return m_cancelled; }
+
   protected:
+    static constexpr int EXPIRING = -2 ;  // m_slot of an entry detached for firing in the current pass
+    static constexpr int FIRING = -3 ;    // m_slot of the entry whose callback is running
+
     int          numberOfElements(void) ;
+    su_time_t    expiryTime(su_time_t now, uint32_t milliseconds) const ;
+    void         reportBatch(unsigned int count) ;
+    bool         removeExpired(queueEntry_t* entry) ;
+    void         fireExpired(void) ;
 
+    TimerEntryPool m_pool ;
     su_root_t*    m_root ;
     std::string   m_name ;
+    std::string   m_owner ;
     su_timer_t*   m_timer ;
     queueEntry_t* m_head ;
     queueEntry_t* m_tail ;
+    queueEntry_t* m_expiring ;        // expired entries waiting for their callbacks to run
     int           m_length ;
     unsigned      m_in_timer:1; /**< Set when executing timers */
+    uint64_t      m_armed ;
+    uint64_t      m_fired ;
+    uint64_t      m_cancelled ;
+    unsigned int  m_slackMsecs ;
+    unsigned int  m_coalesceMsecs ;
    } ;
 
    class LockingTimerQueue: public TimerQueue {
@@ -94,6 +273,52 @@ namespace drachtio {
     std::mutex    m_mutex;
    } ;
 
+  /**
+   * Hierarchical timing wheel with the same interface as TimerQueue.
+   * 
+   * Entries are hashed into a 256-slot inner wheel plus three 64-slot outer wheels
+   * by expiry tick, so add and remove are O(1) regardless of how many timers are live.
+   * Entries in an outer wheel are cascaded inward as the inner wheel wraps.  Timers
+   * fire on a tick boundary, so an entry may go off up to one tick late but never early.
+   */
+  class TimerWheel: public TimerQueue {
+  public:
+    static constexpr unsigned int DEFAULT_TICK_MSECS = 10 ;
+
+    TimerWheel(su_root_t* root, const char* szName = NULL, unsigned int tickMsecs = DEFAULT_TICK_MSECS) ;
+    virtual ~TimerWheel() ;
+
+    virtual TimerEventHandle add( TimerFunc f, void* functionArgs, uint32_t milliseconds ) ;
+    virtual TimerEventHandle add( TimerFunc f, void* functionArgs, uint32_t milliseconds, su_time_t now ) ;
+    virtual void remove( TimerEventHandle handle) ;
+    virtual int positionOf(TimerEventHandle handle) ;
+
+    virtual void doTimer(su_timer_t* timer) ;
+
+  protected:
+    static constexpr unsigned int INNER_BITS = 8 ;
+    static constexpr unsigned int OUTER_BITS = 6 ;
+    static constexpr unsigned int OUTER_WHEELS = 3 ;
+    static constexpr unsigned int INNER_SIZE = 1 << INNER_BITS ;
+    static constexpr unsigned int OUTER_SIZE = 1 << OUTER_BITS ;
+    static constexpr unsigned int NUM_SLOTS = INNER_SIZE + OUTER_WHEELS * OUTER_SIZE ;
+    static constexpr uint64_t MAX_SPAN = (uint64_t) 1 << (INNER_BITS + OUTER_WHEELS * OUTER_BITS) ;
+    static constexpr uint64_t NOT_ARMED = UINT64_MAX ;
+
+    void link( queueEntry_t* entry ) ;
+    void unlink( queueEntry_t* entry ) ;
+    void cascade( unsigned int wheel, unsigned int index ) ;
+    void armTimer( uint64_t tick ) ;
+    void armForNextExpiry(void) ;
+    su_time_t timeOfTick( uint64_t tick ) ;
+
+    unsigned int  m_tickMsecs ;
+    uint64_t      m_currentTick ;     // next tick to be processed
+    su_time_t     m_currentTickTime ; // wall-clock time at which m_currentTick is due
+    uint64_t      m_armedTick ;       // tick the su_timer is set for, or NOT_ARMED
+    queueEntry_t* m_slots[NUM_SLOTS] ;
+  } ;
+
 }
 
 #endif
@@ -137,8 +137,11 @@ function runFixture(f, fixtureIndex) {
           const cid_str = '-cid_str %u-%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p' +
             '%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p' +
             '%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p%p@%s';
-          let cmd = `sipp -sf ./${f.uac.name} ${f.uac.target} ${f.uac.long_call_id ? cid_str : ''} -m 1`;
+          let cmd = `sipp -sf ./${f.uac.name} ${f.uac.target} ${f.uac.long_call_id ? cid_str : ''} -m ${f.uac.calls || 1}`;
           if (f.uac.transport === 'tcp') cmd += ' -t tn';
+          // stress fixtures: calls per second and the number of calls sipp keeps open at once
+          if (f.uac.rate) cmd += ` -r ${f.uac.rate}`;
+          if (f.uac.limit) cmd += ` -l ${f.uac.limit}`;
           logger.debug(`starting UAC scenario: ${cmd}`);
           uacPromise = execCmd(cmd, {cwd: './scenarios'});
         }
@@ -0,0 +1,151 @@
+const Emitter = require('events');
+const net = require('net');
+const fs = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+const crypto = require('crypto');
+const config = require('./config');
+const debug = require('debug')('drachtio:server-test');
+
+// the empty stored block that ends every sync flush, which is left off the wire
+const FLUSH_TRAILER = Buffer.from([0x00, 0x00, 0xff, 0xff]);
+
+/* the dictionary both ends prime their streams with, read from the server source so that the two can not drift apart */
+function loadDictionary() {
+  const src = fs.readFileSync(path.resolve(__dirname, '../../src/client-compression.cpp'), 'utf8');
+  const decl = src.match(/FrameCompressor::DICTIONARY\s*=\s*([\s\S]*?")\s*;\s*$/m)[1];
+  let dict = '';
+  for (const m of decl.matchAll(/"((?:[^"\\]|\\.)*)"/g)) {
+    dict += m[1].replace(/\\(.)/g, (_, c) => ({r: '\r', n: '\n'})[c] || c);
+  }
+  return Buffer.from(dict, 'latin1');
+}
+
+// runs one message through a long-lived deflate or inflate stream, sync-flushed
+function flushThrough(stream, buf) {
+  return new Promise((resolve, reject) => {
+    const chunks = [];
+    const onData = (chunk) => chunks.push(chunk);
+    stream.on('data', onData);
+    stream.once('error', reject);
+    stream.write(buf);
+    stream.flush(zlib.constants.Z_SYNC_FLUSH, () => {
+      setImmediate(() => {
+        stream.removeListener('data', onData);
+        stream.removeListener('error', reject);
+        resolve(Buffer.concat(chunks));
+      });
+    });
+  });
+}
+
+/**
+ * Speaks the application protocol over a raw socket to check compression negotiation,
+ * which drachtio-srf does not do.
+ */
+class Compression extends Emitter {
+  constructor() {
+    super();
+    const dictionary = loadDictionary();
+    this.deflater = zlib.createDeflateRaw({dictionary});
+    this.inflater = zlib.createInflateRaw({dictionary});
+    this.buffer = Buffer.alloc(0);
+    this.frames = [];
+    this.waiting = [];
+  }
+
+  connect(opts) {
+    opts = opts || config.drachtio.connectOpts;
+    this.secret = opts.secret;
+    return new Promise((resolve, reject) => {
+      this.socket = net.connect(opts.port, opts.host, () => {
+        this.socket.removeListener('error', reject);
+        resolve();
+      });
+      this.socket.once('error', reject);
+      this.socket.on('data', this._onData.bind(this));
+      this.socket.on('close', () => {
+        this.closed = true;
+        this.waiting.splice(0).forEach(({reject}) => reject(new Error('connection closed by drachtio')));
+      });
+    });
+  }
+
+  disconnect() {
+    if (this.socket) this.socket.destroy();
+  }
+
+  /**
+   * The client asks for compression and pipelines a ping right behind its authenticate, before it has
+   * seen the response: that ping is plain and must be answered.  Once it has seen deflate taken up it
+   * sends compress, and pipelines a compressed ping right behind that.
+   */
+  async pipelined() {
+    this._write(Buffer.concat([
+      this._frame(`${this._id()}|authenticate|${this.secret}|compression-test||deflate`),
+      this._frame(`${this._id()}|ping`)
+    ]));
+
+    const auth = (await this._nextFrame()).toString();
+    debug(`Compression: authenticate response ${auth}`);
+    if (!/\|response\|[^|]+\|OK\|/.test(auth) || !auth.endsWith('|deflate')) {
+      throw new Error(`deflate not taken up in authenticate response: ${auth}`);
+    }
+    const pong = await this._inflate(await this._nextFrame());
+    if (!pong.endsWith('|OK|pong')) throw new Error(`unexpected response to ping pipelined behind authenticate: ${pong}`);
+
+    const ping = await this._deflate(`${this._id()}|ping`);
+    this._write(Buffer.concat([this._frame(`${this._id()}|compress|deflate`), this._frame(ping)]));
+    const ack = await this._inflate(await this._nextFrame());
+    if (!/\|response\|[^|]+\|OK$/.test(ack)) throw new Error(`unexpected response to compress: ${ack}`);
+    const pong2 = await this._inflate(await this._nextFrame());
+    if (!pong2.endsWith('|OK|pong')) throw new Error(`unexpected response to compressed ping: ${pong2}`);
+
+    if (this.closed) throw new Error('connection closed by drachtio');
+  }
+
+  _id() {
+    return crypto.randomBytes(8).toString('hex');
+  }
+
+  _frame(payload) {
+    const buf = Buffer.isBuffer(payload) ? payload : Buffer.from(payload);
+    return Buffer.concat([Buffer.from(`${buf.length}#`), buf]);
+  }
+
+  _write(buf) {
+    this.socket.write(buf);
+  }
+
+  async _deflate(msg) {
+    const out = await flushThrough(this.deflater, Buffer.from(msg));
+    if (!out.subarray(out.length - FLUSH_TRAILER.length).equals(FLUSH_TRAILER)) throw new Error('deflate did not end in a sync flush');
+    return out.subarray(0, out.length - FLUSH_TRAILER.length);
+  }
+
+  async _inflate(frame) {
+    return (await flushThrough(this.inflater, Buffer.concat([frame, FLUSH_TRAILER]))).toString();
+  }
+
+  _nextFrame() {
+    if (this.frames.length) return Promise.resolve(this.frames.shift());
+    if (this.closed) return Promise.reject(new Error('connection closed by drachtio'));
+    return new Promise((resolve, reject) => this.waiting.push({resolve, reject}));
+  }
+
+  _onData(data) {
+    this.buffer = Buffer.concat([this.buffer, data]);
+    for (;;) {
+      const hash = this.buffer.indexOf('#');
+      if (hash < 0) return;
+      const len = parseInt(this.buffer.subarray(0, hash).toString(), 10);
+      if (this.buffer.length < hash + 1 + len) return;
+      const frame = this.buffer.subarray(hash + 1, hash + 1 + len);
+      this.buffer = this.buffer.subarray(hash + 1 + len);
+      if (this.waiting.length) this.waiting.shift().resolve(frame);
+      else this.frames.push(frame);
+    }
+  }
+}
+
+module.exports = Compression;
@@ -0,0 +1,241 @@
+const Emitter = require('events');
+const net = require('net');
+const fs = require('fs');
+const crypto = require('crypto');
+const config = require('./config');
+const testbed = require('../testbed');
+const delay = require('../utils/delay');
+const debug = require('debug')('drachtio:server-test');
+
+// the --dialog-journal the fixture starts drachtio with
+const JOURNAL = '/tmp/drachtio-fixture-restart.journal';
+
+// the application name we connect with, which drachtio journals with each dialog so it can route the dialog to us after a restart
+const APP_NAME = 'restart-fixture';
+
+// uac-restart.xml asks us to refresh every 90s, so a refresh is due 40-50s after the call is answered
+const CALLS = 2;
+const REFRESHES_DUE_MSECS = 51000;
+
+const SDP = 'v=0\r\no=drachtio 1 1 IN IP4 127.0.0.1\r\ns=-\r\nc=IN IP4 127.0.0.1\r\nt=0 0\r\n' +
+  'm=audio 15000 RTP/AVP 0\r\na=rtpmap:0 PCMU/8000\r\n';
+
+function header(sip, name) {
+  const m = new RegExp(`^${name}:\\s*(.*)$`, 'mi').exec(sip);
+  return m ? m[1].trim() : null;
+}
+
+/**
+ * Speaks the application protocol over a raw socket, as a restarted application would: it connects with the
+ * same application name as before the restart, sends requests within a restored dialog by dialog id, and is
+ * sent the requests the far end makes within it.
+ */
+class Restart extends Emitter {
+  constructor() {
+    super();
+    this.messages = [];
+    this.waiting = [];
+    this.logged = [];
+    this.onLine = this._onLine.bind(this);
+  }
+
+  connect(opts) {
+    this.opts = opts || config.drachtio.connectOpts;
+    return this._connect()
+      .then(() => this._request(`${this._id()}|route|invite`));
+  }
+
+  disconnect() {
+    testbed.log.removeListener('line', this.onLine);
+    if (this.socket) this.socket.destroy();
+    fs.rmSync(JOURNAL, {force: true});
+    fs.rmSync(`${JOURNAL}.compact`, {force: true});
+  }
+
+  /**
+   * Answers the calls, crashes drachtio and brings it back up once their refreshes are overdue, then
+   * checks that the refreshes go out over the rebuilt legs spread a second apart, sends a re-INVITE on
+   * each restored dialog, and answers the re-INVITE and BYE the far end then sends on it.
+   */
+  async restoredDialogs() {
+    const dialogs = [];
+    for (let i = 0; i < CALLS; i++) {
+      const invite = await this._next((m) => 'sip' === m.tokens[1] && m.sip.startsWith('INVITE '));
+      const callId = header(invite.sip, 'Call-ID');
+      const fromTag = /;\s*tag=([^;>\s]+)/.exec(header(invite.sip, 'From'))[1];
+      await this._request(`${this._id()}|sip|${invite.tokens[8]}|`, `SIP/2.0 200 OK\r\nContent-Type: application/sdp\r\n\r\n${SDP}`);
+      dialogs.push({callId, dialogId: `${callId};from-tag=${fromTag}`});
+    }
+    const answeredAt = Date.now();
+    for (let i = 0; i < CALLS; i++) {
+      await this._next((m) => 'sip' === m.tokens[1] && m.sip.startsWith('ACK '));
+    }
+    debug(`Restart: answered ${dialogs.map((d) => d.callId)}`);
+
+    // the journal writer is given a moment to put the dialogs on disk; a crash inside that window loses them
+    await delay(1000);
+    this._close();
+    testbed.log.on('line', this.onLine);
+    await testbed.restart(Math.max(0, answeredAt + REFRESHES_DUE_MSECS - Date.now()));
+    await this._connect();
+
+    const restored = await this._logged(/restored (\d+) dialogs from/);
+    const overdue = await this._logged(/- (\d+) restored dialogs had session timers that went off while we were down/);
+    if (+restored.match[1] < CALLS || +overdue.match[1] < CALLS) {
+      throw new Error(`expected ${CALLS} restored dialogs with overdue session timers: ${restored.line} / ${overdue.line}`);
+    }
+    const refreshes = [];
+    for (const d of dialogs) {
+      refreshes.push(await this._logged(new RegExp(`sending refreshing re-INVITE with call-id ${d.callId}`), 10000));
+    }
+    refreshes.sort((a, b) => a.at - b.at);
+    for (let i = 0; i < refreshes.length; i++) {
+      if (refreshes[i].at - restored.at > 5000) throw new Error(`overdue refresh went out ${refreshes[i].at - restored.at}ms after restart`);
+      if (i > 0 && refreshes[i].at - refreshes[i - 1].at < 500) {
+        throw new Error(`overdue refreshes were not spread out: ${refreshes.map((r) => r.at - restored.at)}ms after restart`);
+      }
+    }
+    debug(`Restart: overdue refreshes went out ${refreshes.map((r) => r.at - restored.at)}ms after restart`);
+
+    // let the last refresh be answered and acknowledged before the application starts a transaction of its own
+    await delay(1000);
+    for (const d of dialogs) {
+      await this._requestInDialog(d.dialogId, `INVITE sip:placeholder SIP/2.0\r\nContent-Type: application/sdp\r\n\r\n${SDP}`);
+      this._send(`${this._id()}|sip||${d.dialogId}\r\nACK sip:placeholder SIP/2.0\r\n\r\n`);
+    }
+
+    // without the application name journaled with them these would get a 481, and the far end would lose the call
+    for (const d of dialogs) {
+      await this._answerInDialog(d, 'INVITE', `SIP/2.0 200 OK\r\nContent-Type: application/sdp\r\n\r\n${SDP}`);
+      await this._answerInDialog(d, 'BYE', 'SIP/2.0 200 OK\r\n\r\n');
+    }
+    debug(`Restart: far end re-INVITE and BYE on ${dialogs.map((d) => d.callId)} reached us`);
+  }
+
+  // waits for the far end to send a request within a restored dialog, and answers it
+  async _answerInDialog(dialog, method, response) {
+    const req = await this._next((m) => 'sip' === m.tokens[1] && m.sip.startsWith(`${method} `) &&
+      dialog.callId === header(m.sip, 'Call-ID'));
+    await this._request(`${this._id()}|sip|${req.tokens[8]}|`, response);
+  }
+
+  // sends a request within a dialog and waits for its final response, which must be a 200
+  async _requestInDialog(dialogId, request) {
+    const sent = await this._request(`${this._id()}|sip||${dialogId}`, request);
+    const transactionId = sent.tokens[10];
+    const response = await this._next((m) => 'sip' === m.tokens[1] && transactionId === m.tokens[8] &&
+      /^SIP\/2.0 [2-6]/.test(m.sip));
+    if (!response.sip.startsWith('SIP/2.0 200')) {
+      throw new Error(`${request.split(' ')[0]} on restored dialog ${dialogId} failed: ${response.sip.split('\r\n')[0]}`);
+    }
+  }
+
+  _connect() {
+    this.buffer = Buffer.alloc(0);
+    return new Promise((resolve, reject) => {
+      this.socket = net.connect(this.opts.port, this.opts.host, () => {
+        this.socket.removeListener('error', reject);
+        resolve();
+      });
+      this.socket.once('error', reject);
+      const socket = this.socket;
+      this.socket.on('data', (data) => this._onData(socket, data));
+      this.socket.on('close', () => {
+        if (socket !== this.socket) return;
+        this.waiting.splice(0).forEach(({reject}) => reject(new Error('connection closed by drachtio')));
+      });
+    })
+      .then(() => this._request(`${this._id()}|authenticate|${this.opts.secret}||||${APP_NAME}`));
+  }
+
+  // drops the connection to a server about to be killed, without failing anything waiting on it
+  _close() {
+    const socket = this.socket;
+    this.socket = null;
+    this.messages = [];
+    socket.destroy();
+  }
+
+  // sends a message and waits for drachtio's response to it, which must be OK
+  async _request(meta, sip) {
+    const msgId = meta.split('|')[0];
+    this._send(sip ? `${meta}\r\n${sip}` : meta);
+    const response = await this._next((m) => 'response' === m.tokens[1] && msgId === m.tokens[2]);
+    if ('OK' !== response.tokens[3]) throw new Error(`drachtio rejected ${meta}: ${response.tokens.slice(3).join('|')}`);
+    return response;
+  }
+
+  _send(msg) {
+    const buf = Buffer.from(msg);
+    this.socket.write(Buffer.concat([Buffer.from(`${buf.length}#`), buf]));
+  }
+
+  _id() {
+    return crypto.randomBytes(8).toString('hex');
+  }
+
+  _next(match, timeout = 30000) {
+    const i = this.messages.findIndex(match);
+    if (i >= 0) return Promise.resolve(this.messages.splice(i, 1)[0]);
+    return new Promise((resolve, reject) => {
+      const waiter = {match, resolve, reject};
+      waiter.timer = setTimeout(() => {
+        this.waiting.splice(this.waiting.indexOf(waiter), 1);
+        reject(new Error(`timed out waiting for a message from drachtio: ${match}`));
+      }, timeout);
+      this.waiting.push(waiter);
+    });
+  }
+
+  _onData(socket, data) {
+    if (socket !== this.socket) return;
+    this.buffer = Buffer.concat([this.buffer, data]);
+    for (;;) {
+      const hash = this.buffer.indexOf('#');
+      if (hash < 0) return;
+      const len = parseInt(this.buffer.subarray(0, hash).toString(), 10);
+      if (this.buffer.length < hash + 1 + len) return;
+      const frame = this.buffer.subarray(hash + 1, hash + 1 + len).toString();
+      this.buffer = this.buffer.subarray(hash + 1 + len);
+
+      const eol = frame.indexOf('\r\n');
+      const msg = {
+        tokens: (eol < 0 ? frame : frame.slice(0, eol)).split('|'),
+        sip: eol < 0 ? '' : frame.slice(eol + 2)
+      };
+      const i = this.waiting.findIndex((w) => w.match(msg));
+      if (i < 0) this.messages.push(msg);
+      else {
+        const waiter = this.waiting.splice(i, 1)[0];
+        clearTimeout(waiter.timer);
+        waiter.resolve(msg);
+      }
+    }
+  }
+
+  _onLine(line) {
+    this.logged.push({line, at: Date.now()});
+    this.emit('line');
+  }
+
+  // resolves with the first line drachtio has logged since the restart that matches re
+  _logged(re, timeout = 5000) {
+    return new Promise((resolve, reject) => {
+      const check = () => {
+        const entry = this.logged.find((e) => re.test(e.line));
+        if (!entry) return false;
+        this.removeListener('line', check);
+        clearTimeout(timer);
+        resolve(Object.assign({match: re.exec(entry.line)}, entry));
+        return true;
+      };
+      const timer = setTimeout(() => {
+        this.removeListener('line', check);
+        reject(new Error(`drachtio did not log ${re} after restart`));
+      }, timeout);
+      if (!check()) this.on('line', check);
+    });
+  }
+}
+
+module.exports = Restart;
@@ -161,6 +161,34 @@ class App extends Emitter {
 
     return this;
   }
+  // send a reliable 183 right away and answer once the early dialog has been held open for a while
+  acceptReliable(sdp, opts = {}) {
+    this.srf.prack((req, res) => res.send(200));
+    this.srf.invite((req, res) => {
+      req.on('cancel', () => {
+        req.canceled = true;
+      });
+      const localSdp = sdp || req.body.replace(/m=audio\s+(\d+)/, 'm=audio 15000');
+
+      res.send(183, {headers: {'Require': '100rel'}, body: localSdp});
+
+      setTimeout(() => {
+        if (req.canceled) return;
+
+        this.srf.createUAS(req, res, {localSdp})
+          .then((uas) => {
+            this.emit('connected');
+            uas.on('destroy', () => this.srf.endSession(req));
+            return;
+          })
+          .catch((err) => {
+            console.error(`Uas: failed to connect: ${err}`);
+          });
+      }, opts.delay || 1000);
+    });
+
+    return this;
+  }
   handleSessionExpired(sdp, delay) {
     this.srf.invite((req, res) => {
 
@@ -1,10 +1,13 @@
 const { spawn, execSync } = require('child_process');
+const Emitter = require('events');
 const fs = require('fs');
 const debug = require('debug')('drachtio:server-test');
 const obj = module.exports = {} ;
 
 let drachtio = null;
 let router = null;
+let lastStart = null;     // how drachtio was last started, so that restart can start it again the same way
+let restarting = false;
 
 function killStaleProcesses() {
   try {
@@ -110,6 +113,40 @@ process.on('SIGTERM', () => { cleanup(); process.exit(1); });
 obj.waitForPort = waitForPort;
 obj.waitForPortInUse = waitForPortInUse;
 
+// drachtio's console output, emitted a line at a time as 'line', for scripts that check what the server did
+obj.log = new Emitter();
+
+function spawnDrachtio({args, env, logStream}, onError) {
+  let partial = '';
+  const output = (data) => {
+    debug(`${data.toString()}`);
+    if (logStream) logStream.write(data);
+    const lines = (partial + data.toString()).split('\n');
+    partial = lines.pop();
+    lines.forEach((line) => obj.log.emit('line', line));
+  };
+
+  drachtio = spawn('../build/drachtio', args, {
+    env,
+    detached: true,
+    stdio: ['ignore', 'pipe', 'pipe']
+  });
+  drachtio.on('error', (err) => {
+    console.log(`Failed to start subprocess: ${err}`);
+    drachtio = null;
+    onError(err);
+  });
+  drachtio.on('exit', (code, signal) => {
+    debug(`drachtio exited with code ${code}, signal ${signal}`);
+    if (logStream) {
+      const msg = `=== drachtio exit code=${code} signal=${signal} ===\n`;
+      try { restarting ? logStream.write(msg) : logStream.end(msg); } catch (e) {}
+    }
+  });
+  drachtio.stdout.on('data', output);
+  drachtio.stderr.on('data', output);
+}
+
 obj.start = async (confPath, extraArgs, tls = false, waitDelay = 500, env = {}, logPath = null) => {
   confPath = confPath || './drachtio.conf.xml';
   debug(`starting drachtio with config file: ${confPath} and env ${JSON.stringify(env)}`);
@@ -144,29 +181,8 @@ obj.start = async (confPath, extraArgs, tls = false, waitDelay = 500, env = {},
   return new Promise((resolve, reject) => {
     const args = ['-f', confPath].concat(Array.isArray(extraArgs) ? extraArgs : []);
 
-    drachtio = spawn('../build/drachtio', args, {
-      env,
-      detached: true,
-      stdio: ['ignore', 'pipe', 'pipe']
-    });
-    drachtio.on('error', (err) => {
-      console.log(`Failed to start subprocess: ${err}`);
-      drachtio = null;
-      reject(err);
-    });
-    drachtio.on('exit', (code, signal) => {
-      debug(`drachtio exited with code ${code}, signal ${signal}`);
-      if (logStream) try { logStream.end(`=== drachtio exit code=${code} signal=${signal} ===\n`); } catch (e) {}
-    });
-
-    drachtio.stdout.on('data', (data) => {
-      debug(`${data.toString()}`);
-      if (logStream) logStream.write(data);
-    });
-    drachtio.stderr.on('data', (data) => {
-      debug(`${data.toString()}`);
-      if (logStream) logStream.write(data);
-    });
+    lastStart = {args, env, logStream, waitDelay};
+    spawnDrachtio(lastStart, reject);
 
     const routerArgs = ['./scripts/call-router'];
     if (tls) routerArgs.push(['--transport=tls']);
@@ -191,6 +207,33 @@ obj.start = async (confPath, extraArgs, tls = false, waitDelay = 500, env = {},
   });
 };
 
+/**
+ * Kills drachtio with signal (by default without giving it a chance to clean up, as a crash would), leaves
+ * the call router running, and after downMs starts drachtio again exactly as it was last started.
+ */
+obj.restart = async(downMs = 0, signal = 'SIGKILL') => {
+  if (!drachtio || !lastStart) throw new Error('restart called with no drachtio running');
+  restarting = true;
+  try {
+    await new Promise((resolve) => {
+      drachtio.once('exit', resolve);
+      drachtio.kill(signal);
+    });
+    drachtio = null;
+    await new Promise((resolve) => setTimeout(resolve, downMs));
+    await waitForPort(9022, 5000).catch(() => {
+      debug('warning: port 9022 still in use, restarting anyway');
+    });
+    if (lastStart.logStream) lastStart.logStream.write(`\n=== drachtio restart: ${new Date().toISOString()} ===\n`);
+    await new Promise((resolve, reject) => {
+      spawnDrachtio(lastStart, reject);
+      setTimeout(() => resolve(drachtio), lastStart.waitDelay);
+    });
+  } finally {
+    restarting = false;
+  }
+};
+
 obj.stop = () => {
   return new Promise((resolve) => {
     if (!drachtio && !router) {